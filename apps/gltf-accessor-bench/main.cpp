@@ -0,0 +1,425 @@
+#include "utils/gltf.hpp"
+
+#include <args.hxx>
+#include <glm/gtc/type_precision.hpp>
+#include <tiny_gltf.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace
+{
+
+size_t failureCount = 0;
+
+void check(bool condition, const std::string &what)
+{
+  if (!condition) {
+    std::cerr << "FAILED: " << what << std::endl;
+    ++failureCount;
+  }
+}
+
+void checkThrows(const std::function<void()> &function, const std::string &what)
+{
+  try {
+    function();
+  } catch (const std::runtime_error &) {
+    return;
+  }
+  std::cerr << "FAILED: " << what << " did not throw" << std::endl;
+  ++failureCount;
+}
+
+// Model whose accessors read a single buffer, built by appending data to it
+class TestModel
+{
+public:
+  TestModel() { model.buffers.emplace_back(); }
+
+  // Append values to the buffer, aligned to 4 bytes, in a new buffer view
+  template <typename T>
+  int addBufferView(const std::vector<T> &values, size_t byteStride = 0)
+  {
+    auto &data = model.buffers[0].data;
+    data.resize((data.size() + 3) & ~size_t(3));
+    tinygltf::BufferView bufferView;
+    bufferView.buffer = 0;
+    bufferView.byteOffset = data.size();
+    bufferView.byteLength = values.size() * sizeof(T);
+    bufferView.byteStride = byteStride;
+    const auto *bytes = reinterpret_cast<const unsigned char *>(values.data());
+    data.insert(end(data), bytes, bytes + bufferView.byteLength);
+    model.bufferViews.push_back(bufferView);
+    return int(model.bufferViews.size() - 1);
+  }
+
+  int addAccessor(int bufferView, size_t byteOffset, int componentType,
+      int type, size_t count, bool normalized = false)
+  {
+    tinygltf::Accessor accessor;
+    accessor.bufferView = bufferView;
+    accessor.byteOffset = byteOffset;
+    accessor.componentType = componentType;
+    accessor.type = type;
+    accessor.count = count;
+    accessor.normalized = normalized;
+    model.accessors.push_back(accessor);
+    return int(model.accessors.size() - 1);
+  }
+
+  // Make accessorIdx sparse, with UNSIGNED_SHORT indices
+  template <typename T>
+  void setSparse(int accessorIdx, const std::vector<uint16_t> &indices,
+      const std::vector<T> &values)
+  {
+    auto &sparse = model.accessors[accessorIdx].sparse;
+    sparse.isSparse = true;
+    sparse.count = int(indices.size());
+    // TinyGLTF leaves the offsets uninitialized
+    sparse.indices.bufferView = addBufferView(indices);
+    sparse.indices.byteOffset = 0;
+    sparse.indices.componentType = TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT;
+    sparse.values.bufferView = addBufferView(values);
+    sparse.values.byteOffset = 0;
+  }
+
+  tinygltf::Model model;
+};
+
+// Elements read by decode() and operator[] must both be the expected ones
+template <typename T>
+void checkReads(const tinygltf::Model &model, int accessorIdx,
+    const std::vector<T> &expected, const std::string &what)
+{
+  const AccessorView<T> view{model, accessorIdx};
+  check(view.size() == expected.size(), what + ": size");
+  check(view.decode() == expected, what + ": decode()");
+  check(std::vector<T>(view.begin(), view.end()) == expected,
+      what + ": operator[]");
+}
+
+void checkNormalizedIntegers()
+{
+  TestModel test;
+  const std::vector<uint8_t> ubytes = {0, 255, 51, 0, 102, 153, 204, 255};
+  const std::vector<int8_t> bytes = {-128, -127, 0, 127};
+  const std::vector<uint16_t> ushorts = {0, 65535, 13107, 65535};
+  const std::vector<int16_t> shorts = {-32768, -32767, 0, 32767};
+  const auto ubyteIdx = test.addAccessor(test.addBufferView(ubytes), 0,
+      TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE, TINYGLTF_TYPE_VEC4, 2, true);
+  const auto byteIdx = test.addAccessor(test.addBufferView(bytes), 0,
+      TINYGLTF_COMPONENT_TYPE_BYTE, TINYGLTF_TYPE_SCALAR, 4, true);
+  const auto ushortIdx = test.addAccessor(test.addBufferView(ushorts), 0,
+      TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT, TINYGLTF_TYPE_VEC2, 2, true);
+  const auto shortIdx = test.addAccessor(test.addBufferView(shorts), 0,
+      TINYGLTF_COMPONENT_TYPE_SHORT, TINYGLTF_TYPE_SCALAR, 4, true);
+  const auto &model = test.model;
+
+  checkReads<glm::vec4>(model, ubyteIdx,
+      {glm::vec4(0, 1, 0.2f, 0), glm::vec4(0.4f, 0.6f, 0.8f, 1)},
+      "UNSIGNED_BYTE normalized");
+  checkReads<float>(model, byteIdx, {-1, -1, 0, 1}, "BYTE normalized");
+  checkReads<glm::vec2>(model, ushortIdx,
+      {glm::vec2(0, 1), glm::vec2(0.2f, 1)}, "UNSIGNED_SHORT normalized");
+  checkReads<float>(model, shortIdx, {-1, -1, 0, 1}, "SHORT normalized");
+
+  // Integer elements are not normalized
+  checkReads<glm::u16vec2>(model, ushortIdx,
+      {glm::u16vec2(0, 65535), glm::u16vec2(13107, 65535)},
+      "UNSIGNED_SHORT normalized read as integers");
+  check(!AccessorView<glm::vec4>(model, ubyteIdx).isDirect(),
+      "Normalized accessor is not direct");
+}
+
+void checkStridedView()
+{
+  // Interleaved positions and normals
+  TestModel test;
+  const std::vector<float> vertices = {
+      1, 2, 3, 0, 0, 1, 4, 5, 6, 0, 1, 0, 7, 8, 9, 1, 0, 0};
+  const auto bufferView = test.addBufferView(vertices, 6 * sizeof(float));
+  const auto positionIdx = test.addAccessor(bufferView, 0,
+      TINYGLTF_COMPONENT_TYPE_FLOAT, TINYGLTF_TYPE_VEC3, 3);
+  const auto normalIdx = test.addAccessor(bufferView, 3 * sizeof(float),
+      TINYGLTF_COMPONENT_TYPE_FLOAT, TINYGLTF_TYPE_VEC3, 3);
+  const auto &model = test.model;
+
+  checkReads<glm::vec3>(model, positionIdx,
+      {glm::vec3(1, 2, 3), glm::vec3(4, 5, 6), glm::vec3(7, 8, 9)},
+      "Strided positions");
+  checkReads<glm::vec3>(model, normalIdx,
+      {glm::vec3(0, 0, 1), glm::vec3(0, 1, 0), glm::vec3(1, 0, 0)},
+      "Strided normals");
+
+  const AccessorView<glm::vec3> view{model, positionIdx};
+  check(view.isDirect() && !view.isTightlyPacked(),
+      "Strided view is direct, not tightly packed");
+  check(view.byteStride() == 6 * sizeof(float), "Strided view byteStride()");
+
+  // Missing components are 0, extra ones are ignored
+  checkReads<glm::vec4>(model, positionIdx,
+      {glm::vec4(1, 2, 3, 0), glm::vec4(4, 5, 6, 0), glm::vec4(7, 8, 9, 0)},
+      "VEC3 read as vec4");
+  checkReads<glm::vec2>(model, normalIdx,
+      {glm::vec2(0, 0), glm::vec2(0, 1), glm::vec2(1, 0)},
+      "VEC3 read as vec2");
+
+  const auto bytes = getAccessorBytes(model, model.accessors[normalIdx]);
+  std::vector<float> normals(bytes.size() / sizeof(float));
+  std::memcpy(normals.data(), bytes.data(), bytes.size());
+  check(normals == std::vector<float>{0, 0, 1, 0, 1, 0, 1, 0, 0},
+      "getAccessorBytes() of strided normals");
+}
+
+void checkSparseOverrides()
+{
+  TestModel test;
+  const std::vector<float> values = {0, 1, 2, 3, 4};
+  const auto denseIdx = test.addAccessor(test.addBufferView(values), 0,
+      TINYGLTF_COMPONENT_TYPE_FLOAT, TINYGLTF_TYPE_SCALAR, 5);
+  test.setSparse<float>(denseIdx, {1, 4}, {10, 40});
+  // Without buffer view, elements are zeros
+  const auto zerosIdx = test.addAccessor(-1, 0, TINYGLTF_COMPONENT_TYPE_FLOAT,
+      TINYGLTF_TYPE_VEC2, 3);
+  test.setSparse<float>(zerosIdx, {2}, {5, 6});
+  // Sparse values are in the component type of the accessor
+  const std::vector<uint8_t> ubytes = {0, 0, 0};
+  const auto normalizedIdx = test.addAccessor(test.addBufferView(ubytes), 0,
+      TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE, TINYGLTF_TYPE_SCALAR, 3, true);
+  test.setSparse<uint8_t>(normalizedIdx, {0}, {255});
+  const auto &model = test.model;
+
+  checkReads<float>(model, denseIdx, {0, 10, 2, 3, 40}, "Sparse accessor");
+  checkReads<glm::vec2>(model, zerosIdx,
+      {glm::vec2(0), glm::vec2(0), glm::vec2(5, 6)},
+      "Sparse accessor without buffer view");
+  checkReads<float>(
+      model, normalizedIdx, {1, 0, 0}, "Normalized sparse accessor");
+  check(!AccessorView<float>(model, denseIdx).isTightlyPacked(),
+      "Sparse accessor is not tightly packed");
+
+  const auto bytes = getAccessorBytes(model, model.accessors[denseIdx]);
+  std::vector<float> elements(bytes.size() / sizeof(float));
+  std::memcpy(elements.data(), bytes.data(), bytes.size());
+  check(elements == std::vector<float>{0, 10, 2, 3, 40},
+      "getAccessorBytes() of sparse accessor");
+}
+
+void checkOutOfBounds()
+{
+  TestModel test;
+  const std::vector<float> values = {0, 1, 2, 3, 4, 5};
+  const auto bufferView = test.addBufferView(values);
+  // One element too many, at the start or at the end of the view
+  const auto tooLongIdx = test.addAccessor(
+      bufferView, 0, TINYGLTF_COMPONENT_TYPE_FLOAT, TINYGLTF_TYPE_VEC3, 3);
+  const auto offsetIdx = test.addAccessor(bufferView, sizeof(float),
+      TINYGLTF_COMPONENT_TYPE_FLOAT, TINYGLTF_TYPE_VEC3, 2);
+  const auto exactIdx = test.addAccessor(
+      bufferView, 0, TINYGLTF_COMPONENT_TYPE_FLOAT, TINYGLTF_TYPE_VEC3, 2);
+  const auto invalidTypeIdx =
+      test.addAccessor(bufferView, 0, 0, TINYGLTF_TYPE_SCALAR, 1);
+  const auto unsortedIdx = test.addAccessor(
+      bufferView, 0, TINYGLTF_COMPONENT_TYPE_FLOAT, TINYGLTF_TYPE_SCALAR, 6);
+  test.setSparse<float>(unsortedIdx, {3, 1}, {10, 30});
+  const auto outOfRangeIdx = test.addAccessor(
+      bufferView, 0, TINYGLTF_COMPONENT_TYPE_FLOAT, TINYGLTF_TYPE_SCALAR, 6);
+  test.setSparse<float>(outOfRangeIdx, {6}, {10});
+  const auto valuesOutOfBoundsIdx = test.addAccessor(
+      bufferView, 0, TINYGLTF_COMPONENT_TYPE_FLOAT, TINYGLTF_TYPE_SCALAR, 6);
+  test.setSparse<float>(valuesOutOfBoundsIdx, {0, 1}, {10});
+  // Buffer view past the end of its buffer
+  auto &model = test.model;
+  auto truncated = model.bufferViews[bufferView];
+  truncated.byteOffset = model.buffers[0].data.size() - 2;
+  truncated.byteLength = sizeof(float);
+  model.bufferViews.push_back(truncated);
+  const auto truncatedIdx = test.addAccessor(int(model.bufferViews.size() - 1),
+      0, TINYGLTF_COMPONENT_TYPE_FLOAT, TINYGLTF_TYPE_SCALAR, 1);
+
+  check(AccessorView<glm::vec3>(model, exactIdx).size() == 2,
+      "Accessor ending at the end of its buffer view");
+  const std::pair<int, const char *> invalidAccessors[] = {
+      {tooLongIdx, "Accessor longer than its buffer view"},
+      {offsetIdx, "Accessor offset past its buffer view"},
+      {invalidTypeIdx, "Accessor with invalid componentType"},
+      {unsortedIdx, "Sparse accessor with unsorted indices"},
+      {outOfRangeIdx, "Sparse accessor with out of range index"},
+      {valuesOutOfBoundsIdx, "Sparse values out of their buffer view"},
+      {truncatedIdx, "Buffer view out of its buffer"}};
+  for (const auto &invalid : invalidAccessors) {
+    const auto &accessor = model.accessors[invalid.first];
+    checkThrows([&]() { AccessorView<float>{model, accessor}; },
+        std::string(invalid.second) + ": AccessorView");
+    checkThrows([&]() { getAccessorBytes(model, accessor); },
+        std::string(invalid.second) + ": getAccessorBytes()");
+  }
+}
+
+void checkMemcpyFastPath()
+{
+  TestModel test;
+  const std::vector<float> values = {1, 2, 3, 4, 5, 6};
+  const std::vector<uint16_t> indices = {0, 1, 2, 3};
+  const auto positionIdx = test.addAccessor(test.addBufferView(values), 0,
+      TINYGLTF_COMPONENT_TYPE_FLOAT, TINYGLTF_TYPE_VEC3, 2);
+  const auto indexIdx = test.addAccessor(test.addBufferView(indices), 0,
+      TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT, TINYGLTF_TYPE_SCALAR, 4);
+  const auto &model = test.model;
+
+  check(AccessorView<glm::vec3>(model, positionIdx).isTightlyPacked(),
+      "Packed vec3 accessor is tightly packed");
+  checkReads<glm::vec3>(model, positionIdx,
+      {glm::vec3(1, 2, 3), glm::vec3(4, 5, 6)}, "Packed vec3 accessor");
+  check(AccessorView<uint16_t>(model, indexIdx).isTightlyPacked(),
+      "Packed UNSIGNED_SHORT accessor read as uint16_t is tightly packed");
+
+  // Conversions take the decoding loop
+  check(!AccessorView<glm::vec4>(model, positionIdx).isDirect(),
+      "vec3 accessor read as vec4 is not direct");
+  check(!AccessorView<uint32_t>(model, indexIdx).isDirect(),
+      "UNSIGNED_SHORT accessor read as uint32_t is not direct");
+  checkReads<uint32_t>(model, indexIdx, {0, 1, 2, 3},
+      "UNSIGNED_SHORT accessor read as uint32_t");
+}
+
+// Best time of iterationCount calls of function, in nanoseconds per element
+double measure(size_t iterationCount, size_t elementCount,
+    const std::function<void()> &function)
+{
+  using Clock = std::chrono::steady_clock;
+  auto best = std::numeric_limits<double>::max();
+  for (size_t i = 0; i < iterationCount; ++i) {
+    const auto start = Clock::now();
+    function();
+    best = std::min(best,
+        std::chrono::duration<double, std::nano>(Clock::now() - start).count());
+  }
+  return best / elementCount;
+}
+
+void runBenchmarks(size_t elementCount, size_t iterationCount)
+{
+  TestModel test;
+  std::vector<float> interleaved(elementCount * 6);
+  for (size_t i = 0; i < interleaved.size(); ++i) {
+    interleaved[i] = float(i % 1000);
+  }
+  std::vector<uint16_t> texCoords(elementCount * 2);
+  for (size_t i = 0; i < texCoords.size(); ++i) {
+    texCoords[i] = uint16_t(i * 7);
+  }
+  std::vector<uint16_t> sparseIndices;
+  for (size_t i = 0; i < std::min<size_t>(elementCount, 65536); i += 16) {
+    sparseIndices.push_back(uint16_t(i));
+  }
+  const std::vector<float> sparseValues(sparseIndices.size() * 3, 1.f);
+
+  const auto packedBufferView = test.addBufferView(std::vector<float>(
+      begin(interleaved), begin(interleaved) + elementCount * 3));
+  const auto packedIdx = test.addAccessor(packedBufferView, 0,
+      TINYGLTF_COMPONENT_TYPE_FLOAT, TINYGLTF_TYPE_VEC3, elementCount);
+  const auto stridedIdx =
+      test.addAccessor(test.addBufferView(interleaved, 6 * sizeof(float)), 0,
+          TINYGLTF_COMPONENT_TYPE_FLOAT, TINYGLTF_TYPE_VEC3, elementCount);
+  const auto normalizedIdx = test.addAccessor(test.addBufferView(texCoords),
+      0, TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT, TINYGLTF_TYPE_VEC2,
+      elementCount, true);
+  const auto sparseIdx = test.addAccessor(packedBufferView, 0,
+      TINYGLTF_COMPONENT_TYPE_FLOAT, TINYGLTF_TYPE_VEC3, elementCount);
+  test.setSparse(sparseIdx, sparseIndices, sparseValues);
+  const auto &model = test.model;
+
+  std::cout << elementCount << " elements, best of " << iterationCount
+            << " iterations, in ns per element:" << std::endl;
+  const auto report = [&](const char *name, double nanoseconds) {
+    std::cout << "  " << name << ": " << nanoseconds << std::endl;
+  };
+
+  std::vector<glm::vec3> positions(elementCount);
+  std::vector<glm::vec2> vec2s(elementCount);
+  const auto decode = [&](int accessorIdx) {
+    return measure(iterationCount, elementCount, [&]() {
+      AccessorView<glm::vec3>{model, accessorIdx}.decode(positions.data());
+    });
+  };
+  report("vec3 decode(), tightly packed (memcpy)", decode(packedIdx));
+  report("vec3 decode(), strided", decode(stridedIdx));
+  report("vec3 decode(), sparse", decode(sparseIdx));
+  report("normalized UNSIGNED_SHORT vec2 decode()",
+      measure(iterationCount, elementCount, [&]() {
+        AccessorView<glm::vec2>{model, normalizedIdx}.decode(vec2s.data());
+      }));
+  report("vec3 operator[], strided",
+      measure(iterationCount, elementCount, [&]() {
+        const AccessorView<glm::vec3> view{model, stridedIdx};
+        for (size_t i = 0; i < view.size(); ++i) {
+          positions[i] = view[i];
+        }
+      }));
+  report("getAccessorBytes(), strided",
+      measure(iterationCount, elementCount, [&]() {
+        getAccessorBytes(model, model.accessors[stridedIdx]);
+      }));
+  report("getAccessorBytes(), sparse",
+      measure(iterationCount, elementCount, [&]() {
+        getAccessorBytes(model, model.accessors[sparseIdx]);
+      }));
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+  // args library https://github.com/taywee/args
+  args::ArgumentParser parser{
+      "Check the decoding of glTF accessors by AccessorView and "
+      "getAccessorBytes(), then measure it.",
+      "Exits with 1 if a check fails."};
+  args::HelpFlag help{parser, "help", "Display this help menu", {'h', "help"}};
+  args::Flag checkOnly{
+      parser, "check", "Only run the checks, without benchmarks", {"check"}};
+  args::ValueFlag<size_t> elementCount{parser, "elements",
+      "Number of elements of the benchmarked accessors (default: 1000000)",
+      {"elements"}, 1000000};
+  args::ValueFlag<size_t> iterationCount{parser, "iterations",
+      "Number of runs of each benchmark, the best is reported (default: 10)",
+      {"iterations"}, 10};
+
+  try {
+    parser.ParseCLI(argc, argv);
+  } catch (const args::Help &) {
+    std::cout << parser;
+    return 0;
+  } catch (const args::Error &e) {
+    std::cerr << e.what() << std::endl;
+    std::cerr << parser;
+    return 1;
+  }
+
+  checkNormalizedIntegers();
+  checkStridedView();
+  checkSparseOverrides();
+  checkOutOfBounds();
+  checkMemcpyFastPath();
+  if (failureCount) {
+    std::cerr << failureCount << " checks failed" << std::endl;
+    return 1;
+  }
+  std::cout << "All checks passed" << std::endl;
+
+  if (!checkOnly && args::get(elementCount) && args::get(iterationCount)) {
+    runBenchmarks(args::get(elementCount), args::get(iterationCount));
+  }
+  return 0;
+}
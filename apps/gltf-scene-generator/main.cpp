@@ -0,0 +1,249 @@
+#include "utils/filesystem.hpp"
+#include "utils/procedural_scene.hpp"
+
+#include <args.hxx>
+#include <stb_image_write.h>
+#include <tiny_gltf.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <thread>
+#include <vector>
+
+namespace
+{
+
+void appendBytes(void *context, void *data, int size)
+{
+  const auto bytes = static_cast<unsigned char *>(data);
+  auto &vector = *static_cast<std::vector<unsigned char> *>(context);
+  vector.insert(end(vector), bytes, bytes + size);
+}
+
+// Encode the decoded images of the model to PNG, with a thread per core: the
+// images of large scenes take most of the time of writing them
+std::vector<std::vector<unsigned char>> encodeImages(
+    const tinygltf::Model &model)
+{
+  std::vector<std::vector<unsigned char>> pngs(model.images.size());
+  std::atomic<size_t> nextImage{0};
+  const auto encode = [&]() {
+    for (auto i = nextImage++; i < pngs.size(); i = nextImage++) {
+      const auto &image = model.images[i];
+      stbi_write_png_to_func(appendBytes, &pngs[i], image.width, image.height,
+          image.component, image.image.data(), 0);
+    }
+  };
+  const auto threadCount = std::min<size_t>(
+      std::max(std::thread::hardware_concurrency(), 1u), pngs.size());
+  std::vector<std::thread> threads;
+  for (size_t i = 1; i < threadCount; ++i) {
+    threads.emplace_back(encode);
+  }
+  encode();
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  return pngs;
+}
+
+// Replace the decoded images of the model by PNG files next to the glTF file
+bool writeImageFiles(tinygltf::Model &model, const fs::path &path)
+{
+  const auto pngs = encodeImages(model);
+  for (size_t i = 0; i < pngs.size(); ++i) {
+    auto &image = model.images[i];
+    image.uri = path.stem().string() + "-" + image.name + ".png";
+    std::ofstream file{
+        (path.parent_path() / image.uri).string(), std::ios::binary};
+    file.write(reinterpret_cast<const char *>(pngs[i].data()),
+        std::streamsize(pngs[i].size()));
+    if (!file) {
+      std::cerr << "Unable to write " << image.uri << std::endl;
+      return false;
+    }
+    image.image.clear();
+  }
+  return true;
+}
+
+// Replace the decoded images of the model by PNG data in buffer views of its
+// buffer, which is the binary chunk of a GLB file
+void packImages(tinygltf::Model &model)
+{
+  const auto pngs = encodeImages(model);
+  auto &data = model.buffers[0].data;
+  for (size_t i = 0; i < pngs.size(); ++i) {
+    data.resize((data.size() + 3) & ~size_t(3));
+
+    tinygltf::BufferView bufferView;
+    bufferView.buffer = 0;
+    bufferView.byteOffset = data.size();
+    bufferView.byteLength = pngs[i].size();
+    model.bufferViews.push_back(bufferView);
+    data.insert(end(data), begin(pngs[i]), end(pngs[i]));
+
+    auto &image = model.images[i];
+    image.bufferView = int(model.bufferViews.size() - 1);
+    image.image.clear();
+  }
+}
+
+uint64_t countTriangles(const tinygltf::Model &model)
+{
+  uint64_t triangleCount = 0;
+  for (const auto &node : model.nodes) {
+    if (node.mesh < 0) {
+      continue;
+    }
+    for (const auto &primitive : model.meshes[node.mesh].primitives) {
+      triangleCount += model.accessors[primitive.indices].count / 3;
+    }
+  }
+  return triangleCount;
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+  // args library https://github.com/taywee/args
+  args::ArgumentParser parser{
+      "Write procedural glTF scenes of any size, for scaling tests.",
+      "A .glb output is a single file, with PNG images in its binary chunk. "
+      "A .gltf output is written with a .bin buffer and PNG files next to "
+      "it."};
+  args::HelpFlag help{parser, "help", "Display this help menu", {'h', "help"}};
+  args::Positional<std::string> output{parser, "output",
+      "Path of the .gltf or .glb file to write", args::Options::Required};
+  std::string sceneHelp = "Standard scene whose parameters are overridden by "
+                          "the other options, one of:";
+  for (const auto &name : standardSceneNames()) {
+    sceneHelp += " " + name;
+  }
+  args::ValueFlag<std::string> scene{parser, "scene", sceneHelp, {"scene"}};
+  args::ValueFlag<uint32_t> nodeCount{
+      parser, "nodes", "Number of nodes drawing a mesh", {"nodes"}};
+  args::ValueFlag<uint32_t> hierarchyDepth{parser, "depth",
+      "Levels of the node hierarchy, 1 for every node under the root",
+      {"depth"}};
+  args::ValueFlag<float> instancingRatio{parser, "instancing",
+      "Fraction of the nodes drawing a mesh drawn by another node, from 0 (a "
+      "mesh per node) to 1 (a single mesh)",
+      {"instancing"}};
+  args::ValueFlag<uint32_t> primitivesPerMesh{parser, "primitives",
+      "Number of primitives of each mesh", {"primitives"}};
+  args::ValueFlag<uint32_t> trianglesPerPrimitive{parser, "triangles",
+      "Number of triangles of each primitive, rounded to a sphere "
+      "tessellation",
+      {"triangles"}};
+  args::ValueFlag<uint32_t> materialCount{
+      parser, "materials", "Number of materials", {"materials"}};
+  args::ValueFlag<uint32_t> textureSize{parser, "texture-size",
+      "Width and height of the textures of the materials, 0 for none",
+      {"texture-size"}};
+  args::Flag prettyPrint{
+      parser, "pretty", "Indent the JSON of the glTF file", {"pretty"}};
+
+  try {
+    parser.ParseCLI(argc, argv);
+  } catch (const args::Help &) {
+    std::cout << parser;
+    return 0;
+  } catch (const args::Error &e) {
+    std::cerr << e.what() << std::endl;
+    std::cerr << parser;
+    return 1;
+  }
+
+  ProceduralSceneParams params;
+  if (scene) {
+    try {
+      params = getStandardScene(args::get(scene));
+    } catch (const std::runtime_error &e) {
+      std::cerr << e.what() << std::endl;
+      return 1;
+    }
+  }
+  if (nodeCount) {
+    params.nodeCount = args::get(nodeCount);
+  }
+  if (hierarchyDepth) {
+    params.hierarchyDepth = args::get(hierarchyDepth);
+  }
+  if (instancingRatio) {
+    params.instancingRatio = args::get(instancingRatio);
+  }
+  if (primitivesPerMesh) {
+    params.primitivesPerMesh = args::get(primitivesPerMesh);
+  }
+  if (trianglesPerPrimitive) {
+    params.trianglesPerPrimitive = args::get(trianglesPerPrimitive);
+  }
+  if (materialCount) {
+    params.materialCount = args::get(materialCount);
+  }
+  if (textureSize) {
+    params.textureSize = args::get(textureSize);
+  }
+
+  const fs::path outputPath = args::get(output);
+  const auto binary = outputPath.extension() == ".glb";
+  if (!binary && outputPath.extension() != ".gltf") {
+    std::cerr << "The output must be a .gltf or .glb file" << std::endl;
+    return 1;
+  }
+
+  const auto startTime = std::chrono::steady_clock::now();
+  auto model = generateProceduralScene(params);
+  const auto triangleCount = countTriangles(model);
+  if (binary) {
+    packImages(model);
+    // The binary chunk of a GLB file is at most 4GB
+    if (model.buffers[0].data.size() >
+        std::numeric_limits<uint32_t>::max() - 3) {
+      std::cerr << "The buffer exceeds the 4GB of a GLB file, write a .gltf "
+                   "file instead"
+                << std::endl;
+      return 1;
+    }
+  } else {
+    model.buffers[0].uri = outputPath.stem().string() + ".bin";
+    if (!writeImageFiles(model, outputPath)) {
+      return 1;
+    }
+  }
+  const auto bufferSize = model.buffers[0].data.size();
+
+  // Images are already written, by writeImageFiles or packImages
+  tinygltf::TinyGLTF writer;
+  writer.SetImageWriter(
+      [](const std::string *, const std::string *, tinygltf::Image *, bool,
+          void *) { return true; },
+      nullptr);
+  // TinyGLTF does not report write errors
+  if (fs::exists(outputPath)) {
+    fs::remove(outputPath);
+  }
+  writer.WriteGltfSceneToFile(&model, outputPath.string(), false, false,
+      bool(prettyPrint), binary);
+  if (!fs::exists(outputPath)) {
+    std::cerr << "Unable to write " << outputPath << std::endl;
+    return 1;
+  }
+
+  const auto seconds = std::chrono::duration<double>(
+      std::chrono::steady_clock::now() - startTime)
+                           .count();
+  std::cout << "Wrote " << outputPath.string() << " in " << seconds << "s: "
+            << model.nodes.size() << " nodes, " << model.meshes.size()
+            << " meshes, " << triangleCount << " triangles drawn, "
+            << model.materials.size() << " materials, " << model.images.size()
+            << " images, " << bufferSize << " bytes of buffer" << std::endl;
+  return 0;
+}
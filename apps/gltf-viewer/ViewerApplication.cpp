@@ -1,22 +1,48 @@
 #include "ViewerApplication.hpp"
 #include "cout_colors.hpp"
 
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
 #include <iostream>
+#include <limits>
 #include <numeric>
+#include <sstream>
 #include <string>
 #include <vector>
 
+#include <glm/gtc/constants.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/quaternion.hpp>
 #include <glm/gtc/type_ptr.hpp>
 #include <glm/gtx/io.hpp>
 
+#include "utils/animation.hpp"
+#include "utils/benchmark.hpp"
 #include "utils/gltf.hpp"
 #include "utils/cameras.hpp"
+#include "utils/image_writer.hpp"
 #include "utils/images.hpp"
-#include <stb_image_write.h>
+#include "utils/materials.hpp"
+#include "utils/morph_targets.hpp"
+#include "utils/profiler.hpp"
+#include "utils/program_cache.hpp"
+#include "utils/program_compiler.hpp"
+#include "utils/scene_hierarchy.hpp"
+#include "utils/skinning.hpp"
+#include "utils/sparse_accessors.hpp"
+#include "utils/textures.hpp"
+#include "utils/trace.hpp"
 #include <tiny_gltf.h>
 
+// Vertex attributes of the primitives given to the shaders
+static const std::vector<std::string> VERTEX_ATTRIBUTES{"POSITION", "NORMAL", "TANGENT", "TEXCOORD_0", "JOINTS_0", "WEIGHTS_0"};
+
+// Frames per second of render-sequence, for animations and video encoders
+static const float SEQUENCE_FRAME_RATE = 30.f;
+
 void keyCallback(
     GLFWwindow *window, int key, int scancode, int action, int mods)
 {
@@ -35,19 +61,30 @@ If there is errors or warning, print them.
 
 Reference : https://celeborn2bealive.github.io/openglnoel/docs/gltf-viewer-02-gltf-02-initialization#loading-the-gltf-file
 */
-bool ViewerApplication::loadGltfFile(tinygltf::Model &model)
+bool ViewerApplication::loadGltfFile(const fs::path &path, tinygltf::Model &model)
 {
   std::cout << COLOR_MAGENTA << "(つ•̀ᴥ•́)つ*:･ﾟ✧ " << COLOR_RESET << " Let's load some Models" << std::endl;
+  TraceScope trace{"Parse"};
 
   // Define a loader
   tinygltf::TinyGLTF loader;
+  // Images are decoded by the parser, traced on their own
+  loader.SetImageLoader(
+      [](tinygltf::Image *image, const int imageIdx, std::string *err, std::string *warn, int reqWidth,
+          int reqHeight, const unsigned char *bytes, int size, void *userData) {
+        TraceScope trace{"Image decode"};
+        return tinygltf::LoadImageData(image, imageIdx, err, warn, reqWidth, reqHeight, bytes, size, userData);
+      },
+      nullptr);
 
   // Define outputs strings
   std::string err;
   std::string warn;
 
-  // Load the model from our source string
-  bool ret = loader.LoadASCIIFromFile(&model, &err, &warn, m_gltfFilePath.string());
+  // Load the model from our source string, or from a binary glTF file
+  bool ret = path.extension() == ".glb"
+                 ? loader.LoadBinaryFromFile(&model, &err, &warn, path.string())
+                 : loader.LoadASCIIFromFile(&model, &err, &warn, path.string());
 
   // Display errors if required
   if (!warn.empty())
@@ -63,7 +100,7 @@ bool ViewerApplication::loadGltfFile(tinygltf::Model &model)
   if (!ret)
   {
     std::cout << "Failed to parse glTF : " << std::endl;
-    return -1;
+    return false;
   }
 
   // Return the command value
@@ -81,6 +118,7 @@ Reference : https://celeborn2bealive.github.io/openglnoel/docs/gltf-viewer-02-gl
 std::vector<GLuint> ViewerApplication::createBufferObjects(const tinygltf::Model &model)
 {
   std::cout << COLOR_MAGENTA << "(つ•̀ᴥ•́)つ*:･ﾟ✧ " << COLOR_RESET << " Let's create a VBO" << std::endl;
+  TraceScope trace{"Buffer upload"};
 
   // Create a vector of buffers objects
   std::vector<GLuint> bufferObjects(model.buffers.size(), 0);
@@ -126,15 +164,19 @@ Reference : https://celeborn2bealive.github.io/openglnoel/docs/gltf-viewer-02-gl
 
 std::vector<GLuint> ViewerApplication::createVertexArrayObjects(const tinygltf::Model &model,
                                                                 const std::vector<GLuint> &bufferObjects,
+                                                                SparseAccessorBuffers &sparseAccessorBuffers,
                                                                 std::vector<VaoRange> &meshIndexToVaoRange)
 {
   std::cout << COLOR_MAGENTA << "(つ•̀ᴥ•́)つ*:･ﾟ✧ " << COLOR_RESET << " Let's create a VAO" << std::endl;
+  TraceScope trace{"VAO creation"};
 
   // Define vertex attribs const
   const GLuint VERTEX_ATTRIB_POSITION_IDX = 0;
   const GLuint VERTEX_ATTRIB_NORMAL_IDX = 1;
   const GLuint VERTEX_ATTRIB_TEXCOORD0_IDX = 2;
   const GLuint VERTEX_ATTRIB_TANGENT_IDX = 3;
+  const GLuint VERTEX_ATTRIB_JOINTS0_IDX = 4;
+  const GLuint VERTEX_ATTRIB_WEIGHTS0_IDX = 5;
 
   // Init the tangent checker
   bool hasTangent = true;
@@ -184,11 +226,13 @@ std::vector<GLuint> ViewerApplication::createVertexArrayObjects(const tinygltf::
 
       // Based on https://github.com/KhronosGroup/glTF/tree/master/specification/2.0#meshes
       // Model should provide tangent.
-      std::vector<std::string> parameters{"POSITION", "NORMAL", "TANGENT", "TEXCOORD_0"};
+      const auto &parameters = VERTEX_ATTRIBUTES;
       std::vector<GLuint> vertexAttribEnum {VERTEX_ATTRIB_POSITION_IDX,
                                             VERTEX_ATTRIB_NORMAL_IDX,
                                             VERTEX_ATTRIB_TANGENT_IDX,
-                                            VERTEX_ATTRIB_TEXCOORD0_IDX};
+                                            VERTEX_ATTRIB_TEXCOORD0_IDX,
+                                            VERTEX_ATTRIB_JOINTS0_IDX,
+                                            VERTEX_ATTRIB_WEIGHTS0_IDX};
 
       for (size_t i = 0; i < parameters.size(); ++i)
       {
@@ -208,10 +252,12 @@ std::vector<GLuint> ViewerApplication::createVertexArrayObjects(const tinygltf::
           // ie. the index of the accessor for this attribute
           const auto accessorIdx = (*iterator).second;
           const auto &accessor = model.accessors[accessorIdx];             // TODO get the correct tinygltf::Accessor from model.accessors
-          const auto &bufferView = model.bufferViews[accessor.bufferView]; // TODO get the correct tinygltf::BufferView from model.bufferViews. You need to use the accessor
-          const auto bufferIdx = bufferView.buffer;                        // TODO get the index of the buffer used by the bufferView (you need to use it)
-          const auto bufferObject = bufferObjects[bufferIdx];              // TODO get the correct buffer object from the buffer index
-          assert(GL_ARRAY_BUFFER == bufferView.target);
+
+          // Sparse accessors are drawn from their dense copy, tightly packed from its start
+          const auto sparseBufferObject = sparseAccessorBuffers.getBufferObject(accessorIdx);
+          const auto bufferObject = sparseBufferObject
+                                        ? sparseBufferObject
+                                        : bufferObjects[model.bufferViews[accessor.bufferView].buffer];
 
           // TODO Enable the vertex attrib array corresponding to POSITION with glEnableVertexAttribArray
           // (you need to use VERTEX_ATTRIB_POSITION_IDX which is defined at the top of the file)
@@ -221,19 +267,28 @@ std::vector<GLuint> ViewerApplication::createVertexArrayObjects(const tinygltf::
           glBindBuffer(GL_ARRAY_BUFFER, bufferObject);
 
           // TODO Compute the total byte offset using the accessor and the buffer view
-          const auto byteOffset = bufferView.byteOffset + accessor.byteOffset;
-          const auto byteStride = bufferView.byteStride ? bufferView.byteStride : 3 * sizeof(float);
+          const auto byteOffset = sparseBufferObject ? 0 : getAccessorByteOffset(model, accessor);
+          const auto byteStride = sparseBufferObject ? 0 : getAccessorByteStride(model, accessor);
+
+          // Joint indices stay integers (uvec4 in the vertex shader)
+          if (vertexAttrib == VERTEX_ATTRIB_JOINTS0_IDX)
+          {
+            glVertexAttribIPointer(vertexAttrib, accessor.type, accessor.componentType, GLsizei(byteStride),
+                                   (const GLvoid *)byteOffset);
+            continue;
+          }
 
           // TODO Call glVertexAttribPointer with the correct arguments.
           // Remember size is obtained with accessor.type, type is obtained with accessor.componentType.
-          // The stride is obtained in the bufferView, normalized is always GL_FALSE, and pointer is the byteOffset (don't forget the cast).
+          // The stride is obtained from the accessor, normalized integers (quantized texture coordinates for
+          // instance) are converted to floats, and pointer is the byteOffset (don't forget the cast).
           glVertexAttribPointer(
-              vertexAttrib,              // GLuint index,
-              accessor.type,             // GLint size,
-              accessor.componentType,    // GLenum type,
-              GL_FALSE,                  // GLboolean normalized,
-              bufferView.byteStride,     // GLsizei stride,
-              (const GLvoid *)byteOffset // const GLvoid * pointer)
+              vertexAttrib,                                // GLuint index,
+              accessor.type,                               // GLint size,
+              accessor.componentType,                      // GLenum type,
+              accessor.normalized ? GL_TRUE : GL_FALSE,    // GLboolean normalized,
+              GLsizei(byteStride),                         // GLsizei stride,
+              (const GLvoid *)byteOffset                   // const GLvoid * pointer)
           );
         }
       } // </>End vertex attribution loop
@@ -253,11 +308,10 @@ std::vector<GLuint> ViewerApplication::createVertexArrayObjects(const tinygltf::
       if (primitive.indices >= 0)
       {
         const auto &accessor = model.accessors[primitive.indices];
-        const auto &bufferView = model.bufferViews[accessor.bufferView];
-        const auto bufferIdx = bufferView.buffer;
-        const auto bufferObject = bufferObjects[bufferIdx];
-
-        assert(GL_ELEMENT_ARRAY_BUFFER == bufferView.target);
+        const auto sparseBufferObject = sparseAccessorBuffers.getBufferObject(primitive.indices);
+        const auto bufferObject = sparseBufferObject
+                                      ? sparseBufferObject
+                                      : bufferObjects[model.bufferViews[accessor.bufferView].buffer];
         glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, bufferObject);
       }
     } // </>End Primitive loop
@@ -272,76 +326,6 @@ std::vector<GLuint> ViewerApplication::createVertexArrayObjects(const tinygltf::
   return vertexArrayObjects;
 }
 
-/*
-This method should compute a vector of texture objects. Each texture object is filled with an image and sampling parameters from the corresponding texture of the glTF file. This step basically consists of picking code examples from this section and putting them in a loop in order to initialize each texture object.
-*/
-std::vector<GLuint> ViewerApplication::createTextureObjects(const tinygltf::Model &model) const
-{
-
-  // When a filter is undefined, we use GL_LINEAR as default filter.
-  // And when no sampler is defined for the texture (in that case we have texture.sampler == -1),
-  // we use a default sampler defined as:
-  tinygltf::Sampler defaultSampler;
-  defaultSampler.minFilter = GL_LINEAR;
-  defaultSampler.magFilter = GL_LINEAR;
-  defaultSampler.wrapS = GL_REPEAT;
-  defaultSampler.wrapT = GL_REPEAT;
-  defaultSampler.wrapR = GL_REPEAT;
-
-  // Gen texture
-  std::vector<GLuint> textures;
-
-  // This code example shows how to fill a texture object using an image from tinygltf
-  for (const auto &texture : model.textures)
-  {
-    assert(texture.source >= 0);
-    const auto &image = model.images[texture.source];
-    GLuint textureIdx;
-    glGenTextures(1, &textureIdx);
-
-    glBindTexture(GL_TEXTURE_2D, textureIdx);
-    glTexImage2D(GL_TEXTURE_2D,
-                 0,
-                 GL_RGBA,
-                 image.width,
-                 image.height,
-                 0,
-                 GL_RGBA,
-                 image.pixel_type,
-                 image.image.data());
-
-    // The constant number here correspond to OpenGL constants such as GL_LINEAR, NEAREST_MIPMAP_NEAREST, GL_REPEAT, etc.
-    // It means we can directly use the values to setup texture sampling with the OpenGL API:
-    const auto &sampler = texture.sampler >= 0 ? model.samplers[texture.sampler] : defaultSampler;
-    glTexParameteri(GL_TEXTURE_2D,
-                    GL_TEXTURE_MIN_FILTER,
-                    sampler.minFilter != -1 ? sampler.minFilter : GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D,
-                    GL_TEXTURE_MAG_FILTER,
-                    sampler.magFilter != -1 ? sampler.magFilter : GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, sampler.wrapS);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, sampler.wrapT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_R, sampler.wrapR);
-
-    // Some samplers use mipmapping for their minification filter.
-    // In that case, the specification tells us we need to have mipmaps computed for the texture.
-    // OpenGL can compute them for us
-    if (sampler.minFilter == GL_NEAREST_MIPMAP_NEAREST ||
-        sampler.minFilter == GL_NEAREST_MIPMAP_LINEAR ||
-        sampler.minFilter == GL_LINEAR_MIPMAP_NEAREST ||
-        sampler.minFilter == GL_LINEAR_MIPMAP_LINEAR)
-    {
-      glGenerateMipmap(GL_TEXTURE_2D);
-    }
-
-    // Push back to the vector
-    textures.push_back(textureIdx);
-  }
-
-  glBindTexture(GL_TEXTURE_2D, 0);
-  return textures;
-}
-
 /*
 Main run method
 */
@@ -353,42 +337,6 @@ int ViewerApplication::run()
   std::cout << "==============================================" << COLOR_RESET << std::endl
             << std::endl;
 
-  // Loader shaders
-  const auto glslProgram =
-      compileProgram({m_ShadersRootPath / m_AppName / m_vertexShader,
-                      m_ShadersRootPath / m_AppName / m_fragmentShader});
-
-  const auto uniformModelViewProjMatrix = glGetUniformLocation(glslProgram.glId(), "uModelViewProjMatrix");
-  const auto uniformModelViewMatrix = glGetUniformLocation(glslProgram.glId(), "uModelViewMatrix");
-  const auto uniformNormalMatrix = glGetUniformLocation(glslProgram.glId(), "uNormalMatrix");
-  const auto uniformModelMatrix = glGetUniformLocation(glslProgram.glId(), "uModelMatrix");
-
-  // We now need to send the light parameters from the application.
-  // For that we need to get uniform locations with glGetUniformLocation at the begining of run() (like other uniforms).
-  const auto uniformLightDirection = glGetUniformLocation(glslProgram.glId(), "uLightDirection");
-  const auto uniformLightRadiance = glGetUniformLocation(glslProgram.glId(), "uLightRadiance");
-
-  // In the C++ code, apply the modifications needed to make it work (get uniform locations, bind textures, set uniforms)
-  const auto uniformEmissiveFactor = glGetUniformLocation(glslProgram.glId(), "uEmissiveFactor");
-  const auto uniformEmissiveTexture = glGetUniformLocation(glslProgram.glId(), "uEmissiveTexture");
-
-  // An occlusion map, which is just a factor to apply to the whole lighting equation, quite easy too
-  const auto uniformOcclusionTexture = glGetUniformLocation(glslProgram.glId(), "uOcclusionTexture");
-  const auto uniformOcclusionStrength = glGetUniformLocation(glslProgram.glId(), "uOcclusionStrength");
-
-  // The first step is to get the uniform location of uBaseColorTexture.
-  const auto uniformBaseColorTexture = glGetUniformLocation(glslProgram.glId(), "uBaseColorTexture");
-  const auto uniformBaseColorFactor = glGetUniformLocation(glslProgram.glId(), "uBaseColorFactor");
-  const auto uniformMetallicFactor = glGetUniformLocation(glslProgram.glId(), "uMetallicFactor");
-  const auto uniformRougnessFactor = glGetUniformLocation(glslProgram.glId(), "uRougnessFactor");
-  const auto uniformMetallicRoughnessTexture = glGetUniformLocation(glslProgram.glId(), "uMetallicRoughnessTexture");
-
-  // Normal map
-  const auto uniformNormalMapTexture = glGetUniformLocation(glslProgram.glId(), "uNormalMapTexture");
-  const auto uniformNormalMapScale = glGetUniformLocation(glslProgram.glId(), "uNormalMapScale");
-  const auto uniformNormalMapUse = glGetUniformLocation(glslProgram.glId(), "uNormalMapUse");
-  
-
   // Declare and initialize two glm::vec3 variables lightDirection and lightIntensity.
   glm::vec3 lightDirection(1.f, 1.f, 1.f);
   glm::vec3 lightRadiance(2.f, 2.f, 2.f);
@@ -402,8 +350,18 @@ int ViewerApplication::run()
   bool useNormalMap = true;
 
   // TODO Loading the glTF file
+  // Render farm workers take the model loaded by the driver before forking them: moving it does
+  // not copy its buffers and images, whose memory pages stay shared between the workers
   tinygltf::Model model;
-  bool loadingModelSuccess = loadGltfFile(model);
+  bool loadingModelSuccess = true;
+  if (m_pPreloadedModel)
+  {
+    model = std::move(*m_pPreloadedModel);
+  }
+  else
+  {
+    loadingModelSuccess = loadGltfFile(m_gltfFilePath, model);
+  }
   // Test
   if (loadingModelSuccess)
   {
@@ -414,6 +372,16 @@ int ViewerApplication::run()
   {
     std::cout << COLOR_RED << "ლ(ಥ Д ಥ )ლ " << COLOR_RESET << " Oh no !! Model failed to load" << COLOR_RESET << std::endl
               << std::endl;
+    return 1;
+  }
+
+  // Dense copies of the sparse accessors that are drawn, materialized on worker threads while the
+  // rest of the scene loads
+  SparseAccessorBuffers sparseAccessorBuffers{model, VERTEX_ATTRIBUTES};
+  if (sparseAccessorBuffers.size())
+  {
+    std::cout << COLOR_CYAN << "(ʘᗩʘ’)" << COLOR_RESET << " " << sparseAccessorBuffers.size()
+              << " sparse accessor(s) to materialize" << std::endl;
   }
 
   /*
@@ -427,6 +395,17 @@ int ViewerApplication::run()
     diagonal = bboxMax - bboxMin
   */
 
+  // Transforms of the nodes, flattened so that world matrices are computed once per pose instead of
+  // once per draw
+  SceneHierarchy sceneHierarchy{model};
+
+  // Animations write the transforms of the nodes they animate into the scene hierarchy
+  AnimationPlayer animationPlayer{model};
+  if (animationPlayer.size())
+  {
+    std::cout << COLOR_CYAN << "(ʘᗩʘ’)" << COLOR_RESET << " " << animationPlayer.size() << " animation(s)" << std::endl;
+  }
+
   // void computeSceneBounds(const tinygltf::Model &model, glm::vec3 &bboxMin, glm::vec3 &bboxMax);
   glm::vec3 bboxMin, bboxMax;
   computeSceneBounds(model, bboxMin, bboxMax);
@@ -440,11 +419,27 @@ int ViewerApplication::run()
 
   // Build projection matrix
   // Use near = 0.001f * maxDistance and far = 1.5f * maxDistance to compute the project matrix (the call to glm::perspective).
-  const auto projMatrix = glm::perspective(
-      70.f,
-      float(m_nWindowWidth) / m_nWindowHeight,
-      0.001f * maxDistance,
-      1.5f * maxDistance);
+  // Batch rendering changes the resolution between images, hence a function of the viewport size.
+  const auto computeProjMatrix = [&](GLsizei viewportWidth, GLsizei viewportHeight) {
+    return glm::perspective(
+        70.f,
+        float(viewportWidth) / viewportHeight,
+        0.001f * maxDistance,
+        1.5f * maxDistance);
+  };
+
+  // Images are rendered offscreen for --output and render-batch jobs, there is no window
+  const bool renderOffscreen = !m_OutputPath.empty() || !m_renderJobs.empty() || m_renderSequence.frameCount;
+
+  // Offscreen images draw each pose several times (supersampling passes, tiles):
+  // skin their vertices once per pose with a compute shader
+  const auto skinningMode = m_skinningMode != SkinningMode::Auto
+                                ? m_skinningMode
+                                : (renderOffscreen ? SkinningMode::Compute : SkinningMode::VertexShader);
+  // Same for the morph targets of each frame, blended once per change of weights
+  const auto morphMode = m_morphMode != MorphMode::Auto
+                             ? m_morphMode
+                             : (renderOffscreen ? MorphMode::Compute : MorphMode::VertexShader);
 
   // TODO Implement a new CameraController model and use it instead. Propose the
   // choice from the GUI
@@ -483,37 +478,145 @@ int ViewerApplication::run()
     }
   }
 
-  // Add a call to your method in the run() method,
-  // in the initialization step,
-  // before the drawing loop
-  // (for example, before the call to createBufferObjects).
-  // Store the result in a vector textureObjects.
-  std::vector<GLuint> textureObjects = createTextureObjects(model);
-
-  // After the call, create a single texture object with a variable GLuint whiteTexture to reference it.
-  // Fill it with a single white RGBA pixel (float white[] = {1, 1, 1, 1};)
-  // and set sampling parameters to GL_LINEAR and wrapping parameters to GL_REPEAT.
-  // This texture will be used for the base color of objects that have no materials
-  // (as specified in the glTF specification, if no base color texture is present, we should use white).
-  GLuint whiteTexture;
-  float white[] = {1, 1, 1, 1};
-  glGenTextures(1, &whiteTexture);
-  glBindTexture(GL_TEXTURE_2D, whiteTexture);
-  glTexImage2D(GL_TEXTURE_2D,
-               0,
-               GL_RGBA,
-               1, // width
-               1, // height
-               0,
-               GL_RGBA,
-               GL_FLOAT,
-               &white);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_R, GL_REPEAT);
-  glBindTexture(GL_TEXTURE_2D, 0);
+  // Texture objects are owned by the residency manager, which keeps them under
+  // the texture memory budget according to their footprint on screen.
+  // With texture arrays, the material buffer owns packed copies instead.
+  const auto textureBindingMode = resolveTextureBindingMode(model, m_textureBindingMode, m_textureBudgetBytes != 0);
+  std::unique_ptr<TextureResidencyManager> textureManager;
+  if (textureBindingMode != TextureBindingMode::Arrays)
+  {
+    textureManager = std::make_unique<TextureResidencyManager>(model, m_textureBudgetBytes);
+  }
+  else if (m_textureBudgetBytes)
+  {
+    std::cout << COLOR_CYAN << "(ʘᗩʘ’)" << COLOR_RESET << " Texture arrays are fully resident, the texture budget is ignored." << std::endl;
+  }
+  MaterialBuffer materialBuffer{model, textureBindingMode, textureManager.get()};
+
+  // Joint matrices of all skins, uploaded once per pose for every skinned draw
+  JointMatrixBuffer jointMatrixBuffer{model};
+
+  // Morph targets of each primitive, and active targets of each node uploaded when their weights change
+  MorphTargetBuffers morphTargetBuffers{model};
+
+  // Loader shaders. Each combination of material features (textures, tangents)
+  // gets its own variant of the program, so that the shaders do not branch at
+  // runtime on what the material has.
+  // Linked programs are kept in the program binary cache for the next runs,
+  // and built in the background by the program compiler.
+  ProgramBinaryCache programCache{m_shaderCachePath};
+  ProgramCompiler programCompiler{programCache, m_GLFWHandle.window(), !m_syncShaders};
+  ShaderVariantCache<ShadingProgram> shadingPrograms{
+      [&](uint32_t features) {
+        auto defines = materialBuffer.shaderDefines();
+        for (const auto &define : materialShaderDefines(features))
+        {
+          defines.push_back(define);
+        }
+
+        ShadingProgram shading;
+        shading.ticket = programCompiler.submit({m_ShadersRootPath / m_AppName / m_vertexShader,
+                                                 m_ShadersRootPath / m_AppName / m_fragmentShader},
+                                                defines);
+        return shading;
+      },
+      [&](ShadingProgram &shading, bool wait) {
+        // Status queries are deferred until the program is ready, or needed right now
+        if (!wait && !programCompiler.isReady(shading.ticket))
+        {
+          return false;
+        }
+        shading.program = programCompiler.take(shading.ticket);
+        materialBuffer.setupProgram(shading.program);
+
+        const auto glId = shading.program.glId();
+        shading.uniformModelViewProjMatrix = glGetUniformLocation(glId, "uModelViewProjMatrix");
+        shading.uniformModelViewMatrix = glGetUniformLocation(glId, "uModelViewMatrix");
+        shading.uniformNormalMatrix = glGetUniformLocation(glId, "uNormalMatrix");
+        shading.uniformModelMatrix = glGetUniformLocation(glId, "uModelMatrix");
+
+        // We now need to send the light parameters from the application.
+        // For that we need to get uniform locations with glGetUniformLocation (like other uniforms).
+        shading.uniformLightDirection = glGetUniformLocation(glId, "uLightDirection");
+        shading.uniformLightRadiance = glGetUniformLocation(glId, "uLightRadiance");
+
+        // Material parameters are read by the shader from the material buffer:
+        // a draw only needs to select its material
+        shading.uniformMaterialIndex = glGetUniformLocation(glId, "uMaterialIndex");
+
+        // Skinning variants read the matrices of the joints of their skin from the joint matrix buffer
+        shading.uniformJointOffset = glGetUniformLocation(glId, "uJointOffset");
+        const auto uniformJointMatrices = glGetUniformLocation(glId, "uJointMatrices");
+        if (uniformJointMatrices >= 0)
+        {
+          glProgramUniform1i(glId, uniformJointMatrices, GLint(JointMatrixBuffer::TEXTURE_UNIT));
+        }
+
+        // Morph variants blend the active targets of their node, given per primitive
+        shading.uniformMorphParameters = glGetUniformLocation(glId, "uMorphParameters");
+        const auto uniformMorphTargets = glGetUniformLocation(glId, "uMorphTargets");
+        if (uniformMorphTargets >= 0)
+        {
+          glProgramUniform1i(glId, uniformMorphTargets, GLint(MorphTargetBuffers::TARGETS_TEXTURE_UNIT));
+          glProgramUniform1i(glId, glGetUniformLocation(glId, "uMorphWeights"),
+                             GLint(MorphTargetBuffers::WEIGHTS_TEXTURE_UNIT));
+        }
+        return true;
+      }};
+
+  // Request every variant needed by the scene up front, so that they compile
+  // while we upload the geometry. Until its variant is ready, a primitive is
+  // drawn with the placeholder, the variant without any texture.
+  const uint32_t placeholderFeatures = 0;
+  const auto shadersStartTime = m_GLFWHandle.time();
+  shadingPrograms.tryGet(placeholderFeatures);
+  for (const auto &mesh : model.meshes)
+  {
+    for (const auto &primitive : mesh.primitives)
+    {
+      shadingPrograms.tryGet(materialBuffer.shaderFeatures(primitive, ~0u));
+    }
+  }
+  // Skinned and morphed primitives have their own variants, unless their vertices are deformed by a compute shader.
+  // Skinned primitives with morph targets are always skinned by the vertex shader, after the blending.
+  for (const auto &node : model.nodes)
+  {
+    if (node.mesh < 0)
+    {
+      continue;
+    }
+    const auto &primitives = model.meshes[node.mesh].primitives;
+    for (size_t primitiveIdx = 0; primitiveIdx < primitives.size(); ++primitiveIdx)
+    {
+      const auto &primitive = primitives[primitiveIdx];
+      const auto isMorphed = morphTargetBuffers.targets(node.mesh, primitiveIdx) != nullptr;
+      const auto isSkinned = node.skin >= 0 && isSkinnedPrimitive(primitive);
+      const auto vertexFeatures =
+          (isSkinned && (skinningMode == SkinningMode::VertexShader || isMorphed) ? SHADER_HAS_SKIN : 0u) |
+          (isMorphed && morphMode == MorphMode::VertexShader ? SHADER_HAS_MORPH : 0u);
+      if (vertexFeatures)
+      {
+        shadingPrograms.tryGet(placeholderFeatures | vertexFeatures);
+        shadingPrograms.tryGet(materialBuffer.shaderFeatures(primitive, ~0u) | vertexFeatures);
+      }
+    }
+  }
+
+  // Time spent getting the programs of the scene ready, from the cache or not
+  bool shadersReadyReported = false;
+  const auto reportShadersReady = [&]() {
+    if (shadersReadyReported || shadingPrograms.readyCount() != shadingPrograms.size())
+    {
+      return;
+    }
+    shadersReadyReported = true;
+    std::cout << COLOR_CYAN << "(ʘᗩʘ’)" << COLOR_RESET << " Shaders ready in "
+              << 1000. * (m_GLFWHandle.time() - shadersStartTime) << " ms: "
+              << programCache.loadedCount() << " program(s) loaded from cache, "
+              << programCache.compiledCount() << " compiled"
+              << (programCache.enabled() ? "" : " (cache disabled)")
+              << ", " << toString(programCompiler.backend()) << " compilation" << std::endl;
+  };
 
   // TODO Creation of Buffer Objects
   std::vector<GLuint> VBO = createBufferObjects(model);
@@ -531,7 +634,7 @@ int ViewerApplication::run()
 
   // TODO Creation of Vertex Array Objects
   std::vector<VaoRange> meshIndexToVaoRange;
-  std::vector<GLuint> VAO = createVertexArrayObjects(model, VBO, meshIndexToVaoRange);
+  std::vector<GLuint> VAO = createVertexArrayObjects(model, VBO, sparseAccessorBuffers, meshIndexToVaoRange);
   if (VAO.size() != 0)
   {
     std::cout << COLOR_GREEN << "ლ ( ◕  ᗜ  ◕ ) ლ " << COLOR_RESET << "VAO created" << COLOR_RESET << std::endl;
@@ -544,164 +647,197 @@ int ViewerApplication::run()
               << std::endl;
   }
 
-  // Setup OpenGL state for rendering
-  glEnable(GL_DEPTH_TEST);
-  glslProgram.use();
-
-  const auto whiteTextureCall = [&]() {
-    // Default to white texture
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, whiteTexture);
-    glUniform1i(uniformBaseColorTexture, 0);
-    glUniform4f(uniformBaseColorFactor, 1, 1, 1, 1);
-  };
+  // Vertex array objects of the primitives of skinned nodes in compute mode, drawing their vertices
+  // skinned once per pose
+  std::unique_ptr<PreSkinnedPrimitives> preSkinnedPrimitives;
+  if (jointMatrixBuffer.jointCount())
+  {
+    if (skinningMode == SkinningMode::Compute)
+    {
+      preSkinnedPrimitives = std::make_unique<PreSkinnedPrimitives>(
+          model, m_ShadersRootPath / m_AppName / "skinning.cs.glsl", [&](int meshIdx, size_t primitiveIdx) {
+            return VAO[meshIndexToVaoRange[meshIdx].begin + primitiveIdx];
+          });
+    }
+    std::cout << COLOR_CYAN << "(ʘᗩʘ’)" << COLOR_RESET << " " << model.skins.size() << " skin(s), "
+              << jointMatrixBuffer.jointCount() << " joint(s), " << toString(skinningMode) << " skinning" << std::endl;
+  }
 
-  const auto noMetallicRoughnessCall = [&]() {
-    // Default to no MetallicRoughness
-    glActiveTexture(GL_TEXTURE1);
-    glBindTexture(GL_TEXTURE_2D, 0);
-    glUniform1i(uniformMetallicRoughnessTexture, 1);
-    glUniform1f(uniformMetallicFactor, 1.f);
-    glUniform1f(uniformRougnessFactor, 1.f);
-  };
+  // Vertex array objects of the morphed primitives of each node in compute mode, drawing their vertices
+  // blended once per change of weights
+  std::unique_ptr<PreBlendedPrimitives> preBlendedPrimitives;
+  if (morphTargetBuffers.primitiveCount())
+  {
+    if (morphMode == MorphMode::Compute)
+    {
+      preBlendedPrimitives = std::make_unique<PreBlendedPrimitives>(
+          model, m_ShadersRootPath / m_AppName / "morph_targets.cs.glsl", morphTargetBuffers,
+          [&](int meshIdx, size_t primitiveIdx) {
+            return VAO[meshIndexToVaoRange[meshIdx].begin + primitiveIdx];
+          });
+    }
+    std::cout << COLOR_CYAN << "(ʘᗩʘ’)" << COLOR_RESET << " " << morphTargetBuffers.primitiveCount()
+              << " morphed primitive(s), " << morphTargetBuffers.targetCount() << " target(s), "
+              << toString(morphMode) << " morphing" << std::endl;
+  }
 
-  const auto noEmissiveCall = [&]() {
-    // Default to no emissive
-    glActiveTexture(GL_TEXTURE2);
-    glBindTexture(GL_TEXTURE_2D, 0);
-    glUniform1i(uniformEmissiveTexture, 2);
-    glUniform3f(uniformEmissiveFactor, 0, 0, 0);
-  };
+  // Setup OpenGL state for rendering
+  glEnable(GL_DEPTH_TEST);
 
-  const auto noOcclusionCall = [&]() {
-    // Default to no occlusion
-    glActiveTexture(GL_TEXTURE3);
-    glBindTexture(GL_TEXTURE_2D, 0);
-    glUniform1i(uniformOcclusionTexture, 0);
-    glUniform1f(uniformOcclusionStrength, 1.f);
-  };
+  // Frame times and counters for the profiler panel. Offscreen images are timed on the GPU as a whole,
+  // with their own queries.
+  FrameProfiler profiler{!renderOffscreen};
+  auto &frameCounters = profiler.counters();
 
-  const auto noNormalMapCall = [&]() {
-    // Default to no Normal map
-    glActiveTexture(GL_TEXTURE4);
-    glBindTexture(GL_TEXTURE_2D, 0);
-    glUniform1i(uniformNormalMapTexture, 0);
-    glUniform1f(uniformNormalMapScale, 1.f);
-    glUniform1i(uniformNormalMapUse, false);
-  };
+  // The variant of the program in use, and the node whose matrices it has
+  const ShadingProgram *currentProgram = nullptr;
+  int currentProgramNodeIdx = -1;
 
   // In order to have a more or less clean implementation,
-  // we will implement the texture binding in a specific lambda function bindMaterial(int materialIdx)
+  // we will implement the material binding in a specific lambda function bindMaterial(int materialIdx).
+  // With bindless textures or texture arrays, selecting the material is the only state change.
   const auto bindMaterial = [&](const auto materialIndex) {
-    // Material binding
-    if (materialIndex >= 0)
+    glUniform1i(currentProgram->uniformMaterialIndex, materialBuffer.gpuMaterialIndex(materialIndex));
+    ++frameCounters.stateChanges;
+    if (materialBuffer.mode() == TextureBindingMode::Classic)
     {
+      materialBuffer.bindTextures(materialIndex);
+      frameCounters.textureBinds += MATERIAL_TEXTURE_SLOT_COUNT;
+    }
+  };
 
-      // Get the material
-      const auto &material = model.materials[materialIndex];
-      const auto &pbrMetallicRoughness = material.pbrMetallicRoughness;
-
-      // Base color texture call
-      if (useBaseColorTexture && pbrMetallicRoughness.baseColorTexture.index >= 0)
-      {
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, textureObjects[pbrMetallicRoughness.baseColorTexture.index]);
-        glUniform1i(uniformBaseColorTexture, 0);
-        glUniform4f(uniformBaseColorFactor,
-                    (float)pbrMetallicRoughness.baseColorFactor[0] || 1.f,
-                    (float)pbrMetallicRoughness.baseColorFactor[1] || 1.f,
-                    (float)pbrMetallicRoughness.baseColorFactor[2] || 1.f,
-                    (float)pbrMetallicRoughness.baseColorFactor[3] || 1.f);
-      }
-      else
-      {
-        // Default to white texture
-        whiteTextureCall();
-      }
-
-      // Metallic roughness call
-      if (useMetallicRoughnessTexture && pbrMetallicRoughness.metallicRoughnessTexture.index >= 0)
-      {
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D, textureObjects[pbrMetallicRoughness.metallicRoughnessTexture.index]);
-        glUniform1i(uniformMetallicRoughnessTexture, 1);
-        glUniform1f(uniformMetallicFactor, pbrMetallicRoughness.metallicFactor || 1.f);
-        glUniform1f(uniformRougnessFactor, pbrMetallicRoughness.roughnessFactor || 1.f);
-      }
-      else
+  // Report the on-screen size of a primitive to the texture residency manager,
+  // for every texture of its material
+  const auto requestTextureFootprints = [&](const auto materialIndex, float footprint) {
+    if (materialIndex < 0 || !textureManager)
+    {
+      return;
+    }
+    const auto &material = model.materials[materialIndex];
+    for (const auto textureIndex : {material.pbrMetallicRoughness.baseColorTexture.index,
+                                    material.pbrMetallicRoughness.metallicRoughnessTexture.index,
+                                    material.emissiveTexture.index,
+                                    material.occlusionTexture.index,
+                                    material.normalTexture.index})
+    {
+      if (textureIndex >= 0)
       {
-        // Default to no MetallicRoughness
-        noMetallicRoughnessCall();
+        textureManager->requestFootprint(textureIndex, footprint);
       }
+    }
+  };
 
-      // Emissive texture call
-      if (useEmissive && material.emissiveTexture.index >= 0)
-      {
-        glActiveTexture(GL_TEXTURE2);
-        glBindTexture(GL_TEXTURE_2D, textureObjects[material.emissiveTexture.index]);
-        glUniform1i(uniformEmissiveTexture, 2);
-        glUniform3f(uniformEmissiveFactor,
-                    (float)material.emissiveFactor[0] || 0.f,
-                    (float)material.emissiveFactor[1] || 0.f,
-                    (float)material.emissiveFactor[2] || 0.f);
-      }
-      else
+  // Report the on-screen size of every primitive of the scene seen by camera, without drawing it: residency
+  // only depends on the bounds of the primitives, computed on the CPU
+  const auto requestSceneFootprints = [&](const Camera &camera, GLsizei imageWidth, GLsizei imageHeight) {
+    sceneHierarchy.update();
+    const auto viewMatrix = camera.getViewMatrix();
+    const auto projMatrix = computeProjMatrix(imageWidth, imageHeight);
+    const std::function<void(int)> visitNode = [&](int nodeIdx) {
+      const auto &node = model.nodes[nodeIdx];
+      if (node.mesh >= 0)
       {
-        noEmissiveCall();
+        // Skinned vertices are already in world space, see drawNode
+        const auto isSkinnedNode = node.skin >= 0 && size_t(node.skin) < model.skins.size();
+        const glm::mat4 modelMatrix = isSkinnedNode ? glm::mat4(1) : sceneHierarchy.worldMatrix(nodeIdx);
+        const auto modelViewMatrix = viewMatrix * modelMatrix;
+        const auto maxScale = glm::max(glm::length(glm::vec3(modelMatrix[0])),
+                                       glm::max(glm::length(glm::vec3(modelMatrix[1])),
+                                                glm::length(glm::vec3(modelMatrix[2]))));
+        for (const auto &primitive : model.meshes[node.mesh].primitives)
+        {
+          // Approximate its diameter in pixels from its bounding sphere
+          glm::vec3 localMin, localMax;
+          if (primitive.material >= 0 && getPrimitiveLocalBounds(model, primitive, localMin, localMax))
+          {
+            const auto viewCenter = glm::vec3(modelViewMatrix * glm::vec4(0.5f * (localMin + localMax), 1.f));
+            const auto radius = 0.5f * glm::length(localMax - localMin) * maxScale;
+            const auto distance = glm::length(viewCenter);
+            const auto footprint = distance > radius ? radius * std::abs(projMatrix[1][1]) * imageHeight / distance
+                                                     : std::numeric_limits<float>::max();
+            requestTextureFootprints(primitive.material, footprint);
+          }
+        }
       }
-
-      // Occlusion call
-      if (useOcclusion && material.occlusionTexture.index >= 0)
+      for (const auto nodeChildIdx : node.children)
       {
-        glActiveTexture(GL_TEXTURE3);
-        glBindTexture(GL_TEXTURE_2D, textureObjects[material.occlusionTexture.index]);
-        glUniform1i(uniformOcclusionTexture, 3);
-        glUniform1f(uniformOcclusionStrength, material.occlusionTexture.strength || 1.f);
+        visitNode(nodeChildIdx);
       }
-      else
+    };
+    if (model.defaultScene >= 0)
+    {
+      for (const auto nodeIdx : model.scenes[model.defaultScene].nodes)
       {
-        noOcclusionCall();
+        visitNode(nodeIdx);
       }
+    }
+  };
 
-      // Normal map call
-      if (useNormalMap && material.normalTexture.index >= 0)
+  // Lambda function to draw a tile of an image of the scene, on a viewport of the size of the tile
+  // The projection is offset by jitter pixels for supersampling.
+  const auto drawSceneTile = [&](const Camera &camera, GLsizei imageWidth, GLsizei imageHeight, const ImageTile &tile,
+                                 const glm::vec2 &jitter) {
+    // Joint matrices and pre-skinned vertices only change with the pose, the active morph targets and
+    // pre-blended vertices with the weights
+    {
+      FrameProfiler::CpuScope deformationScope{profiler, "Deformation"};
+      FrameProfiler::GpuScope deformationPass{profiler, "Deformation"};
+      sceneHierarchy.update();
+      if (jointMatrixBuffer.update(sceneHierarchy))
       {
-        glActiveTexture(GL_TEXTURE4);
-        glBindTexture(GL_TEXTURE_2D, textureObjects[material.normalTexture.index]);
-        glUniform1i(uniformNormalMapTexture, 4);
-        glUniform1f(uniformNormalMapScale, material.normalTexture.scale || 1.f);
-        glUniform1i(uniformNormalMapUse, true);
+        frameCounters.uploadedBytes += jointMatrixBuffer.jointCount() * sizeof(glm::mat4);
+        if (preSkinnedPrimitives)
+        {
+          preSkinnedPrimitives->update(jointMatrixBuffer);
+        }
       }
-      else
+      if (morphTargetBuffers.update(sceneHierarchy))
       {
-        noNormalMapCall();
+        frameCounters.uploadedBytes += morphTargetBuffers.activeTargetCount() * sizeof(glm::vec2);
+        if (preBlendedPrimitives)
+        {
+          preBlendedPrimitives->update(sceneHierarchy);
+        }
       }
-
-      return;
     }
 
-    // Default to white texture
-    whiteTextureCall();
-
-    // Default to no MetallicRoughness
-    noMetallicRoughnessCall();
-
-    // Default to no emissive
-    noEmissiveCall();
-
-    // Default to no occlusion
-    noOcclusionCall();
-
-    // Default to no normal map
-    noNormalMapCall();
-  };
-
-  // Lambda function to draw the scene
-  const auto drawScene = [&](const Camera &camera) {
-    glViewport(0, 0, m_nWindowWidth, m_nWindowHeight);
+    FrameProfiler::GpuScope scenePass{profiler, "Scene"};
+    glViewport(0, 0, tile.width, tile.height);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
     const auto viewMatrix = camera.getViewMatrix();
+    auto projMatrix = computeProjMatrix(imageWidth, imageHeight);
+    if (renderOffscreen)
+    {
+      // Image files store rows from top to bottom: render upside down so that
+      // the pixels read back need no flip. Mirroring reverses the winding of
+      // triangles, hence the front face.
+      projMatrix = glm::scale(glm::mat4(1), glm::vec3(1, -1, 1)) * projMatrix;
+      glFrontFace(GL_CW);
+    }
+    if (tile.width != imageWidth || tile.height != imageHeight)
+    {
+      projMatrix = computeTileMatrix(imageWidth, imageHeight, tile) * projMatrix;
+    }
+    if (jitter != glm::vec2(0))
+    {
+      projMatrix = glm::translate(glm::mat4(1), glm::vec3(2.f * jitter / glm::vec2(tile.width, tile.height), 0)) * projMatrix;
+    }
+
+    materialBuffer.bind();
+    jointMatrixBuffer.bind();
+    morphTargetBuffers.bindWeights();
+    frameCounters.textureBinds += materialBuffer.textureArrayCount() + 2;
+    currentProgram = nullptr;
+    currentProgramNodeIdx = -1;
+
+    // Textures enabled from the GUI, they select the variant of the program
+    const GLuint textureToggles =
+        (useBaseColorTexture ? 1u << MATERIAL_TEXTURE_BASE_COLOR : 0u) |
+        (useMetallicRoughnessTexture ? 1u << MATERIAL_TEXTURE_METALLIC_ROUGHNESS : 0u) |
+        (useEmissive ? 1u << MATERIAL_TEXTURE_EMISSIVE : 0u) |
+        (useOcclusion ? 1u << MATERIAL_TEXTURE_OCCLUSION : 0u) |
+        (useNormalMap ? 1u << MATERIAL_TEXTURE_NORMAL : 0u);
 
     // Then in the render loop we need to set our uniforms with glUniform3f.
     // For the light direction, we must be careful to
@@ -710,37 +846,70 @@ int ViewerApplication::run()
     // before sending it to the shader.
     // Otherwise, we will see the light move as we move the camera, and that's not what we want of course.
 
-    const auto lightDirectionViewSpace = glm::normalize(glm::vec3(viewMatrix * glm::vec4(lightDirection, 0.)));
-    if (uniformLightDirection >= 0)
-    {
-      if (useLightFromCamera)
+    const auto lightDirectionViewSpace = useLightFromCamera
+                                             ? glm::vec3(0, 0, 1)
+                                             : glm::normalize(glm::vec3(viewMatrix * glm::vec4(lightDirection, 0.)));
+
+    // Switch to the variant of the program for features. Uniforms belong to a
+    // program, so the light is sent again on each switch, and the matrices of
+    // the node when the program does not have them yet.
+    const auto useProgram = [&](uint32_t features, int nodeIdx, const glm::mat4 &modelMatrix,
+                                const glm::mat4 &modelViewMatrix, const glm::mat4 &modelViewProjectionMatrix,
+                                const glm::mat4 &normalMatrix, GLint jointOffset) {
+      // Images are only rendered with the final variants
+      const auto *pShading = !renderOffscreen ? shadingPrograms.tryGet(features)
+                                                  : &shadingPrograms.get(features);
+      if (!pShading)
       {
-        glUniform3f(uniformLightDirection, 0, 0, 1);
+        pShading = &shadingPrograms.get(placeholderFeatures | (features & (SHADER_HAS_SKIN | SHADER_HAS_MORPH)));
       }
-      else
+      const auto &shading = *pShading;
+      if (&shading != currentProgram)
       {
-        glUniform3f(uniformLightDirection, lightDirectionViewSpace.x, lightDirectionViewSpace.y, lightDirectionViewSpace.z);
+        currentProgram = &shading;
+        currentProgramNodeIdx = -1;
+        shading.program.use();
+        ++frameCounters.stateChanges;
+
+        if (shading.uniformLightDirection >= 0)
+        {
+          glUniform3f(shading.uniformLightDirection, lightDirectionViewSpace.x, lightDirectionViewSpace.y, lightDirectionViewSpace.z);
+        }
+        if (shading.uniformLightRadiance >= 0)
+        {
+          glUniform3f(shading.uniformLightRadiance, lightRadiance.r, lightRadiance.g, lightRadiance.b);
+        }
       }
-    }
-    if (uniformLightRadiance >= 0)
-    {
-      glUniform3f(uniformLightRadiance, lightRadiance.r, lightRadiance.g, lightRadiance.b);
-    }
+      if (currentProgramNodeIdx == nodeIdx)
+      {
+        return;
+      }
+      currentProgramNodeIdx = nodeIdx;
+
+      // Send all of these to the shaders with glUniformMatrix4fv.
+      glUniformMatrix4fv(shading.uniformModelMatrix, 1, GL_FALSE, (const GLfloat *)&modelMatrix);
+      glUniformMatrix4fv(shading.uniformModelViewMatrix, 1, GL_FALSE, (const GLfloat *)&modelViewMatrix);
+      glUniformMatrix4fv(shading.uniformNormalMatrix, 1, GL_FALSE, (const GLfloat *)&normalMatrix);
+      glUniformMatrix4fv(shading.uniformModelViewProjMatrix, 1, GL_FALSE, (const GLfloat *)&modelViewProjectionMatrix);
+      if (shading.uniformJointOffset >= 0)
+      {
+        glUniform1i(shading.uniformJointOffset, jointOffset);
+      }
+    };
 
     // The recursive function that should draw a node
     // We use a std::function because a simple lambda cannot be recursive
-    const std::function<void(int, const glm::mat4 &)> drawNode =
-        [&](int nodeIdx, const glm::mat4 &parentMatrix) {
+    const std::function<void(int)> drawNode =
+        [&](int nodeIdx) {
           // TODO The drawNode function
 
           // Now we can attack the drawNode function.
           // The first step is to get the node (as a tinygltf::Node)
-          // and to compute its model matrix from the parent matrix.
-          // Fortunately for you, I included a helper function getLocalToWorldMatrix(node, parentMatrix).
-          // If you are interested you can take a look at the code,
-          // its mostly calls to glm function to perform the right maths.
+          // and its model matrix, computed for the current pose by the scene hierarchy.
+          // Skinned vertices are already in world space: the model matrix of skinned nodes is ignored.
           const auto &node = model.nodes[nodeIdx];
-          glm::mat4 modelMatrix = getLocalToWorldMatrix(node, parentMatrix);
+          const auto isSkinnedNode = node.skin >= 0 && size_t(node.skin) < model.skins.size();
+          const glm::mat4 modelMatrix = isSkinnedNode ? glm::mat4(1) : sceneHierarchy.worldMatrix(nodeIdx);
 
           // Then we need to ensure that the node has a mesh
           if (node.mesh >= 0)
@@ -754,11 +923,7 @@ int ViewerApplication::run()
             // Compute normalMatrix
             glm::mat4 normalMatrix = glm::transpose(glm::inverse(modelViewMatrix));
 
-            // Send all of these to the shaders with glUniformMatrix4fv.
-            glUniformMatrix4fv(uniformModelMatrix, 1, GL_FALSE, (const GLfloat *)&modelMatrix);
-            glUniformMatrix4fv(uniformModelViewMatrix, 1, GL_FALSE, (const GLfloat *)&modelViewMatrix);
-            glUniformMatrix4fv(uniformNormalMatrix, 1, GL_FALSE, (const GLfloat *)&normalMatrix);
-            glUniformMatrix4fv(uniformModelViewProjMatrix, 1, GL_FALSE, (const GLfloat *)&modelViewProjectionMatrix);
+            // They are sent to the shaders with the program of the first primitive, see useProgram
 
             // Get the mesh
             const auto &mesh = model.meshes[node.mesh];
@@ -774,12 +939,42 @@ int ViewerApplication::run()
             for (size_t primitiveIdx = 0; primitiveIdx < mesh.primitives.size(); ++primitiveIdx)
             {
 
-              // Get the VAO of the primitive (using vertexArrayObjects, the vaoRange and the primitive index) and bind it.
-              const auto &vao = VAO[vaoRange.begin + primitiveIdx];
-
               // Get the current primitive.
               const auto &primitive = mesh.primitives[primitiveIdx];
 
+              // Get the VAO of the primitive (using vertexArrayObjects, the vaoRange and the primitive index) and bind it.
+              // Pre-skinned and pre-blended primitives have their own, drawing their deformed vertices.
+              const auto isSkinned = isSkinnedNode && isSkinnedPrimitive(primitive);
+              const auto *pMorphTargets = morphTargetBuffers.targets(node.mesh, primitiveIdx);
+              const auto preSkinnedVao = isSkinned && preSkinnedPrimitives
+                                             ? preSkinnedPrimitives->vertexArrayObject(node.skin, node.mesh, primitiveIdx)
+                                             : 0;
+              const auto preBlendedVao = pMorphTargets && preBlendedPrimitives
+                                             ? preBlendedPrimitives->vertexArrayObject(nodeIdx, primitiveIdx)
+                                             : 0;
+              const auto vao = preBlendedVao ? preBlendedVao
+                                             : preSkinnedVao ? preSkinnedVao : VAO[vaoRange.begin + primitiveIdx];
+
+              // Use the variant of the program matching its material, blending its morph targets and skinning its
+              // vertices unless they are already
+              const auto isMorphed = pMorphTargets && !preBlendedVao;
+              const auto features = materialBuffer.shaderFeatures(primitive, textureToggles) |
+                                    (isSkinned && !preSkinnedVao ? SHADER_HAS_SKIN : 0u) |
+                                    (isMorphed ? SHADER_HAS_MORPH : 0u);
+              useProgram(features, nodeIdx, modelMatrix, modelViewMatrix, modelViewProjectionMatrix, normalMatrix,
+                         isSkinnedNode ? jointMatrixBuffer.jointOffset(node.skin) : 0);
+              if (isMorphed)
+              {
+                morphTargetBuffers.bindTargets(*pMorphTargets);
+                ++frameCounters.textureBinds;
+                glUniform4i(currentProgram->uniformMorphParameters, morphTargetBuffers.activeTargetOffset(nodeIdx),
+                            morphTargetBuffers.activeTargetCount(nodeIdx), pMorphTargets->vertexCount,
+                            pMorphTargets->texelsPerVertex);
+              }
+
+              glBindVertexArray(vao);
+              ++frameCounters.stateChanges;
+
               // Now we need to check if the primitive has indices by testing if (primitive.indices >= 0).
               // If its the case we should use glDrawElements for the drawing,
               // If not we should use glDrawArrays.
@@ -791,9 +986,8 @@ int ViewerApplication::run()
                 // You need to get the accessor of the indices (model.accessors[primitive.indices])
                 const auto &accessor = model.accessors[primitive.indices];
 
-                // And the bufferView to compute the total byte offset to use for indices
-                const auto &bufferView = model.bufferViews[accessor.bufferView];
-                const auto byteOffset = bufferView.byteOffset + accessor.byteOffset;
+                // And the total byte offset to use for indices (dense copies of sparse accessors start at 0)
+                const auto byteOffset = needsDenseCopy(accessor) ? 0 : getAccessorByteOffset(model, accessor);
 
                 // In the drawScene lambda function, just before drawing a specific primitive (before binding its VAO),
                 // add a call to bindMaterial with the material index of the primitive as argument.
@@ -804,12 +998,12 @@ int ViewerApplication::run()
                 // the number of indices (accessor.count),
                 // the component type of indices (accessor.componentType)
                 // the byte offset as last argument (with a cast to const GLvoid*).
-                glBindVertexArray(vao);
                 glDrawElements(
                     static_cast<GLenum>(primitive.mode),
                     static_cast<GLsizei>(accessor.count),
                     static_cast<GLenum>(accessor.componentType),
                     (const GLvoid *)byteOffset);
+                frameCounters.addDraw(GLenum(primitive.mode), GLsizei(accessor.count));
               }
               else
               {
@@ -821,10 +1015,6 @@ int ViewerApplication::run()
                 const auto accessorIdx = (*begin(primitive.attributes)).second;
                 const auto &accessor = model.accessors[accessorIdx];
 
-                // And the bufferView to compute the total byte offset to use for indices
-                const auto &bufferView = model.bufferViews[accessor.bufferView];
-                const auto byteOffset = bufferView.byteOffset + accessor.byteOffset;
-
                 // Then call glDrawArrays, passing it
                 // the mode of the primitive,
                 // 0 as second argument,
@@ -833,6 +1023,7 @@ int ViewerApplication::run()
                     static_cast<GLenum>(primitive.mode),
                     static_cast<GLint>(0),
                     static_cast<GLsizei>(accessor.count));
+                frameCounters.addDraw(GLenum(primitive.mode), GLsizei(accessor.count));
               }
             }
           }
@@ -845,8 +1036,7 @@ int ViewerApplication::run()
           for (const auto nodeChildIdx : node.children)
           {
             // Call drawNode on each children.
-            // The matrix passed as second argument should be the modelMatrix that has been computed earlier in the function.
-            drawNode(nodeChildIdx, modelMatrix);
+            drawNode(nodeChildIdx);
           }
         };
 
@@ -856,7 +1046,7 @@ int ViewerApplication::run()
       // TODO Draw all nodes
       for (const auto nodeIdx : model.scenes[model.defaultScene].nodes)
       {
-        drawNode(nodeIdx, glm::mat4(1));
+        drawNode(nodeIdx);
       }
     }
 
@@ -864,26 +1054,512 @@ int ViewerApplication::run()
     glBindVertexArray(0);
   };
 
-  if (!m_OutputPath.empty())
+  // Lambda function to draw the scene
+  const auto drawScene = [&](const Camera &camera, GLsizei viewportWidth, GLsizei viewportHeight) {
+    drawSceneTile(camera, viewportWidth, viewportHeight, ImageTile{0, 0, viewportWidth, viewportHeight}, glm::vec2(0));
+  };
+
+  if (renderOffscreen)
   {
 
-    std::cout << COLOR_MAGENTA << "(つ•̀ᴥ•́)つ*:･ﾟ✧ " << COLOR_RESET << " Let's make an image !" << std::endl;
+    // --output is a batch of one image, seen from the camera of the command line or the default one.
+    // A sequence is a batch of frames, seen from cameras along a path or turning around the scene.
+    auto jobs = m_renderJobs;
+    if (m_renderSequence.frameCount)
+    {
+      const auto &path = m_renderSequence.cameraPath;
+      const auto turntableCamera = cameraController->getCamera();
+      for (uint32_t frame = 0; frame < m_renderSequence.frameCount; ++frame)
+      {
+        RenderJob job;
+        if (!m_renderSequence.outputPattern.empty())
+        {
+          job.output = formatFramePath(m_renderSequence.outputPattern, frame);
+        }
+        job.width = m_nWindowWidth;
+        job.height = m_nWindowHeight;
+        job.hasCamera = true;
+        if (!path.empty())
+        {
+          const auto t = m_renderSequence.frameCount > 1 ? float(frame) / (m_renderSequence.frameCount - 1) : 0.f;
+          job.camera = sampleCameraPath(path, glm::mix(path.front().time, path.back().time, t));
+        }
+        else
+        {
+          // The last frame stops one step before a full turn, so that the sequence loops
+          const auto angle = 2.f * glm::pi<float>() * frame / m_renderSequence.frameCount;
+          const auto eye = glm::vec3(glm::rotate(glm::mat4(1), angle, up) * glm::vec4(turntableCamera.eye() - center, 0));
+          job.camera = Camera{center + eye, center, up};
+        }
+        // The first animation plays along, at the frame rate of the sequence
+        if (animationPlayer.size())
+        {
+          job.animationTime = float(frame) / SEQUENCE_FRAME_RATE;
+        }
+        jobs.emplace_back(std::move(job));
+      }
+    }
+    else if (jobs.empty())
+    {
+      jobs.emplace_back();
+      jobs.back().output = m_OutputPath;
+      jobs.back().width = m_nWindowWidth;
+      jobs.back().height = m_nWindowHeight;
+    }
+
+    // The bench command renders the frames of the sequence without reading them back, after
+    // warmup frames along the same path, with at most two frames in flight
+    if (m_benchmark.frameCount)
+    {
+      std::cout << COLOR_MAGENTA << "(つ•̀ᴥ•́)つ*:･ﾟ✧ " << COLOR_RESET << " Let's benchmark " << m_benchmark.warmupFrames
+                << " warmup frames and " << jobs.size() << " frames !" << std::endl;
+      BenchmarkResults results;
+      results.sceneName = m_benchmark.sceneName;
+      results.renderer = reinterpret_cast<const char *>(glGetString(GL_RENDERER));
+      results.width = m_nWindowWidth;
+      results.height = m_nWindowHeight;
+      results.warmupFrames = m_benchmark.warmupFrames;
+
+      OffscreenTarget offscreenTarget{OffscreenTarget::ColorFormat::RGBA8, GLsizei(m_samples)};
+      offscreenTarget.setPassCount(m_supersamplePasses);
+      const auto frameCount = size_t(m_benchmark.warmupFrames) + jobs.size();
+      std::vector<GLuint> gpuTimeQueries(jobs.size());
+      glGenQueries(GLsizei(gpuTimeQueries.size()), gpuTimeQueries.data());
+      std::vector<GLsync> fences(frameCount, nullptr);
+      int64_t peakVideoMemoryBytes = getUsedVideoMemoryBytes();
+
+      // The scene is loaded once the requested shader variants are built and the uploads done: every range
+      // recorded so far is a load phase, and later ones belong to frames
+      shadingPrograms.finishAll();
+      glFinish();
+      results.loadMs = 1e-3 * traceTimeUs();
+      for (const auto &total : getTraceTotals())
+      {
+        results.loadPhasesMs.emplace_back(total.first, 1e-3 * total.second);
+      }
+
+      using Clock = std::chrono::steady_clock;
+      auto frameStartTime = Clock::now();
+      for (size_t frame = 0; frame < frameCount; ++frame)
+      {
+        // Warmup frames go along the path from its start, looping
+        const auto measured = frame >= m_benchmark.warmupFrames;
+        const auto jobIndex = measured ? frame - m_benchmark.warmupFrames : frame % jobs.size();
+        const auto &job = jobs[jobIndex];
+        profiler.newFrame();
+        if (job.animationTime >= 0.f && animationPlayer.size())
+        {
+          FrameProfiler::CpuScope animationScope{profiler, "Animation"};
+          const auto duration = animationPlayer.duration(0);
+          animationPlayer.apply(0, duration > 0.f ? std::fmod(job.animationTime, duration) : 0.f, sceneHierarchy);
+        }
+        const auto width = GLsizei(job.width);
+        const auto height = GLsizei(job.height);
+        if (m_textureBudgetBytes && textureManager)
+        {
+          requestSceneFootprints(job.camera, width, height);
+          textureManager->update(std::numeric_limits<size_t>::max());
+          materialBuffer.update();
+        }
+
+        {
+          FrameProfiler::CpuScope imageScope{profiler, "Image"};
+          if (measured)
+          {
+            glBeginQuery(GL_TIME_ELAPSED, gpuTimeQueries[jobIndex]);
+          }
+          renderToTarget(offscreenTarget, width, height, [&]() {
+            drawSceneTile(job.camera, width, height, ImageTile{0, 0, width, height}, offscreenTarget.jitter());
+          });
+          if (measured)
+          {
+            glEndQuery(GL_TIME_ELAPSED);
+          }
+        }
+        fences[frame] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        const auto cpuMs = std::chrono::duration<double, std::milli>(Clock::now() - frameStartTime).count();
 
-    // Render to image
-    std::vector<unsigned char> pixels(m_nWindowWidth * m_nWindowHeight * 3);
-    renderToImage(m_nWindowWidth, m_nWindowHeight, 3, pixels.data(), [&]() {
-      drawScene(cameraController->getCamera());
-    });
+        const auto waitedFrame = frame - std::min<size_t>(frame, 2);
+        if (fences[waitedFrame])
+        {
+          glClientWaitSync(fences[waitedFrame], GL_SYNC_FLUSH_COMMANDS_BIT, std::numeric_limits<GLuint64>::max());
+          glDeleteSync(fences[waitedFrame]);
+          fences[waitedFrame] = nullptr;
+        }
+        if (frame + 1 == m_benchmark.warmupFrames || (frame == 0 && !m_benchmark.warmupFrames))
+        {
+          peakVideoMemoryBytes = std::max(peakVideoMemoryBytes, getUsedVideoMemoryBytes());
+        }
+
+        const auto frameEndTime = Clock::now();
+        if (measured)
+        {
+          results.cpuMs.push_back(cpuMs);
+          results.frameMs.push_back(std::chrono::duration<double, std::milli>(frameEndTime - frameStartTime).count());
+        }
+        frameStartTime = frameEndTime;
+      }
+      glFinish();
+      for (const auto fence : fences)
+      {
+        if (fence)
+        {
+          glDeleteSync(fence);
+        }
+      }
+      for (const auto query : gpuTimeQueries)
+      {
+        GLuint64 nanoseconds = 0;
+        glGetQueryObjectui64v(query, GL_QUERY_RESULT, &nanoseconds);
+        results.gpuMs.push_back(1e-6 * nanoseconds);
+      }
+      glDeleteQueries(GLsizei(gpuTimeQueries.size()), gpuTimeQueries.data());
+      profiler.newFrame();
+      results.counters = profiler.lastCounters();
+      results.peakResidentBytes = getPeakResidentBytes();
+      results.peakVideoMemoryBytes = std::max(peakVideoMemoryBytes, getUsedVideoMemoryBytes());
+      for (const auto &buffer : model.buffers)
+      {
+        results.uploadedBytes += buffer.data.size();
+      }
+      if (programCache.enabled())
+      {
+        results.shaderCachePath = m_shaderCachePath;
+      }
+      results.loadedProgramCount = programCache.loadedCount();
+      results.compiledProgramCount = programCache.compiledCount();
+      results.uploadedBytes += textureManager ? textureManager->uploadedBytes() : materialBuffer.uploadedBytes();
+
+      // Logs go to the error output when results go to the standard output
+      if (m_benchmark.resultsPath.empty())
+      {
+        std::ostringstream resultsString;
+        writeBenchmarkResults(resultsString, results);
+        std::fputs(resultsString.str().c_str(), stdout);
+        std::fflush(stdout);
+        return 0;
+      }
+      std::ofstream resultsFile(m_benchmark.resultsPath.string());
+      writeBenchmarkResults(resultsFile, results);
+      if (!resultsFile)
+      {
+        std::cerr << "Unable to write " << m_benchmark.resultsPath << std::endl;
+        return 1;
+      }
+      std::cout << COLOR_MAGENTA << "╰[✿•̀o•́✿]╯       " << COLOR_RESET << "Results written to " << m_benchmark.resultsPath << std::endl;
+      return 0;
+    }
 
-    // Flip the image vertically, because OpenGL does not use the same convention for that than png files.
-    flipImageYAxis<unsigned char>(m_nWindowWidth, m_nWindowHeight, 3, pixels.data());
+    std::cout << COLOR_MAGENTA << "(つ•̀ᴥ•́)つ*:･ﾟ✧ " << COLOR_RESET << " Let's make "
+              << (jobs.size() == 1 ? "an image" : std::to_string(jobs.size()) + " images") << " !" << std::endl;
 
-    // Write the png file with stb_image_write library which is included in the third-parties.
-    const auto strPath = m_OutputPath.string();
-    stbi_write_png(strPath.c_str(), m_nWindowWidth, m_nWindowHeight, 3, pixels.data(), 0);
+    // Raw frames of a sequence are streamed in order to a file, a named pipe (opening it waits for a
+    // reader) or the standard output, for a video encoder such as ffmpeg
+    std::FILE *pStream = nullptr;
+    const auto &streamPath = m_renderSequence.stream;
+    if (streamPath == "-")
+    {
+      pStream = stdout;
+    }
+    else if (!streamPath.empty())
+    {
+      pStream = std::fopen(streamPath.string().c_str(), "wb");
+      if (!pStream)
+      {
+        std::cerr << "Unable to open " << streamPath << " for writing" << std::endl;
+        return 1;
+      }
+    }
+    if (pStream)
+    {
+      std::cout << COLOR_CYAN << "(ʘᗩʘ’)" << COLOR_RESET << " Streaming raw frames, for instance to: ffmpeg -f rawvideo -pix_fmt rgb24 -s "
+                << m_nWindowWidth << "x" << m_nWindowHeight << " -r " << SEQUENCE_FRAME_RATE << " -i - output.mp4" << std::endl;
+    }
+    size_t streamFailures = 0;
+    // Streamed frames are 8 bits: float pixels are clamped and quantized
+    std::vector<unsigned char> streamBytes;
+    const auto streamPixels = [&](const void *pixels, size_t componentCount, bool floatPixels) {
+      if (!pStream)
+      {
+        return;
+      }
+      auto *bytes = static_cast<const unsigned char *>(pixels);
+      if (floatPixels)
+      {
+        const auto *components = static_cast<const float *>(pixels);
+        streamBytes.resize(componentCount);
+        std::transform(components, components + componentCount, begin(streamBytes),
+            [](float value) { return (unsigned char)(glm::clamp(value, 0.f, 1.f) * 255.f + 0.5f); });
+        bytes = streamBytes.data();
+      }
+      if (std::fwrite(bytes, 1, componentCount, pStream) != componentCount)
+      {
+        ++streamFailures;
+      }
+    };
+
+    // Images are encoded and written by a pool of threads, the format is chosen by the extension of
+    // their path. When every thread is busy, writeImage() waits so that images do not pile up.
+    ImageWriter imageWriter{m_writerThreads, 0, m_pngCompressionLevel};
+
+    // With render-farm, jobs are claimed from the queue shared with the other workers instead of
+    // taken in order, and the time from claim to readback of each job is recorded there
+    std::vector<double> jobStartTimes(jobs.size(), 0.);
+    size_t renderedCount = 0;
+    const auto claimJob = [&](size_t next) {
+      const auto jobIndex = m_pRenderFarmQueue ? m_pRenderFarmQueue->claim(int32_t(m_renderFarmWorker)) : next;
+      if (jobIndex < jobs.size())
+      {
+        jobStartTimes[jobIndex] = m_GLFWHandle.time();
+      }
+      return jobIndex;
+    };
+    const auto completeJob = [&](const RenderJob &job) {
+      ++renderedCount;
+      if (m_pRenderFarmQueue)
+      {
+        const auto jobIndex = size_t(&job - jobs.data());
+        m_pRenderFarmQueue->complete(jobIndex, m_GLFWHandle.time() - jobStartTimes[jobIndex]);
+      }
+    };
+
+    // Float file formats are rendered in a float target and read back as floats, to keep the values
+    // above 1 and the precision of dark values
+    const auto rendersFloat = [](const RenderJob &job) {
+      return isFloatImageFileFormat(getImageFileFormat(job.output));
+    };
+    const auto writeImage = [&](const RenderJob &job, const void *glPixels) {
+      completeJob(job);
+      const auto isFloat = rendersFloat(job);
+      const auto size = size_t(job.width) * job.height * 3;
+      streamPixels(glPixels, size, isFloat);
+      if (job.output.empty())
+      {
+        return;
+      }
+      Image image;
+      image.width = job.width;
+      image.height = job.height;
+      if (isFloat)
+      {
+        const auto *components = static_cast<const float *>(glPixels);
+        image.floatPixels.assign(components, components + size);
+      }
+      else
+      {
+        const auto *components = static_cast<const unsigned char *>(glPixels);
+        image.pixels.assign(components, components + size);
+      }
+      image.bottomUp = false; // Rendered upside down, see drawScene()
+      imageWriter.write(job.output, std::move(image));
+    };
+
+    // The scene, textures and shaders are loaded once for all jobs.
+    // Pixels are read back through a ring of buffers, so that the GPU renders
+    // the next image while the previous one is transferred and written.
+    // All images are rendered in the same target, only reallocated when the
+    // resolution or format changes. The shaders already encode colors in sRGB, so the
+    // target stores them as is: 8 bits, or half floats for float file formats.
+    // Antialiasing: multisampling, and supersampling by averaging jittered passes.
+    OffscreenTarget offscreenTarget{OffscreenTarget::ColorFormat::RGBA8, GLsizei(m_samples)};
+    offscreenTarget.setPassCount(m_supersamplePasses);
+    PixelReadbackRing readbackRing;
+    std::vector<GLuint> renderTimeQueries; // Of the images that are not tiled
+
+    // Images larger than a tile are rendered tile after tile with sub frustums. A band of rows is
+    // written as soon as its row of tiles is rendered, so that neither the GPU nor the host hold
+    // the whole image.
+    GLint maxViewportDims[2] = {0, 0};
+    GLint maxRenderbufferSize = 0;
+    glGetIntegerv(GL_MAX_VIEWPORT_DIMS, maxViewportDims);
+    glGetIntegerv(GL_MAX_RENDERBUFFER_SIZE, &maxRenderbufferSize);
+    const auto tileSize = std::min({GLsizei(m_tileSize), GLsizei(maxViewportDims[0]), GLsizei(maxViewportDims[1]),
+        GLsizei(maxRenderbufferSize)});
+    size_t tiledFailures = 0;
+    const auto renderTiledImage = [&](const RenderJob &job, const Camera &camera) {
+      const auto width = GLsizei(job.width);
+      const auto height = GLsizei(job.height);
+      const auto isFloat = rendersFloat(job);
+      std::unique_ptr<ImageRowWriter> rowWriter;
+      std::vector<unsigned char> band;
+      std::vector<unsigned char> tilePixels;
+      std::vector<float> floatBand; // Instead of band and tilePixels for float images
+      std::vector<float> floatTilePixels;
+      // Render tile and copy it to its columns of bandPixels, written once its row of tiles is complete
+      const auto renderTile = [&](const ImageTile &tile, auto &bandPixels, auto &pixels) {
+        if (tile.x == 0)
+        {
+          bandPixels.resize(size_t(width) * tile.height * 3);
+        }
+        pixels.resize(size_t(tile.width) * tile.height * 3);
+        renderToImage(offscreenTarget, tile.width, tile.height, 3, pixels.data(), [&]() {
+          drawSceneTile(camera, width, height, tile, offscreenTarget.jitter());
+        });
+        for (GLsizei y = 0; y < tile.height; ++y)
+        {
+          std::copy_n(pixels.data() + size_t(y) * tile.width * 3, size_t(tile.width) * 3,
+              bandPixels.data() + (size_t(y) * width + tile.x) * 3);
+        }
+
+        if (tile.x + tile.width == width)
+        {
+          if (rowWriter)
+          {
+            rowWriter->writeRows(bandPixels.data(), tile.height);
+          }
+          streamPixels(bandPixels.data(), bandPixels.size(), isFloat);
+        }
+      };
+      if (m_textureBudgetBytes && textureManager)
+      {
+        requestSceneFootprints(camera, width, height);
+        textureManager->update(std::numeric_limits<size_t>::max());
+        materialBuffer.update();
+      }
+      try
+      {
+        if (!job.output.empty())
+        {
+          rowWriter = std::make_unique<ImageRowWriter>(job.output, job.width, job.height, 3);
+        }
+        for (const auto &tile : splitImage(width, height, tileSize))
+        {
+          if (isFloat)
+          {
+            renderTile(tile, floatBand, floatTilePixels);
+          }
+          else
+          {
+            renderTile(tile, band, tilePixels);
+          }
+        }
+        if (rowWriter)
+        {
+          rowWriter->finish();
+        }
+      }
+      catch (const std::runtime_error &e)
+      {
+        std::cerr << e.what() << std::endl;
+        ++tiledFailures;
+      }
+    };
+
+    const auto batchStartTime = m_GLFWHandle.time();
+    for (auto jobIndex = claimJob(0); jobIndex < jobs.size(); jobIndex = claimJob(jobIndex + 1))
+    {
+      const auto &job = jobs[jobIndex];
+      profiler.newFrame();
+      const auto camera = job.hasCamera ? job.camera : cameraController->getCamera();
+      if (job.animationTime >= 0.f && animationPlayer.size())
+      {
+        FrameProfiler::CpuScope animationScope{profiler, "Animation"};
+        const auto duration = animationPlayer.duration(0);
+        animationPlayer.apply(0, duration > 0.f ? std::fmod(job.animationTime, duration) : 0.f, sceneHierarchy);
+      }
+      const auto width = GLsizei(job.width);
+      const auto height = GLsizei(job.height);
+      const auto isFloat = rendersFloat(job);
+      offscreenTarget.setFormat(
+          isFloat ? OffscreenTarget::ColorFormat::RGBA16F : OffscreenTarget::ColorFormat::RGBA8, GLsizei(m_samples));
+
+      if (width > tileSize || height > tileSize)
+      {
+        // Streamed frames must stay in order
+        readbackRing.flush();
+        renderTiledImage(job, camera);
+        completeJob(job);
+        reportShadersReady();
+        continue;
+      }
+
+      // With a texture budget, residency depends on what is visible: collect
+      // texture footprints before rendering the image
+      if (m_textureBudgetBytes && textureManager)
+      {
+        requestSceneFootprints(camera, width, height);
+        textureManager->update(std::numeric_limits<size_t>::max());
+        materialBuffer.update();
+      }
+
+      // Render to image, timed on the GPU
+      const auto draw = [&]() {
+        drawSceneTile(camera, width, height, ImageTile{0, 0, width, height}, offscreenTarget.jitter());
+      };
+      FrameProfiler::CpuScope imageScope{profiler, "Image"};
+      GLuint renderTimeQuery = 0;
+      glGenQueries(1, &renderTimeQuery);
+      renderTimeQueries.push_back(renderTimeQuery);
+      glBeginQuery(GL_TIME_ELAPSED, renderTimeQuery);
+      if (m_syncReadback && isFloat)
+      {
+        std::vector<float> glPixels(size_t(width) * height * 3);
+        renderToImage(offscreenTarget, width, height, 3, glPixels.data(), draw);
+        writeImage(job, glPixels.data());
+      }
+      else if (m_syncReadback)
+      {
+        std::vector<unsigned char> glPixels(size_t(width) * height * 3);
+        renderToImage(offscreenTarget, width, height, 3, glPixels.data(), draw);
+        writeImage(job, glPixels.data());
+      }
+      else
+      {
+        renderToImageAsync(offscreenTarget, width, height, 3, isFloat ? GL_FLOAT : GL_UNSIGNED_BYTE, readbackRing, draw,
+            [&](const void *glPixels) { writeImage(job, glPixels); });
+      }
+      glEndQuery(GL_TIME_ELAPSED);
+      reportShadersReady();
+    }
+    readbackRing.flush();
+    const auto writeFailures = imageWriter.finish() + tiledFailures;
+    if (pStream)
+    {
+      if (std::fflush(pStream) != 0)
+      {
+        ++streamFailures;
+      }
+      if (pStream != stdout)
+      {
+        std::fclose(pStream);
+      }
+      if (streamFailures)
+      {
+        std::cerr << "Unable to stream " << streamFailures << " frames to " << streamPath << std::endl;
+      }
+    }
+
+    // Cost of antialiasing: GPU time of the images, including the readback
+    if (!renderTimeQueries.empty())
+    {
+      GLuint64 totalNanoseconds = 0;
+      for (const auto query : renderTimeQueries)
+      {
+        GLuint64 nanoseconds = 0;
+        glGetQueryObjectui64v(query, GL_QUERY_RESULT, &nanoseconds);
+        totalNanoseconds += nanoseconds;
+      }
+      glDeleteQueries(GLsizei(renderTimeQueries.size()), renderTimeQueries.data());
+      std::cout << COLOR_CYAN << "(ʘᗩʘ’)" << COLOR_RESET << " GPU time: " << 1e-6 * totalNanoseconds / renderTimeQueries.size()
+                << " ms per image (" << offscreenTarget.samples() << "x MSAA, " << offscreenTarget.passCount()
+                << (offscreenTarget.passCount() > 1 ? " supersampling passes)" : " pass)") << std::endl;
+    }
+
+    if (renderedCount > 1)
+    {
+      const auto batchSeconds = m_GLFWHandle.time() - batchStartTime;
+      std::cout << COLOR_CYAN << "(ʘᗩʘ’)" << COLOR_RESET << " " << renderedCount << " images in "
+                << 1000. * batchSeconds << " ms (" << renderedCount / batchSeconds << " images/s, "
+                << (m_syncReadback ? "synchronous" : "pipelined") << " readback, "
+                << imageWriter.threadCount() << " writer threads)" << std::endl;
+    }
+    if (writeFailures || streamFailures)
+    {
+      return 1;
+    }
 
     // Finally at the end of the if statement, returns 0. So in that mode, our application just render an image in a file and leave.
-    std::cout << COLOR_MAGENTA << "╰[✿•̀o•́✿]╯       " << COLOR_RESET << "Image was rendered ! Yay !" << std::endl;
+    std::cout << COLOR_MAGENTA << "╰[✿•̀o•́✿]╯       " << COLOR_RESET << (jobs.size() > 1 ? "Images were rendered ! Yay !" : "Image was rendered ! Yay !") << std::endl;
     std::cout << COLOR_MAGENTA << "ʕ༼◕  ౪  ◕✿༽ʔ    " << COLOR_RESET << "Good bye !" << std::endl;
     std::cout << COLOR_BOLD << std::endl
               << "==============================================" << std::endl;
@@ -897,20 +1573,58 @@ int ViewerApplication::run()
 
     std::cout << COLOR_MAGENTA << "(つ•̀ᴥ•́)つ*:･ﾟ✧ " << COLOR_RESET << " Let's run in interactive mode !" << std::endl;
 
+    // The first animation plays from the start, looping
+    size_t currentAnimation = 0;
+    bool playAnimation = true;
+    float animationSpeed = 1.f;
+    double animationTime = 0.;
+    double animationSeconds = 0.; // Time spent sampling the last frame
+
     // Loop until the user closes the window
     for (auto iterationCount = 0u; !m_GLFWHandle.shouldClose(); ++iterationCount)
     {
       const auto seconds = glfwGetTime();
+      profiler.newFrame();
       const auto camera = cameraController->getCamera();
-      drawScene(camera);
+      if (animationPlayer.size())
+      {
+        FrameProfiler::CpuScope animationScope{profiler, "Animation"};
+        const auto duration = animationPlayer.duration(currentAnimation);
+        const auto animationStartTime = m_GLFWHandle.time();
+        animationPlayer.apply(currentAnimation, duration > 0.f ? float(std::fmod(animationTime, duration)) : 0.f,
+                              sceneHierarchy);
+        animationSeconds = m_GLFWHandle.time() - animationStartTime;
+      }
+      {
+        FrameProfiler::CpuScope sceneScope{profiler, "Scene"};
+        if (textureManager)
+        {
+          requestSceneFootprints(camera, m_nWindowWidth, m_nWindowHeight);
+        }
+        drawScene(camera, m_nWindowWidth, m_nWindowHeight);
+      }
+      reportShadersReady();
+      if (textureManager)
+      {
+        FrameProfiler::CpuScope streamingScope{profiler, "Texture streaming"};
+        const auto uploadedBytes = textureManager->uploadedBytes();
+        textureManager->update();
+        materialBuffer.update();
+        frameCounters.uploadedBytes += textureManager->uploadedBytes() - uploadedBytes;
+      }
 
       // GUI code:
       imguiNewFrame();
 
       {
+        FrameProfiler::CpuScope guiScope{profiler, "GUI"};
         ImGui::Begin("GUI");
         ImGui::Text("Application average %.3f ms/frame (%.1f FPS)",
                     1000.0f / ImGui::GetIO().Framerate, ImGui::GetIO().Framerate);
+        if (ImGui::CollapsingHeader("Profiler"))
+        {
+          profiler.drawGUI();
+        }
         if (ImGui::CollapsingHeader("Camera info"))
         {
           ImGui::Text("eye: %.3f %.3f %.3f", camera.eye().x, camera.eye().y,
@@ -1035,14 +1749,71 @@ int ViewerApplication::run()
           }
         }
 
+        if (animationPlayer.size() && ImGui::CollapsingHeader("Animation", ImGuiTreeNodeFlags_DefaultOpen))
+        {
+          if (ImGui::BeginCombo("Animation", animationPlayer.name(currentAnimation).c_str()))
+          {
+            for (size_t i = 0; i < animationPlayer.size(); ++i)
+            {
+              if (ImGui::Selectable(animationPlayer.name(i).c_str(), i == currentAnimation))
+              {
+                currentAnimation = i;
+                animationTime = 0.;
+              }
+            }
+            ImGui::EndCombo();
+          }
+          ImGui::Checkbox("Play", &playAnimation);
+          ImGui::SliderFloat("Speed", &animationSpeed, 0.f, 4.f);
+          const auto duration = animationPlayer.duration(currentAnimation);
+          auto time = duration > 0.f ? float(std::fmod(animationTime, duration)) : 0.f;
+          if (ImGui::SliderFloat("Time", &time, 0.f, duration))
+          {
+            animationTime = time;
+          }
+          ImGui::Text("%zu channels sampled in %.3f ms", animationPlayer.channelCount(currentAnimation),
+                      1000. * animationSeconds);
+        }
+
+        if (ImGui::CollapsingHeader("Shaders"))
+        {
+          ImGui::Text("Texture binding: %s", toString(materialBuffer.mode()));
+          ImGui::Text("Compilation: %s", toString(programCompiler.backend()));
+          ImGui::Text("Variants ready: %zu / %zu", shadingPrograms.readyCount(), shadingPrograms.size());
+          ImGui::Text("Program binary cache: %s", programCache.enabled() ? "enabled" : "disabled");
+          ImGui::Text("%zu loaded, %zu compiled", programCache.loadedCount(), programCache.compiledCount());
+          if (jointMatrixBuffer.jointCount())
+          {
+            ImGui::Text("Skinning: %s, %zu joints", toString(skinningMode), jointMatrixBuffer.jointCount());
+          }
+          if (morphTargetBuffers.primitiveCount())
+          {
+            ImGui::Text("Morphing: %s, %zu targets, %zu active", toString(morphMode),
+                        morphTargetBuffers.targetCount(), morphTargetBuffers.activeTargetCount());
+          }
+        }
+
+        if (textureManager && ImGui::CollapsingHeader("Texture residency"))
+        {
+          textureManager->drawGUI();
+        }
+
         ImGui::End();
       }
 
-      imguiRenderFrame();
+      {
+        FrameProfiler::CpuScope guiScope{profiler, "GUI"};
+        FrameProfiler::GpuScope guiPass{profiler, "GUI"};
+        imguiRenderFrame();
+      }
 
       glfwPollEvents(); // Poll for and process events
 
       auto ellapsedTime = glfwGetTime() - seconds;
+      if (playAnimation)
+      {
+        animationTime += animationSpeed * ellapsedTime;
+      }
       auto guiHasFocus = ImGui::GetIO().WantCaptureMouse || ImGui::GetIO().WantCaptureKeyboard;
       if (!guiHasFocus)
       {
@@ -1065,47 +1836,59 @@ int ViewerApplication::run()
 /*
 Constructor
 */
-ViewerApplication::ViewerApplication(
-    const fs::path &appPath,
-    uint32_t width,
-    uint32_t height,
-    const fs::path &gltfFile,
-    const std::vector<float> &lookatArgs,
-    const std::string &vertexShader,
-    const std::string &fragmentShader,
-    const fs::path &output) : m_nWindowWidth(width),
-                              m_nWindowHeight(height),
-                              m_AppPath{appPath},
-                              m_AppName{m_AppPath.stem().string()},
-                              m_ImGuiIniFilename{m_AppName + ".imgui.ini"},
-                              m_ShadersRootPath{m_AppPath.parent_path() / "shaders"},
-                              m_gltfFilePath{gltfFile},
-                              m_OutputPath{output}
+ViewerApplication::ViewerApplication(const fs::path &appPath, const ViewerOptions &options) :
+    m_nWindowWidth(options.width),
+    m_nWindowHeight(options.height),
+    m_AppPath{appPath},
+    m_AppName{m_AppPath.stem().string()},
+    m_ImGuiIniFilename{m_AppName + ".imgui.ini"},
+    m_ShadersRootPath{m_AppPath.parent_path() / "shaders"},
+    m_gltfFilePath{options.gltfFile},
+    m_OutputPath{options.output},
+    m_textureBudgetBytes{options.textureBudgetMB * 1024 * 1024},
+    m_textureBindingMode{options.textureBindingMode},
+    m_shaderCachePath{options.shaderCachePath},
+    m_syncShaders{options.syncShaders},
+    m_renderJobs{options.renderJobs},
+    m_syncReadback{options.syncReadback},
+    m_writerThreads{options.writerThreads},
+    m_pngCompressionLevel{options.pngCompressionLevel},
+    m_renderSequence{options.renderSequence},
+    m_tileSize{options.tileSize},
+    m_samples{options.samples},
+    m_supersamplePasses{options.supersamplePasses},
+    m_pRenderFarmQueue{options.renderFarmQueue},
+    m_renderFarmWorker{options.renderFarmWorker},
+    m_pPreloadedModel{options.preloadedModel},
+    m_skinningMode{options.skinningMode},
+    m_morphMode{options.morphMode},
+    m_benchmark{options.benchmark}
 {
-  if (!lookatArgs.empty())
+  if (!options.lookatArgs.empty())
   {
     m_hasUserCamera = true;
-    m_userCamera =
-        Camera{glm::vec3(lookatArgs[0], lookatArgs[1], lookatArgs[2]),
-               glm::vec3(lookatArgs[3], lookatArgs[4], lookatArgs[5]),
-               glm::vec3(lookatArgs[6], lookatArgs[7], lookatArgs[8])};
+    m_userCamera = makeLookatCamera(options.lookatArgs.data());
   }
 
-  if (!vertexShader.empty())
+  if (!options.vertexShader.empty())
   {
-    m_vertexShader = vertexShader;
+    m_vertexShader = options.vertexShader;
   }
 
-  if (!fragmentShader.empty())
+  if (!options.fragmentShader.empty())
   {
-    m_fragmentShader = fragmentShader;
+    m_fragmentShader = options.fragmentShader;
   }
 
-  ImGui::GetIO().IniFilename =
-      m_ImGuiIniFilename.c_str(); // At exit, ImGUI will store its windows
-                                  // positions in this file
+  // Headless contexts (offscreen rendering without display) have neither window nor ImGui
+  if (!m_GLFWHandle.headless())
+  {
+    ImGui::GetIO().IniFilename =
+        m_ImGuiIniFilename.c_str(); // At exit, ImGUI will store its windows
+                                    // positions in this file
 
-  glfwSetKeyCallback(m_GLFWHandle.window(), keyCallback);
+    glfwSetKeyCallback(m_GLFWHandle.window(), keyCallback);
+  }
 
   printGLVersion();
 }
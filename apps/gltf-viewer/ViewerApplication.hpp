@@ -1,21 +1,67 @@
 #pragma once
 
 #include "utils/GLFWHandle.hpp"
+#include "utils/benchmark.hpp"
 #include "utils/cameras.hpp"
 #include "utils/filesystem.hpp"
+#include "utils/materials.hpp"
+#include "utils/morph_targets.hpp"
+#include "utils/program_compiler.hpp"
+#include "utils/render_farm.hpp"
+#include "utils/render_jobs.hpp"
+#include "utils/scene_hierarchy.hpp"
 #include "utils/shaders.hpp"
+#include "utils/skinning.hpp"
+#include "utils/sparse_accessors.hpp"
 #include <tiny_gltf.h>
 
+// Options of the viewer, set from the command line
+struct ViewerOptions
+{
+  uint32_t width = 1280;
+  uint32_t height = 720;
+  fs::path gltfFile;
+  std::vector<float> lookatArgs; // Empty for the default camera
+  std::string vertexShader; // Empty for the default shaders
+  std::string fragmentShader;
+  fs::path output; // Renders a single image without window if not empty
+
+  size_t textureBudgetMB = 0; // 0 for no limit
+  TextureBindingMode textureBindingMode = TextureBindingMode::Auto;
+  fs::path shaderCachePath; // Empty to always compile shaders
+  bool syncShaders = false;
+
+  std::vector<RenderJob> renderJobs; // Images of render-batch and render-farm
+  bool syncReadback = false;
+  size_t writerThreads = 0; // 0 for one per hardware thread
+  int pngCompressionLevel = 8;
+  RenderSequence renderSequence; // Frames of render-sequence and bench
+  uint32_t tileSize = 4096;
+  uint32_t samples = 1;
+  uint32_t supersamplePasses = 1;
+
+  // With render-farm, the queue shared by the workers, and the index of this
+  // one
+  RenderFarmQueue *renderFarmQueue = nullptr;
+  size_t renderFarmWorker = 0;
+  // Scene already loaded, or generated, instead of gltfFile
+  tinygltf::Model *preloadedModel = nullptr;
+
+  SkinningMode skinningMode = SkinningMode::Auto;
+  MorphMode morphMode = MorphMode::Auto;
+  BenchmarkSettings benchmark;
+};
+
 class ViewerApplication
 {
 public:
-  ViewerApplication(const fs::path &appPath, uint32_t width, uint32_t height,
-                    const fs::path &gltfFile, const std::vector<float> &lookatArgs,
-                    const std::string &vertexShader, const std::string &fragmentShader,
-                    const fs::path &output);
+  ViewerApplication(const fs::path &appPath, const ViewerOptions &options);
 
   int run();
 
+  // Load a .gltf file, printing errors and warnings
+  static bool loadGltfFile(const fs::path &path, tinygltf::Model &model);
+
 private:
   /**
    * Struct
@@ -28,16 +74,32 @@ private:
     GLsizei count; // Number of elements in range
   };
 
+  // A variant of the shading program and the locations of its uniforms,
+  // which are only known once the program compiler has built it
+  struct ShadingProgram
+  {
+    ProgramCompiler::Ticket ticket;
+    GLProgram program;
+    GLint uniformModelViewProjMatrix;
+    GLint uniformModelViewMatrix;
+    GLint uniformNormalMatrix;
+    GLint uniformModelMatrix;
+    GLint uniformLightDirection;
+    GLint uniformLightRadiance;
+    GLint uniformMaterialIndex;
+    GLint uniformJointOffset;
+    GLint uniformMorphParameters;
+  };
+
   /**
    * Methods
    */
 
-  bool loadGltfFile(tinygltf::Model &model);
   std::vector<GLuint> createBufferObjects(const tinygltf::Model &model);
   std::vector<GLuint> createVertexArrayObjects(const tinygltf::Model &model,
                                                const std::vector<GLuint> &bufferObjects,
+                                               SparseAccessorBuffers &sparseAccessorBuffers,
                                                std::vector<VaoRange> &meshIndexToVaoRange);
-  std::vector<GLuint> createTextureObjects(const tinygltf::Model &model) const;
 
   /**
    * Attributes
@@ -60,12 +122,50 @@ private:
 
   fs::path m_OutputPath;
 
+  // GPU memory allowed for textures, 0 for no limit
+  size_t m_textureBudgetBytes = 0;
+  TextureBindingMode m_textureBindingMode = TextureBindingMode::Auto;
+
+  // Directory of the program binary cache, empty to always compile shaders
+  fs::path m_shaderCachePath;
+  // Compile shaders on the rendering thread, one after the other
+  bool m_syncShaders = false;
+
+  // Images of the render-batch command, rendered without window
+  std::vector<RenderJob> m_renderJobs;
+  // Read rendered images back synchronously instead of through a buffer ring
+  bool m_syncReadback = false;
+  // Threads of the ImageWriter encoding output images (0 = hardware threads)
+  size_t m_writerThreads = 0;
+  int m_pngCompressionLevel = 8;
+  // Frames of the render-sequence command, rendered without window
+  RenderSequence m_renderSequence;
+  // Offscreen images larger than this are rendered and written by tiles
+  uint32_t m_tileSize = 4096;
+  // Antialiasing of offscreen images: MSAA samples, and jittered passes
+  // averaged together
+  uint32_t m_samples = 1;
+  uint32_t m_supersamplePasses = 1;
+  // With render-farm, this process is one of the workers taking their jobs
+  // from the shared queue, and the scene was loaded before forking them
+  RenderFarmQueue *m_pRenderFarmQueue = nullptr;
+  size_t m_renderFarmWorker = 0;
+  tinygltf::Model *m_pPreloadedModel = nullptr;
+  // Skinning in the vertex shader, or ahead of the draws with a compute shader
+  SkinningMode m_skinningMode = SkinningMode::Auto;
+  // Morph targets blended in the vertex shader, or ahead of the draws with a
+  // compute shader
+  MorphMode m_morphMode = MorphMode::Auto;
+  // With the bench command, the frames of m_renderSequence are measured
+  // instead of written
+  BenchmarkSettings m_benchmark;
+
   // Order is important here, see comment below
   const std::string m_ImGuiIniFilename;
   // Last to be initialized, first to be destroyed:
   GLFWHandle m_GLFWHandle{int(m_nWindowWidth), int(m_nWindowHeight),
                           "glTF Viewer",
-                          m_OutputPath.empty()}; // show the window only if m_OutputPath is empty
+                          m_OutputPath.empty() && m_renderJobs.empty() && !m_renderSequence.frameCount}; // show the window only if there is nothing to render offscreen
   /*
     ! THE ORDER OF DECLARATION OF MEMBER VARIABLES IS IMPORTANT !
     - m_ImGuiIniFilename.c_str() will be used by ImGUI in ImGui::Shutdown, which
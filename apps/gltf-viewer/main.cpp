@@ -1,12 +1,29 @@
 #include "ViewerApplication.hpp"
 #include "utils/GLFWHandle.hpp"
 #include "utils/filesystem.hpp"
+#include "utils/procedural_scene.hpp"
+#include "utils/trace.hpp"
 
 #include <args.hxx>
 
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <thread>
+
 std::vector<std::string> split(
     const std::string &str, const std::string &delim);
 
+// Commands running the viewer application
+enum class ViewerCommand
+{
+  Interactive,
+  RenderBatch,
+  RenderSequence,
+  RenderFarm,
+  Bench
+};
+
 int main(int argc, char **argv)
 {
   auto returnCode = 0;
@@ -21,51 +38,401 @@ int main(int argc, char **argv)
         GLFWHandle handle{1, 1, "", false};
         printGLVersion();
       }};
-  args::Command interactive{
-      commands, "viewer", "Run glTF viewer", [&](args::Subparser &parser) {
-        args::Positional<std::string> file{
-            parser, "file", "Path to file", args::Options::Required};
-        args::ValueFlag<std::string> lookat{parser, "lookat",
-            "Look at parameters for the Camera with format "
-            "eye_x,eye_y,eye_z,center_x,center_y,center_z,up_x,up_y,up_z",
-            {"lookat"}};
-        args::ValueFlag<std::string> vertexShader{
-            parser, "vs", "Vertex shader to use", {"vs"}};
-        args::ValueFlag<std::string> fragmentShader{
-            parser, "fs", "Fragment shader to use", {"fs"}};
-        args::ValueFlag<int32_t> imageWidth{parser, "width",
-            "Width of window or output image if -b is specified",
-            {"w", "width"}};
-        args::ValueFlag<int32_t> imageHeight{parser, "height",
-            "Height of window or output image if -b is specified",
-            {"h", "height"}};
-        args::ValueFlag<std::string> output{parser, "output",
-            "Output path to render the image. If specified no window is shown. "
-            "Only png is supported.",
-            {"o", "output"}};
-        parser.Parse();
+  // The viewer, render-batch, render-sequence, render-farm and bench commands
+  // share their options, render-batch and render-farm take a job file,
+  // render-sequence and bench their frames in addition
+  const auto runViewer = [&](args::Subparser &parser, ViewerCommand command) {
+    const auto farm = command == ViewerCommand::RenderFarm;
+    const auto batch = command == ViewerCommand::RenderBatch || farm;
+    const auto bench = command == ViewerCommand::Bench;
+    const auto sequence = command == ViewerCommand::RenderSequence || bench;
+    // Without file, bench generates one of its standard scenes
+    args::Positional<std::string> file{parser, "file", "Path to file",
+        bench ? args::Options::None : args::Options::Required};
+    std::unique_ptr<args::Positional<std::string>> jobsFile;
+    std::unique_ptr<args::ValueFlag<uint32_t>> frameCount;
+    std::unique_ptr<args::ValueFlag<std::string>> cameraPath;
+    std::unique_ptr<args::ValueFlag<std::string>> stream;
+    std::unique_ptr<args::ValueFlag<uint32_t>> workers;
+    std::unique_ptr<args::ValueFlag<uint32_t>> warmupFrames;
+    std::unique_ptr<args::ValueFlag<std::string>> scene;
+    std::unique_ptr<args::ValueFlag<std::string>> results;
+    if (sequence) {
+      frameCount = std::make_unique<args::ValueFlag<uint32_t>>(parser,
+          "frames",
+          std::string{"Number of frames, for a full turn of the turntable or "
+                      "from the first to the last keyframe of the camera "
+                      "path (default: "} +
+              (bench ? "300" : "120") + ").",
+          args::Matcher{"frames"}, bench ? 300 : 120);
+      cameraPath = std::make_unique<args::ValueFlag<std::string>>(parser,
+          "camera-path",
+          "Path to a .json or .csv file of camera keyframes (time, lookat). "
+          "Without it, the camera turns around the scene.",
+          args::Matcher{"camera-path"});
+    }
+    if (bench) {
+      warmupFrames = std::make_unique<args::ValueFlag<uint32_t>>(parser,
+          "warmup",
+          "Number of frames rendered before the measured ones (default: 30).",
+          args::Matcher{"warmup"}, 30);
+      std::string sceneNames;
+      for (const auto &name : standardSceneNames()) {
+        sceneNames += (sceneNames.empty() ? "" : ", ") + name;
+      }
+      scene = std::make_unique<args::ValueFlag<std::string>>(parser, "scene",
+          "Procedural scene rendered without file: " + sceneNames +
+              " (default: " + standardSceneNames().front() + ").",
+          args::Matcher{"scene"}, standardSceneNames().front());
+      results = std::make_unique<args::ValueFlag<std::string>>(parser,
+          "results",
+          "Path of the .json results (default: the standard output, logs "
+          "going to the error output).",
+          args::Matcher{"results"});
+    } else if (sequence) {
+      stream = std::make_unique<args::ValueFlag<std::string>>(parser,
+          "stream",
+          "File or named pipe receiving raw RGB frames, - for the standard "
+          "output.",
+          args::Matcher{"stream"});
+    }
+    if (farm) {
+      workers = std::make_unique<args::ValueFlag<uint32_t>>(parser, "workers",
+          "Number of worker processes, each with its own OpenGL context "
+          "(default: one per hardware thread).",
+          args::Matcher{"workers"}, 0);
+    }
+    if (batch) {
+      jobsFile = std::make_unique<args::Positional<std::string>>(parser,
+          "jobs",
+          "Path to a .json or .csv file listing the images to render "
+          "(output path, resolution, camera)",
+          args::Options::Required);
+    }
+    args::ValueFlag<std::string> lookat{parser, "lookat",
+        "Look at parameters for the Camera with format "
+        "eye_x,eye_y,eye_z,center_x,center_y,center_z,up_x,up_y,up_z",
+        {"lookat"}};
+    args::ValueFlag<std::string> vertexShader{
+        parser, "vs", "Vertex shader to use", {"vs"}};
+    args::ValueFlag<std::string> fragmentShader{
+        parser, "fs", "Fragment shader to use", {"fs"}};
+    args::ValueFlag<int32_t> imageWidth{parser, "width",
+        "Width of window or output image if -b is specified",
+        {"w", "width"}};
+    args::ValueFlag<int32_t> imageHeight{parser, "height",
+        "Height of window or output image if -b is specified",
+        {"h", "height"}};
+    args::ValueFlag<std::string> output{parser, "output",
+        "Output path to render the image. If specified no window is shown. "
+        "The format is chosen by extension: png (default), qoi, ppm, pfm or "
+        "exr. pfm and exr images are rendered in half floats, without "
+        "clamping. With render-sequence, runs of # are replaced by the frame "
+        "number.",
+        {"o", "output"}};
+    args::ValueFlag<uint32_t> textureBudget{parser, "texture-budget-mb",
+        "GPU memory allowed for textures, in MB. Mip levels are evicted "
+        "and streamed back according to what is visible. 0 (default) "
+        "means no limit.",
+        {"texture-budget-mb"}};
+    args::ValueFlag<std::string> textureBinding{parser, "texture-binding",
+        "How shaders access material textures: auto (default), bindless "
+        "(GL_ARB_bindless_texture), arrays (GL_TEXTURE_2D_ARRAY) or "
+        "classic (texture units bound per draw).",
+        {"texture-binding"}};
+    args::ValueFlag<std::string> shaderCache{parser, "shader-cache",
+        "Directory of the program binary cache (default: shader-cache "
+        "next to the executable).",
+        {"shader-cache"}};
+    args::Flag noShaderCache{parser, "no-shader-cache",
+        "Always compile shaders, without reading or writing the program "
+        "binary cache.",
+        {"no-shader-cache"}};
+    args::Flag syncShaders{parser, "sync-shaders",
+        "Compile shaders one after the other on the rendering thread "
+        "instead of in parallel.",
+        {"sync-shaders"}};
+    args::Flag syncReadback{parser, "sync-readback",
+        "Read rendered images back synchronously, waiting for the GPU after "
+        "each image, instead of pipelining readbacks.",
+        {"sync-readback"}};
+    args::ValueFlag<uint32_t> writerThreads{parser, "writer-threads",
+        "Number of threads encoding output images (default: one per "
+        "hardware thread, one per worker with render-farm).",
+        {"writer-threads"}, 0};
+    args::ValueFlag<int> pngCompression{parser, "png-compression",
+        "zlib level of png outputs, from 0 (fastest, biggest) to 9 "
+        "(default: 8).",
+        {"png-compression"}, 8};
+    args::ValueFlag<uint32_t> tileSize{parser, "tile-size",
+        "Offscreen images wider or taller than this are rendered by tiles and "
+        "written by bands of rows, bounding memory use (default: 4096, "
+        "lowered to the limits of the GPU). Tiled png files are not "
+        "compressed, prefer qoi or exr.",
+        {"tile-size"}, 4096};
+    args::ValueFlag<uint32_t> samples{parser, "samples",
+        "Number of MSAA samples of offscreen images, clamped to the limit of "
+        "the GPU (default: 1).",
+        {"samples"}, 1};
+    args::ValueFlag<uint32_t> supersample{parser, "supersample",
+        "Render offscreen images this many times with a jittered projection "
+        "and average them (default: 1). Combines with --samples.",
+        {"supersample"}, 1};
+    args::ValueFlag<std::string> skinning{parser, "skinning",
+        "How skinned meshes are drawn: auto (default), vertex (skinned by "
+        "the vertex shader of each draw) or compute (skinned once per pose "
+        "by a compute shader, chosen by auto for offscreen images).",
+        {"skinning"}};
+    args::ValueFlag<std::string> morphing{parser, "morphing",
+        "How morph targets are blended: auto (default), vertex (by the "
+        "vertex shader of each draw) or compute (once per change of weights "
+        "by a compute shader, chosen by auto for offscreen images).",
+        {"morphing"}};
+    args::ValueFlag<std::string> trace{parser, "trace",
+        "Record the load phases, the passes of each frame and their GPU "
+        "times to a Chrome Trace Event .json file (chrome://tracing, "
+        "ui.perfetto.dev). With render-farm, each worker writes its own "
+        "file, suffixed by its index.",
+        {"trace"}};
+    parser.Parse();
+
+    ViewerOptions options;
+    options.gltfFile = args::get(file);
+    options.vertexShader = args::get(vertexShader);
+    options.fragmentShader = args::get(fragmentShader);
+    options.textureBudgetMB = args::get(textureBudget);
+    options.syncShaders = syncShaders;
+    options.syncReadback = syncReadback;
+    options.pngCompressionLevel = args::get(pngCompression);
+    options.tileSize = args::get(tileSize);
+    options.samples = args::get(samples);
+    options.supersamplePasses = args::get(supersample);
+
+    if (textureBinding) {
+      try {
+        options.textureBindingMode =
+            parseTextureBindingMode(args::get(textureBinding));
+      } catch (const std::runtime_error &e) {
+        throw args::ValidationError(e.what());
+      }
+    }
+
+    if (skinning) {
+      try {
+        options.skinningMode = parseSkinningMode(args::get(skinning));
+      } catch (const std::runtime_error &e) {
+        throw args::ValidationError(e.what());
+      }
+    }
+
+    if (morphing) {
+      try {
+        options.morphMode = parseMorphMode(args::get(morphing));
+      } catch (const std::runtime_error &e) {
+        throw args::ValidationError(e.what());
+      }
+    }
+
+    if (lookat) {
+      const std::string &lookatArgs = args::get(lookat);
+      const auto tokens = split(lookatArgs, ",");
+      if (tokens.size() != 9) {
+        throw args::ValidationError("Unable to parse --lookat argument "
+                                    "(expected 9 numbers, got " +
+                                    std::to_string(tokens.size()) + ")");
+      }
+      for (const auto &arg : tokens) {
+        options.lookatArgs.emplace_back(std::stof(arg));
+      }
+    }
+
+    if (imageWidth) {
+      options.width = args::get(imageWidth);
+    }
+    if (imageHeight) {
+      options.height = args::get(imageHeight);
+    }
+
+    auto &renderJobs = options.renderJobs;
+    if (batch) {
+      try {
+        renderJobs =
+            loadRenderJobs(args::get(*jobsFile), options.width, options.height);
+      } catch (const std::runtime_error &e) {
+        throw args::ValidationError(e.what());
+      }
+      if (renderJobs.empty()) {
+        throw args::ValidationError("No job in " + args::get(*jobsFile));
+      }
+    }
+
+    auto &renderSequence = options.renderSequence;
+    auto &outputPath = options.output;
+    outputPath = args::get(output);
+    if (options.tileSize == 0) {
+      throw args::ValidationError("--tile-size must be at least 1");
+    }
+    if (sequence) {
+      renderSequence.frameCount = args::get(*frameCount);
+      renderSequence.outputPattern = outputPath;
+      if (stream) {
+        renderSequence.stream = args::get(*stream);
+      }
+      outputPath.clear();
+      if (renderSequence.frameCount == 0) {
+        throw args::ValidationError("--frames must be at least 1");
+      }
+      if (!bench && renderSequence.outputPattern.empty() &&
+          renderSequence.stream.empty()) {
+        throw args::ValidationError(
+            "render-sequence needs --output or --stream");
+      }
+      if (*cameraPath) {
+        try {
+          renderSequence.cameraPath = loadCameraPath(args::get(*cameraPath));
+        } catch (const std::runtime_error &e) {
+          throw args::ValidationError(e.what());
+        }
+      }
+      // Frames go to the standard output, logs must not
+      if (renderSequence.stream == "-") {
+        std::cout.rdbuf(std::cerr.rdbuf());
+      }
+    }
 
-        std::vector<float> lookatParams;
-        if (lookat) {
-          const std::string &lookatArgs = args::get(lookat);
-          const auto tokens = split(lookatArgs, ",");
-          if (tokens.size() != 9) {
-            throw args::ValidationError("Unable to parse --lookat argument "
-                                        "(expected 9 numbers, got " +
-                                        std::to_string(tokens.size()) + ")");
-          }
-          for (const auto &arg : tokens) {
-            lookatParams.emplace_back(std::stof(arg));
-          }
+    // The frames of bench are measured instead of written, in the scene of
+    // the file or in a generated one
+    auto &benchmark = options.benchmark;
+    tinygltf::Model proceduralModel;
+    if (bench) {
+      renderSequence.outputPattern.clear();
+      benchmark.warmupFrames = args::get(*warmupFrames);
+      benchmark.frameCount = renderSequence.frameCount;
+      benchmark.resultsPath = args::get(*results);
+      benchmark.sceneName = file ? args::get(file) : args::get(*scene);
+      // Load phases are measured from the trace
+      startTrace();
+      if (!file) {
+        try {
+          proceduralModel =
+              generateProceduralScene(getStandardScene(args::get(*scene)));
+        } catch (const std::runtime_error &e) {
+          throw args::ValidationError(e.what());
         }
+      }
+      if (benchmark.resultsPath.empty()) {
+        std::cout.rdbuf(std::cerr.rdbuf());
+      }
+    }
 
-        uint32_t width = imageWidth ? args::get(imageWidth) : 1280;
-        uint32_t height = imageHeight ? args::get(imageHeight) : 720;
+    const auto appPath = fs::path{argv[0]};
+    if (!noShaderCache) {
+      options.shaderCachePath = shaderCache
+                            ? fs::path{args::get(shaderCache)}
+                            : appPath.parent_path() / "shader-cache";
+    }
 
-        ViewerApplication app{fs::path{argv[0]}, width, height, args::get(file),
-            lookatParams, args::get(vertexShader), args::get(fragmentShader),
-            args::get(output)};
-        returnCode = app.run();
+    const fs::path tracePath = args::get(trace);
+    if (!tracePath.empty() && !traceEnabled()) {
+      startTrace();
+    }
+
+    const auto runApplication = [&](RenderFarmQueue *renderFarmQueue,
+                                    size_t renderFarmWorker,
+                                    tinygltf::Model *preloadedModel,
+                                    size_t writerThreadCount) {
+      options.renderFarmQueue = renderFarmQueue;
+      options.renderFarmWorker = renderFarmWorker;
+      options.preloadedModel = preloadedModel;
+      options.writerThreads = writerThreadCount;
+      ViewerApplication app{appPath, options};
+      return app.run();
+    };
+
+    if (!farm) {
+      returnCode = runApplication(nullptr, 0,
+          bench && !file ? &proceduralModel : nullptr,
+          args::get(writerThreads));
+      if (!tracePath.empty() && !writeTrace(tracePath)) {
+        returnCode = 1;
+      }
+      return;
+    }
+
+    // The scene is loaded before forking the workers, so that they share its
+    // memory instead of each loading a copy. No OpenGL context must exist
+    // yet: each worker creates its own.
+    tinygltf::Model model;
+    if (!ViewerApplication::loadGltfFile(args::get(file), model)) {
+      returnCode = 1;
+      return;
+    }
+    auto workerCount = size_t(args::get(*workers));
+    if (workerCount == 0) {
+      workerCount = std::max(std::thread::hardware_concurrency(), 1u);
+    }
+    workerCount = std::min(workerCount, renderJobs.size());
+    const auto writerThreadCount =
+        args::get(writerThreads) ? args::get(writerThreads) : 1;
+
+    RenderFarmQueue queue{renderJobs.size()};
+    std::cout << "Rendering " << renderJobs.size() << " images with "
+              << workerCount << " workers" << std::endl;
+    const auto startTime = std::chrono::steady_clock::now();
+    const auto failedWorkerCount = runRenderFarm(workerCount, [&](size_t worker) {
+      // The logs of the workers would be interleaved, only errors are kept
+      std::cout.rdbuf(nullptr);
+      if (tracePath.empty()) {
+        return runApplication(&queue, worker, &model, writerThreadCount);
+      }
+      setTraceProcess(int(worker) + 1, "Render farm worker");
+      auto workerReturnCode =
+          runApplication(&queue, worker, &model, writerThreadCount);
+      auto workerTracePath = tracePath;
+      workerTracePath.replace_filename(tracePath.stem().string() + "-" +
+                                       std::to_string(worker) +
+                                       tracePath.extension().string());
+      if (!writeTrace(workerTracePath)) {
+        workerReturnCode = 1;
+      }
+      return workerReturnCode;
+    });
+    const auto wallSeconds = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - startTime)
+                                 .count();
+    const auto failedJobCount =
+        printRenderFarmStats(std::cout, queue, workerCount, wallSeconds);
+    returnCode = failedWorkerCount || failedJobCount ? 1 : 0;
+    if (!tracePath.empty() && !writeTrace(tracePath)) {
+      returnCode = 1;
+    }
+  };
+  args::Command interactive{commands, "viewer", "Run glTF viewer",
+      [&](args::Subparser &parser) {
+        runViewer(parser, ViewerCommand::Interactive);
+      }};
+  args::Command renderBatch{commands, "render-batch",
+      "Render the images listed in a job file, loading the glTF file once",
+      [&](args::Subparser &parser) {
+        runViewer(parser, ViewerCommand::RenderBatch);
+      }};
+  args::Command renderFarm{commands, "render-farm",
+      "Render the images listed in a job file with several processes, for "
+      "many-core machines without GPU",
+      [&](args::Subparser &parser) {
+        runViewer(parser, ViewerCommand::RenderFarm);
+      }};
+  args::Command benchCommand{commands, "bench",
+      "Measure the frame times of a scene along a camera path, rendered "
+      "offscreen after warmup frames, and write them as JSON",
+      [&](args::Subparser &parser) {
+        runViewer(parser, ViewerCommand::Bench);
+      }};
+  args::Command renderSequenceCommand{commands, "render-sequence",
+      "Render the frames of a turntable or of a camera path, to images or "
+      "streamed to another program",
+      [&](args::Subparser &parser) {
+        runViewer(parser, ViewerCommand::RenderSequence);
       }};
 
   try {
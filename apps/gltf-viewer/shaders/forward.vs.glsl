@@ -4,6 +4,10 @@ layout(location = 0) in vec3 aPosition;
 layout(location = 1) in vec3 aNormal;
 layout(location = 2) in vec2 aTexCoords;
 layout(location = 3) in vec3 aTangent;
+#ifdef HAS_SKIN
+layout(location = 4) in uvec4 aJoints;
+layout(location = 5) in vec4 aWeights;
+#endif
 
 out vec3 vViewSpacePosition;
 out vec3 vViewSpaceNormal;
@@ -16,11 +20,66 @@ uniform mat4 uModelViewMatrix;
 uniform mat4 uModelMatrix;
 uniform mat4 uNormalMatrix;
 
+#ifdef HAS_SKIN
+// Joint matrices of all skins, 4 texels per matrix. They bring vertices to
+// world space: skinned meshes are drawn with an identity model matrix.
+uniform samplerBuffer uJointMatrices;
+uniform int uJointOffset;
+
+mat4 getJointMatrix(uint joint) {
+  int texel = 4 * (uJointOffset + int(joint));
+  return mat4(texelFetch(uJointMatrices, texel),
+              texelFetch(uJointMatrices, texel + 1),
+              texelFetch(uJointMatrices, texel + 2),
+              texelFetch(uJointMatrices, texel + 3));
+}
+#endif
+
+#ifdef HAS_MORPH
+// Displacements of the targets of the primitive (position, normal and tangent
+// texels of each vertex of each target), and (target index, weight) of the
+// active targets of all instances
+uniform samplerBuffer uMorphTargets;
+uniform samplerBuffer uMorphWeights;
+// First active target of the instance, active target count, vertex count,
+// texels per vertex
+uniform ivec4 uMorphParameters;
+#endif
+
 void main() {
-  vViewSpacePosition = vec3(uModelViewMatrix * vec4(aPosition, 1));
-  vViewSpaceNormal = normalize(vec3(uNormalMatrix * vec4(aNormal, 0)));
+  vec4 position = vec4(aPosition, 1);
+  vec3 normal = aNormal;
+  vec3 tangent = aTangent;
+#ifdef HAS_MORPH
+  // Targets are blended before skinning
+  for (int i = 0; i < uMorphParameters.y; ++i) {
+    vec2 weight = texelFetch(uMorphWeights, uMorphParameters.x + i).xy;
+    int texel = (int(weight.x) * uMorphParameters.z + gl_VertexID) *
+                uMorphParameters.w;
+    position.xyz += weight.y * texelFetch(uMorphTargets, texel).xyz;
+    if (uMorphParameters.w > 1) {
+      normal += weight.y * texelFetch(uMorphTargets, texel + 1).xyz;
+    }
+    if (uMorphParameters.w > 2) {
+      tangent += weight.y * texelFetch(uMorphTargets, texel + 2).xyz;
+    }
+  }
+#endif
+#ifdef HAS_SKIN
+  mat4 skinMatrix = aWeights.x * getJointMatrix(aJoints.x) +
+                    aWeights.y * getJointMatrix(aJoints.y) +
+                    aWeights.z * getJointMatrix(aJoints.z) +
+                    aWeights.w * getJointMatrix(aJoints.w);
+  position = skinMatrix * position;
+  // Normals by the inverse transpose, for joints with a non-uniform scale
+  normal = transpose(inverse(mat3(skinMatrix))) * normal;
+  tangent = mat3(skinMatrix) * tangent;
+#endif
+
+  vViewSpacePosition = vec3(uModelViewMatrix * position);
+  vViewSpaceNormal = normalize(vec3(uNormalMatrix * vec4(normal, 0)));
   vTexCoords = aTexCoords;
-  vTangent = aTangent;
-  vNormal = aNormal;
-  gl_Position =  uModelViewProjMatrix * vec4(aPosition, 1);
-}
\ No newline at end of file
+  vTangent = tangent;
+  vNormal = normal;
+  gl_Position =  uModelViewProjMatrix * position;
+}
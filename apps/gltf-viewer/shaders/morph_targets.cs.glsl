@@ -0,0 +1,51 @@
+#version 430
+
+// Pre-blending of the morph targets of a primitive (see PreBlendedPrimitives)
+
+layout(local_size_x = 64) in;
+
+struct MorphVertex {
+  vec4 position;
+  vec4 normal;
+  vec4 tangent;
+};
+
+layout(std430, binding = 1) readonly buffer BaseVertices {
+  MorphVertex baseVertices[];
+};
+
+layout(std430, binding = 2) writeonly buffer BlendedVertices {
+  MorphVertex blendedVertices[];
+};
+
+// Displacements of the targets of the primitive (position, normal and tangent
+// texels of each vertex of each target)
+uniform samplerBuffer uMorphTargets;
+// (target index, weight) of the active targets of all instances
+uniform samplerBuffer uMorphWeights;
+// First active target of the instance, active target count, vertex count,
+// texels per vertex
+uniform ivec4 uMorphParameters;
+
+void main() {
+  int index = int(gl_GlobalInvocationID.x);
+  if (index >= uMorphParameters.z) {
+    return;
+  }
+  MorphVertex vertex = baseVertices[index];
+  for (int i = 0; i < uMorphParameters.y; ++i) {
+    vec2 weight = texelFetch(uMorphWeights, uMorphParameters.x + i).xy;
+    int texel = (int(weight.x) * uMorphParameters.z + index) *
+                uMorphParameters.w;
+    vertex.position.xyz += weight.y * texelFetch(uMorphTargets, texel).xyz;
+    if (uMorphParameters.w > 1) {
+      vertex.normal.xyz +=
+          weight.y * texelFetch(uMorphTargets, texel + 1).xyz;
+    }
+    if (uMorphParameters.w > 2) {
+      vertex.tangent.xyz +=
+          weight.y * texelFetch(uMorphTargets, texel + 2).xyz;
+    }
+  }
+  blendedVertices[index] = vertex;
+}
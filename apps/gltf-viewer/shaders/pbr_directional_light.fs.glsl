@@ -1,4 +1,8 @@
-#version 330
+#version 430
+
+#ifdef USE_BINDLESS_TEXTURES
+#extension GL_ARB_bindless_texture : require
+#endif
 
 in vec3 vViewSpacePosition;
 in vec3 vViewSpaceNormal;
@@ -9,22 +13,51 @@ in vec3 vNormal;
 uniform vec3 uLightDirection;
 uniform vec3 uLightRadiance;
 
-uniform sampler2D uBaseColorTexture;
-uniform vec4 uBaseColorFactor;
+// Material parameters, see GPUMaterial in utils/materials.hpp
+const uint BASE_COLOR_TEXTURE = 0u;
+const uint METALLIC_ROUGHNESS_TEXTURE = 1u;
+const uint EMISSIVE_TEXTURE = 2u;
+const uint OCCLUSION_TEXTURE = 3u;
+const uint NORMAL_TEXTURE = 4u;
 
-uniform float uMetallicFactor;
-uniform float uRougnessFactor;
-uniform sampler2D uMetallicRoughnessTexture;
+struct Material
+{
+  vec4 baseColorFactor;
+  vec3 emissiveFactor;
+  float metallicFactor;
+  float roughnessFactor;
+  float occlusionStrength;
+  float normalScale;
+  uint textureFlags;
+  uvec2 textures[5]; // bindless handle, or (array index, layer)
+};
+
+layout(std430, binding = 0) readonly buffer Materials
+{
+  Material uMaterials[];
+};
 
-uniform sampler2D uEmissiveTexture;
-uniform vec3 uEmissiveFactor;
+uniform int uMaterialIndex;
 
-uniform sampler2D uOcclusionTexture;
-uniform float uOcclusionStrength;
+#if defined(USE_TEXTURE_ARRAYS)
+uniform sampler2DArray uTextureArrays[16];
+#elif !defined(USE_BINDLESS_TEXTURES)
+uniform sampler2D uMaterialTextures[5];
+#endif
 
-uniform sampler2D uNormalMapTexture;
-uniform float uNormalMapScale;
-uniform bool uNormalMapUse;
+// Textures are only sampled if the variant of the shader has been compiled
+// with their HAS_* define, see materialShaderDefines()
+vec4 sampleTexture(uint slot, vec2 texCoords)
+{
+#if defined(USE_BINDLESS_TEXTURES)
+  return texture(sampler2D(uMaterials[uMaterialIndex].textures[slot]), texCoords);
+#elif defined(USE_TEXTURE_ARRAYS)
+  uvec2 location = uMaterials[uMaterialIndex].textures[slot];
+  return texture(uTextureArrays[location.x], vec3(texCoords, float(location.y)));
+#else
+  return texture(uMaterialTextures[slot], texCoords);
+#endif
+}
 
 uniform mat4 uModelViewMatrix;
 uniform mat4 uModelMatrix;
@@ -59,14 +92,18 @@ vec4 SRGBtoLINEAR(vec4 srgbIn)
 
 void main()
 {
+  Material material = uMaterials[uMaterialIndex];
+
   vec3 N;
 
-  if (uNormalMapUse) {
-    N = texture(uNormalMapTexture, vTexCoords).rgb;
+#ifdef HAS_NORMAL_MAP
+  {
+    N = sampleTexture(NORMAL_TEXTURE, vTexCoords).rgb;
     N = N * 2.0 - 1.0;
-    N = N * vec3(uNormalMapScale, uNormalMapScale, 1.0);
+    N = N * vec3(material.normalScale, material.normalScale, 1.0);
     mat3 TBN;
-    if (vTangent == vec3(0,0,0)) {
+#ifndef HAS_TANGENTS
+    {
       // Compute TBN Matrix from GPU
       // Inspired from https://community.khronos.org/t/computing-the-tangent-space-in-the-fragment-shader/52861
       vec3 posdFdx = dFdx(vViewSpacePosition);
@@ -81,7 +118,9 @@ void main()
       T = normalize(T - dot(T, N) * N);
       vec3 B = cross(N, T);
       TBN = mat3(T, B, N);
-    } else {
+    }
+#else
+    {
       // Use tangent values provided
       // Inspired from https://learnopengl.com/Advanced-Lighting/Normal-Mapping
       vec3 T = normalize(vec3(uModelViewMatrix * vec4(vTangent, 0.0)));
@@ -90,10 +129,12 @@ void main()
       vec3 B = cross(N, T);
       TBN = mat3(T, B, N);
     }
+#endif
     N = normalize(TBN * N); 
-  } else {
-    N = normalize(vViewSpaceNormal);
   }
+#else
+  N = normalize(vViewSpaceNormal);
+#endif
 
   vec3 L = uLightDirection;
   vec3 V = normalize(-vViewSpacePosition);
@@ -109,15 +150,22 @@ void main()
   float NdotH_2 = NdotH * NdotH;
 
   // Base texture
-  vec4 baseColorFromTexture = SRGBtoLINEAR(texture(uBaseColorTexture, vTexCoords));
-  //vec4 baseColorFromTexture = SRGBtoLINEAR(texture(uNormalMapTexture, vTexCoords)); // Test for normal map texture load
-  vec4 baseColor = baseColorFromTexture * uBaseColorFactor;
+#ifdef HAS_BASE_COLOR_TEXTURE
+  vec4 baseColorFromTexture = SRGBtoLINEAR(sampleTexture(BASE_COLOR_TEXTURE, vTexCoords));
+#else
+  vec4 baseColorFromTexture = vec4(1);
+#endif
+  vec4 baseColor = baseColorFromTexture * material.baseColorFactor;
   // vec3 diffuse = baseColor.rgb * M_1_PI * NdotL;
 
   // Metallic values
-  vec4 metallicRoughnessTexture = texture(uMetallicRoughnessTexture, vTexCoords);
-  float metallic = metallicRoughnessTexture.b * uMetallicFactor;
-  float roughness = metallicRoughnessTexture.g * uRougnessFactor;
+#ifdef HAS_MR_TEXTURE
+  vec4 metallicRoughnessTexture = sampleTexture(METALLIC_ROUGHNESS_TEXTURE, vTexCoords);
+#else
+  vec4 metallicRoughnessTexture = vec4(1);
+#endif
+  float metallic = metallicRoughnessTexture.b * material.metallicFactor;
+  float roughness = metallicRoughnessTexture.g * material.roughnessFactor;
   float alpha = roughness * roughness;
   float alpha_2 = alpha * alpha;
 
@@ -126,17 +174,21 @@ void main()
   vec3 F0 = mix(dielectricSpecular, baseColor.rgb, metallic);
 
   // Emissive texture
-  vec3 emissive = vec3(0);
-  emissive = SRGBtoLINEAR(texture(uEmissiveTexture, vTexCoords)).rgb;
-  emissive *= uEmissiveFactor;
+  vec3 emissive = material.emissiveFactor;
+#ifdef HAS_EMISSIVE
+  emissive *= SRGBtoLINEAR(sampleTexture(EMISSIVE_TEXTURE, vTexCoords)).rgb;
+#endif
 
   // Occlusion texture
   // The occlusion map texture. The occlusion values are sampled from the R channel.
   // Higher values indicate areas that should receive full indirect lighting and lower values indicate no indirect lighting.
   // These values are linear.
   // If other channels are present (GBA), they are ignored for occlusion calculations.
-  vec4 occlusionTexture = texture(uOcclusionTexture, vTexCoords);
-  float occlusionSampled = occlusionTexture.r;
+#ifdef HAS_OCCLUSION
+  float occlusionSampled = sampleTexture(OCCLUSION_TEXTURE, vTexCoords).r;
+#else
+  float occlusionSampled = 1.0;
+#endif
 
   // Surface Reflection Ratio (F)
   // Fresnel Schlick
@@ -166,7 +218,7 @@ void main()
   vec3 color = f * uLightRadiance * NdotL;
 
   // Add occlusion
-  color = mix(color, color * occlusionSampled, uOcclusionStrength);
+  color = mix(color, color * occlusionSampled, material.occlusionStrength);
 
   // Mix
   fColor = LINEARtoSRGB(color);
@@ -0,0 +1,61 @@
+#version 430
+
+// Pre-skinning of the vertices of a primitive (see PreSkinnedPrimitives)
+
+layout(local_size_x = 64) in;
+
+struct SkinVertex {
+  vec4 position;
+  vec4 normal;
+  vec4 tangent;
+  uvec4 joints;
+  vec4 weights;
+};
+
+struct SkinnedVertex {
+  vec4 position;
+  vec4 normal;
+  vec4 tangent;
+};
+
+layout(std430, binding = 1) readonly buffer SourceVertices {
+  SkinVertex sourceVertices[];
+};
+
+layout(std430, binding = 2) writeonly buffer SkinnedVertices {
+  SkinnedVertex skinnedVertices[];
+};
+
+// Joint matrices of all skins, 4 texels per matrix
+uniform samplerBuffer uJointMatrices;
+uniform int uJointOffset;
+uniform uint uVertexCount;
+
+mat4 getJointMatrix(uint joint) {
+  int texel = 4 * (uJointOffset + int(joint));
+  return mat4(texelFetch(uJointMatrices, texel),
+              texelFetch(uJointMatrices, texel + 1),
+              texelFetch(uJointMatrices, texel + 2),
+              texelFetch(uJointMatrices, texel + 3));
+}
+
+void main() {
+  uint index = gl_GlobalInvocationID.x;
+  if (index >= uVertexCount) {
+    return;
+  }
+  SkinVertex vertex = sourceVertices[index];
+  mat4 skinMatrix = vertex.weights.x * getJointMatrix(vertex.joints.x) +
+                    vertex.weights.y * getJointMatrix(vertex.joints.y) +
+                    vertex.weights.z * getJointMatrix(vertex.joints.z) +
+                    vertex.weights.w * getJointMatrix(vertex.joints.w);
+  // Tangents follow the surface, normals the inverse transpose, which differs
+  // for joints with a non-uniform scale
+  mat3 skinTangentMatrix = mat3(skinMatrix);
+  mat3 skinNormalMatrix = transpose(inverse(skinTangentMatrix));
+
+  skinnedVertices[index].position = skinMatrix * vertex.position;
+  skinnedVertices[index].normal = vec4(skinNormalMatrix * vertex.normal.xyz, 0);
+  skinnedVertices[index].tangent =
+      vec4(skinTangentMatrix * vertex.tangent.xyz, vertex.tangent.w);
+}
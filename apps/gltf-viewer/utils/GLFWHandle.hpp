@@ -1,24 +1,41 @@
 #pragma once
 
 #include "gl_debug_output.hpp"
+#include "gl_extensions.hpp"
 #include "glfw.hpp"
+#include "headless_context.hpp"
 #include <glm/glm.hpp>
 
 #include <imgui.h>
 #include <imgui_impl_glfw.h>
 #include <imgui_impl_opengl3.h>
 
+#include <chrono>
 #include <iostream>
+#include <memory>
 #include <stdexcept>
 
 // Class responsible for initializing GLFW, creating a window, initializing
 // OpenGL function pointers with GLAD library and initializing ImGUI
+//
+// A handle without visible window is headless when there is no display or
+// GLFW cannot create a window: the OpenGL context is then a HeadlessContext
+// (EGL or OSMesa), and there is neither window nor ImGui.
 class GLFWHandle
 {
 public:
   GLFWHandle(int width, int height, const char *title, bool visible = true)
   {
+    if (!visible && !hasDisplay()) {
+      initHeadless("no display");
+      return;
+    }
+
     if (!glfwInit()) {
+      if (!visible) {
+        initHeadless("unable to init GLFW");
+        return;
+      }
       std::cerr << "Unable to init GLFW.\n";
       throw std::runtime_error("Unable to init GLFW.\n");
     }
@@ -37,8 +54,12 @@ public:
     m_pWindow =
         glfwCreateWindow(int(width), int(height), title, nullptr, nullptr);
     if (!m_pWindow) {
-      std::cerr << "Unable to open window.\n";
       glfwTerminate();
+      if (!visible) {
+        initHeadless("unable to open window");
+        return;
+      }
+      std::cerr << "Unable to open window.\n";
       throw std::runtime_error("Unable to open window.\n");
     }
 
@@ -51,6 +72,8 @@ public:
       throw std::runtime_error("Unable to init OpenGL.\n");
     }
 
+    loadGLExtensions((GLADloadproc)glfwGetProcAddress);
+
     initGLDebugOutput();
 
     // Setup ImGui
@@ -62,6 +85,10 @@ public:
 
   ~GLFWHandle()
   {
+    if (m_pHeadlessContext) {
+      return; // Destroyed with its member
+    }
+
     ImGui_ImplOpenGL3_Shutdown();
     ImGui_ImplGlfw_Shutdown();
     ImGui::DestroyContext();
@@ -74,21 +101,71 @@ public:
   GLFWHandle(const GLFWHandle &) = delete;
   GLFWHandle &operator=(const GLFWHandle &) = delete;
 
-  bool shouldClose() const { return glfwWindowShouldClose(m_pWindow); }
+  bool shouldClose() const
+  {
+    return !m_pWindow || glfwWindowShouldClose(m_pWindow);
+  }
 
   glm::ivec2 framebufferSize() const
   {
+    if (!m_pWindow) {
+      return glm::ivec2(0);
+    }
     int displayWidth, displayHeight;
     glfwGetFramebufferSize(m_pWindow, &displayWidth, &displayHeight);
     return glm::ivec2(displayWidth, displayHeight);
   }
 
-  void swapBuffers() const { glfwSwapBuffers(m_pWindow); }
+  void swapBuffers() const
+  {
+    if (m_pWindow) {
+      glfwSwapBuffers(m_pWindow);
+    }
+  }
 
+  // nullptr when headless
   GLFWwindow *window() { return m_pWindow; }
 
+  bool headless() const { return m_pHeadlessContext != nullptr; }
+
+  const HeadlessContext *headlessContext() const
+  {
+    return m_pHeadlessContext.get();
+  }
+
+  // Seconds, like glfwGetTime() (which needs GLFW to be initialized)
+  double time() const
+  {
+    if (!m_pHeadlessContext) {
+      return glfwGetTime();
+    }
+    return std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - m_HeadlessStartTime)
+        .count();
+  }
+
 private:
+  void initHeadless(const char *reason)
+  {
+    m_pHeadlessContext = std::make_unique<HeadlessContext>();
+    m_HeadlessStartTime = std::chrono::steady_clock::now();
+
+    if (!gladLoadGLLoader(HeadlessContext::getProcAddress)) {
+      std::cerr << "Unable to init OpenGL.\n";
+      throw std::runtime_error("Unable to init OpenGL.\n");
+    }
+
+    loadGLExtensions(HeadlessContext::getProcAddress);
+
+    initGLDebugOutput();
+
+    std::clog << "Headless OpenGL context (" << reason
+              << "): " << toString(m_pHeadlessContext->backend()) << std::endl;
+  }
+
   GLFWwindow *m_pWindow = nullptr;
+  std::unique_ptr<HeadlessContext> m_pHeadlessContext;
+  std::chrono::steady_clock::time_point m_HeadlessStartTime;
 };
 
 inline void imguiNewFrame()
@@ -111,5 +188,6 @@ inline void printGLVersion()
   glGetIntegerv(GL_MINOR_VERSION, &glVersion[1]);
 
   std::clog << "OpenGL Version " << glVersion[0] << "." << glVersion[1]
-            << std::endl;
+            << " (" << glGetString(GL_RENDERER) << ", "
+            << glGetString(GL_VENDOR) << ")" << std::endl;
 }
\ No newline at end of file
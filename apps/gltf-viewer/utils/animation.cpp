@@ -0,0 +1,364 @@
+#include "animation.hpp"
+
+#include "gltf.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+
+// Keyframe k of times such that times[k] <= time < times[k + 1] (0 before the
+// first keyframe, the last one after it), searched from cursor, the keyframe
+// of the previous sample
+size_t findKeyframe(const std::vector<float> &times, float time, size_t cursor)
+{
+  const auto lastKeyframe = times.size() - 1;
+  size_t first = 0;
+  if (cursor <= lastKeyframe && time >= times[cursor]) {
+    // Playing forward moves by a few keyframes at most per frame
+    for (size_t step = 0; step < 4; ++step, ++cursor) {
+      if (cursor == lastKeyframe || time < times[cursor + 1]) {
+        return cursor;
+      }
+    }
+    first = cursor;
+  }
+  // Seeking or looping back
+  const auto it = std::upper_bound(begin(times) + first, end(times), time);
+  return it == begin(times) ? 0 : size_t(it - begin(times)) - 1;
+}
+
+// Position of time between keyframe and the next one, from 0 to 1
+float getInterpolationFactor(
+    const std::vector<float> &times, size_t keyframe, float time)
+{
+  if (keyframe + 1 >= times.size()) {
+    return 0.f;
+  }
+  const auto delta = times[keyframe + 1] - times[keyframe];
+  if (delta <= 0.f) {
+    return 0.f;
+  }
+  return std::min(std::max((time - times[keyframe]) / delta, 0.f), 1.f);
+}
+
+// Kapoulkine, "Approximating slerp": the factor of an nlerp that follows
+// slerp closely, from the absolute cosine d between the quaternions
+inline float correctNlerpFactor(float d, float t)
+{
+  const auto a = 1.0904f + d * (-3.2452f + d * (3.55645f - d * 1.43519f));
+  const auto b = 0.848013f + d * (-1.06021f + d * 0.215638f);
+  const auto k = a * (t - 0.5f) * (t - 0.5f) + b;
+  return t + t * (t - 0.5f) * (t - 1.f) * k;
+}
+
+void slerpScalar(float &x0, float &y0, float &z0, float &w0, float x1, float y1,
+    float z1, float w1, float t)
+{
+  const auto cosine = x0 * x1 + y0 * y1 + z0 * z1 + w0 * w1;
+  // Along the shortest path
+  const auto sign = cosine < 0.f ? -1.f : 1.f;
+  const auto u = correctNlerpFactor(std::abs(cosine), t);
+  const auto x = x0 + u * (sign * x1 - x0);
+  const auto y = y0 + u * (sign * y1 - y0);
+  const auto z = z0 + u * (sign * z1 - z0);
+  const auto w = w0 + u * (sign * w1 - w0);
+  const auto length = std::sqrt(x * x + y * y + z * z + w * w);
+  const auto invLength = length > 0.f ? 1.f / length : 0.f;
+  x0 = x * invLength;
+  y0 = y * invLength;
+  z0 = z * invLength;
+  w0 = w * invLength;
+}
+
+// Interpolate count pairs of quaternions (x0, y0, z0, w0) and (x1, y1, z1,
+// w1), stored as structure of arrays, by factors t. The results replace the
+// first quaternions.
+void slerpBatch(float *x0, float *y0, float *z0, float *w0, const float *x1,
+    const float *y1, const float *z1, const float *w1, const float *t,
+    size_t count)
+{
+  size_t i = 0;
+#if defined(__SSE2__) || defined(_M_X64)
+  // Four quaternions per iteration, the same operations as slerpScalar
+  const auto signMask = _mm_set1_ps(-0.f);
+  const auto half = _mm_set1_ps(0.5f);
+  const auto one = _mm_set1_ps(1.f);
+  const auto polynomial = [](__m128 x, float c0, float c1, float c2) {
+    return _mm_add_ps(_mm_set1_ps(c0),
+        _mm_mul_ps(x, _mm_add_ps(_mm_set1_ps(c1),
+                          _mm_mul_ps(x, _mm_set1_ps(c2)))));
+  };
+  for (; i + 4 <= count; i += 4) {
+    const auto ax = _mm_loadu_ps(x0 + i), ay = _mm_loadu_ps(y0 + i),
+               az = _mm_loadu_ps(z0 + i), aw = _mm_loadu_ps(w0 + i);
+    auto bx = _mm_loadu_ps(x1 + i), by = _mm_loadu_ps(y1 + i),
+         bz = _mm_loadu_ps(z1 + i), bw = _mm_loadu_ps(w1 + i);
+    const auto vt = _mm_loadu_ps(t + i);
+
+    const auto cosine = _mm_add_ps(
+        _mm_add_ps(_mm_mul_ps(ax, bx), _mm_mul_ps(ay, by)),
+        _mm_add_ps(_mm_mul_ps(az, bz), _mm_mul_ps(aw, bw)));
+    const auto sign = _mm_and_ps(cosine, signMask);
+    bx = _mm_xor_ps(bx, sign);
+    by = _mm_xor_ps(by, sign);
+    bz = _mm_xor_ps(bz, sign);
+    bw = _mm_xor_ps(bw, sign);
+    const auto d = _mm_andnot_ps(signMask, cosine);
+
+    // a = 1.0904 + d * (-3.2452 + d * (3.55645 - d * 1.43519))
+    const auto a = _mm_add_ps(_mm_set1_ps(1.0904f),
+        _mm_mul_ps(d, polynomial(d, -3.2452f, 3.55645f, -1.43519f)));
+    const auto b = polynomial(d, 0.848013f, -1.06021f, 0.215638f);
+    const auto centered = _mm_sub_ps(vt, half);
+    const auto k = _mm_add_ps(_mm_mul_ps(a, _mm_mul_ps(centered, centered)), b);
+    const auto u = _mm_add_ps(vt,
+        _mm_mul_ps(_mm_mul_ps(vt, centered),
+            _mm_mul_ps(_mm_sub_ps(vt, one), k)));
+
+    const auto x = _mm_add_ps(ax, _mm_mul_ps(u, _mm_sub_ps(bx, ax)));
+    const auto y = _mm_add_ps(ay, _mm_mul_ps(u, _mm_sub_ps(by, ay)));
+    const auto z = _mm_add_ps(az, _mm_mul_ps(u, _mm_sub_ps(bz, az)));
+    const auto w = _mm_add_ps(aw, _mm_mul_ps(u, _mm_sub_ps(bw, aw)));
+    const auto length = _mm_sqrt_ps(
+        _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)),
+            _mm_add_ps(_mm_mul_ps(z, z), _mm_mul_ps(w, w))));
+    // Zero length (opposite quaternions at t = 0.5) gives zeros, not NaNs
+    const auto invLength = _mm_and_ps(_mm_div_ps(one, length),
+        _mm_cmpgt_ps(length, _mm_setzero_ps()));
+    _mm_storeu_ps(x0 + i, _mm_mul_ps(x, invLength));
+    _mm_storeu_ps(y0 + i, _mm_mul_ps(y, invLength));
+    _mm_storeu_ps(z0 + i, _mm_mul_ps(z, invLength));
+    _mm_storeu_ps(w0 + i, _mm_mul_ps(w, invLength));
+  }
+#endif
+  for (; i < count; ++i) {
+    slerpScalar(x0[i], y0[i], z0[i], w0[i], x1[i], y1[i], z1[i], w1[i], t[i]);
+  }
+}
+
+// Elements of an accessor as consecutive floats
+std::vector<float> decodeFloats(const tinygltf::Model &model, int accessorIdx)
+{
+  const auto &accessor = model.accessors.at(accessorIdx);
+  const auto decode = [&](auto element) {
+    using Element = decltype(element);
+    const auto elements = AccessorView<Element>{model, accessor}.decode();
+    std::vector<float> floats(
+        elements.size() * sizeof(Element) / sizeof(float));
+    if (!floats.empty()) {
+      std::memcpy(
+          floats.data(), elements.data(), floats.size() * sizeof(float));
+    }
+    return floats;
+  };
+  switch (accessor.type) {
+  case TINYGLTF_TYPE_SCALAR:
+    return decode(float{});
+  case TINYGLTF_TYPE_VEC2:
+    return decode(glm::vec2{});
+  case TINYGLTF_TYPE_VEC3:
+    return decode(glm::vec3{});
+  case TINYGLTF_TYPE_VEC4:
+    return decode(glm::vec4{});
+  default:
+    throw std::runtime_error("Unsupported type of animation output");
+  }
+}
+
+} // namespace
+
+void AnimationPlayer::RotationBatch::clear()
+{
+  for (auto *pArray : {&x0, &y0, &z0, &w0, &x1, &y1, &z1, &w1, &t}) {
+    pArray->clear();
+  }
+  nodes.clear();
+}
+
+void AnimationPlayer::RotationBatch::push(
+    const float *q0, const float *q1, float factor, int node)
+{
+  x0.push_back(q0[0]);
+  y0.push_back(q0[1]);
+  z0.push_back(q0[2]);
+  w0.push_back(q0[3]);
+  x1.push_back(q1[0]);
+  y1.push_back(q1[1]);
+  z1.push_back(q1[2]);
+  w1.push_back(q1[3]);
+  t.push_back(factor);
+  nodes.push_back(node);
+}
+
+AnimationPlayer::AnimationPlayer(const tinygltf::Model &model)
+{
+  for (const auto &gltfAnimation : model.animations) {
+    Animation animation{gltfAnimation.name, 0.f, {}, {}};
+    if (animation.name.empty()) {
+      animation.name = "Animation " + std::to_string(m_Animations.size());
+    }
+
+    for (const auto &gltfSampler : gltfAnimation.samplers) {
+      Sampler sampler{{}, {}, 0,
+          gltfSampler.interpolation == "STEP"
+              ? Interpolation::Step
+              : gltfSampler.interpolation == "CUBICSPLINE"
+                    ? Interpolation::CubicSpline
+                    : Interpolation::Linear};
+      try {
+        sampler.times = AccessorView<float>{model, gltfSampler.input}.decode();
+        sampler.values = decodeFloats(model, gltfSampler.output);
+      } catch (const std::runtime_error &e) {
+        std::cerr << animation.name << ": " << e.what() << std::endl;
+      }
+      const auto valuesPerKeyframe =
+          sampler.interpolation == Interpolation::CubicSpline ? 3 : 1;
+      if (!sampler.times.empty()) {
+        sampler.componentCount =
+            sampler.values.size() / (sampler.times.size() * valuesPerKeyframe);
+      }
+      animation.samplers.emplace_back(std::move(sampler));
+    }
+
+    for (const auto &gltfChannel : gltfAnimation.channels) {
+      static const std::pair<const char *, Path> paths[] = {
+          {"translation", Path::Translation}, {"rotation", Path::Rotation},
+          {"scale", Path::Scale}, {"weights", Path::Weights}};
+      const auto pathIt = std::find_if(std::begin(paths), std::end(paths),
+          [&](const std::pair<const char *, Path> &path) {
+            return gltfChannel.target_path == path.first;
+          });
+      if (pathIt == std::end(paths) || gltfChannel.target_node < 0) {
+        // Targets of extensions
+        continue;
+      }
+      const auto path = (*pathIt).second;
+      const auto componentCount =
+          path == Path::Rotation ? 4u : path == Path::Weights ? 0u : 3u;
+      if (gltfChannel.sampler < 0 ||
+          size_t(gltfChannel.sampler) >= animation.samplers.size() ||
+          size_t(gltfChannel.target_node) >= model.nodes.size()) {
+        std::cerr << animation.name << ": invalid channel" << std::endl;
+        continue;
+      }
+      const auto &sampler = animation.samplers[gltfChannel.sampler];
+      if (sampler.componentCount == 0 ||
+          (componentCount && sampler.componentCount != componentCount)) {
+        std::cerr << animation.name << ": invalid sampler "
+                  << gltfChannel.sampler << std::endl;
+        continue;
+      }
+      animation.channels.push_back(Channel{
+          size_t(gltfChannel.sampler), gltfChannel.target_node, path, 0});
+      animation.duration =
+          std::max(animation.duration, sampler.times.back());
+    }
+    m_Animations.emplace_back(std::move(animation));
+  }
+}
+
+void AnimationPlayer::apply(
+    size_t animationIdx, float time, SceneHierarchy &hierarchy)
+{
+  auto &animation = m_Animations[animationIdx];
+  auto &translations = hierarchy.translations();
+  auto &rotations = hierarchy.rotations();
+  auto &scales = hierarchy.scales();
+  bool transformsChanged = false;
+  bool weightsChanged = false;
+
+  m_RotationBatch.clear();
+  for (auto &channel : animation.channels) {
+    const auto &sampler = animation.samplers[channel.sampler];
+    const auto &times = sampler.times;
+    const auto keyframe = findKeyframe(times, time, channel.cursor);
+    channel.cursor = keyframe;
+    const auto factor = getInterpolationFactor(times, keyframe, time);
+    const auto n = sampler.componentCount;
+    const auto nextKeyframe = std::min(keyframe + 1, times.size() - 1);
+
+    // Linear rotations are interpolated all together below
+    if (channel.path == Path::Rotation &&
+        sampler.interpolation == Interpolation::Linear) {
+      m_RotationBatch.push(&sampler.values[keyframe * 4],
+          &sampler.values[nextKeyframe * 4], factor, channel.node);
+      transformsChanged = true;
+      continue;
+    }
+
+    m_Values.resize(n);
+    if (sampler.interpolation == Interpolation::CubicSpline) {
+      // Hermite spline between the values, with the out-tangent of the
+      // keyframe and the in-tangent of the next one scaled by their interval
+      const auto *v0 = &sampler.values[(3 * keyframe + 1) * n];
+      const auto *b0 = &sampler.values[(3 * keyframe + 2) * n];
+      const auto *a1 = &sampler.values[3 * nextKeyframe * n];
+      const auto *v1 = &sampler.values[(3 * nextKeyframe + 1) * n];
+      const auto delta = times[nextKeyframe] - times[keyframe];
+      const auto t = factor, t2 = t * t, t3 = t2 * t;
+      const auto h00 = 2.f * t3 - 3.f * t2 + 1.f;
+      const auto h10 = (t3 - 2.f * t2 + t) * delta;
+      const auto h01 = -2.f * t3 + 3.f * t2;
+      const auto h11 = (t3 - t2) * delta;
+      for (size_t i = 0; i < n; ++i) {
+        m_Values[i] = h00 * v0[i] + h10 * b0[i] + h01 * v1[i] + h11 * a1[i];
+      }
+    } else {
+      const auto *v0 = &sampler.values[keyframe * n];
+      const auto *v1 = &sampler.values[nextKeyframe * n];
+      const auto t =
+          sampler.interpolation == Interpolation::Step ? 0.f : factor;
+      for (size_t i = 0; i < n; ++i) {
+        m_Values[i] = v0[i] + t * (v1[i] - v0[i]);
+      }
+    }
+
+    const auto *v = m_Values.data();
+    switch (channel.path) {
+    case Path::Translation:
+      translations[channel.node] = glm::vec3(v[0], v[1], v[2]);
+      transformsChanged = true;
+      break;
+    case Path::Rotation:
+      rotations[channel.node] =
+          glm::normalize(glm::quat(v[3], v[0], v[1], v[2]));
+      transformsChanged = true;
+      break;
+    case Path::Scale:
+      scales[channel.node] = glm::vec3(v[0], v[1], v[2]);
+      transformsChanged = true;
+      break;
+    case Path::Weights:
+      std::copy_n(
+          v, std::min(n, hierarchy.weightCount(channel.node)),
+          hierarchy.weights(channel.node));
+      weightsChanged = true;
+      break;
+    }
+  }
+
+  auto &batch = m_RotationBatch;
+  slerpBatch(batch.x0.data(), batch.y0.data(), batch.z0.data(),
+      batch.w0.data(), batch.x1.data(), batch.y1.data(), batch.z1.data(),
+      batch.w1.data(), batch.t.data(), batch.nodes.size());
+  for (size_t i = 0; i < batch.nodes.size(); ++i) {
+    rotations[batch.nodes[i]] =
+        glm::quat(batch.w0[i], batch.x0[i], batch.y0[i], batch.z0[i]);
+  }
+
+  if (transformsChanged) {
+    hierarchy.invalidate();
+  }
+  if (weightsChanged) {
+    hierarchy.invalidateWeights();
+  }
+}
@@ -0,0 +1,109 @@
+#pragma once
+
+#include "scene_hierarchy.hpp"
+
+#include <tiny_gltf.h>
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// Playback of the animations of a model (model.animations). Keyframes are
+// decoded once to floats, and applying an animation at a time writes the
+// sampled translations, rotations, scales and morph target weights straight
+// into the arrays of a SceneHierarchy.
+//
+// Sampling is built for thousands of animated nodes per frame:
+// - each channel keeps a cursor on its last keyframe, so that finding the
+// keyframes around the time is O(1) when playing forward (seeking falls back
+// to a binary search)
+// - linearly interpolated rotations, the bulk of skeletal animation, are
+// gathered in structure of arrays and interpolated in batches with SIMD
+// instructions, by an nlerp whose parameter is corrected to follow slerp
+class AnimationPlayer
+{
+public:
+  // Channels with an invalid sampler, node or accessor are skipped (with a
+  // message on the error output)
+  explicit AnimationPlayer(const tinygltf::Model &model);
+
+  size_t size() const { return m_Animations.size(); }
+
+  const std::string &name(size_t animationIdx) const
+  {
+    return m_Animations[animationIdx].name;
+  }
+
+  // Time of the last keyframe of the animation, in seconds
+  float duration(size_t animationIdx) const
+  {
+    return m_Animations[animationIdx].duration;
+  }
+
+  // Number of channels of the animation (node properties it animates)
+  size_t channelCount(size_t animationIdx) const
+  {
+    return m_Animations[animationIdx].channels.size();
+  }
+
+  // Write the values of the animation at time (in seconds, clamped to the
+  // keyframes of each channel) into hierarchy, and invalidate what changed
+  void apply(size_t animationIdx, float time, SceneHierarchy &hierarchy);
+
+private:
+  enum class Path
+  {
+    Translation,
+    Rotation,
+    Scale,
+    Weights
+  };
+
+  enum class Interpolation
+  {
+    Linear,
+    Step,
+    CubicSpline
+  };
+
+  struct Sampler
+  {
+    std::vector<float> times;
+    // componentCount floats per keyframe, 3 times more with cubic splines
+    // (in-tangent, value, out-tangent)
+    std::vector<float> values;
+    size_t componentCount;
+    Interpolation interpolation;
+  };
+
+  struct Channel
+  {
+    size_t sampler;
+    int node;
+    Path path;
+    size_t cursor; // Keyframe of the last sample
+  };
+
+  struct Animation
+  {
+    std::string name;
+    float duration;
+    std::vector<Sampler> samplers;
+    std::vector<Channel> channels;
+  };
+
+  // Linear rotations of an apply(), in structure of arrays: q0, q1, and the
+  // interpolation factor of each, with the node receiving the result
+  struct RotationBatch
+  {
+    std::vector<float> x0, y0, z0, w0, x1, y1, z1, w1, t;
+    std::vector<int> nodes;
+
+    void clear();
+    void push(const float *q0, const float *q1, float t, int node);
+  };
+
+  std::vector<Animation> m_Animations;
+  RotationBatch m_RotationBatch;
+  std::vector<float> m_Values; // Of the channel being sampled
+};
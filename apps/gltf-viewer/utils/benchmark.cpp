@@ -0,0 +1,108 @@
+#include "benchmark.hpp"
+
+#include "gl_extensions.hpp"
+#include "reports.hpp"
+
+#include <algorithm>
+#include <numeric>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/resource.h>
+#endif
+
+namespace
+{
+
+// GL_NVX_gpu_memory_info, in KB
+const GLenum GL_GPU_MEMORY_INFO_DEDICATED_VIDMEM_NVX = 0x9047;
+const GLenum GL_GPU_MEMORY_INFO_CURRENT_AVAILABLE_VIDMEM_NVX = 0x9049;
+
+void writeStatistics(std::ostream &out, std::vector<double> values)
+{
+  std::sort(begin(values), end(values));
+  const auto mean =
+      values.empty() ? 0.
+                     : std::accumulate(begin(values), end(values), 0.) /
+                           values.size();
+  out << "{\"min\": " << (values.empty() ? 0. : values.front())
+      << ", \"median\": " << percentile(values, 0.5)
+      << ", \"p95\": " << percentile(values, 0.95)
+      << ", \"p99\": " << percentile(values, 0.99) << ", \"mean\": " << mean
+      << ", \"max\": " << (values.empty() ? 0. : values.back()) << "}";
+}
+
+} // namespace
+
+void writeBenchmarkResults(std::ostream &out, const BenchmarkResults &results)
+{
+  out << "{\n  \"scene\": ";
+  writeJsonString(out, results.sceneName);
+  out << ",\n  \"renderer\": ";
+  writeJsonString(out, results.renderer);
+  out << ",\n  \"width\": " << results.width
+      << ",\n  \"height\": " << results.height
+      << ",\n  \"warmupFrames\": " << results.warmupFrames
+      << ",\n  \"frames\": " << results.frameMs.size();
+  out << ",\n  \"frameMs\": ";
+  writeStatistics(out, results.frameMs);
+  out << ",\n  \"cpuMs\": ";
+  writeStatistics(out, results.cpuMs);
+  out << ",\n  \"gpuMs\": ";
+  writeStatistics(out, results.gpuMs);
+  const auto &counters = results.counters;
+  out << ",\n  \"drawCalls\": " << counters.drawCalls
+      << ",\n  \"triangles\": " << counters.triangles
+      << ",\n  \"stateChanges\": " << counters.stateChanges
+      << ",\n  \"textureBinds\": " << counters.textureBinds;
+  out << ",\n  \"loadMs\": " << results.loadMs << ",\n  \"loadPhasesMs\": {";
+  for (size_t i = 0; i < results.loadPhasesMs.size(); ++i) {
+    out << (i ? ", " : "");
+    writeJsonString(out, results.loadPhasesMs[i].first);
+    out << ": " << results.loadPhasesMs[i].second;
+  }
+  out << "},\n  \"shaderCache\": ";
+  if (!results.shaderCachePath.empty()) {
+    writeJsonString(out, results.shaderCachePath.string());
+  } else {
+    out << "null";
+  }
+  out << ",\n  \"loadedPrograms\": " << results.loadedProgramCount
+      << ",\n  \"compiledPrograms\": " << results.compiledProgramCount;
+  out << ",\n  \"peakResidentBytes\": " << results.peakResidentBytes
+      << ",\n  \"peakVideoMemoryBytes\": ";
+  if (results.peakVideoMemoryBytes >= 0) {
+    out << results.peakVideoMemoryBytes;
+  } else {
+    out << "null";
+  }
+  out << ",\n  \"uploadedBytes\": " << results.uploadedBytes << "\n}\n";
+}
+
+uint64_t getPeakResidentBytes()
+{
+#if defined(__unix__) || defined(__APPLE__)
+  rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) != 0) {
+    return 0;
+  }
+#if defined(__APPLE__)
+  return uint64_t(usage.ru_maxrss); // Bytes
+#else
+  return uint64_t(usage.ru_maxrss) * 1024; // KB
+#endif
+#else
+  return 0;
+#endif
+}
+
+int64_t getUsedVideoMemoryBytes()
+{
+  if (!hasGLExtension("GL_NVX_gpu_memory_info")) {
+    return -1;
+  }
+  GLint dedicatedKB = 0;
+  GLint availableKB = 0;
+  glGetIntegerv(GL_GPU_MEMORY_INFO_DEDICATED_VIDMEM_NVX, &dedicatedKB);
+  glGetIntegerv(GL_GPU_MEMORY_INFO_CURRENT_AVAILABLE_VIDMEM_NVX, &availableKB);
+  return int64_t(dedicatedKB - availableKB) * 1024;
+}
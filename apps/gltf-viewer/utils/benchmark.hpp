@@ -0,0 +1,63 @@
+#pragma once
+
+#include "filesystem.hpp"
+#include "profiler.hpp"
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Frames of the bench command: the frames of a render sequence (see
+// RenderSequence) rendered offscreen without being read back, after warmup
+// frames along the same path
+struct BenchmarkSettings
+{
+  uint32_t warmupFrames = 0;
+  uint32_t frameCount = 0; // No benchmark if 0
+  fs::path resultsPath; // .json file, the standard output if empty
+  std::string sceneName; // Path of the file, or name of the procedural scene
+};
+
+// Measures of a benchmark, written as JSON
+struct BenchmarkResults
+{
+  std::string sceneName;
+  std::string renderer;
+  uint32_t width = 0;
+  uint32_t height = 0;
+  uint32_t warmupFrames = 0;
+
+  // Of each measured frame, in ms: from the start of a frame to the start of
+  // the next one, commands issued by the CPU, and GPU time of the commands
+  std::vector<double> frameMs;
+  std::vector<double> cpuMs;
+  std::vector<double> gpuMs;
+  FrameCounters counters; // Of the last frame
+
+  // From the start of the application to the first frame, and time spent in
+  // each load phase before it, summed over the threads
+  double loadMs = 0.;
+  std::vector<std::pair<std::string, double>> loadPhasesMs;
+  // Directory of the program binary cache, empty if disabled, and programs
+  // loaded from it or compiled, to compare the shader load phases of runs
+  fs::path shaderCachePath;
+  size_t loadedProgramCount = 0;
+  size_t compiledProgramCount = 0;
+
+  uint64_t peakResidentBytes = 0;
+  int64_t peakVideoMemoryBytes = -1; // -1 if the driver does not tell
+  uint64_t uploadedBytes = 0; // Buffers and textures
+};
+
+// Write results as a JSON object: min, median, p95, p99, mean and max of the
+// frame, CPU and GPU times, with the other measures
+void writeBenchmarkResults(std::ostream &out, const BenchmarkResults &results);
+
+// Largest resident set size of the process so far, 0 if unknown
+uint64_t getPeakResidentBytes();
+
+// Video memory in use according to the driver (GL_NVX_gpu_memory_info), -1 if
+// it does not tell
+int64_t getUsedVideoMemoryBytes();
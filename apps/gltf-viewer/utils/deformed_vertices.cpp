@@ -0,0 +1,94 @@
+#include "deformed_vertices.hpp"
+
+namespace
+{
+
+// State of a vertex attribute of the bound vertex array object
+struct VertexAttribute
+{
+  GLuint idx;
+  GLint enabled = 0;
+  GLint buffer = 0;
+  GLint size = 0;
+  GLint type = 0;
+  GLint normalized = 0;
+  GLint integer = 0;
+  GLint stride = 0;
+  GLvoid *offset = nullptr;
+};
+
+VertexAttribute getVertexAttribute(GLuint idx)
+{
+  VertexAttribute attribute;
+  attribute.idx = idx;
+  glGetVertexAttribiv(idx, GL_VERTEX_ATTRIB_ARRAY_ENABLED, &attribute.enabled);
+  if (!attribute.enabled) {
+    return attribute;
+  }
+  glGetVertexAttribiv(
+      idx, GL_VERTEX_ATTRIB_ARRAY_BUFFER_BINDING, &attribute.buffer);
+  glGetVertexAttribiv(idx, GL_VERTEX_ATTRIB_ARRAY_SIZE, &attribute.size);
+  glGetVertexAttribiv(idx, GL_VERTEX_ATTRIB_ARRAY_TYPE, &attribute.type);
+  glGetVertexAttribiv(
+      idx, GL_VERTEX_ATTRIB_ARRAY_NORMALIZED, &attribute.normalized);
+  glGetVertexAttribiv(idx, GL_VERTEX_ATTRIB_ARRAY_INTEGER, &attribute.integer);
+  glGetVertexAttribiv(idx, GL_VERTEX_ATTRIB_ARRAY_STRIDE, &attribute.stride);
+  glGetVertexAttribPointerv(
+      idx, GL_VERTEX_ATTRIB_ARRAY_POINTER, &attribute.offset);
+  return attribute;
+}
+
+void setVertexAttribute(const VertexAttribute &attribute)
+{
+  if (!attribute.enabled) {
+    return;
+  }
+  glBindBuffer(GL_ARRAY_BUFFER, GLuint(attribute.buffer));
+  glEnableVertexAttribArray(attribute.idx);
+  if (attribute.integer) {
+    glVertexAttribIPointer(attribute.idx, attribute.size,
+        GLenum(attribute.type), attribute.stride, attribute.offset);
+  } else {
+    glVertexAttribPointer(attribute.idx, attribute.size,
+        GLenum(attribute.type), GLboolean(attribute.normalized),
+        attribute.stride, attribute.offset);
+  }
+}
+
+} // namespace
+
+GLuint createDeformedVertexArray(
+    GLuint sourceVao, GLuint deformedBuffer, bool hasNormals, bool hasTangents)
+{
+  glBindVertexArray(sourceVao);
+  GLint elementBuffer = 0;
+  glGetIntegerv(GL_ELEMENT_ARRAY_BUFFER_BINDING, &elementBuffer);
+  const VertexAttribute copiedAttributes[] = {
+      getVertexAttribute(VERTEX_ATTRIB_TEXCOORD0_IDX),
+      getVertexAttribute(VERTEX_ATTRIB_JOINTS0_IDX),
+      getVertexAttribute(VERTEX_ATTRIB_WEIGHTS0_IDX)};
+
+  GLuint vao = 0;
+  glGenVertexArrays(1, &vao);
+  glBindVertexArray(vao);
+  glBindBuffer(GL_ARRAY_BUFFER, deformedBuffer);
+  const auto enableDeformedAttribute = [&](GLuint idx, size_t offset) {
+    glEnableVertexAttribArray(idx);
+    glVertexAttribPointer(idx, 4, GL_FLOAT, GL_FALSE, sizeof(DeformedVertex),
+        (const GLvoid *)offset);
+  };
+  enableDeformedAttribute(VERTEX_ATTRIB_POSITION_IDX, 0);
+  if (hasNormals) {
+    enableDeformedAttribute(VERTEX_ATTRIB_NORMAL_IDX, sizeof(glm::vec4));
+  }
+  if (hasTangents) {
+    enableDeformedAttribute(VERTEX_ATTRIB_TANGENT_IDX, 2 * sizeof(glm::vec4));
+  }
+  for (const auto &attribute : copiedAttributes) {
+    setVertexAttribute(attribute);
+  }
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, GLuint(elementBuffer));
+  glBindVertexArray(0);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+  return vao;
+}
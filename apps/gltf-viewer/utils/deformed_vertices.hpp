@@ -0,0 +1,28 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+// Vertices written by the compute shaders that deform primitives ahead of
+// their draws (skinning.cs.glsl, morph_targets.cs.glsl), in std430 layout
+struct DeformedVertex
+{
+  glm::vec4 position;
+  glm::vec4 normal;
+  glm::vec4 tangent;
+};
+static_assert(sizeof(DeformedVertex) == 48, "DeformedVertex must match std430");
+
+// Vertex attribute locations of forward.vs.glsl
+const GLuint VERTEX_ATTRIB_POSITION_IDX = 0;
+const GLuint VERTEX_ATTRIB_NORMAL_IDX = 1;
+const GLuint VERTEX_ATTRIB_TEXCOORD0_IDX = 2;
+const GLuint VERTEX_ATTRIB_TANGENT_IDX = 3;
+const GLuint VERTEX_ATTRIB_JOINTS0_IDX = 4;
+const GLuint VERTEX_ATTRIB_WEIGHTS0_IDX = 5;
+
+// Vertex array object drawing the DeformedVertex of deformedBuffer instead of
+// the positions, normals and tangents of sourceVao. Texture coordinates,
+// joints, weights and indices are those of sourceVao, copied from its state.
+GLuint createDeformedVertexArray(
+    GLuint sourceVao, GLuint deformedBuffer, bool hasNormals, bool hasTangents);
@@ -0,0 +1,57 @@
+#include "gl_extensions.hpp"
+
+#include <cstring>
+
+int GLAD_GL_ARB_bindless_texture = 0;
+PFNGLGETTEXTUREHANDLEARBPROC glad_glGetTextureHandleARB = nullptr;
+PFNGLMAKETEXTUREHANDLERESIDENTARBPROC glad_glMakeTextureHandleResidentARB =
+    nullptr;
+PFNGLMAKETEXTUREHANDLENONRESIDENTARBPROC
+    glad_glMakeTextureHandleNonResidentARB = nullptr;
+
+int GLAD_GL_KHR_parallel_shader_compile = 0;
+PFNGLMAXSHADERCOMPILERTHREADSKHRPROC glad_glMaxShaderCompilerThreadsKHR =
+    nullptr;
+
+bool hasGLExtension(const char *name)
+{
+  GLint extensionCount = 0;
+  glGetIntegerv(GL_NUM_EXTENSIONS, &extensionCount);
+  for (GLint i = 0; i < extensionCount; ++i) {
+    const auto extension =
+        reinterpret_cast<const char *>(glGetStringi(GL_EXTENSIONS, i));
+    if (extension && std::strcmp(extension, name) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void loadGLExtensions(GLADloadproc load)
+{
+  if (hasGLExtension("GL_ARB_bindless_texture")) {
+    glad_glGetTextureHandleARB =
+        (PFNGLGETTEXTUREHANDLEARBPROC)load("glGetTextureHandleARB");
+    glad_glMakeTextureHandleResidentARB =
+        (PFNGLMAKETEXTUREHANDLERESIDENTARBPROC)load(
+            "glMakeTextureHandleResidentARB");
+    glad_glMakeTextureHandleNonResidentARB =
+        (PFNGLMAKETEXTUREHANDLENONRESIDENTARBPROC)load(
+            "glMakeTextureHandleNonResidentARB");
+    GLAD_GL_ARB_bindless_texture = glad_glGetTextureHandleARB &&
+                                   glad_glMakeTextureHandleResidentARB &&
+                                   glad_glMakeTextureHandleNonResidentARB;
+  }
+
+  if (hasGLExtension("GL_KHR_parallel_shader_compile")) {
+    glad_glMaxShaderCompilerThreadsKHR =
+        (PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)load(
+            "glMaxShaderCompilerThreadsKHR");
+  } else if (hasGLExtension("GL_ARB_parallel_shader_compile")) {
+    glad_glMaxShaderCompilerThreadsKHR =
+        (PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)load(
+            "glMaxShaderCompilerThreadsARB");
+  }
+  GLAD_GL_KHR_parallel_shader_compile =
+      glad_glMaxShaderCompilerThreadsKHR != nullptr;
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+// OpenGL extensions that are not part of the GL 4.4 core profile generated by
+// glad. Function pointers follow glad conventions so that code using them
+// reads like core GL code, but they are only valid if the corresponding
+// GLAD_GL_* flag is set after loadGLExtensions().
+
+#include <glad/glad.h>
+
+// GL_ARB_bindless_texture
+extern int GLAD_GL_ARB_bindless_texture;
+typedef GLuint64(APIENTRYP PFNGLGETTEXTUREHANDLEARBPROC)(GLuint texture);
+typedef void(APIENTRYP PFNGLMAKETEXTUREHANDLERESIDENTARBPROC)(GLuint64 handle);
+typedef void(APIENTRYP PFNGLMAKETEXTUREHANDLENONRESIDENTARBPROC)(
+    GLuint64 handle);
+extern PFNGLGETTEXTUREHANDLEARBPROC glad_glGetTextureHandleARB;
+extern PFNGLMAKETEXTUREHANDLERESIDENTARBPROC glad_glMakeTextureHandleResidentARB;
+extern PFNGLMAKETEXTUREHANDLENONRESIDENTARBPROC
+    glad_glMakeTextureHandleNonResidentARB;
+#define glGetTextureHandleARB glad_glGetTextureHandleARB
+#define glMakeTextureHandleResidentARB glad_glMakeTextureHandleResidentARB
+#define glMakeTextureHandleNonResidentARB glad_glMakeTextureHandleNonResidentARB
+
+// GL_KHR_parallel_shader_compile, or its ARB twin with the same enums
+extern int GLAD_GL_KHR_parallel_shader_compile;
+#define GL_MAX_SHADER_COMPILER_THREADS_KHR 0x91B0
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+typedef void(APIENTRYP PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)(GLuint count);
+extern PFNGLMAXSHADERCOMPILERTHREADSKHRPROC glad_glMaxShaderCompilerThreadsKHR;
+#define glMaxShaderCompilerThreadsKHR glad_glMaxShaderCompilerThreadsKHR
+
+// Must be called once a context is current and glad is loaded.
+void loadGLExtensions(GLADloadproc load);
+
+bool hasGLExtension(const char *name);
@@ -3,7 +3,18 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/quaternion.hpp>
 
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
 #include <iostream>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
 
 glm::mat4 getLocalToWorldMatrix(
     const tinygltf::Node &node, const glm::mat4 &parentMatrix)
@@ -35,119 +46,360 @@ glm::mat4 getLocalToWorldMatrix(
                                                  node.scale[1], node.scale[2]));
 };
 
+namespace
+{
+
+// Bounds of the positions of a float VEC3 accessor, each vertex read once
+void scanPositionBounds(const unsigned char *pData, size_t count,
+    size_t byteStride, glm::vec3 &bboxMin, glm::vec3 &bboxMax)
+{
+  if (count == 0) {
+    return;
+  }
+#if defined(__SSE2__) || defined(_M_X64)
+  // One vertex per SSE register: the fourth lane reads the next float, which
+  // does not exist after the last vertex, so it is read separately
+  auto vMin = _mm_set1_ps(std::numeric_limits<float>::max());
+  auto vMax = _mm_set1_ps(std::numeric_limits<float>::lowest());
+  for (size_t i = 0; i + 1 < count; ++i) {
+    const auto position =
+        _mm_loadu_ps((const float *)(pData + byteStride * i));
+    vMin = _mm_min_ps(vMin, position);
+    vMax = _mm_max_ps(vMax, position);
+  }
+  const auto *pLast = (const float *)(pData + byteStride * (count - 1));
+  const auto last = _mm_set_ps(0.f, pLast[2], pLast[1], pLast[0]);
+  vMin = _mm_min_ps(vMin, last);
+  vMax = _mm_max_ps(vMax, last);
+  float lanes[4];
+  _mm_storeu_ps(lanes, vMin);
+  bboxMin = glm::min(bboxMin, glm::vec3(lanes[0], lanes[1], lanes[2]));
+  _mm_storeu_ps(lanes, vMax);
+  bboxMax = glm::max(bboxMax, glm::vec3(lanes[0], lanes[1], lanes[2]));
+#else
+  for (size_t i = 0; i < count; ++i) {
+    glm::vec3 position;
+    std::memcpy(&position, pData + byteStride * i, sizeof(position));
+    bboxMin = glm::min(bboxMin, position);
+    bboxMax = glm::max(bboxMax, position);
+  }
+#endif
+}
+
+bool isValidBox(const glm::vec3 &bboxMin, const glm::vec3 &bboxMax)
+{
+  for (glm::length_t i = 0; i < 3; ++i) {
+    if (!std::isfinite(bboxMin[i]) || !std::isfinite(bboxMax[i]) ||
+        bboxMin[i] > bboxMax[i]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Box containing the box transformed by matrix, without transforming its 8
+// corners (Arvo): the center is transformed, and the half extent by the
+// absolute values of the linear part.
+void transformBox(const glm::mat4 &matrix, const glm::vec3 &bboxMin,
+    const glm::vec3 &bboxMax, glm::vec3 &outMin, glm::vec3 &outMax)
+{
+  const auto center =
+      glm::vec3(matrix * glm::vec4(0.5f * (bboxMin + bboxMax), 1.f));
+  const auto halfExtent = 0.5f * (bboxMax - bboxMin);
+  const auto absLinear = glm::mat3(glm::abs(matrix[0]), glm::abs(matrix[1]),
+      glm::abs(matrix[2]));
+  const auto worldHalfExtent = absLinear * halfExtent;
+  outMin = glm::min(outMin, center - worldHalfExtent);
+  outMax = glm::max(outMax, center + worldHalfExtent);
+}
+
+} // namespace
+
 void computeSceneBounds(
     const tinygltf::Model &model, glm::vec3 &bboxMin, glm::vec3 &bboxMax)
 {
-  // Compute scene bounding box
-  // todo refactor with scene drawing
-  // todo need a visitScene generic function that takes a accept() functor
   bboxMin = glm::vec3(std::numeric_limits<float>::max());
   bboxMax = glm::vec3(std::numeric_limits<float>::lowest());
-  if (model.defaultScene >= 0) {
-    const std::function<void(int, const glm::mat4 &)> updateBounds =
-        [&](int nodeIdx, const glm::mat4 &parentMatrix) {
-          const auto &node = model.nodes[nodeIdx];
-          const glm::mat4 modelMatrix =
-              getLocalToWorldMatrix(node, parentMatrix);
-          if (node.mesh >= 0) {
-            const auto &mesh = model.meshes[node.mesh];
-            for (size_t pIdx = 0; pIdx < mesh.primitives.size(); ++pIdx) {
-              const auto &primitive = mesh.primitives[pIdx];
-              const auto positionAttrIdxIt =
-                  primitive.attributes.find("POSITION");
-              if (positionAttrIdxIt == end(primitive.attributes)) {
-                continue;
-              }
-              const auto &positionAccessor =
-                  model.accessors[(*positionAttrIdxIt).second];
-              if (positionAccessor.type != 3) {
-                std::cerr << "Position accessor with type != VEC3, skipping"
-                          << std::endl;
-                continue;
-              }
-              const auto &positionBufferView =
-                  model.bufferViews[positionAccessor.bufferView];
-              const auto byteOffset =
-                  positionAccessor.byteOffset + positionBufferView.byteOffset;
-              const auto &positionBuffer =
-                  model.buffers[positionBufferView.buffer];
-              const auto positionByteStride =
-                  positionBufferView.byteStride ? positionBufferView.byteStride
-                                                : 3 * sizeof(float);
-
-              if (primitive.indices >= 0) {
-                const auto &indexAccessor = model.accessors[primitive.indices];
-                const auto &indexBufferView =
-                    model.bufferViews[indexAccessor.bufferView];
-                const auto indexByteOffset =
-                    indexAccessor.byteOffset + indexBufferView.byteOffset;
-                const auto &indexBuffer = model.buffers[indexBufferView.buffer];
-                auto indexByteStride = indexBufferView.byteStride;
-
-                switch (indexAccessor.componentType) {
-                default:
-                  std::cerr
-                      << "Primitive index accessor with bad componentType "
-                      << indexAccessor.componentType << ", skipping it."
-                      << std::endl;
-                  continue;
-                case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE:
-                  indexByteStride =
-                      indexByteStride ? indexByteStride : sizeof(uint8_t);
-                  break;
-                case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT:
-                  indexByteStride =
-                      indexByteStride ? indexByteStride : sizeof(uint16_t);
-                  break;
-                case TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT:
-                  indexByteStride =
-                      indexByteStride ? indexByteStride : sizeof(uint32_t);
-                  break;
-                }
-
-                for (size_t i = 0; i < indexAccessor.count; ++i) {
-                  uint32_t index = 0;
-                  switch (indexAccessor.componentType) {
-                  case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE:
-                    index = *((const uint8_t *)&indexBuffer
-                                  .data[indexByteOffset + indexByteStride * i]);
-                    break;
-                  case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT:
-                    index = *((const uint16_t *)&indexBuffer
-                                  .data[indexByteOffset + indexByteStride * i]);
-                    break;
-                  case TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT:
-                    index = *((const uint32_t *)&indexBuffer
-                                  .data[indexByteOffset + indexByteStride * i]);
-                    break;
-                  }
-                  const auto &localPosition =
-                      *((const glm::vec3 *)&positionBuffer
-                              .data[byteOffset + positionByteStride * index]);
-                  const auto worldPosition =
-                      glm::vec3(modelMatrix * glm::vec4(localPosition, 1.f));
-                  bboxMin = glm::min(bboxMin, worldPosition);
-                  bboxMax = glm::max(bboxMax, worldPosition);
-                }
-              } else {
-                for (size_t i = 0; i < positionAccessor.count; ++i) {
-                  const auto &localPosition =
-                      *((const glm::vec3 *)&positionBuffer
-                              .data[byteOffset + positionByteStride * i]);
-                  const auto worldPosition =
-                      glm::vec3(modelMatrix * glm::vec4(localPosition, 1.f));
-                  bboxMin = glm::min(bboxMin, worldPosition);
-                  bboxMax = glm::max(bboxMax, worldPosition);
-                }
-              }
+  if (model.defaultScene < 0) {
+    return;
+  }
+
+  // Local bounds of the POSITION accessors drawn by the scene, with the model
+  // matrices of their instances
+  struct AccessorBounds
+  {
+    glm::vec3 bboxMin{std::numeric_limits<float>::max()};
+    glm::vec3 bboxMax{std::numeric_limits<float>::lowest()};
+    bool scan = false; // min/max missing or invalid, positions are scanned
+    std::vector<glm::mat4> instances;
+  };
+  std::unordered_map<int, AccessorBounds> accessorBounds;
+
+  const auto addInstance = [&](const tinygltf::Primitive &primitive,
+                               const glm::mat4 &modelMatrix) {
+    const auto positionAttrIdxIt = primitive.attributes.find("POSITION");
+    if (positionAttrIdxIt == end(primitive.attributes)) {
+      return;
+    }
+    const auto accessorIdx = (*positionAttrIdxIt).second;
+    auto it = accessorBounds.find(accessorIdx);
+    if (it == end(accessorBounds)) {
+      it = accessorBounds.emplace(accessorIdx, AccessorBounds{}).first;
+      auto &bounds = (*it).second;
+      bounds.scan = !getPrimitiveLocalBounds(
+                        model, primitive, bounds.bboxMin, bounds.bboxMax) ||
+                    !isValidBox(bounds.bboxMin, bounds.bboxMax);
+    }
+    (*it).second.instances.push_back(modelMatrix);
+  };
+
+  // Skinned nodes are drawn in world space, their own matrix ignored: they
+  // are bounded once the matrices of all joints are known
+  std::vector<glm::mat4> worldMatrices(model.nodes.size(), glm::mat4(1));
+  std::vector<int> skinnedNodes;
+  const std::function<void(int, const glm::mat4 &)> collectInstances =
+      [&](int nodeIdx, const glm::mat4 &parentMatrix) {
+        const auto &node = model.nodes[nodeIdx];
+        const glm::mat4 modelMatrix = getLocalToWorldMatrix(node, parentMatrix);
+        worldMatrices[nodeIdx] = modelMatrix;
+        if (node.mesh >= 0) {
+          if (node.skin >= 0 && size_t(node.skin) < model.skins.size()) {
+            skinnedNodes.push_back(nodeIdx);
+          } else {
+            for (const auto &primitive : model.meshes[node.mesh].primitives) {
+              addInstance(primitive, modelMatrix);
             }
           }
-          for (const auto childNodeIdx : node.children) {
-            updateBounds(childNodeIdx, modelMatrix);
-          }
-        };
-    for (const auto nodeIdx : model.scenes[model.defaultScene].nodes) {
-      updateBounds(nodeIdx, glm::mat4(1));
+        }
+        for (const auto childNodeIdx : node.children) {
+          collectInstances(childNodeIdx, modelMatrix);
+        }
+      };
+  for (const auto nodeIdx : model.scenes[model.defaultScene].nodes) {
+    collectInstances(nodeIdx, glm::mat4(1));
+  }
+
+  // Skinned vertices are weighted averages of their positions transformed by
+  // joint matrices: the box of the positions transformed by each joint
+  // matrix contains them, in the rest pose of the scene
+  for (const auto nodeIdx : skinnedNodes) {
+    const auto &node = model.nodes[nodeIdx];
+    const auto &skin = model.skins[node.skin];
+    std::vector<glm::mat4> inverseBindMatrices;
+    if (skin.inverseBindMatrices >= 0) {
+      try {
+        inverseBindMatrices =
+            AccessorView<glm::mat4>{model, skin.inverseBindMatrices}.decode();
+      } catch (const std::runtime_error &e) {
+        std::cerr << "Skin " << node.skin << ": " << e.what() << std::endl;
+      }
+    }
+    inverseBindMatrices.resize(skin.joints.size(), glm::mat4(1));
+    for (size_t i = 0; i < skin.joints.size(); ++i) {
+      const auto jointNode = skin.joints[i];
+      if (jointNode < 0 || size_t(jointNode) >= model.nodes.size()) {
+        continue;
+      }
+      const auto jointMatrix =
+          worldMatrices[jointNode] * inverseBindMatrices[i];
+      for (const auto &primitive : model.meshes[node.mesh].primitives) {
+        addInstance(primitive, jointMatrix);
+      }
     }
   }
-}
\ No newline at end of file
+
+  // Accessors without usable min/max are scanned once, whatever their number
+  // of instances and indices, in parallel when they are big enough to be
+  // worth threads
+  std::vector<std::pair<int, AccessorBounds *>> scans;
+  size_t scannedVertexCount = 0;
+  for (auto &it : accessorBounds) {
+    auto &bounds = it.second;
+    if (!bounds.scan) {
+      continue;
+    }
+    const auto &accessor = model.accessors[it.first];
+    if (accessor.type != TINYGLTF_TYPE_VEC3) {
+      std::cerr << "Position accessor " << it.first
+                << " without bounds is not VEC3, skipping" << std::endl;
+      bounds.instances.clear();
+      continue;
+    }
+    bounds.bboxMin = glm::vec3(std::numeric_limits<float>::max());
+    bounds.bboxMax = glm::vec3(std::numeric_limits<float>::lowest());
+    scans.emplace_back(it.first, &bounds);
+    scannedVertexCount += accessor.count;
+  }
+  // Float positions are scanned in place, others (quantized, sparse) are
+  // decoded first
+  const auto scanAccessor = [&](int accessorIdx, AccessorBounds &bounds) {
+    try {
+      const AccessorView<glm::vec3> positions{model, accessorIdx};
+      if (positions.isDirect() && !positions.isSparse()) {
+        scanPositionBounds(positions.data(), positions.size(),
+            positions.byteStride(), bounds.bboxMin, bounds.bboxMax);
+      } else {
+        const auto decoded = positions.decode();
+        scanPositionBounds((const unsigned char *)decoded.data(),
+            decoded.size(), sizeof(glm::vec3), bounds.bboxMin, bounds.bboxMax);
+      }
+    } catch (const std::runtime_error &e) {
+      std::cerr << "Position accessor " << accessorIdx << ": " << e.what()
+                << std::endl;
+    }
+  };
+  const size_t minVerticesPerThread = 1 << 20;
+  const auto threadCount = std::min<size_t>(
+      {std::max(std::thread::hardware_concurrency(), 1u), scans.size(),
+          scannedVertexCount / minVerticesPerThread});
+  if (threadCount <= 1) {
+    for (const auto &scan : scans) {
+      scanAccessor(scan.first, *scan.second);
+    }
+  } else {
+    std::atomic<size_t> nextScan{0};
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < threadCount; ++i) {
+      threads.emplace_back([&]() {
+        for (auto scan = nextScan++; scan < scans.size(); scan = nextScan++) {
+          scanAccessor(scans[scan].first, *scans[scan].second);
+        }
+      });
+    }
+    for (auto &thread : threads) {
+      thread.join();
+    }
+  }
+
+  for (const auto &it : accessorBounds) {
+    const auto &bounds = it.second;
+    if (bounds.instances.empty() ||
+        !isValidBox(bounds.bboxMin, bounds.bboxMax)) {
+      continue;
+    }
+    for (const auto &modelMatrix : bounds.instances) {
+      transformBox(
+          modelMatrix, bounds.bboxMin, bounds.bboxMax, bboxMin, bboxMax);
+    }
+  }
+}
+
+bool getPrimitiveLocalBounds(const tinygltf::Model &model,
+    const tinygltf::Primitive &primitive, glm::vec3 &bboxMin,
+    glm::vec3 &bboxMax)
+{
+  const auto positionAttrIdxIt = primitive.attributes.find("POSITION");
+  if (positionAttrIdxIt == end(primitive.attributes)) {
+    return false;
+  }
+  const auto &positionAccessor = model.accessors[(*positionAttrIdxIt).second];
+  if (positionAccessor.minValues.size() < 3 ||
+      positionAccessor.maxValues.size() < 3) {
+    return false;
+  }
+  bboxMin = glm::vec3(positionAccessor.minValues[0],
+      positionAccessor.minValues[1], positionAccessor.minValues[2]);
+  bboxMax = glm::vec3(positionAccessor.maxValues[0],
+      positionAccessor.maxValues[1], positionAccessor.maxValues[2]);
+  return true;
+}
+
+size_t getAccessorByteOffset(
+    const tinygltf::Model &model, const tinygltf::Accessor &accessor)
+{
+  return model.bufferViews[accessor.bufferView].byteOffset +
+         accessor.byteOffset;
+}
+
+size_t getAccessorByteStride(
+    const tinygltf::Model &model, const tinygltf::Accessor &accessor)
+{
+  const auto byteStride =
+      accessor.ByteStride(model.bufferViews[accessor.bufferView]);
+  if (byteStride <= 0) {
+    throw std::runtime_error("Accessor with invalid byteStride or type");
+  }
+  return size_t(byteStride);
+}
+
+std::vector<unsigned char> getAccessorBytes(
+    const tinygltf::Model &model, const tinygltf::Accessor &accessor)
+{
+  const auto componentSize =
+      tinygltf::GetComponentSizeInBytes(uint32_t(accessor.componentType));
+  const auto componentCount =
+      tinygltf::GetNumComponentsInType(uint32_t(accessor.type));
+  if (componentSize <= 0 || componentCount <= 0) {
+    throw std::runtime_error("Accessor with invalid type or componentType");
+  }
+  const auto elementSize = size_t(componentSize) * size_t(componentCount);
+
+  std::vector<unsigned char> bytes(accessor.count * elementSize, 0);
+  if (accessor.bufferView >= 0) {
+    const auto byteStride = getAccessorByteStride(model, accessor);
+    const auto *pElements = getBufferViewElements(model, accessor.bufferView,
+        accessor.byteOffset, byteStride, accessor.count, elementSize);
+    if (byteStride == elementSize) {
+      std::memcpy(bytes.data(), pElements, bytes.size());
+    } else {
+      for (size_t i = 0; i < accessor.count; ++i) {
+        std::memcpy(bytes.data() + elementSize * i,
+            pElements + byteStride * i, elementSize);
+      }
+    }
+  }
+
+  const auto sparse = getAccessorSparseValues(model, accessor, elementSize);
+  for (size_t i = 0; i < sparse.indices.size(); ++i) {
+    std::memcpy(bytes.data() + elementSize * sparse.indices[i],
+        sparse.pValues + elementSize * i, elementSize);
+  }
+  return bytes;
+}
+
+const unsigned char *getBufferViewElements(const tinygltf::Model &model,
+    int bufferViewIdx, size_t byteOffset, size_t byteStride, size_t count,
+    size_t elementSize)
+{
+  const auto &bufferView = model.bufferViews.at(bufferViewIdx);
+  const auto &buffer = model.buffers.at(bufferView.buffer);
+  const auto byteLength =
+      count ? byteOffset + byteStride * (count - 1) + elementSize : 0;
+  if (byteLength > bufferView.byteLength ||
+      bufferView.byteOffset + bufferView.byteLength > buffer.data.size()) {
+    throw std::runtime_error("Accessor out of the bounds of buffer view " +
+                             std::to_string(bufferViewIdx));
+  }
+  return buffer.data.data() + bufferView.byteOffset + byteOffset;
+}
+
+AccessorSparseValues getAccessorSparseValues(const tinygltf::Model &model,
+    const tinygltf::Accessor &accessor, size_t elementSize)
+{
+  AccessorSparseValues values;
+  const auto &sparse = accessor.sparse;
+  if (!sparse.isSparse || sparse.count <= 0) {
+    return values;
+  }
+  const auto sparseCount = size_t(sparse.count);
+
+  tinygltf::Accessor indexAccessor;
+  indexAccessor.bufferView = sparse.indices.bufferView;
+  indexAccessor.byteOffset = size_t(sparse.indices.byteOffset);
+  indexAccessor.componentType = sparse.indices.componentType;
+  indexAccessor.count = sparseCount;
+  indexAccessor.type = TINYGLTF_TYPE_SCALAR;
+  values.indices = AccessorView<uint32_t>{model, indexAccessor}.decode();
+  for (size_t i = 0; i < sparseCount; ++i) {
+    if (values.indices[i] >= accessor.count ||
+        (i > 0 && values.indices[i] <= values.indices[i - 1])) {
+      throw std::runtime_error(
+          "Sparse accessor with out of range or unsorted indices");
+    }
+  }
+
+  // Sparse values are tightly packed
+  values.pValues = getBufferViewElements(model, sparse.values.bufferView,
+      size_t(sparse.values.byteOffset), elementSize, sparseCount, elementSize);
+  return values;
+}
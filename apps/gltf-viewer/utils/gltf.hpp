@@ -3,8 +3,367 @@
 #include <glm/glm.hpp>
 #include <tiny_gltf.h>
 
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
 glm::mat4 getLocalToWorldMatrix(
     const tinygltf::Node &node, const glm::mat4 &parentMatrix);
 
 void computeSceneBounds(
-    const tinygltf::Model &model, glm::vec3 &bboxMin, glm::vec3 &bboxMax);
\ No newline at end of file
+    const tinygltf::Model &model, glm::vec3 &bboxMin, glm::vec3 &bboxMax);
+
+// Bounding box of a primitive in its local space, read from the min/max
+// fields of its POSITION accessor. Returns false if they are not available.
+bool getPrimitiveLocalBounds(const tinygltf::Model &model,
+    const tinygltf::Primitive &primitive, glm::vec3 &bboxMin,
+    glm::vec3 &bboxMax);
+
+// Offset of the first element of accessor in its buffer
+size_t getAccessorByteOffset(
+    const tinygltf::Model &model, const tinygltf::Accessor &accessor);
+
+// Distance between two elements of accessor in its buffer: the stride of its
+// buffer view, or the size of an element if they are tightly packed
+size_t getAccessorByteStride(
+    const tinygltf::Model &model, const tinygltf::Accessor &accessor);
+
+// Elements of accessor tightly packed in its own component type, with its
+// sparse values applied. Throw std::runtime_error if the accessor is invalid.
+std::vector<unsigned char> getAccessorBytes(
+    const tinygltf::Model &model, const tinygltf::Accessor &accessor);
+
+// First of count elements of elementSize bytes, byteStride bytes apart from
+// byteOffset in buffer view bufferViewIdx. Throw std::runtime_error if they
+// are not all in the buffer view.
+const unsigned char *getBufferViewElements(const tinygltf::Model &model,
+    int bufferViewIdx, size_t byteOffset, size_t byteStride, size_t count,
+    size_t elementSize);
+
+// Sparse values of an accessor, replacing elements of its buffer view
+struct AccessorSparseValues
+{
+  std::vector<uint32_t> indices;          // Increasing, of replaced elements
+  const unsigned char *pValues = nullptr; // Tightly packed elements
+};
+
+// Sparse values of accessor, whose elements are elementSize bytes long, none
+// if it is not sparse. Throw std::runtime_error if they are invalid (indices
+// out of range or not increasing, out of bounds).
+AccessorSparseValues getAccessorSparseValues(const tinygltf::Model &model,
+    const tinygltf::Accessor &accessor, size_t elementSize);
+
+// Component types of accessors, one specialization per
+// TINYGLTF_COMPONENT_TYPE_*: their C++ type, and the float value of a
+// normalized integer (glTF 2.0 specification, "Animations" section).
+template <int ComponentType> struct AccessorComponent;
+
+template <> struct AccessorComponent<TINYGLTF_COMPONENT_TYPE_BYTE>
+{
+  using Type = int8_t;
+  static float normalize(Type c) { return std::max(c / 127.f, -1.f); }
+};
+
+template <> struct AccessorComponent<TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE>
+{
+  using Type = uint8_t;
+  static float normalize(Type c) { return c / 255.f; }
+};
+
+template <> struct AccessorComponent<TINYGLTF_COMPONENT_TYPE_SHORT>
+{
+  using Type = int16_t;
+  static float normalize(Type c) { return std::max(c / 32767.f, -1.f); }
+};
+
+template <> struct AccessorComponent<TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT>
+{
+  using Type = uint16_t;
+  static float normalize(Type c) { return c / 65535.f; }
+};
+
+template <> struct AccessorComponent<TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT>
+{
+  using Type = uint32_t;
+  static float normalize(Type c) { return float(c / 4294967295.); }
+};
+
+template <> struct AccessorComponent<TINYGLTF_COMPONENT_TYPE_FLOAT>
+{
+  using Type = float;
+  static float normalize(Type c) { return c; }
+};
+
+// Elements read by AccessorView<T>: scalars, glm vectors and matrices (column
+// major, like glTF)
+template <typename T> struct AccessorElement
+{
+  using Component = T;
+  static constexpr glm::length_t size = 1;
+  static Component &get(T &element, glm::length_t) { return element; }
+};
+
+template <glm::length_t N, typename C, glm::qualifier Q>
+struct AccessorElement<glm::vec<N, C, Q>>
+{
+  using Component = C;
+  static constexpr glm::length_t size = N;
+  static Component &get(glm::vec<N, C, Q> &element, glm::length_t i)
+  {
+    return element[i];
+  }
+};
+
+template <glm::length_t Columns, glm::length_t Rows, typename C,
+    glm::qualifier Q>
+struct AccessorElement<glm::mat<Columns, Rows, C, Q>>
+{
+  using Component = C;
+  static constexpr glm::length_t size = Columns * Rows;
+  static Component &get(
+      glm::mat<Columns, Rows, C, Q> &element, glm::length_t i)
+  {
+    return element[i / Rows][i % Rows];
+  }
+};
+
+// Read-only view of the elements of an accessor, converted to T (float,
+// uint32_t, glm::vec3, glm::mat4...), so that CPU side geometry processing
+// does not deal with component types, strides and sparse storage:
+//
+//   for (const auto position : AccessorView<glm::vec3>{model, accessorIdx})
+//
+// Components are converted with static_cast, or normalized if the accessor is
+// normalized and T has floating point components. Components missing from
+// the accessor are 0, extra ones are ignored. Sparse values replace the ones
+// of the buffer view, which is all zeros without bufferView.
+//
+// The component type is dispatched once per view, to a decoding loop
+// specialized for it. Prefer decode() to operator[] for whole accessors: when
+// the buffer holds exactly the components of T, tightly packed and without
+// sparse values, it is a single memcpy.
+//
+// Throw std::runtime_error if the accessor is invalid (unknown component
+// type, out of bounds).
+template <typename T> class AccessorView
+{
+public:
+  using Element = AccessorElement<T>;
+  using Component = typename Element::Component;
+
+  AccessorView(
+      const tinygltf::Model &model, const tinygltf::Accessor &accessor);
+  AccessorView(const tinygltf::Model &model, int accessorIdx) :
+      AccessorView(model, model.accessors.at(accessorIdx))
+  {
+  }
+
+  size_t size() const { return m_Count; }
+  bool empty() const { return m_Count == 0; }
+
+  T operator[](size_t i) const
+  {
+    if (!m_SparseIndices.empty()) {
+      const auto it = std::lower_bound(
+          m_SparseIndices.begin(), m_SparseIndices.end(), uint32_t(i));
+      if (it != m_SparseIndices.end() && *it == i) {
+        return m_SparseValues[it - m_SparseIndices.begin()];
+      }
+    }
+    T element(Component(0));
+    if (m_pData) {
+      m_pDecode(m_pData + m_ByteStride * i, 0, 1, m_ComponentCount,
+          m_Normalized, &element);
+    }
+    return element;
+  }
+
+  // Write the size() elements to pOut
+  void decode(T *pOut) const
+  {
+    if (!m_pData) {
+      std::fill_n(pOut, m_Count, T(Component(0)));
+    } else if (isTightlyPacked()) {
+      std::memcpy(pOut, m_pData, m_Count * sizeof(T));
+    } else {
+      m_pDecode(
+          m_pData, m_ByteStride, m_Count, m_ComponentCount, m_Normalized, pOut);
+    }
+    for (size_t i = 0; i < m_SparseIndices.size(); ++i) {
+      pOut[m_SparseIndices[i]] = m_SparseValues[i];
+    }
+  }
+
+  std::vector<T> decode() const
+  {
+    std::vector<T> elements(m_Count);
+    decode(elements.data());
+    return elements;
+  }
+
+  // Whether the buffer view stores exactly the components of T, so that
+  // elements can be read from data() every byteStride() bytes without
+  // conversion (sparse values still apply)
+  bool isDirect() const { return m_IsDirect; }
+  bool isTightlyPacked() const
+  {
+    return m_IsDirect && m_ByteStride == sizeof(T) && m_SparseIndices.empty();
+  }
+  bool isSparse() const { return !m_SparseIndices.empty(); }
+
+  // First element in the buffer, nullptr without buffer view
+  const unsigned char *data() const { return m_pData; }
+  size_t byteStride() const { return m_ByteStride; }
+
+  class Iterator
+  {
+  public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = T;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const T *;
+    using reference = T;
+
+    Iterator(const AccessorView *pView, size_t index) :
+        m_pView(pView), m_Index(index)
+    {
+    }
+
+    T operator*() const { return (*m_pView)[m_Index]; }
+    Iterator &operator++()
+    {
+      ++m_Index;
+      return *this;
+    }
+    Iterator operator++(int)
+    {
+      auto it = *this;
+      ++m_Index;
+      return it;
+    }
+    bool operator==(const Iterator &other) const
+    {
+      return m_Index == other.m_Index;
+    }
+    bool operator!=(const Iterator &other) const
+    {
+      return m_Index != other.m_Index;
+    }
+
+  private:
+    const AccessorView *m_pView;
+    size_t m_Index;
+  };
+
+  Iterator begin() const { return Iterator(this, 0); }
+  Iterator end() const { return Iterator(this, m_Count); }
+
+private:
+  // Decode count elements of componentCount components, byteStride bytes
+  // apart
+  using DecodeFunction = void (*)(const unsigned char *pData,
+      size_t byteStride, size_t count, glm::length_t componentCount,
+      bool normalized, T *pOut);
+
+  template <int ComponentType>
+  static void decodeElements(const unsigned char *pData, size_t byteStride,
+      size_t count, glm::length_t componentCount, bool normalized, T *pOut)
+  {
+    using Source = typename AccessorComponent<ComponentType>::Type;
+    const auto readCount = std::min(componentCount, Element::size);
+    for (size_t i = 0; i < count; ++i) {
+      Source components[Element::size];
+      std::memcpy(components, pData + byteStride * i,
+          size_t(readCount) * sizeof(Source));
+      T element(Component(0));
+      for (glm::length_t c = 0; c < readCount; ++c) {
+        Element::get(element, c) =
+            normalized ? Component(
+                             AccessorComponent<ComponentType>::normalize(
+                                 components[c]))
+                       : Component(components[c]);
+      }
+      pOut[i] = element;
+    }
+  }
+
+  template <int ComponentType> void setComponentType()
+  {
+    m_pDecode = &decodeElements<ComponentType>;
+    m_ComponentSize = sizeof(typename AccessorComponent<ComponentType>::Type);
+    m_IsDirect =
+        std::is_same<typename AccessorComponent<ComponentType>::Type,
+            Component>::value &&
+        m_ComponentCount == Element::size && !m_Normalized &&
+        sizeof(T) == sizeof(Component) * Element::size;
+  }
+
+  size_t m_Count = 0;
+  glm::length_t m_ComponentCount = 0;
+  size_t m_ComponentSize = 0;
+  bool m_Normalized = false;
+  bool m_IsDirect = false;
+  DecodeFunction m_pDecode = nullptr;
+  const unsigned char *m_pData = nullptr;
+  size_t m_ByteStride = 0;
+  std::vector<uint32_t> m_SparseIndices; // Increasing
+  std::vector<T> m_SparseValues;
+};
+
+template <typename T>
+AccessorView<T>::AccessorView(
+    const tinygltf::Model &model, const tinygltf::Accessor &accessor) :
+    m_Count(accessor.count),
+    m_ComponentCount(
+        glm::length_t(tinygltf::GetNumComponentsInType(accessor.type))),
+    m_Normalized(
+        accessor.normalized && std::is_floating_point<Component>::value)
+{
+  switch (accessor.componentType) {
+  case TINYGLTF_COMPONENT_TYPE_BYTE:
+    setComponentType<TINYGLTF_COMPONENT_TYPE_BYTE>();
+    break;
+  case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE:
+    setComponentType<TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE>();
+    break;
+  case TINYGLTF_COMPONENT_TYPE_SHORT:
+    setComponentType<TINYGLTF_COMPONENT_TYPE_SHORT>();
+    break;
+  case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT:
+    setComponentType<TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT>();
+    break;
+  case TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT:
+    setComponentType<TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT>();
+    break;
+  case TINYGLTF_COMPONENT_TYPE_FLOAT:
+    setComponentType<TINYGLTF_COMPONENT_TYPE_FLOAT>();
+    break;
+  default:
+    throw std::runtime_error("Accessor with invalid componentType " +
+                             std::to_string(accessor.componentType));
+  }
+  if (m_ComponentCount <= 0) {
+    throw std::runtime_error(
+        "Accessor with invalid type " + std::to_string(accessor.type));
+  }
+
+  const auto elementSize = m_ComponentSize * size_t(m_ComponentCount);
+  if (accessor.bufferView >= 0) {
+    m_ByteStride = getAccessorByteStride(model, accessor);
+    m_pData = getBufferViewElements(model, accessor.bufferView,
+        accessor.byteOffset, m_ByteStride, m_Count, elementSize);
+  }
+
+  auto sparse = getAccessorSparseValues(model, accessor, elementSize);
+  m_SparseIndices = std::move(sparse.indices);
+  m_SparseValues.resize(m_SparseIndices.size());
+  if (sparse.pValues) {
+    m_pDecode(sparse.pValues, elementSize, m_SparseValues.size(),
+        m_ComponentCount, m_Normalized, m_SparseValues.data());
+  }
+}
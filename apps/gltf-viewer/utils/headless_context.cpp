@@ -0,0 +1,361 @@
+#include "headless_context.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <initializer_list>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#if defined(__unix__)
+#include <dlfcn.h>
+#define GLMLV_HEADLESS_CONTEXT 1
+#endif
+
+// The few EGL and OSMesa declarations that are needed, so that their headers
+// are not required to build
+
+namespace
+{
+
+using EGLBoolean = unsigned int;
+using EGLint = int32_t;
+using EGLenum = unsigned int;
+using EGLDisplay = void *;
+using EGLConfig = void *;
+using EGLContext = void *;
+using EGLSurface = void *;
+using EGLDeviceEXT = void *;
+
+constexpr EGLint EGL_NONE = 0x3038;
+constexpr EGLint EGL_EXTENSIONS = 0x3055;
+constexpr EGLint EGL_RENDERABLE_TYPE = 0x3040;
+constexpr EGLint EGL_OPENGL_BIT = 0x0008;
+constexpr EGLenum EGL_OPENGL_API = 0x30A2;
+constexpr EGLint EGL_CONTEXT_MAJOR_VERSION = 0x3098;
+constexpr EGLint EGL_CONTEXT_MINOR_VERSION = 0x30FB;
+constexpr EGLint EGL_CONTEXT_OPENGL_PROFILE_MASK = 0x30FD;
+constexpr EGLint EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT = 0x0001;
+constexpr EGLint EGL_CONTEXT_OPENGL_DEBUG = 0x31B0;
+constexpr EGLenum EGL_PLATFORM_DEVICE_EXT = 0x313F;
+constexpr EGLenum EGL_PLATFORM_SURFACELESS_MESA = 0x31DD;
+
+using PFNEGLGETPROCADDRESSPROC = void *(*)(const char *);
+using PFNEGLQUERYSTRINGPROC = const char *(*)(EGLDisplay, EGLint);
+using PFNEGLGETDISPLAYPROC = EGLDisplay (*)(void *);
+using PFNEGLGETPLATFORMDISPLAYEXTPROC = EGLDisplay (*)(
+    EGLenum, void *, const EGLint *);
+using PFNEGLQUERYDEVICESEXTPROC = EGLBoolean (*)(
+    EGLint, EGLDeviceEXT *, EGLint *);
+using PFNEGLINITIALIZEPROC = EGLBoolean (*)(EGLDisplay, EGLint *, EGLint *);
+using PFNEGLTERMINATEPROC = EGLBoolean (*)(EGLDisplay);
+using PFNEGLBINDAPIPROC = EGLBoolean (*)(EGLenum);
+using PFNEGLCHOOSECONFIGPROC = EGLBoolean (*)(
+    EGLDisplay, const EGLint *, EGLConfig *, EGLint, EGLint *);
+using PFNEGLCREATECONTEXTPROC = EGLContext (*)(
+    EGLDisplay, EGLConfig, EGLContext, const EGLint *);
+using PFNEGLDESTROYCONTEXTPROC = EGLBoolean (*)(EGLDisplay, EGLContext);
+using PFNEGLMAKECURRENTPROC = EGLBoolean (*)(
+    EGLDisplay, EGLSurface, EGLSurface, EGLContext);
+using PFNEGLGETERRORPROC = EGLint (*)();
+
+constexpr int OSMESA_FORMAT = 0x22;
+constexpr int OSMESA_DEPTH_BITS = 0x30;
+constexpr int OSMESA_PROFILE = 0x33;
+constexpr int OSMESA_CORE_PROFILE = 0x34;
+constexpr int OSMESA_CONTEXT_MAJOR_VERSION = 0x36;
+constexpr int OSMESA_CONTEXT_MINOR_VERSION = 0x37;
+
+using PFNOSMESACREATECONTEXTATTRIBSPROC = void *(*)(const int *, void *);
+using PFNOSMESAMAKECURRENTPROC = unsigned char (*)(
+    void *, void *, GLenum, GLsizei, GLsizei);
+using PFNOSMESADESTROYCONTEXTPROC = void (*)(void *);
+using PFNOSMESAGETPROCADDRESSPROC = void *(*)(const char *);
+
+// Of the current HeadlessContext
+PFNEGLGETPROCADDRESSPROC s_eglGetProcAddress = nullptr;
+PFNOSMESAGETPROCADDRESSPROC s_OSMesaGetProcAddress = nullptr;
+
+bool hasExtension(const char *extensions, const char *name)
+{
+  if (!extensions) {
+    return false;
+  }
+  const auto length = std::strlen(name);
+  for (auto *p = std::strstr(extensions, name); p;
+       p = std::strstr(p + length, name)) {
+    if ((p == extensions || p[-1] == ' ') &&
+        (p[length] == ' ' || p[length] == '\0')) {
+      return true;
+    }
+  }
+  return false;
+}
+
+#ifdef GLMLV_HEADLESS_CONTEXT
+void *openLibrary(std::initializer_list<const char *> names)
+{
+  for (const auto name : names) {
+    if (auto *library = dlopen(name, RTLD_NOW | RTLD_LOCAL)) {
+      return library;
+    }
+  }
+  return nullptr;
+}
+
+template <typename Function>
+Function loadSymbol(void *library, const char *name)
+{
+  return reinterpret_cast<Function>(dlsym(library, name));
+}
+#endif
+
+} // namespace
+
+const char *toString(HeadlessContext::Backend backend)
+{
+  switch (backend) {
+  case HeadlessContext::Backend::EGLDevice:
+    return "EGL device";
+  case HeadlessContext::Backend::EGLSurfaceless:
+    return "EGL surfaceless";
+  case HeadlessContext::Backend::EGLDefaultDisplay:
+    return "EGL default display";
+  case HeadlessContext::Backend::OSMesa:
+    return "OSMesa";
+  }
+  return "";
+}
+
+bool hasDisplay()
+{
+#if defined(__unix__) && !defined(__APPLE__)
+  const auto *display = std::getenv("DISPLAY");
+  const auto *waylandDisplay = std::getenv("WAYLAND_DISPLAY");
+  return (display && *display) || (waylandDisplay && *waylandDisplay);
+#else
+  return true;
+#endif
+}
+
+HeadlessContext::HeadlessContext()
+{
+  std::string errors;
+  if (!createEGLContext(errors) && !createOSMesaContext(errors)) {
+    throw std::runtime_error(
+        "Unable to create an OpenGL context without display:" + errors);
+  }
+}
+
+HeadlessContext::~HeadlessContext()
+{
+#ifdef GLMLV_HEADLESS_CONTEXT
+  if (m_Backend == Backend::OSMesa) {
+    loadSymbol<PFNOSMESADESTROYCONTEXTPROC>(
+        m_pLibrary, "OSMesaDestroyContext")(m_pContext);
+    s_OSMesaGetProcAddress = nullptr;
+  } else {
+    loadSymbol<PFNEGLMAKECURRENTPROC>(m_pLibrary, "eglMakeCurrent")(
+        m_pDisplay, nullptr, nullptr, nullptr);
+    loadSymbol<PFNEGLDESTROYCONTEXTPROC>(m_pLibrary, "eglDestroyContext")(
+        m_pDisplay, m_pContext);
+    loadSymbol<PFNEGLTERMINATEPROC>(m_pLibrary, "eglTerminate")(m_pDisplay);
+    s_eglGetProcAddress = nullptr;
+  }
+  dlclose(m_pLibrary);
+#endif
+}
+
+void *HeadlessContext::getProcAddress(const char *name)
+{
+  if (s_eglGetProcAddress) {
+    return s_eglGetProcAddress(name);
+  }
+  if (s_OSMesaGetProcAddress) {
+    return s_OSMesaGetProcAddress(name);
+  }
+  return nullptr;
+}
+
+bool HeadlessContext::createEGLContext(std::string &errors)
+{
+#ifdef GLMLV_HEADLESS_CONTEXT
+  auto *library = openLibrary({"libEGL.so.1", "libEGL.so"});
+  if (!library) {
+    errors += "\n  EGL: libEGL.so.1 not found";
+    return false;
+  }
+
+  const auto getProcAddress =
+      loadSymbol<PFNEGLGETPROCADDRESSPROC>(library, "eglGetProcAddress");
+  const auto queryString =
+      loadSymbol<PFNEGLQUERYSTRINGPROC>(library, "eglQueryString");
+  const auto getDisplay =
+      loadSymbol<PFNEGLGETDISPLAYPROC>(library, "eglGetDisplay");
+  const auto initialize =
+      loadSymbol<PFNEGLINITIALIZEPROC>(library, "eglInitialize");
+  const auto terminate =
+      loadSymbol<PFNEGLTERMINATEPROC>(library, "eglTerminate");
+  const auto bindAPI = loadSymbol<PFNEGLBINDAPIPROC>(library, "eglBindAPI");
+  const auto chooseConfig =
+      loadSymbol<PFNEGLCHOOSECONFIGPROC>(library, "eglChooseConfig");
+  const auto createContext =
+      loadSymbol<PFNEGLCREATECONTEXTPROC>(library, "eglCreateContext");
+  const auto makeCurrent =
+      loadSymbol<PFNEGLMAKECURRENTPROC>(library, "eglMakeCurrent");
+  const auto getError = loadSymbol<PFNEGLGETERRORPROC>(library, "eglGetError");
+  if (!getProcAddress || !queryString || !getDisplay || !initialize ||
+      !terminate || !bindAPI || !chooseConfig || !createContext ||
+      !makeCurrent || !getError) {
+    errors += "\n  EGL: missing EGL 1.4 functions";
+    dlclose(library);
+    return false;
+  }
+
+  // Displays to try, in order of preference
+  std::vector<std::pair<Backend, EGLDisplay>> displays;
+  const auto *clientExtensions = queryString(nullptr, EGL_EXTENSIONS);
+  const auto getPlatformDisplay =
+      hasExtension(clientExtensions, "EGL_EXT_platform_base")
+          ? reinterpret_cast<PFNEGLGETPLATFORMDISPLAYEXTPROC>(
+                getProcAddress("eglGetPlatformDisplayEXT"))
+          : nullptr;
+  if (getPlatformDisplay &&
+      hasExtension(clientExtensions, "EGL_EXT_platform_device")) {
+    const auto queryDevices = reinterpret_cast<PFNEGLQUERYDEVICESEXTPROC>(
+        getProcAddress("eglQueryDevicesEXT"));
+    EGLDeviceEXT devices[8];
+    EGLint deviceCount = 0;
+    if (queryDevices && queryDevices(8, devices, &deviceCount)) {
+      for (EGLint i = 0; i < deviceCount; ++i) {
+        displays.emplace_back(Backend::EGLDevice,
+            getPlatformDisplay(EGL_PLATFORM_DEVICE_EXT, devices[i], nullptr));
+      }
+    }
+  }
+  if (getPlatformDisplay &&
+      hasExtension(clientExtensions, "EGL_MESA_platform_surfaceless")) {
+    displays.emplace_back(Backend::EGLSurfaceless,
+        getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, nullptr, nullptr));
+  }
+  displays.emplace_back(Backend::EGLDefaultDisplay, getDisplay(nullptr));
+
+  for (const auto &candidate : displays) {
+    const auto display = candidate.second;
+    if (!display || !initialize(display, nullptr, nullptr)) {
+      continue;
+    }
+    const auto *extensions = queryString(display, EGL_EXTENSIONS);
+    if (!hasExtension(extensions, "EGL_KHR_surfaceless_context") ||
+        !bindAPI(EGL_OPENGL_API)) {
+      terminate(display);
+      continue;
+    }
+
+    // Without surface, the config only matters for the rendering API
+    const EGLint configAttributes[] = {
+        EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_NONE};
+    EGLConfig config = nullptr;
+    EGLint configCount = 0;
+    if (!chooseConfig(display, configAttributes, &config, 1, &configCount) ||
+        configCount == 0) {
+      if (!hasExtension(extensions, "EGL_KHR_no_config_context")) {
+        terminate(display);
+        continue;
+      }
+      config = nullptr;
+    }
+
+    EGLint contextAttributes[] = {EGL_CONTEXT_MAJOR_VERSION, 4,
+        EGL_CONTEXT_MINOR_VERSION, 4, EGL_CONTEXT_OPENGL_PROFILE_MASK,
+        EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT, EGL_CONTEXT_OPENGL_DEBUG, 1,
+        EGL_NONE};
+    auto context = createContext(display, config, nullptr, contextAttributes);
+    if (!context) {
+      // Debug contexts are EGL 1.5
+      contextAttributes[6] = EGL_NONE;
+      context = createContext(display, config, nullptr, contextAttributes);
+    }
+    if (!context || !makeCurrent(display, nullptr, nullptr, context)) {
+      errors += "\n  " + std::string(toString(candidate.first)) +
+                ": no OpenGL 4.4 core context (error 0x" +
+                [](EGLint error) {
+                  char buffer[16];
+                  std::snprintf(buffer, sizeof(buffer), "%x", error);
+                  return std::string(buffer);
+                }(getError()) +
+                ")";
+      terminate(display);
+      continue;
+    }
+
+    m_Backend = candidate.first;
+    m_pLibrary = library;
+    m_pDisplay = display;
+    m_pContext = context;
+    s_eglGetProcAddress = getProcAddress;
+    return true;
+  }
+
+  errors += "\n  EGL: no display supporting surfaceless OpenGL contexts";
+  dlclose(library);
+  return false;
+#else
+  errors += "\n  EGL: only supported on Unix";
+  return false;
+#endif
+}
+
+bool HeadlessContext::createOSMesaContext(std::string &errors)
+{
+#ifdef GLMLV_HEADLESS_CONTEXT
+  auto *library =
+      openLibrary({"libOSMesa.so.8", "libOSMesa.so.6", "libOSMesa.so"});
+  if (!library) {
+    errors += "\n  OSMesa: libOSMesa.so not found";
+    return false;
+  }
+
+  const auto createContext = loadSymbol<PFNOSMESACREATECONTEXTATTRIBSPROC>(
+      library, "OSMesaCreateContextAttribs");
+  const auto makeCurrent =
+      loadSymbol<PFNOSMESAMAKECURRENTPROC>(library, "OSMesaMakeCurrent");
+  const auto destroyContext =
+      loadSymbol<PFNOSMESADESTROYCONTEXTPROC>(library, "OSMesaDestroyContext");
+  const auto getProcAddress =
+      loadSymbol<PFNOSMESAGETPROCADDRESSPROC>(library, "OSMesaGetProcAddress");
+  if (!createContext || !makeCurrent || !destroyContext || !getProcAddress) {
+    errors += "\n  OSMesa: missing OSMesaCreateContextAttribs";
+    dlclose(library);
+    return false;
+  }
+
+  const int attributes[] = {OSMESA_FORMAT, GL_RGBA, OSMESA_DEPTH_BITS, 24,
+      OSMESA_PROFILE, OSMESA_CORE_PROFILE, OSMESA_CONTEXT_MAJOR_VERSION, 4,
+      OSMESA_CONTEXT_MINOR_VERSION, 4, 0};
+  auto *context = createContext(attributes, nullptr);
+  if (!context) {
+    errors += "\n  OSMesa: no OpenGL 4.4 core context";
+    dlclose(library);
+    return false;
+  }
+  // Rendering goes to framebuffer objects, the buffer of the context is only
+  // there to make it current
+  if (!makeCurrent(context, m_OSMesaBuffer, GL_UNSIGNED_BYTE, 1, 1)) {
+    errors += "\n  OSMesa: unable to make the context current";
+    destroyContext(context);
+    dlclose(library);
+    return false;
+  }
+
+  m_Backend = Backend::OSMesa;
+  m_pLibrary = library;
+  m_pContext = context;
+  s_OSMesaGetProcAddress = getProcAddress;
+  return true;
+#else
+  errors += "\n  OSMesa: only supported on Unix";
+  return false;
+#endif
+}
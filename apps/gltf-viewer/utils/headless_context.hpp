@@ -0,0 +1,56 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <string>
+
+// OpenGL 4.4 core context without window system, for offscreen rendering on
+// machines without display (servers, containers, CI).
+//
+// EGL is tried first: on a GPU with EGL_EXT_platform_device, else with
+// Mesa's EGL_MESA_platform_surfaceless (llvmpipe works without any GPU).
+// OSMesa is the fallback. Both libraries are loaded at runtime, so they are
+// not required to build or to run with a window.
+//
+// The context has no default framebuffer: render into framebuffer objects.
+class HeadlessContext
+{
+public:
+  enum class Backend
+  {
+    EGLDevice,
+    EGLSurfaceless,
+    EGLDefaultDisplay,
+    OSMesa
+  };
+
+  // Create the context and make it current on the calling thread. Throw
+  // std::runtime_error listing why each backend failed.
+  HeadlessContext();
+  ~HeadlessContext();
+
+  HeadlessContext(const HeadlessContext &) = delete;
+  HeadlessContext &operator=(const HeadlessContext &) = delete;
+
+  Backend backend() const { return m_Backend; }
+
+  // Loader for glad and loadGLExtensions(), valid while a HeadlessContext
+  // exists
+  static void *getProcAddress(const char *name);
+
+private:
+  bool createEGLContext(std::string &errors);
+  bool createOSMesaContext(std::string &errors);
+
+  Backend m_Backend = Backend::EGLDevice;
+  void *m_pLibrary = nullptr;
+  void *m_pDisplay = nullptr; // EGLDisplay
+  void *m_pContext = nullptr; // EGLContext or OSMesaContext
+  unsigned char m_OSMesaBuffer[4] = {}; // 1x1 color buffer
+};
+
+const char *toString(HeadlessContext::Backend backend);
+
+// Whether windows can be created: false on Linux without X11 or Wayland
+// display
+bool hasDisplay();
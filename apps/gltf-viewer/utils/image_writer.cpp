@@ -0,0 +1,729 @@
+#include "image_writer.hpp"
+
+#include "images.hpp"
+#include "trace.hpp"
+
+#include <glm/gtc/packing.hpp>
+#include <stb_image_write.h>
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+
+// The raw formats are written with the byte order of the host, which is
+// assumed to be little endian (the PFM header says so, and EXR requires it).
+
+namespace
+{
+
+std::ofstream openOutput(const fs::path &path)
+{
+  std::ofstream output(path.string(), std::ios::binary);
+  if (!output) {
+    std::stringstream ss;
+    ss << "Unable to open " << path << " for writing";
+    throw std::runtime_error(ss.str());
+  }
+  return output;
+}
+
+void checkOutput(const std::ofstream &output, const fs::path &path)
+{
+  if (!output) {
+    std::stringstream ss;
+    ss << "Unable to write " << path;
+    throw std::runtime_error(ss.str());
+  }
+}
+
+// Reverse the rows of image if they are not in the order expected by the file
+// format
+void orderRows(Image &image, bool bottomUp)
+{
+  if (image.bottomUp != bottomUp) {
+    if (image.floatPixels.empty()) {
+      flipImageYAxis<unsigned char>(
+          image.width, image.height, image.numComponents, image.pixels.data());
+    } else {
+      flipImageYAxis<float>(image.width, image.height, image.numComponents,
+          image.floatPixels.data());
+    }
+    image.bottomUp = bottomUp;
+  }
+}
+
+// Linear value of each 8 bits component (gamma 2.2, as in the shaders)
+const std::array<float, 256> &getLinearTable()
+{
+  static const auto table = []() {
+    std::array<float, 256> values;
+    for (size_t i = 0; i < values.size(); ++i) {
+      values[i] = std::pow(float(i) / 255.f, 2.2f);
+    }
+    return values;
+  }();
+  return table;
+}
+
+// Linear value of a color component written by the shaders, and value of an
+// alpha component
+float toLinear(unsigned char value) { return getLinearTable()[value]; }
+float toLinear(float value) { return std::pow(std::max(value, 0.f), 2.2f); }
+float toAlpha(unsigned char value) { return value / 255.f; }
+float toAlpha(float value) { return value; }
+
+template <typename T> void writeValue(std::ostream &output, const T &value)
+{
+  output.write(reinterpret_cast<const char *>(&value), sizeof(value));
+}
+
+void writePNG(const fs::path &path, Image &image)
+{
+  orderRows(image, false);
+  const auto strPath = path.string();
+  if (!stbi_write_png(strPath.c_str(), int(image.width), int(image.height),
+          int(image.numComponents), image.pixels.data(), 0)) {
+    std::stringstream ss;
+    ss << "Unable to write " << path;
+    throw std::runtime_error(ss.str());
+  }
+}
+
+// pixels are the components of image, rows ordered from bottom to top
+template <typename Component>
+void writePFM(const fs::path &path, const Image &image, const Component *pixels)
+{
+  auto output = openOutput(path);
+  output << "PF\n" << image.width << " " << image.height << "\n-1.0\n";
+  std::vector<float> row(image.width * 3);
+  for (uint32_t y = 0; y < image.height; ++y) {
+    const auto *rowPixels =
+        pixels + size_t(y) * image.width * image.numComponents;
+    for (uint32_t x = 0; x < image.width; ++x) {
+      for (size_t c = 0; c < 3; ++c) {
+        row[x * 3 + c] = toLinear(rowPixels[x * image.numComponents + c]);
+      }
+    }
+    output.write(
+        reinterpret_cast<const char *>(row.data()), row.size() * sizeof(float));
+  }
+  checkOutput(output, path);
+}
+
+} // namespace
+
+// Encoder of the rows of an image, from top to bottom, for ImageRowWriter
+class RowEncoder
+{
+public:
+  RowEncoder(uint32_t width, uint32_t height, uint32_t numComponents) :
+      m_Width(width), m_Height(height), m_NumComponents(numComponents)
+  {
+  }
+  virtual ~RowEncoder() = default;
+
+  virtual void writeHeader(std::ostream &output) = 0;
+  virtual void writeRows(
+      std::ostream &output, const unsigned char *pixels, uint32_t rowCount) = 0;
+  // Only implemented by float formats
+  virtual void writeFloatRows(std::ostream &, const float *, uint32_t)
+  {
+    throw std::runtime_error("Float pixels are only written to float formats");
+  }
+  virtual void writeFooter(std::ostream &) {}
+
+protected:
+  uint32_t m_Width;
+  uint32_t m_Height;
+  uint32_t m_NumComponents;
+  uint32_t m_RowIndex = 0; // Of the next row to write
+};
+
+namespace
+{
+
+uint32_t updateCRC32(uint32_t crc, const unsigned char *data, size_t size)
+{
+  static const auto table = []() {
+    std::array<uint32_t, 256> values;
+    for (uint32_t i = 0; i < values.size(); ++i) {
+      auto c = i;
+      for (int k = 0; k < 8; ++k) {
+        c = c & 1 ? 0xedb88320u ^ (c >> 1) : c >> 1;
+      }
+      values[i] = c;
+    }
+    return values;
+  }();
+  crc = ~crc;
+  for (size_t i = 0; i < size; ++i) {
+    crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+  }
+  return ~crc;
+}
+
+void pushBigEndian(std::vector<unsigned char> &data, uint32_t value)
+{
+  for (int shift = 24; shift >= 0; shift -= 8) {
+    data.push_back((unsigned char)(value >> shift));
+  }
+}
+
+// PNG whose image data is a zlib stream of stored (not compressed) deflate
+// blocks, so that it can be written one row at a time. stb_image_write
+// compresses whole images only.
+class PNGRowEncoder : public RowEncoder
+{
+public:
+  using RowEncoder::RowEncoder;
+
+  void writeHeader(std::ostream &output) override
+  {
+    const unsigned char signature[] = {137, 80, 78, 71, 13, 10, 26, 10};
+    output.write(reinterpret_cast<const char *>(signature), sizeof(signature));
+
+    std::vector<unsigned char> header;
+    pushBigEndian(header, m_Width);
+    pushBigEndian(header, m_Height);
+    header.push_back(8);                                // Bit depth
+    header.push_back(m_NumComponents == 4 ? 6 : 2);     // RGBA or RGB
+    header.insert(std::end(header), {0, 0, 0});         // Deflate, no interlace
+    writeChunk(output, "IHDR", header);
+  }
+
+  void writeRows(std::ostream &output, const unsigned char *pixels,
+      uint32_t rowCount) override
+  {
+    const auto rowSize = size_t(m_Width) * m_NumComponents;
+    std::vector<unsigned char> data;
+    for (uint32_t i = 0; i < rowCount; ++i, ++m_RowIndex) {
+      data.clear();
+      if (m_RowIndex == 0) {
+        data.insert(std::end(data), {0x78, 0x01}); // zlib header
+      }
+      // Filter type None, then the row, in blocks of at most 65535 bytes
+      const unsigned char filter = 0;
+      updateAdler32(&filter, 1);
+      const auto *row = pixels + i * rowSize;
+      updateAdler32(row, rowSize);
+      size_t offset = 0;
+      const auto lastRow = m_RowIndex + 1 == m_Height;
+      while (offset < rowSize + 1) {
+        const auto blockSize =
+            std::min<size_t>(0xffff, rowSize + 1 - offset);
+        const auto lastBlock = lastRow && offset + blockSize == rowSize + 1;
+        data.push_back(lastBlock ? 1 : 0);
+        data.push_back((unsigned char)(blockSize & 0xff));
+        data.push_back((unsigned char)(blockSize >> 8));
+        data.push_back((unsigned char)(~blockSize & 0xff));
+        data.push_back((unsigned char)((~blockSize >> 8) & 0xff));
+        for (size_t k = offset; k < offset + blockSize; ++k) {
+          data.push_back(k == 0 ? filter : row[k - 1]);
+        }
+        offset += blockSize;
+      }
+      if (lastRow) {
+        pushBigEndian(data, (m_AdlerB << 16) | m_AdlerA);
+      }
+      writeChunk(output, "IDAT", data);
+    }
+  }
+
+  void writeFooter(std::ostream &output) override
+  {
+    writeChunk(output, "IEND", {});
+  }
+
+private:
+  void writeChunk(std::ostream &output, const char *type,
+      const std::vector<unsigned char> &data)
+  {
+    std::vector<unsigned char> length;
+    pushBigEndian(length, uint32_t(data.size()));
+    output.write(reinterpret_cast<const char *>(length.data()), 4);
+    output.write(type, 4);
+    output.write(reinterpret_cast<const char *>(data.data()), data.size());
+
+    auto crc = updateCRC32(
+        0, reinterpret_cast<const unsigned char *>(type), 4);
+    crc = updateCRC32(crc, data.data(), data.size());
+    std::vector<unsigned char> footer;
+    pushBigEndian(footer, crc);
+    output.write(reinterpret_cast<const char *>(footer.data()), 4);
+  }
+
+  void updateAdler32(const unsigned char *data, size_t size)
+  {
+    for (size_t i = 0; i < size; ++i) {
+      m_AdlerA = (m_AdlerA + data[i]) % 65521;
+      m_AdlerB = (m_AdlerB + m_AdlerA) % 65521;
+    }
+  }
+
+  uint32_t m_AdlerA = 1;
+  uint32_t m_AdlerB = 0;
+};
+
+// https://qoiformat.org/qoi-specification.pdf
+class QOIRowEncoder : public RowEncoder
+{
+public:
+  using RowEncoder::RowEncoder;
+
+  void writeHeader(std::ostream &output) override
+  {
+    std::vector<unsigned char> header = {'q', 'o', 'i', 'f'};
+    pushBigEndian(header, m_Width);
+    pushBigEndian(header, m_Height);
+    header.push_back((unsigned char)m_NumComponents);
+    header.push_back(0); // sRGB with linear alpha
+    output.write(reinterpret_cast<const char *>(header.data()), header.size());
+    m_Previous.a = 255;
+  }
+
+  void writeRows(std::ostream &output, const unsigned char *pixels,
+      uint32_t rowCount) override
+  {
+    m_Data.clear();
+    const auto pixelCount = size_t(m_Width) * m_Height;
+    const auto count = size_t(m_Width) * rowCount;
+    for (size_t i = 0; i < count; ++i, ++m_PixelIndex) {
+      const auto *p = pixels + i * m_NumComponents;
+      Pixel pixel;
+      pixel.r = p[0];
+      pixel.g = p[1];
+      pixel.b = p[2];
+      pixel.a = m_NumComponents == 4 ? p[3] : m_Previous.a;
+      encode(pixel, m_PixelIndex + 1 == pixelCount);
+    }
+    m_RowIndex += rowCount;
+    output.write(reinterpret_cast<const char *>(m_Data.data()), m_Data.size());
+  }
+
+  void writeFooter(std::ostream &output) override
+  {
+    const char endMarker[] = {0, 0, 0, 0, 0, 0, 0, 1};
+    output.write(endMarker, sizeof(endMarker));
+  }
+
+private:
+  struct Pixel
+  {
+    unsigned char r = 0, g = 0, b = 0, a = 0;
+    bool operator==(const Pixel &other) const
+    {
+      return r == other.r && g == other.g && b == other.b && a == other.a;
+    }
+  };
+
+  void encode(const Pixel &pixel, bool lastPixel)
+  {
+    if (pixel == m_Previous) {
+      ++m_Run;
+      if (m_Run == 62 || lastPixel) {
+        m_Data.push_back((unsigned char)(0xc0 | (m_Run - 1))); // QOI_OP_RUN
+        m_Run = 0;
+      }
+      return;
+    }
+    if (m_Run > 0) {
+      m_Data.push_back((unsigned char)(0xc0 | (m_Run - 1)));
+      m_Run = 0;
+    }
+
+    const auto hash =
+        (pixel.r * 3 + pixel.g * 5 + pixel.b * 7 + pixel.a * 11) % 64;
+    if (m_Index[hash] == pixel) {
+      m_Data.push_back((unsigned char)hash); // QOI_OP_INDEX
+    } else {
+      m_Index[hash] = pixel;
+      if (pixel.a == m_Previous.a) {
+        const auto dr = (signed char)(pixel.r - m_Previous.r);
+        const auto dg = (signed char)(pixel.g - m_Previous.g);
+        const auto db = (signed char)(pixel.b - m_Previous.b);
+        const auto drdg = dr - dg;
+        const auto dbdg = db - dg;
+        if (dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 && db >= -2 &&
+            db <= 1) {
+          m_Data.push_back((unsigned char)(0x40 | (dr + 2) << 4 |
+                                           (dg + 2) << 2 |
+                                           (db + 2))); // QOI_OP_DIFF
+        } else if (dg >= -32 && dg <= 31 && drdg >= -8 && drdg <= 7 &&
+                   dbdg >= -8 && dbdg <= 7) {
+          m_Data.push_back((unsigned char)(0x80 | (dg + 32))); // QOI_OP_LUMA
+          m_Data.push_back((unsigned char)((drdg + 8) << 4 | (dbdg + 8)));
+        } else {
+          m_Data.insert(
+              std::end(m_Data), {0xfe, pixel.r, pixel.g, pixel.b}); // RGB
+        }
+      } else {
+        m_Data.insert(std::end(m_Data),
+            {0xff, pixel.r, pixel.g, pixel.b, pixel.a}); // RGBA
+      }
+    }
+    m_Previous = pixel;
+  }
+
+  Pixel m_Index[64];
+  Pixel m_Previous;
+  int m_Run = 0;
+  size_t m_PixelIndex = 0;
+  std::vector<unsigned char> m_Data;
+};
+
+class PPMRowEncoder : public RowEncoder
+{
+public:
+  using RowEncoder::RowEncoder;
+
+  void writeHeader(std::ostream &output) override
+  {
+    output << "P6\n" << m_Width << " " << m_Height << "\n255\n";
+  }
+
+  void writeRows(std::ostream &output, const unsigned char *pixels,
+      uint32_t rowCount) override
+  {
+    if (m_NumComponents == 3) {
+      output.write(reinterpret_cast<const char *>(pixels),
+          size_t(m_Width) * rowCount * 3);
+    } else {
+      std::vector<unsigned char> row(m_Width * 3);
+      for (uint32_t y = 0; y < rowCount; ++y) {
+        const auto *rowPixels = pixels + size_t(y) * m_Width * 4;
+        for (uint32_t x = 0; x < m_Width; ++x) {
+          std::copy_n(rowPixels + x * 4, 3, row.data() + x * 3);
+        }
+        output.write(reinterpret_cast<const char *>(row.data()), row.size());
+      }
+    }
+    m_RowIndex += rowCount;
+  }
+};
+
+// Single part scanline file without compression:
+// https://openexr.readthedocs.io/en/latest/OpenEXRFileLayout.html
+class EXRRowEncoder : public RowEncoder
+{
+public:
+  EXRRowEncoder(uint32_t width, uint32_t height, uint32_t numComponents) :
+      RowEncoder(width, height, numComponents),
+      // Channels are sorted by name, and so are the values of each scanline
+      m_Channels(numComponents == 4
+                     ? std::vector<std::pair<char, size_t>>{{'A', 3},
+                           {'B', 2}, {'G', 1}, {'R', 0}}
+                     : std::vector<std::pair<char, size_t>>{
+                           {'B', 2}, {'G', 1}, {'R', 0}})
+  {
+  }
+
+  void writeHeader(std::ostream &output) override
+  {
+    std::stringstream header;
+    writeValue(header, int32_t(20000630)); // Magic number
+    writeValue(header, int32_t(2));        // Version, single part scanline
+
+    const auto writeAttribute = [&](const char *name, const char *type,
+                                    int32_t size) {
+      header.write(name, std::strlen(name) + 1);
+      header.write(type, std::strlen(type) + 1);
+      writeValue(header, size);
+    };
+
+    writeAttribute("channels", "chlist", int32_t(m_Channels.size() * 18 + 1));
+    for (const auto &channel : m_Channels) {
+      header.put(channel.first);
+      header.put('\0');
+      writeValue(header, int32_t(1));  // HALF
+      writeValue(header, uint32_t(0)); // pLinear and reserved
+      writeValue(header, int32_t(1));  // xSampling
+      writeValue(header, int32_t(1));  // ySampling
+    }
+    header.put('\0');
+
+    writeAttribute("compression", "compression", 1);
+    header.put(0); // NO_COMPRESSION
+    for (const auto name : {"dataWindow", "displayWindow"}) {
+      writeAttribute(name, "box2i", 16);
+      writeValue(header, int32_t(0));
+      writeValue(header, int32_t(0));
+      writeValue(header, int32_t(m_Width) - 1);
+      writeValue(header, int32_t(m_Height) - 1);
+    }
+    writeAttribute("lineOrder", "lineOrder", 1);
+    header.put(0); // INCREASING_Y
+    writeAttribute("pixelAspectRatio", "float", 4);
+    writeValue(header, 1.f);
+    writeAttribute("screenWindowCenter", "v2f", 8);
+    writeValue(header, 0.f);
+    writeValue(header, 0.f);
+    writeAttribute("screenWindowWidth", "float", 4);
+    writeValue(header, 1.f);
+    header.put('\0');
+
+    const auto headerData = header.str();
+    output.write(headerData.data(), headerData.size());
+
+    // Offset table, one scanline per chunk
+    const auto chunkSize = uint64_t(8 + scanlineSize());
+    const auto firstChunk = uint64_t(headerData.size()) + m_Height * 8;
+    for (uint32_t y = 0; y < m_Height; ++y) {
+      writeValue(output, firstChunk + y * chunkSize);
+    }
+  }
+
+  void writeRows(std::ostream &output, const unsigned char *pixels,
+      uint32_t rowCount) override
+  {
+    encodeRows(output, pixels, rowCount);
+  }
+
+  void writeFloatRows(
+      std::ostream &output, const float *pixels, uint32_t rowCount) override
+  {
+    encodeRows(output, pixels, rowCount);
+  }
+
+private:
+  template <typename Component>
+  void encodeRows(
+      std::ostream &output, const Component *pixels, uint32_t rowCount)
+  {
+    std::vector<uint16_t> scanline(m_Width * m_Channels.size());
+    for (uint32_t y = 0; y < rowCount; ++y, ++m_RowIndex) {
+      const auto *rowPixels = pixels + size_t(y) * m_Width * m_NumComponents;
+      for (size_t c = 0; c < m_Channels.size(); ++c) {
+        const auto component = m_Channels[c].second;
+        for (uint32_t x = 0; x < m_Width; ++x) {
+          const auto value = rowPixels[x * m_NumComponents + component];
+          scanline[c * m_Width + x] = glm::packHalf1x16(
+              component == 3 ? toAlpha(value) : toLinear(value));
+        }
+      }
+      writeValue(output, int32_t(m_RowIndex));
+      writeValue(output, scanlineSize());
+      output.write(reinterpret_cast<const char *>(scanline.data()),
+          scanline.size() * sizeof(uint16_t));
+    }
+  }
+
+  int32_t scanlineSize() const
+  {
+    return int32_t(m_Width * m_Channels.size() * sizeof(uint16_t));
+  }
+
+  std::vector<std::pair<char, size_t>> m_Channels; // Name, component
+};
+
+} // namespace
+
+ImageFileFormat getImageFileFormat(const fs::path &path)
+{
+  auto extension = path.extension().string();
+  std::transform(begin(extension), end(extension), begin(extension),
+      [](unsigned char c) { return char(std::tolower(c)); });
+  if (extension == ".qoi") {
+    return ImageFileFormat::QOI;
+  }
+  if (extension == ".ppm") {
+    return ImageFileFormat::PPM;
+  }
+  if (extension == ".pfm") {
+    return ImageFileFormat::PFM;
+  }
+  if (extension == ".exr") {
+    return ImageFileFormat::EXR;
+  }
+  return ImageFileFormat::PNG;
+}
+
+bool isFloatImageFileFormat(ImageFileFormat format)
+{
+  return format == ImageFileFormat::PFM || format == ImageFileFormat::EXR;
+}
+
+void writeImageFile(const fs::path &path, Image &image)
+{
+  const auto isFloat = !image.floatPixels.empty();
+  const auto size = size_t(image.width) * image.height * image.numComponents;
+  if ((isFloat ? image.floatPixels.size() : image.pixels.size()) != size) {
+    throw std::runtime_error("Image size does not match its pixels");
+  }
+  const auto format = getImageFileFormat(path);
+  if (isFloat && !isFloatImageFileFormat(format)) {
+    std::stringstream ss;
+    ss << "Unable to write float pixels to " << path;
+    throw std::runtime_error(ss.str());
+  }
+  switch (format) {
+  case ImageFileFormat::PNG:
+    writePNG(path, image);
+    break;
+  case ImageFileFormat::PFM:
+    orderRows(image, true); // PFM stores rows from bottom to top
+    if (isFloat) {
+      writePFM(path, image, image.floatPixels.data());
+    } else {
+      writePFM(path, image, image.pixels.data());
+    }
+    break;
+  default: {
+    // The other formats are written by rows
+    orderRows(image, false);
+    ImageRowWriter writer{path, image.width, image.height, image.numComponents};
+    if (isFloat) {
+      writer.writeRows(image.floatPixels.data(), image.height);
+    } else {
+      writer.writeRows(image.pixels.data(), image.height);
+    }
+    writer.finish();
+  } break;
+  }
+}
+
+ImageRowWriter::ImageRowWriter(const fs::path &path, uint32_t width,
+    uint32_t height, uint32_t numComponents) :
+    m_Path(path),
+    m_Height(height)
+{
+  switch (getImageFileFormat(path)) {
+  case ImageFileFormat::PNG:
+    m_pEncoder = std::make_unique<PNGRowEncoder>(width, height, numComponents);
+    break;
+  case ImageFileFormat::QOI:
+    m_pEncoder = std::make_unique<QOIRowEncoder>(width, height, numComponents);
+    break;
+  case ImageFileFormat::PPM:
+    m_pEncoder = std::make_unique<PPMRowEncoder>(width, height, numComponents);
+    break;
+  case ImageFileFormat::EXR:
+    m_pEncoder = std::make_unique<EXRRowEncoder>(width, height, numComponents);
+    break;
+  case ImageFileFormat::PFM: {
+    std::stringstream ss;
+    ss << "Unable to write " << path
+       << " by rows: PFM stores rows from bottom to top";
+    throw std::runtime_error(ss.str());
+  }
+  }
+  m_Output = openOutput(path);
+  m_pEncoder->writeHeader(m_Output);
+}
+
+ImageRowWriter::~ImageRowWriter() = default;
+
+void ImageRowWriter::writeRows(const unsigned char *pixels, uint32_t rowCount)
+{
+  if (m_RowCount + rowCount > m_Height) {
+    throw std::runtime_error("Too many rows written to " + m_Path.string());
+  }
+  m_pEncoder->writeRows(m_Output, pixels, rowCount);
+  m_RowCount += rowCount;
+}
+
+void ImageRowWriter::writeRows(const float *pixels, uint32_t rowCount)
+{
+  if (m_RowCount + rowCount > m_Height) {
+    throw std::runtime_error("Too many rows written to " + m_Path.string());
+  }
+  m_pEncoder->writeFloatRows(m_Output, pixels, rowCount);
+  m_RowCount += rowCount;
+}
+
+void ImageRowWriter::finish()
+{
+  if (m_RowCount != m_Height) {
+    std::stringstream ss;
+    ss << "Missing rows in " << m_Path << ": " << m_RowCount << " of "
+       << m_Height << " written";
+    throw std::runtime_error(ss.str());
+  }
+  m_pEncoder->writeFooter(m_Output);
+  m_Output.flush();
+  checkOutput(m_Output, m_Path);
+  m_Output.close();
+}
+
+ImageWriter::ImageWriter(
+    size_t threadCount, size_t queueCapacity, int pngCompressionLevel)
+{
+  stbi_write_png_compression_level = pngCompressionLevel;
+  if (!threadCount) {
+    threadCount = std::max(1u, std::thread::hardware_concurrency());
+  }
+  m_QueueCapacity = queueCapacity ? queueCapacity : 2 * threadCount;
+  for (size_t i = 0; i < threadCount; ++i) {
+    m_Threads.emplace_back([this]() { runWorker(); });
+  }
+}
+
+ImageWriter::~ImageWriter()
+{
+  {
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    m_Stop = true;
+  }
+  m_TaskAvailable.notify_all();
+  for (auto &thread : m_Threads) {
+    thread.join();
+  }
+}
+
+void ImageWriter::write(fs::path path, Image image)
+{
+  {
+    std::unique_lock<std::mutex> lock(m_Mutex);
+    m_TaskDone.wait(lock, [&]() { return m_Queue.size() < m_QueueCapacity; });
+    m_Queue.push_back(Task{std::move(path), std::move(image)});
+  }
+  m_TaskAvailable.notify_one();
+}
+
+size_t ImageWriter::finish()
+{
+  std::unique_lock<std::mutex> lock(m_Mutex);
+  m_TaskDone.wait(lock, [&]() { return m_Queue.empty() && !m_RunningCount; });
+  return m_FailureCount;
+}
+
+void ImageWriter::runWorker()
+{
+  setTraceThreadName("Image writer");
+  for (;;) {
+    Task task;
+    {
+      std::unique_lock<std::mutex> lock(m_Mutex);
+      // Remaining images are written before stopping
+      m_TaskAvailable.wait(lock, [&]() { return m_Stop || !m_Queue.empty(); });
+      if (m_Queue.empty()) {
+        break;
+      }
+      task = std::move(m_Queue.front());
+      m_Queue.pop_front();
+      ++m_RunningCount;
+    }
+    m_TaskDone.notify_all(); // A slot is available
+
+    bool failed = false;
+    try {
+      TraceScope trace{"Image encode"};
+      writeImageFile(task.path, task.image);
+    } catch (const std::exception &e) {
+      std::cerr << e.what() << std::endl;
+      failed = true;
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(m_Mutex);
+      --m_RunningCount;
+      m_FailureCount += failed;
+    }
+    m_TaskDone.notify_all();
+  }
+}
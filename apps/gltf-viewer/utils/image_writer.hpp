@@ -0,0 +1,137 @@
+#pragma once
+
+#include "filesystem.hpp"
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Image as read back from the GPU, with 8 bits or float components
+struct Image
+{
+  uint32_t width = 0;
+  uint32_t height = 0;
+  uint32_t numComponents = 3; // 3 for RGB, 4 for RGBA
+  std::vector<unsigned char> pixels;
+  // Float components instead of pixels, as written by the shaders (gamma
+  // encoded) without clamping. Only for float file formats.
+  std::vector<float> floatPixels;
+  bool bottomUp = true; // Rows from bottom to top (OpenGL convention)
+};
+
+// File formats, chosen by the extension of the output path
+enum class ImageFileFormat
+{
+  PNG, // .png and unknown extensions
+  QOI, // .qoi, lossless and much faster to encode than PNG
+  PPM, // .ppm, raw binary RGB
+  PFM, // .pfm, raw 32 bits float RGB
+  EXR  // .exr, uncompressed 16 bits float channels
+};
+
+ImageFileFormat getImageFileFormat(const fs::path &path);
+
+// Whether format stores float components, and should be rendered in a float
+// target to keep values above 1 and the precision of dark values
+bool isFloatImageFileFormat(ImageFileFormat format);
+
+// Encode image and write it to path in the format of its extension. Throw
+// std::runtime_error on failure. image is modified (rows may be flipped).
+//
+// Float formats (PFM, EXR) store linear values: the components are decoded
+// with the gamma 2.2 applied by the shaders (except alpha). 8 bits formats
+// are not written from float pixels.
+void writeImageFile(const fs::path &path, Image &image);
+
+class RowEncoder;
+
+// Write an image a few rows at a time, from top to bottom, so that it never
+// has to be held whole in memory. Throw std::runtime_error on failure.
+//
+// PFM is not supported (its rows go from bottom to top). PNG files are not
+// compressed, because stb_image_write only compresses whole images: QOI is
+// smaller and as fast to write.
+class ImageRowWriter
+{
+public:
+  ImageRowWriter(const fs::path &path, uint32_t width, uint32_t height,
+      uint32_t numComponents);
+  ~ImageRowWriter();
+
+  ImageRowWriter(const ImageRowWriter &) = delete;
+  ImageRowWriter &operator=(const ImageRowWriter &) = delete;
+
+  // pixels holds rowCount rows of width * numComponents bytes, without padding
+  void writeRows(const unsigned char *pixels, uint32_t rowCount);
+  // Same with float components, for float formats only (see Image)
+  void writeRows(const float *pixels, uint32_t rowCount);
+
+  // Complete the file, once all rows have been written
+  void finish();
+
+private:
+  fs::path m_Path;
+  uint32_t m_Height;
+  uint32_t m_RowCount = 0;
+  std::unique_ptr<RowEncoder> m_pEncoder;
+  std::ofstream m_Output;
+};
+
+// Pool of threads encoding and writing images, so that rendering is not
+// blocked by PNG compression.
+//
+// Images wait in a bounded queue: write() blocks while it is full, which
+// keeps the renderer from getting ahead of the encoders and holding every
+// frame in memory.
+class ImageWriter
+{
+public:
+  // threadCount = 0 uses one thread per hardware thread, queueCapacity = 0
+  // allows two waiting images per thread.
+  //
+  // pngCompressionLevel is the zlib level of stb_image_write (default 8):
+  // lower is faster and bigger. It is a global setting of stb_image_write.
+  explicit ImageWriter(size_t threadCount = 0, size_t queueCapacity = 0,
+      int pngCompressionLevel = 8);
+
+  // Write the remaining images
+  ~ImageWriter();
+
+  ImageWriter(const ImageWriter &) = delete;
+  ImageWriter &operator=(const ImageWriter &) = delete;
+
+  // Queue image to be written to path, wait if the queue is full
+  void write(fs::path path, Image image);
+
+  // Wait for all queued images, and return the number of images that could
+  // not be written since the creation of the writer (errors are logged on
+  // std::cerr)
+  size_t finish();
+
+  size_t threadCount() const { return m_Threads.size(); }
+
+private:
+  struct Task
+  {
+    fs::path path;
+    Image image;
+  };
+
+  void runWorker();
+
+  std::vector<std::thread> m_Threads;
+  size_t m_QueueCapacity;
+
+  std::mutex m_Mutex;
+  std::condition_variable m_TaskAvailable; // Or m_Stop
+  std::condition_variable m_TaskDone;      // Or queue slot available
+  std::deque<Task> m_Queue;
+  size_t m_RunningCount = 0;
+  size_t m_FailureCount = 0;
+  bool m_Stop = false;
+};
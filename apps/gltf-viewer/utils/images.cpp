@@ -1,78 +1,535 @@
 #include "images.hpp"
 
+#include "shaders.hpp"
+
+#include <algorithm>
 #include <cassert>
 #include <glad/glad.h>
 #include <iostream>
 
-void renderToImage(size_t width, size_t height, size_t numComponents,
-    unsigned char *outPixels, std::function<void()> drawScene)
+namespace
 {
-  GLint previousTextureObject = 0;
-  GLint previousFramebufferObject = 0;
+
+void checkDrawFramebuffer(GLuint framebufferObject)
+{
+  GLint currentlyBoundFBO = 0;
+  glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &currentlyBoundFBO);
+  if (GLuint(currentlyBoundFBO) != framebufferObject) {
+    // Display a warning on clog
+    // It may not be an error because the drawScene() function might have render
+    // to the framebuffer but unbound it after.
+    std::clog
+        << "Warning: renderToImage - GL_DRAW_FRAMEBUFFER_BINDING has "
+           "changed during drawScene. It might lead to unexpected behavior."
+        << std::endl;
+  }
+}
+
+// Draw the scene in target once per pass of target
+void drawPasses(OffscreenTarget &target, const std::function<void()> &drawScene)
+{
+  for (size_t pass = 0; pass < target.passCount(); ++pass) {
+    target.bindForDrawing();
+    drawScene();
+    checkDrawFramebuffer(target.drawFramebuffer());
+    target.accumulate();
+  }
+}
+
+GLenum getInternalFormat(OffscreenTarget::ColorFormat format)
+{
+  switch (format) {
+  case OffscreenTarget::ColorFormat::RGBA8:
+    return GL_RGBA8;
+  case OffscreenTarget::ColorFormat::SRGB8_ALPHA8:
+    return GL_SRGB8_ALPHA8;
+  case OffscreenTarget::ColorFormat::RGBA16F:
+    return GL_RGBA16F;
+  }
+  return GL_RGBA8;
+}
+
+// Framebuffer bindings saved on construction and restored on destruction
+struct FramebufferBindingsGuard
+{
+  GLint drawFramebuffer = 0;
+  GLint readFramebuffer = 0;
+
+  FramebufferBindingsGuard()
+  {
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &drawFramebuffer);
+    glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &readFramebuffer);
+  }
+
+  ~FramebufferBindingsGuard()
+  {
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, drawFramebuffer);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, readFramebuffer);
+  }
+};
+
+} // namespace
+
+std::vector<ImageTile> splitImage(
+    GLsizei width, GLsizei height, GLsizei tileSize)
+{
+  std::vector<ImageTile> tiles;
+  for (GLsizei y = 0; y < height; y += tileSize) {
+    for (GLsizei x = 0; x < width; x += tileSize) {
+      tiles.push_back(ImageTile{
+          x, y, std::min(tileSize, width - x), std::min(tileSize, height - y)});
+    }
+  }
+  return tiles;
+}
+
+glm::mat4 computeTileMatrix(GLsizei width, GLsizei height, ImageTile tile)
+{
+  // Scale the normalized device coordinates of the tile, [-1 + 2 * x / width,
+  // -1 + 2 * (x + tile.width) / width] on x, to [-1, 1]. Applied in clip
+  // space, it commutes with the perspective division.
+  const auto scaleX = float(width) / tile.width;
+  const auto scaleY = float(height) / tile.height;
+  glm::mat4 matrix(1);
+  matrix[0][0] = scaleX;
+  matrix[1][1] = scaleY;
+  matrix[3][0] = scaleX - 1.f - 2.f * tile.x / tile.width;
+  matrix[3][1] = scaleY - 1.f - 2.f * tile.y / tile.height;
+  return matrix;
+}
+
+OffscreenTarget::OffscreenTarget(ColorFormat format, GLsizei samples) :
+    m_Format(format)
+{
+  setFormat(format, samples);
+}
+
+OffscreenTarget::~OffscreenTarget()
+{
+  release();
+  glDeleteVertexArrays(1, &m_EmptyVertexArray);
+}
+
+void OffscreenTarget::resize(GLsizei width, GLsizei height)
+{
+  if (width == m_Width && height == m_Height) {
+    return;
+  }
+  m_Width = width;
+  m_Height = height;
+  allocate();
+}
+
+void OffscreenTarget::setFormat(ColorFormat format, GLsizei samples)
+{
+  GLint maxSamples = 1;
+  GLint maxTextureSamples = 1;
+  glGetIntegerv(GL_MAX_SAMPLES, &maxSamples);
+  glGetIntegerv(GL_MAX_COLOR_TEXTURE_SAMPLES, &maxTextureSamples);
+  samples = std::max(
+      1, std::min({samples, GLsizei(maxSamples), GLsizei(maxTextureSamples)}));
+  if (format == m_Format && samples == m_Samples && m_Framebuffer) {
+    return;
+  }
+  m_Format = format;
+  m_Samples = samples;
+  if (m_Width && m_Height) {
+    allocate();
+  }
+}
+
+void OffscreenTarget::bindForDrawing() const
+{
+  glBindFramebuffer(GL_DRAW_FRAMEBUFFER,
+      m_Samples > 1 ? m_MultisampleFramebuffer : m_Framebuffer);
+}
+
+void OffscreenTarget::setPassCount(size_t passCount)
+{
+  passCount = std::max<size_t>(passCount, 1);
+  if (passCount == m_PassCount) {
+    return;
+  }
+  m_PassCount = passCount;
+  m_Pass = 0;
+  if (m_Width && m_Height) {
+    allocate();
+  }
+}
+
+glm::vec2 OffscreenTarget::jitter() const
+{
+  if (m_PassCount == 1) {
+    return glm::vec2(0);
+  }
+  // Halton sequence of bases 2 and 3, well distributed for any pass count
+  const auto halton = [](size_t index, size_t base) {
+    auto fraction = 1.f;
+    auto result = 0.f;
+    for (; index > 0; index /= base) {
+      fraction /= base;
+      result += fraction * (index % base);
+    }
+    return result;
+  };
+  return glm::vec2(halton(m_Pass + 1, 2), halton(m_Pass + 1, 3)) - 0.5f;
+}
+
+void OffscreenTarget::accumulate()
+{
+  if (m_PassCount == 1) {
+    return;
+  }
+
+  if (!m_pAccumulateProgram) {
+    // Full screen triangle adding the pass to the sum, through blending
+    m_pAccumulateProgram = std::make_unique<GLProgram>(buildProgram(
+        R"(#version 330
+void main()
+{
+  vec2 position = vec2(gl_VertexID == 1 ? 3 : -1, gl_VertexID == 2 ? 3 : -1);
+  gl_Position = vec4(position, 0, 1);
+}
+)",
+        R"(#version 330
+uniform sampler2D uPass;
+out vec4 fColor;
+void main() { fColor = texelFetch(uPass, ivec2(gl_FragCoord.xy), 0); }
+)"));
+    glGenVertexArrays(1, &m_EmptyVertexArray);
+  }
+
+  // The pass is then in m_ColorTexture
+  resolve();
 
   // Save previous GL state that we will change in order to put it back after
-  glGetIntegerv(GL_TEXTURE_BINDING_2D, &previousTextureObject);
-  glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &previousFramebufferObject);
+  GLint previousProgram = 0, previousVertexArray = 0, previousTexture = 0,
+        previousActiveTexture = 0;
+  GLint blendSrcRGB = 0, blendDstRGB = 0, blendSrcAlpha = 0, blendDstAlpha = 0;
+  GLfloat blendColor[4];
+  const auto blend = glIsEnabled(GL_BLEND);
+  const auto depthTest = glIsEnabled(GL_DEPTH_TEST);
+  glGetIntegerv(GL_CURRENT_PROGRAM, &previousProgram);
+  glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &previousVertexArray);
+  glGetIntegerv(GL_ACTIVE_TEXTURE, &previousActiveTexture);
+  glActiveTexture(GL_TEXTURE0);
+  glGetIntegerv(GL_TEXTURE_BINDING_2D, &previousTexture);
+  glGetIntegerv(GL_BLEND_SRC_RGB, &blendSrcRGB);
+  glGetIntegerv(GL_BLEND_DST_RGB, &blendDstRGB);
+  glGetIntegerv(GL_BLEND_SRC_ALPHA, &blendSrcAlpha);
+  glGetIntegerv(GL_BLEND_DST_ALPHA, &blendDstAlpha);
+  glGetFloatv(GL_BLEND_COLOR, blendColor);
 
-  GLuint textureObject = 0;
+  glBindFramebuffer(GL_DRAW_FRAMEBUFFER, m_AccumulationFramebuffer);
+  if (m_Pass == 0) {
+    const GLfloat zero[4] = {0, 0, 0, 0};
+    glClearBufferfv(GL_COLOR, 0, zero);
+  }
+  glViewport(0, 0, m_Width, m_Height);
+  glDisable(GL_DEPTH_TEST);
+  glEnable(GL_BLEND);
+  glBlendColor(0, 0, 0, 1.f / m_PassCount);
+  glBlendFunc(GL_CONSTANT_ALPHA, GL_ONE);
+  m_pAccumulateProgram->use();
+  glUniform1i(m_pAccumulateProgram->getUniformLocation("uPass"), 0);
+  glBindTexture(GL_TEXTURE_2D, m_ColorTexture);
+  glBindVertexArray(m_EmptyVertexArray);
+  glDrawArrays(GL_TRIANGLES, 0, 3);
 
-  glGenTextures(1, &textureObject);
+  glBindVertexArray(previousVertexArray);
+  glBindTexture(GL_TEXTURE_2D, previousTexture);
+  glActiveTexture(previousActiveTexture);
+  glUseProgram(previousProgram);
+  glBlendFuncSeparate(blendSrcRGB, blendDstRGB, blendSrcAlpha, blendDstAlpha);
+  glBlendColor(blendColor[0], blendColor[1], blendColor[2], blendColor[3]);
+  if (!blend) {
+    glDisable(GL_BLEND);
+  }
+  if (depthTest) {
+    glEnable(GL_DEPTH_TEST);
+  }
 
-  glBindTexture(GL_TEXTURE_2D, textureObject);
+  m_Pass = (m_Pass + 1) % m_PassCount;
+}
 
-  // Lets avoid warnings
-  const auto w = GLsizei(width);
-  const auto h = GLsizei(height);
+void OffscreenTarget::bindForReading() const
+{
+  if (m_PassCount > 1) {
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, m_AccumulationFramebuffer);
+    glReadBuffer(GL_COLOR_ATTACHMENT0);
+    return;
+  }
+  resolve();
+  glBindFramebuffer(GL_READ_FRAMEBUFFER, m_Framebuffer);
+  glReadBuffer(GL_COLOR_ATTACHMENT0);
+}
 
-  // if we want better quality, we can use multisampling, but for testing
-  // purpose it is useless todo replace with glTexStorage2DMultisample (in that
-  // case need to todo glBlitFramebuffer in another one in order to be able to
-  // glGetTexImage)
-  // https://stackoverflow.com/questions/14019910/how-does-glteximage2dmultisample-work
-  glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA32F, w, h);
+void OffscreenTarget::resolve() const
+{
+  if (m_Samples > 1) {
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, m_MultisampleFramebuffer);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, m_Framebuffer);
+    glBlitFramebuffer(0, 0, m_Width, m_Height, 0, 0, m_Width, m_Height,
+        GL_COLOR_BUFFER_BIT, GL_NEAREST);
+  }
+}
 
-  GLuint depthTexture;
-  glGenTextures(1, &depthTexture);
+void OffscreenTarget::allocate()
+{
+  release();
 
-  glBindTexture(GL_TEXTURE_2D, depthTexture);
+  GLint previousTextureObject = 0;
+  GLint previousRenderbuffer = 0;
+  glGetIntegerv(GL_TEXTURE_BINDING_2D, &previousTextureObject);
+  glGetIntegerv(GL_RENDERBUFFER_BINDING, &previousRenderbuffer);
+  const FramebufferBindingsGuard bindingsGuard;
 
-  glTexStorage2D(GL_TEXTURE_2D, 1, GL_DEPTH_COMPONENT32F, w, h);
+  const auto internalFormat = getInternalFormat(m_Format);
 
+  glGenTextures(1, &m_ColorTexture);
+  glBindTexture(GL_TEXTURE_2D, m_ColorTexture);
+  glTexStorage2D(GL_TEXTURE_2D, 1, internalFormat, m_Width, m_Height);
   glBindTexture(GL_TEXTURE_2D, previousTextureObject);
 
-  GLuint framebufferObject = 0;
-  glGenFramebuffers(1, &framebufferObject);
-  glBindFramebuffer(GL_DRAW_FRAMEBUFFER, framebufferObject);
-
-  glFramebufferTexture(
-      GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, textureObject, 0);
+  glGenFramebuffers(1, &m_Framebuffer);
+  glBindFramebuffer(GL_DRAW_FRAMEBUFFER, m_Framebuffer);
   glFramebufferTexture(
-      GL_DRAW_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, depthTexture, 0);
+      GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, m_ColorTexture, 0);
+
+  if (m_Samples > 1) {
+    // The single sampled framebuffer only receives the resolved colors
+    glGenTextures(1, &m_MultisampleColor);
+    glBindTexture(GL_TEXTURE_2D_MULTISAMPLE, m_MultisampleColor);
+    glTexStorage2DMultisample(GL_TEXTURE_2D_MULTISAMPLE, m_Samples,
+        internalFormat, m_Width, m_Height, GL_TRUE);
+    glBindTexture(GL_TEXTURE_2D_MULTISAMPLE, 0);
+
+    glGenRenderbuffers(1, &m_MultisampleDepth);
+    glBindRenderbuffer(GL_RENDERBUFFER, m_MultisampleDepth);
+    glRenderbufferStorageMultisample(GL_RENDERBUFFER, m_Samples,
+        GL_DEPTH_COMPONENT32F, m_Width, m_Height);
+
+    glGenFramebuffers(1, &m_MultisampleFramebuffer);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, m_MultisampleFramebuffer);
+    glFramebufferTexture(
+        GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, m_MultisampleColor, 0);
+    glFramebufferRenderbuffer(GL_DRAW_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
+        GL_RENDERBUFFER, m_MultisampleDepth);
+  } else {
+    glGenRenderbuffers(1, &m_DepthRenderbuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, m_DepthRenderbuffer);
+    glRenderbufferStorage(
+        GL_RENDERBUFFER, GL_DEPTH_COMPONENT32F, m_Width, m_Height);
+    glFramebufferRenderbuffer(GL_DRAW_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
+        GL_RENDERBUFFER, m_DepthRenderbuffer);
+  }
+  glBindRenderbuffer(GL_RENDERBUFFER, previousRenderbuffer);
 
   GLenum drawBuffers[1] = {GL_COLOR_ATTACHMENT0};
   glDrawBuffers(1, drawBuffers);
 
   const auto framebufferStatus = glCheckFramebufferStatus(GL_DRAW_FRAMEBUFFER);
   assert(framebufferStatus == GL_FRAMEBUFFER_COMPLETE);
+  (void)framebufferStatus;
 
-  drawScene();
+  if (m_PassCount > 1) {
+    // Sum of the passes, 8 bits would not be enough precision
+    glGenTextures(1, &m_AccumulationTexture);
+    glBindTexture(GL_TEXTURE_2D, m_AccumulationTexture);
+    glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA32F, m_Width, m_Height);
+    glBindTexture(GL_TEXTURE_2D, previousTextureObject);
 
-  GLint currentlyBoundFBO = 0;
-  glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &currentlyBoundFBO);
-  if (currentlyBoundFBO != framebufferObject) {
-    // Display a warning on clog
-    // It may not be an error because the drawScene() function might have render
-    // to the framebuffer but unbound it after.
-    std::clog
-        << "Warning: renderToImage - GL_DRAW_FRAMEBUFFER_BINDING has "
-           "changed during drawScene. It might lead to unexpected behavior."
-        << std::endl;
+    glGenFramebuffers(1, &m_AccumulationFramebuffer);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, m_AccumulationFramebuffer);
+    glFramebufferTexture(
+        GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, m_AccumulationTexture, 0);
   }
+}
 
-  glBindTexture(GL_TEXTURE_2D, textureObject);
-  glGetTexImage(GL_TEXTURE_2D, 0, numComponents == 3 ? GL_RGB : GL_RGBA,
-      GL_UNSIGNED_BYTE, outPixels);
+// GL defers the deletion of objects still used by queued commands, so this
+// can be called right after queuing a readback of the target
+void OffscreenTarget::release()
+{
+  glDeleteFramebuffers(1, &m_AccumulationFramebuffer);
+  glDeleteTextures(1, &m_AccumulationTexture);
+  m_AccumulationFramebuffer = m_AccumulationTexture = 0;
+  glDeleteFramebuffers(1, &m_MultisampleFramebuffer);
+  glDeleteRenderbuffers(1, &m_MultisampleDepth);
+  glDeleteTextures(1, &m_MultisampleColor);
+  glDeleteFramebuffers(1, &m_Framebuffer);
+  glDeleteRenderbuffers(1, &m_DepthRenderbuffer);
+  glDeleteTextures(1, &m_ColorTexture);
+  m_MultisampleFramebuffer = m_MultisampleDepth = m_MultisampleColor = 0;
+  m_Framebuffer = m_DepthRenderbuffer = m_ColorTexture = 0;
+}
 
-  glBindTexture(GL_TEXTURE_2D, previousTextureObject);
-  glBindFramebuffer(GL_DRAW_FRAMEBUFFER, previousFramebufferObject);
-}
\ No newline at end of file
+namespace
+{
+
+GLsizeiptr getComponentSize(GLenum type)
+{
+  return type == GL_FLOAT ? sizeof(GLfloat) : sizeof(GLubyte);
+}
+
+// renderToImage() reading components of type
+void renderAndReadPixels(OffscreenTarget &target, size_t width, size_t height,
+    size_t numComponents, GLenum type, void *outPixels,
+    const std::function<void()> &drawScene)
+{
+  GLint previousPackAlignment = 0;
+
+  // Save previous GL state that we will change in order to put it back after
+  const FramebufferBindingsGuard bindingsGuard;
+  glGetIntegerv(GL_PACK_ALIGNMENT, &previousPackAlignment);
+
+  target.resize(GLsizei(width), GLsizei(height));
+  drawPasses(target, drawScene);
+  target.bindForReading();
+
+  // Rows of outPixels are not padded
+  glPixelStorei(GL_PACK_ALIGNMENT, 1);
+  glReadPixels(0, 0, GLsizei(width), GLsizei(height),
+      numComponents == 3 ? GL_RGB : GL_RGBA, type, outPixels);
+  glPixelStorei(GL_PACK_ALIGNMENT, previousPackAlignment);
+}
+
+} // namespace
+
+void renderToImage(OffscreenTarget &target, size_t width, size_t height,
+    size_t numComponents, unsigned char *outPixels,
+    std::function<void()> drawScene)
+{
+  renderAndReadPixels(target, width, height, numComponents, GL_UNSIGNED_BYTE,
+      outPixels, drawScene);
+}
+
+void renderToImage(OffscreenTarget &target, size_t width, size_t height,
+    size_t numComponents, float *outPixels, std::function<void()> drawScene)
+{
+  renderAndReadPixels(
+      target, width, height, numComponents, GL_FLOAT, outPixels, drawScene);
+}
+
+void renderToImage(size_t width, size_t height, size_t numComponents,
+    unsigned char *outPixels, std::function<void()> drawScene)
+{
+  OffscreenTarget target;
+  renderToImage(
+      target, width, height, numComponents, outPixels, std::move(drawScene));
+}
+
+void renderToTarget(OffscreenTarget &target, size_t width, size_t height,
+    const std::function<void()> &drawScene)
+{
+  // Save previous GL state that we will change in order to put it back after
+  const FramebufferBindingsGuard bindingsGuard;
+
+  target.resize(GLsizei(width), GLsizei(height));
+  drawPasses(target, drawScene);
+  target.bindForReading();
+}
+
+void renderToImageAsync(OffscreenTarget &target, size_t width, size_t height,
+    size_t numComponents, GLenum type, PixelReadbackRing &ring,
+    std::function<void()> drawScene, PixelReadbackRing::Consumer consumer)
+{
+  // Save previous GL state that we will change in order to put it back after
+  const FramebufferBindingsGuard bindingsGuard;
+
+  target.resize(GLsizei(width), GLsizei(height));
+  drawPasses(target, drawScene);
+  target.bindForReading();
+  ring.readPixels(GLsizei(width), GLsizei(height), numComponents, type,
+      std::move(consumer));
+}
+
+PixelReadbackRing::PixelReadbackRing(size_t bufferCount) :
+    m_Slots(std::max<size_t>(bufferCount, 1))
+{
+  for (auto &slot : m_Slots) {
+    glGenBuffers(1, &slot.buffer);
+  }
+}
+
+PixelReadbackRing::~PixelReadbackRing()
+{
+  flush();
+  for (auto &slot : m_Slots) {
+    glDeleteBuffers(1, &slot.buffer);
+  }
+}
+
+void PixelReadbackRing::readPixels(GLsizei width, GLsizei height,
+    size_t numComponents, GLenum type, Consumer consumer)
+{
+  if (m_PendingCount == m_Slots.size()) {
+    consumeOldest(true);
+  }
+
+  auto &slot = m_Slots[(m_Oldest + m_PendingCount) % m_Slots.size()];
+  slot.size =
+      GLsizeiptr(width) * height * numComponents * getComponentSize(type);
+  slot.consumer = std::move(consumer);
+
+  GLint previousPackAlignment = 0;
+  glGetIntegerv(GL_PACK_ALIGNMENT, &previousPackAlignment);
+
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+  if (slot.capacity < slot.size) {
+    glBufferData(GL_PIXEL_PACK_BUFFER, slot.size, nullptr, GL_STREAM_READ);
+    slot.capacity = slot.size;
+  }
+  glPixelStorei(GL_PACK_ALIGNMENT, 1);
+  glReadPixels(0, 0, width, height, numComponents == 3 ? GL_RGB : GL_RGBA,
+      type, nullptr);
+  glPixelStorei(GL_PACK_ALIGNMENT, previousPackAlignment);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+  slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  // Make sure the GPU starts working on it even if nothing else is submitted
+  glFlush();
+  ++m_PendingCount;
+}
+
+void PixelReadbackRing::poll()
+{
+  while (m_PendingCount > 0 && consumeOldest(false)) {
+  }
+}
+
+void PixelReadbackRing::flush()
+{
+  while (m_PendingCount > 0) {
+    consumeOldest(true);
+  }
+}
+
+bool PixelReadbackRing::consumeOldest(bool wait)
+{
+  auto &slot = m_Slots[m_Oldest];
+
+  const auto status = glClientWaitSync(slot.fence,
+      wait ? GL_SYNC_FLUSH_COMMANDS_BIT : 0,
+      wait ? GL_TIMEOUT_IGNORED : 0);
+  if (status == GL_TIMEOUT_EXPIRED) {
+    return false;
+  }
+  glDeleteSync(slot.fence);
+  slot.fence = nullptr;
+
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+  const auto *pixels =
+      glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, slot.size, GL_MAP_READ_BIT);
+  if (pixels) {
+    slot.consumer(pixels);
+    glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+  } else {
+    std::cerr << "Unable to map pixel pack buffer" << std::endl;
+  }
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+  slot.consumer = nullptr;
+  m_Oldest = (m_Oldest + 1) % m_Slots.size();
+  --m_PendingCount;
+  return true;
+}
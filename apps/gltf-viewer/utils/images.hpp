@@ -1,30 +1,233 @@
 #pragma once
 
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <cstring>
 #include <functional>
+#include <memory>
+#include <vector>
+
+class GLProgram;
 
+// Reverse the order of the rows of an image, one row at a time with memcpy
 template <typename ComponentType>
 void flipImageYAxis(
     size_t width, size_t height, size_t numComponent, ComponentType *pixels)
 {
+  const auto rowLength = width * numComponent;
+  const auto rowSize = rowLength * sizeof(ComponentType);
+  std::vector<ComponentType> row(rowLength);
+
   auto *pFirstLine = pixels;
-  auto *pLastLine = pixels + (height - 1) * width * numComponent;
+  auto *pLastLine = pixels + (height - 1) * rowLength;
 
   while (pFirstLine < pLastLine) {
-    for (size_t x = 0; x < width * numComponent; ++x)
-      std::swap(pFirstLine[x], pLastLine[x]);
-    pFirstLine += width * numComponent;
-    pLastLine -= width * numComponent;
+    std::memcpy(row.data(), pFirstLine, rowSize);
+    std::memcpy(pFirstLine, pLastLine, rowSize);
+    std::memcpy(pLastLine, row.data(), rowSize);
+    pFirstLine += rowLength;
+    pLastLine -= rowLength;
   }
 }
 
-void renderToImage(size_t width, size_t height, size_t numComponents,
-    unsigned char *outPixels, std::function<void()> drawScene);
-// Setup GL state in order to render in texture, call drawScene() then get the
-// texture from the GPU and store it on outPixels[0 : width * height *
-// numComponent]. Then restore the previous GL state.
+// Rectangle of an image, in pixels from its first row
+struct ImageTile
+{
+  GLsizei x = 0;
+  GLsizei y = 0;
+  GLsizei width = 0;
+  GLsizei height = 0;
+};
+
+// Split a width x height image in tiles of at most tileSize x tileSize pixels,
+// row of tiles after row of tiles
+std::vector<ImageTile> splitImage(
+    GLsizei width, GLsizei height, GLsizei tileSize);
+
+// Matrix to multiply a projection matrix of a width x height image with, so
+// that rendering on a tile.width x tile.height viewport only shows tile (sub
+// frustum). The first row of the image is the one at y = -1 in clip space.
+glm::mat4 computeTileMatrix(GLsizei width, GLsizei height, ImageTile tile);
+
+// Framebuffer to render images offscreen, kept between images so that
+// rendering many of them does not reallocate GPU memory. Storage is only
+// reallocated when the size, format or sample count changes.
+//
+// With samples > 1, rendering goes to multisampled storage that is resolved
+// with a blit into the color texture before reading.
+//
+// With passCount > 1, each image is the average of passCount renderings whose
+// projection is offset by jitter() (supersampling): draw each pass, calling
+// accumulate() after each one, then read the sum.
+class OffscreenTarget
+{
+public:
+  enum class ColorFormat
+  {
+    RGBA8,        // 8 bits per channel, as written by the shaders
+    SRGB8_ALPHA8, // For shaders writing linear colors: enable
+                  // GL_FRAMEBUFFER_SRGB to encode them on write
+    RGBA16F       // Half floats, not clamped: for float images (HDR)
+  };
+
+  explicit OffscreenTarget(
+      ColorFormat format = ColorFormat::RGBA8, GLsizei samples = 1);
+  ~OffscreenTarget();
+
+  OffscreenTarget(const OffscreenTarget &) = delete;
+  OffscreenTarget &operator=(const OffscreenTarget &) = delete;
+
+  void resize(GLsizei width, GLsizei height);
+  // samples is clamped to GL_MAX_SAMPLES and GL_MAX_COLOR_TEXTURE_SAMPLES
+  void setFormat(ColorFormat format, GLsizei samples = 1);
+
+  GLsizei width() const { return m_Width; }
+  GLsizei height() const { return m_Height; }
+  ColorFormat format() const { return m_Format; }
+  GLsizei samples() const { return m_Samples; }
+
+  void setPassCount(size_t passCount);
+  size_t passCount() const { return m_PassCount; }
+
+  // Subpixel offset of the projection of the current pass, in pixels in
+  // [-0.5, 0.5]. Zero with a single pass.
+  glm::vec2 jitter() const;
+
+  // Bind the framebuffer to render into on GL_DRAW_FRAMEBUFFER
+  void bindForDrawing() const;
+
+  // Add the pass that has been drawn to the average, and go to the next pass.
+  // Does nothing with a single pass. Changes GL_DRAW_FRAMEBUFFER.
+  void accumulate();
+
+  // Resolve multisampled rendering if needed, then bind the framebuffer of
+  // the image on GL_READ_FRAMEBUFFER. Changes GL_DRAW_FRAMEBUFFER.
+  void bindForReading() const;
+
+  // Framebuffer bound by bindForDrawing()
+  GLuint drawFramebuffer() const
+  {
+    return m_Samples > 1 ? m_MultisampleFramebuffer : m_Framebuffer;
+  }
+
+  // Single sampled color texture of the last pass, valid after
+  // bindForReading()
+  GLuint colorTexture() const { return m_ColorTexture; }
+
+private:
+  void allocate();
+  void release();
+  void resolve() const;
+
+  ColorFormat m_Format;
+  GLsizei m_Samples = 1;
+  GLsizei m_Width = 0;
+  GLsizei m_Height = 0;
+
+  GLuint m_ColorTexture = 0;
+  GLuint m_DepthRenderbuffer = 0; // Only without multisampling
+  GLuint m_Framebuffer = 0;
+
+  GLuint m_MultisampleColor = 0;
+  GLuint m_MultisampleDepth = 0;
+  GLuint m_MultisampleFramebuffer = 0;
+
+  size_t m_PassCount = 1;
+  size_t m_Pass = 0;
+  GLuint m_AccumulationTexture = 0;
+  GLuint m_AccumulationFramebuffer = 0;
+  std::unique_ptr<GLProgram> m_pAccumulateProgram;
+  GLuint m_EmptyVertexArray = 0;
+};
+
+// Setup GL state in order to render in target resized to width x height, call
+// drawScene() then get the texture from the GPU and store it on outPixels[0 :
+// width * height * numComponent]. Then restore the previous GL state.
 //
 // For this to work, drawScene must render on the currently bound
 // GL_DRAW_FRAMEBUFFER.
 // It means that if drawScene change GL_DRAW_FRAMEBUFFER, in must restore it
 // before doing final rendering (for example for deferred rendering,
-// GL_DRAW_FRAMEBUFFER must be restored before the shading pass).
\ No newline at end of file
+// GL_DRAW_FRAMEBUFFER must be restored before the shading pass).
+void renderToImage(OffscreenTarget &target, size_t width, size_t height,
+    size_t numComponents, unsigned char *outPixels,
+    std::function<void()> drawScene);
+
+// Same, reading float components back (use a RGBA16F target so that they are
+// not clamped nor quantized to 8 bits)
+void renderToImage(OffscreenTarget &target, size_t width, size_t height,
+    size_t numComponents, float *outPixels, std::function<void()> drawScene);
+
+// Same, with a temporary RGBA8 target
+void renderToImage(size_t width, size_t height, size_t numComponents,
+    unsigned char *outPixels, std::function<void()> drawScene);
+
+// Same as renderToImage, without reading the pixels back: the image stays in
+// target (see OffscreenTarget::bindForReading())
+void renderToTarget(OffscreenTarget &target, size_t width, size_t height,
+    const std::function<void()> &drawScene);
+
+// Pipelined readback of rendered images through a ring of pixel pack buffers.
+//
+// readPixels() only queues the transfer of the pixels into the next buffer of
+// the ring with a fence, so that the GPU keeps rendering the next images while
+// previous ones are transferred. Once a transfer has completed, its consumer is
+// called with the mapped buffer: pixels are handed over without copy, and
+// consumers are called in the order of the readPixels() calls. The pointer is
+// only valid during the call, and consumers must not use the ring.
+class PixelReadbackRing
+{
+public:
+  // pixels holds height rows of width * numComponents components of the type
+  // given to readPixels(), without padding, in the order of the framebuffer:
+  // from the bottom row to the top row of the image, unless it was rendered
+  // upside down (as offscreen images are).
+  using Consumer = std::function<void(const void *pixels)>;
+
+  explicit PixelReadbackRing(size_t bufferCount = 3);
+  ~PixelReadbackRing();
+
+  PixelReadbackRing(const PixelReadbackRing &) = delete;
+  PixelReadbackRing &operator=(const PixelReadbackRing &) = delete;
+
+  // Queue the readback of the width x height pixels of the current
+  // GL_READ_FRAMEBUFFER (numComponents is 3 for RGB, 4 for RGBA, type is
+  // GL_UNSIGNED_BYTE or GL_FLOAT). If every buffer is in flight, wait for the
+  // oldest one and consume it.
+  void readPixels(GLsizei width, GLsizei height, size_t numComponents,
+      GLenum type, Consumer consumer);
+
+  // Consume the transfers that have completed, without waiting
+  void poll();
+
+  // Wait for all transfers and consume them
+  void flush();
+
+  size_t pendingCount() const { return m_PendingCount; }
+
+private:
+  struct Slot
+  {
+    GLuint buffer = 0;
+    GLsizeiptr capacity = 0;
+    GLsizeiptr size = 0;
+    GLsync fence = nullptr;
+    Consumer consumer;
+  };
+
+  // Consume the oldest pending transfer, return false if wait is false and it
+  // has not completed yet
+  bool consumeOldest(bool wait);
+
+  std::vector<Slot> m_Slots;
+  size_t m_Oldest = 0; // Index of the oldest pending transfer
+  size_t m_PendingCount = 0;
+};
+
+// Same as renderToImage, but the pixels are read back asynchronously with ring
+// and handed to consumer later (see PixelReadbackRing). target can be used
+// for the next image right away.
+void renderToImageAsync(OffscreenTarget &target, size_t width, size_t height,
+    size_t numComponents, GLenum type, PixelReadbackRing &ring,
+    std::function<void()> drawScene, PixelReadbackRing::Consumer consumer);
@@ -0,0 +1,388 @@
+#include "materials.hpp"
+#include "gl_extensions.hpp"
+#include "trace.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <map>
+#include <stdexcept>
+#include <tuple>
+
+namespace
+{
+
+// Textures can share a GL_TEXTURE_2D_ARRAY if they have the same size, format
+// and sampling parameters
+using TextureArrayKey = std::tuple<int, int, int, int, int, int, int>;
+
+bool hasDecodedImage(const tinygltf::Model &model, int textureIdx)
+{
+  const auto &texture = model.textures[textureIdx];
+  if (texture.source < 0) {
+    return false;
+  }
+  const auto &image = model.images[texture.source];
+  return image.width > 0 && image.height > 0 && !image.image.empty();
+}
+
+TextureArrayKey getTextureArrayKey(const tinygltf::Model &model, int textureIdx)
+{
+  const auto &texture = model.textures[textureIdx];
+  const auto &image = model.images[texture.source];
+  const auto sampler = getTextureSampler(model, texture);
+  return TextureArrayKey{image.width, image.height, image.bits,
+      sampler.minFilter, sampler.magFilter, sampler.wrapS, sampler.wrapT};
+}
+
+std::map<TextureArrayKey, std::vector<int>> groupTexturesForArrays(
+    const tinygltf::Model &model)
+{
+  std::map<TextureArrayKey, std::vector<int>> groups;
+  for (int i = 0; i < int(model.textures.size()); ++i) {
+    if (hasDecodedImage(model, i)) {
+      groups[getTextureArrayKey(model, i)].emplace_back(i);
+    }
+  }
+  return groups;
+}
+
+} // namespace
+
+std::vector<std::string> materialShaderDefines(uint32_t features)
+{
+  static const std::pair<uint32_t, const char *> featureDefines[] = {
+      {SHADER_HAS_BASE_COLOR_TEXTURE, "HAS_BASE_COLOR_TEXTURE"},
+      {SHADER_HAS_MR_TEXTURE, "HAS_MR_TEXTURE"},
+      {SHADER_HAS_EMISSIVE, "HAS_EMISSIVE"},
+      {SHADER_HAS_OCCLUSION, "HAS_OCCLUSION"},
+      {SHADER_HAS_NORMAL_MAP, "HAS_NORMAL_MAP"},
+      {SHADER_HAS_TANGENTS, "HAS_TANGENTS"},
+      {SHADER_HAS_SKIN, "HAS_SKIN"},
+      {SHADER_HAS_MORPH, "HAS_MORPH"}};
+
+  std::vector<std::string> defines;
+  for (const auto &featureDefine : featureDefines) {
+    if (features & featureDefine.first) {
+      defines.emplace_back(featureDefine.second);
+    }
+  }
+  return defines;
+}
+
+const char *toString(TextureBindingMode mode)
+{
+  switch (mode) {
+  case TextureBindingMode::Auto:
+    return "auto";
+  case TextureBindingMode::Classic:
+    return "classic";
+  case TextureBindingMode::Bindless:
+    return "bindless";
+  case TextureBindingMode::Arrays:
+    return "arrays";
+  }
+  return "";
+}
+
+TextureBindingMode parseTextureBindingMode(const std::string &str)
+{
+  for (const auto mode :
+      {TextureBindingMode::Auto, TextureBindingMode::Classic,
+          TextureBindingMode::Bindless, TextureBindingMode::Arrays}) {
+    if (str == toString(mode)) {
+      return mode;
+    }
+  }
+  throw std::runtime_error("Unknown texture binding mode " + str);
+}
+
+TextureBindingMode resolveTextureBindingMode(const tinygltf::Model &model,
+    TextureBindingMode requested, bool useTextureBudget)
+{
+  const auto arraysFit = groupTexturesForArrays(model).size() <=
+                         size_t(MaterialBuffer::MAX_TEXTURE_ARRAYS);
+
+  switch (requested) {
+  case TextureBindingMode::Classic:
+    return TextureBindingMode::Classic;
+  case TextureBindingMode::Bindless:
+    if (GLAD_GL_ARB_bindless_texture) {
+      return TextureBindingMode::Bindless;
+    }
+    std::clog << "GL_ARB_bindless_texture is not supported" << std::endl;
+    break;
+  case TextureBindingMode::Arrays:
+    if (arraysFit) {
+      return TextureBindingMode::Arrays;
+    }
+    std::clog << "Too many texture sizes to use texture arrays" << std::endl;
+    return TextureBindingMode::Classic;
+  case TextureBindingMode::Auto:
+    break;
+  }
+
+  if (GLAD_GL_ARB_bindless_texture) {
+    return TextureBindingMode::Bindless;
+  }
+  if (arraysFit && !useTextureBudget) {
+    return TextureBindingMode::Arrays;
+  }
+  return TextureBindingMode::Classic;
+}
+
+MaterialBuffer::MaterialBuffer(const tinygltf::Model &model,
+    TextureBindingMode mode, TextureResidencyManager *textures) :
+    m_Model(model),
+    m_Mode(mode),
+    m_pTextures(textures)
+{
+  for (const auto &material : model.materials) {
+    const auto &pbr = material.pbrMetallicRoughness;
+    GPUMaterial gpuMaterial{};
+    gpuMaterial.baseColorFactor =
+        glm::vec4(pbr.baseColorFactor[0], pbr.baseColorFactor[1],
+            pbr.baseColorFactor[2], pbr.baseColorFactor[3]);
+    gpuMaterial.emissiveFactor = glm::vec3(material.emissiveFactor[0],
+        material.emissiveFactor[1], material.emissiveFactor[2]);
+    gpuMaterial.metallicFactor = float(pbr.metallicFactor);
+    gpuMaterial.roughnessFactor = float(pbr.roughnessFactor);
+    gpuMaterial.occlusionStrength = float(material.occlusionTexture.strength);
+    gpuMaterial.normalScale = float(material.normalTexture.scale);
+    m_Materials.emplace_back(gpuMaterial);
+
+    m_TextureIndices.push_back({pbr.baseColorTexture.index,
+        pbr.metallicRoughnessTexture.index, material.emissiveTexture.index,
+        material.occlusionTexture.index, material.normalTexture.index});
+  }
+
+  // Default material, as specified by glTF
+  GPUMaterial defaultMaterial{};
+  defaultMaterial.baseColorFactor = glm::vec4(1);
+  defaultMaterial.metallicFactor = 1.f;
+  defaultMaterial.roughnessFactor = 1.f;
+  defaultMaterial.occlusionStrength = 1.f;
+  defaultMaterial.normalScale = 1.f;
+  m_Materials.emplace_back(defaultMaterial);
+  m_TextureIndices.push_back({-1, -1, -1, -1, -1});
+
+  for (size_t i = 0; i < m_Materials.size(); ++i) {
+    for (GLuint slot = 0; slot < MATERIAL_TEXTURE_SLOT_COUNT; ++slot) {
+      const auto textureIdx = m_TextureIndices[i][slot];
+      if (textureIdx >= 0 && hasDecodedImage(model, textureIdx)) {
+        m_Materials[i].textureFlags |= 1u << slot;
+      } else {
+        m_TextureIndices[i][slot] = -1;
+      }
+    }
+  }
+
+  if (m_Mode == TextureBindingMode::Bindless) {
+    m_pTextures->setTextureReleaseCallback(
+        [this](GLuint textureObject) { releaseHandle(textureObject); });
+    writeBindlessHandles();
+    m_TexturesGeneration = m_pTextures->generation();
+  } else if (m_Mode == TextureBindingMode::Arrays) {
+    createTextureArrays();
+  }
+
+  glGenBuffers(1, &m_BufferObject);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_BufferObject);
+  glBufferStorage(GL_SHADER_STORAGE_BUFFER,
+      m_Materials.size() * sizeof(GPUMaterial), m_Materials.data(),
+      GL_DYNAMIC_STORAGE_BIT);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+  std::clog << "Material textures: " << toString(m_Mode) << " binding"
+            << std::endl;
+}
+
+MaterialBuffer::~MaterialBuffer()
+{
+  if (m_Mode == TextureBindingMode::Bindless) {
+    m_pTextures->setTextureReleaseCallback(nullptr);
+    for (const auto &textureAndHandle : m_ResidentHandles) {
+      glMakeTextureHandleNonResidentARB(textureAndHandle.second);
+    }
+  }
+  if (!m_TextureArrays.empty()) {
+    glDeleteTextures(GLsizei(m_TextureArrays.size()), m_TextureArrays.data());
+  }
+  glDeleteBuffers(1, &m_BufferObject);
+}
+
+uint32_t MaterialBuffer::shaderFeatures(
+    const tinygltf::Primitive &primitive, GLuint textureToggles) const
+{
+  uint32_t features = textureFlags(primitive.material) & textureToggles;
+  // Tangents are only used for normal mapping, don't make variants for them
+  // otherwise
+  if ((features & SHADER_HAS_NORMAL_MAP) &&
+      primitive.attributes.find("TANGENT") != end(primitive.attributes)) {
+    features |= SHADER_HAS_TANGENTS;
+  }
+  return features;
+}
+
+std::vector<std::string> MaterialBuffer::shaderDefines() const
+{
+  switch (m_Mode) {
+  case TextureBindingMode::Bindless:
+    return {"USE_BINDLESS_TEXTURES"};
+  case TextureBindingMode::Arrays:
+    return {"USE_TEXTURE_ARRAYS"};
+  default:
+    return {};
+  }
+}
+
+void MaterialBuffer::setupProgram(const GLProgram &program) const
+{
+  if (m_Mode == TextureBindingMode::Classic) {
+    const GLint units[MATERIAL_TEXTURE_SLOT_COUNT] = {0, 1, 2, 3, 4};
+    glProgramUniform1iv(program.glId(),
+        program.getUniformLocation("uMaterialTextures"),
+        MATERIAL_TEXTURE_SLOT_COUNT, units);
+  } else if (m_Mode == TextureBindingMode::Arrays) {
+    GLint units[MAX_TEXTURE_ARRAYS];
+    for (GLint i = 0; i < MAX_TEXTURE_ARRAYS; ++i) {
+      units[i] = i;
+    }
+    glProgramUniform1iv(program.glId(),
+        program.getUniformLocation("uTextureArrays"), MAX_TEXTURE_ARRAYS,
+        units);
+  }
+}
+
+void MaterialBuffer::update()
+{
+  if (m_Mode != TextureBindingMode::Bindless ||
+      m_pTextures->generation() == m_TexturesGeneration) {
+    return;
+  }
+  writeBindlessHandles();
+  m_TexturesGeneration = m_pTextures->generation();
+
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_BufferObject);
+  glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0,
+      m_Materials.size() * sizeof(GPUMaterial), m_Materials.data());
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+void MaterialBuffer::bind() const
+{
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, STORAGE_BINDING, m_BufferObject);
+  for (size_t i = 0; i < m_TextureArrays.size(); ++i) {
+    glActiveTexture(GLenum(GL_TEXTURE0 + i));
+    glBindTexture(GL_TEXTURE_2D_ARRAY, m_TextureArrays[i]);
+  }
+}
+
+void MaterialBuffer::bindTextures(int materialIdx) const
+{
+  const auto &textureIndices = m_TextureIndices[gpuMaterialIndex(materialIdx)];
+  for (GLuint slot = 0; slot < MATERIAL_TEXTURE_SLOT_COUNT; ++slot) {
+    const auto textureIdx = textureIndices[slot];
+    glActiveTexture(GL_TEXTURE0 + slot);
+    glBindTexture(GL_TEXTURE_2D,
+        textureIdx >= 0 ? m_pTextures->textureObject(textureIdx) : 0);
+  }
+}
+
+GLuint64 MaterialBuffer::residentHandle(GLuint textureObject)
+{
+  const auto it = m_ResidentHandles.find(textureObject);
+  if (it != end(m_ResidentHandles)) {
+    return (*it).second;
+  }
+  // Creating a handle makes the texture immutable, which is fine since the
+  // residency manager replaces texture objects instead of modifying them
+  const auto handle = glGetTextureHandleARB(textureObject);
+  glMakeTextureHandleResidentARB(handle);
+  m_ResidentHandles.emplace(textureObject, handle);
+  return handle;
+}
+
+void MaterialBuffer::releaseHandle(GLuint textureObject)
+{
+  const auto it = m_ResidentHandles.find(textureObject);
+  if (it != end(m_ResidentHandles)) {
+    glMakeTextureHandleNonResidentARB((*it).second);
+    m_ResidentHandles.erase(it);
+  }
+}
+
+void MaterialBuffer::writeBindlessHandles()
+{
+  for (size_t i = 0; i < m_Materials.size(); ++i) {
+    for (GLuint slot = 0; slot < MATERIAL_TEXTURE_SLOT_COUNT; ++slot) {
+      const auto textureIdx = m_TextureIndices[i][slot];
+      if (textureIdx < 0) {
+        continue;
+      }
+      const auto handle =
+          residentHandle(m_pTextures->textureObject(textureIdx));
+      m_Materials[i].textures[slot] =
+          glm::uvec2(GLuint(handle & 0xFFFFFFFF), GLuint(handle >> 32));
+    }
+  }
+}
+
+void MaterialBuffer::createTextureArrays()
+{
+  TraceScope trace{"Texture upload"};
+  // (array index, layer) of each glTF texture
+  std::vector<glm::uvec2> textureLocations(m_Model.textures.size());
+
+  GLint previousTextureObject = 0;
+  glGetIntegerv(GL_TEXTURE_BINDING_2D_ARRAY, &previousTextureObject);
+
+  for (const auto &group : groupTexturesForArrays(m_Model)) {
+    const auto &textureIndices = group.second;
+    const auto &firstTexture = m_Model.textures[textureIndices.front()];
+    const auto &firstImage = m_Model.images[firstTexture.source];
+    const auto sampler = getTextureSampler(m_Model, firstTexture);
+    const auto useMipmaps = isMipmapFilter(sampler.minFilter);
+    const auto levelCount =
+        useMipmaps ? 1 + int(std::floor(std::log2(
+                             std::max(firstImage.width, firstImage.height))))
+                   : 1;
+
+    GLuint textureArray = 0;
+    glGenTextures(1, &textureArray);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, textureArray);
+    glTexStorage3D(GL_TEXTURE_2D_ARRAY, levelCount,
+        firstImage.bits == 16 ? GL_RGBA16 : GL_RGBA8, firstImage.width,
+        firstImage.height, GLsizei(textureIndices.size()));
+    for (size_t layer = 0; layer < textureIndices.size(); ++layer) {
+      const auto &image =
+          m_Model.images[m_Model.textures[textureIndices[layer]].source];
+      glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, GLint(layer), image.width,
+          image.height, 1, GL_RGBA, image.pixel_type, image.image.data());
+      m_UploadedBytes += image.image.size();
+      textureLocations[textureIndices[layer]] =
+          glm::uvec2(GLuint(m_TextureArrays.size()), GLuint(layer));
+    }
+
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, sampler.minFilter);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, sampler.magFilter);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, sampler.wrapS);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, sampler.wrapT);
+    if (useMipmaps) {
+      glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+    }
+
+    m_TextureArrays.emplace_back(textureArray);
+  }
+
+  glBindTexture(GL_TEXTURE_2D_ARRAY, previousTextureObject);
+
+  for (size_t i = 0; i < m_Materials.size(); ++i) {
+    for (GLuint slot = 0; slot < MATERIAL_TEXTURE_SLOT_COUNT; ++slot) {
+      const auto textureIdx = m_TextureIndices[i][slot];
+      if (textureIdx >= 0) {
+        m_Materials[i].textures[slot] = textureLocations[textureIdx];
+      }
+    }
+  }
+}
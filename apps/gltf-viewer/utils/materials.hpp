@@ -0,0 +1,170 @@
+#pragma once
+
+#include "shaders.hpp"
+#include "textures.hpp"
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <tiny_gltf.h>
+
+#include <array>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Texture slots of a material, in the order of the bits of
+// GPUMaterial::textureFlags (see pbr_directional_light.fs.glsl)
+enum MaterialTextureSlot
+{
+  MATERIAL_TEXTURE_BASE_COLOR = 0,
+  MATERIAL_TEXTURE_METALLIC_ROUGHNESS,
+  MATERIAL_TEXTURE_EMISSIVE,
+  MATERIAL_TEXTURE_OCCLUSION,
+  MATERIAL_TEXTURE_NORMAL,
+  MATERIAL_TEXTURE_SLOT_COUNT
+};
+
+// Features of a variant of the material shaders, each one compiled in with a
+// define (see materialShaderDefines). Texture features use the same bits as
+// GPUMaterial::textureFlags. Skinning and morph targets are features of the
+// vertex shader, set by the viewer for the primitives that use them.
+enum MaterialShaderFeature : uint32_t
+{
+  SHADER_HAS_BASE_COLOR_TEXTURE = 1u << MATERIAL_TEXTURE_BASE_COLOR,
+  SHADER_HAS_MR_TEXTURE = 1u << MATERIAL_TEXTURE_METALLIC_ROUGHNESS,
+  SHADER_HAS_EMISSIVE = 1u << MATERIAL_TEXTURE_EMISSIVE,
+  SHADER_HAS_OCCLUSION = 1u << MATERIAL_TEXTURE_OCCLUSION,
+  SHADER_HAS_NORMAL_MAP = 1u << MATERIAL_TEXTURE_NORMAL,
+  SHADER_HAS_TANGENTS = 1u << MATERIAL_TEXTURE_SLOT_COUNT,
+  SHADER_HAS_SKIN = 1u << (MATERIAL_TEXTURE_SLOT_COUNT + 1),
+  SHADER_HAS_MORPH = 1u << (MATERIAL_TEXTURE_SLOT_COUNT + 2)
+};
+
+// HAS_BASE_COLOR_TEXTURE, HAS_MR_TEXTURE, HAS_EMISSIVE, HAS_OCCLUSION,
+// HAS_NORMAL_MAP, HAS_TANGENTS, HAS_SKIN and HAS_MORPH for the bits set in
+// features
+std::vector<std::string> materialShaderDefines(uint32_t features);
+
+// How shaders access material textures:
+// - Classic: one texture unit per slot, bound before each draw
+// - Bindless: GL_ARB_bindless_texture handles stored in the material buffer
+// - Arrays: same-sized textures packed in GL_TEXTURE_2D_ARRAY layers, all
+// arrays bound once per frame
+enum class TextureBindingMode
+{
+  Auto,
+  Classic,
+  Bindless,
+  Arrays
+};
+
+const char *toString(TextureBindingMode mode);
+
+// Parse "auto", "classic", "bindless" or "arrays", throw on other values
+TextureBindingMode parseTextureBindingMode(const std::string &str);
+
+// Resolve Auto and unsupported requests to a mode that works on the current
+// context for model. Bindless is preferred, then arrays, unless a texture
+// budget is used since arrays are always fully resident.
+TextureBindingMode resolveTextureBindingMode(const tinygltf::Model &model,
+    TextureBindingMode requested, bool useTextureBudget);
+
+// Layout of one material in the shader storage buffer (std430)
+struct GPUMaterial
+{
+  glm::vec4 baseColorFactor;
+  glm::vec3 emissiveFactor;
+  float metallicFactor;
+  float roughnessFactor;
+  float occlusionStrength;
+  float normalScale;
+  GLuint textureFlags; // Bit i set if slot i has a texture
+  // Per slot: bindless handle (low, high) or (array index, layer)
+  glm::uvec2 textures[MATERIAL_TEXTURE_SLOT_COUNT];
+  glm::uvec2 padding;
+};
+static_assert(sizeof(GPUMaterial) == 96, "GPUMaterial must match std430");
+
+// Shader storage buffer holding the parameters of all materials of a model, so
+// that selecting a material for a draw is a single uniform update. The last
+// entry is the default material, for primitives without material.
+class MaterialBuffer
+{
+public:
+  static const GLuint STORAGE_BINDING = 0;
+  static const GLint MAX_TEXTURE_ARRAYS = 16; // Matches the shader
+
+  // textures must outlive the buffer; it is not used in Arrays mode and may be
+  // null in that case. mode must be resolved (not Auto).
+  MaterialBuffer(const tinygltf::Model &model, TextureBindingMode mode,
+      TextureResidencyManager *textures);
+  ~MaterialBuffer();
+
+  MaterialBuffer(const MaterialBuffer &) = delete;
+  MaterialBuffer &operator=(const MaterialBuffer &) = delete;
+
+  TextureBindingMode mode() const { return m_Mode; }
+
+  // Texture arrays bound by bind() (arrays mode only)
+  size_t textureArrayCount() const { return m_TextureArrays.size(); }
+
+  // Bytes of images uploaded to the texture arrays (arrays mode only)
+  uint64_t uploadedBytes() const { return m_UploadedBytes; }
+
+  // Index in the buffer of the material of a primitive
+  GLint gpuMaterialIndex(int materialIdx) const
+  {
+    return materialIdx >= 0 ? materialIdx : GLint(m_Materials.size() - 1);
+  }
+
+  // Bits of the texture slots of a material that have a texture
+  GLuint textureFlags(int materialIdx) const
+  {
+    return m_Materials[gpuMaterialIndex(materialIdx)].textureFlags;
+  }
+
+  // Shader features needed to draw primitive: its material textures that are
+  // enabled in textureToggles (bits of MaterialTextureSlot), and tangents.
+  uint32_t shaderFeatures(
+      const tinygltf::Primitive &primitive, GLuint textureToggles) const;
+
+  // Defines to compile the material shaders with, in addition to those of
+  // the shader features
+  std::vector<std::string> shaderDefines() const;
+
+  // Set the texture unit of sampler uniforms of program, once after linking
+  void setupProgram(const GLProgram &program) const;
+
+  // Refresh texture references if the residency manager replaced texture
+  // objects (bindless mode only).
+  void update();
+
+  // Bind the buffer and texture arrays, once per frame
+  void bind() const;
+
+  // Classic mode: bind the textures of a material on units 0 to 4
+  void bindTextures(int materialIdx) const;
+
+private:
+  GLuint64 residentHandle(GLuint textureObject);
+  void releaseHandle(GLuint textureObject);
+  void writeBindlessHandles();
+  void createTextureArrays();
+
+  const tinygltf::Model &m_Model;
+  const TextureBindingMode m_Mode;
+  TextureResidencyManager *m_pTextures;
+
+  std::vector<GPUMaterial> m_Materials;
+  // glTF texture index of each slot of each material, -1 if none
+  std::vector<std::array<int, MATERIAL_TEXTURE_SLOT_COUNT>> m_TextureIndices;
+  GLuint m_BufferObject = 0;
+
+  // Bindless mode
+  std::unordered_map<GLuint, GLuint64> m_ResidentHandles;
+  uint64_t m_TexturesGeneration = 0;
+
+  // Arrays mode
+  std::vector<GLuint> m_TextureArrays;
+  uint64_t m_UploadedBytes = 0;
+};
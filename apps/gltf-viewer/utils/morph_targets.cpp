@@ -0,0 +1,410 @@
+#include "morph_targets.hpp"
+
+#include "deformed_vertices.hpp"
+#include "gltf.hpp"
+
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+
+namespace
+{
+
+const GLuint BASE_STORAGE_BINDING = 1;
+const GLuint BLENDED_STORAGE_BINDING = 2;
+const GLuint WORK_GROUP_SIZE = 64;
+
+int findAttribute(
+    const std::map<std::string, int> &attributes, const char *name)
+{
+  const auto it = attributes.find(name);
+  return it != end(attributes) ? (*it).second : -1;
+}
+
+bool anyTargetHas(const tinygltf::Primitive &primitive, const char *name)
+{
+  return std::any_of(begin(primitive.targets), end(primitive.targets),
+      [&](const std::map<std::string, int> &target) {
+        return findAttribute(target, name) >= 0;
+      });
+}
+
+// Base vertices of a primitive, with the accessors it lacks as zeros
+std::vector<DeformedVertex> decodeBaseVertices(
+    const tinygltf::Model &model, const tinygltf::Primitive &primitive)
+{
+  const auto positions = AccessorView<glm::vec3>{
+      model, findAttribute(primitive.attributes, "POSITION")}
+                             .decode();
+  std::vector<DeformedVertex> vertices(positions.size(), DeformedVertex{});
+  for (size_t i = 0; i < vertices.size(); ++i) {
+    vertices[i].position = glm::vec4(positions[i], 1);
+  }
+  const auto normalIdx = findAttribute(primitive.attributes, "NORMAL");
+  if (normalIdx >= 0) {
+    const auto normals = AccessorView<glm::vec3>{model, normalIdx}.decode();
+    for (size_t i = 0; i < std::min(normals.size(), vertices.size()); ++i) {
+      vertices[i].normal = glm::vec4(normals[i], 0);
+    }
+  }
+  const auto tangentIdx = findAttribute(primitive.attributes, "TANGENT");
+  if (tangentIdx >= 0) {
+    const auto tangents = AccessorView<glm::vec4>{model, tangentIdx}.decode();
+    for (size_t i = 0; i < std::min(tangents.size(), vertices.size()); ++i) {
+      vertices[i].tangent = tangents[i];
+    }
+  }
+  return vertices;
+}
+
+} // namespace
+
+const char *toString(MorphMode mode)
+{
+  switch (mode) {
+  case MorphMode::Auto:
+    return "auto";
+  case MorphMode::VertexShader:
+    return "vertex";
+  case MorphMode::Compute:
+    return "compute";
+  }
+  return "unknown";
+}
+
+MorphMode parseMorphMode(const std::string &str)
+{
+  for (const auto mode :
+      {MorphMode::Auto, MorphMode::VertexShader, MorphMode::Compute}) {
+    if (str == toString(mode)) {
+      return mode;
+    }
+  }
+  throw std::runtime_error("Unknown morph mode " + str);
+}
+
+bool hasMorphTargets(const tinygltf::Primitive &primitive)
+{
+  return findAttribute(primitive.attributes, "POSITION") >= 0 &&
+         !primitive.targets.empty();
+}
+
+MorphTargetBuffers::MorphTargetBuffers(const tinygltf::Model &model) :
+    m_FirstPrimitives(model.meshes.size(), -1),
+    m_ActiveTargets(model.nodes.size(), {0, 0})
+{
+  GLint maxTexels = 0;
+  glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &maxTexels);
+
+  for (size_t meshIdx = 0; meshIdx < model.meshes.size(); ++meshIdx) {
+    const auto &primitives = model.meshes[meshIdx].primitives;
+    if (std::none_of(begin(primitives), end(primitives), hasMorphTargets)) {
+      continue;
+    }
+    m_FirstPrimitives[meshIdx] = int(m_Primitives.size());
+    for (const auto &primitive : primitives) {
+      PrimitiveTargets targets{0, 0, 0, 0, 0};
+      if (!hasMorphTargets(primitive)) {
+        m_Primitives.push_back(targets);
+        continue;
+      }
+      const auto &positions = model.accessors.at(
+          findAttribute(primitive.attributes, "POSITION"));
+      // Normals and tangents are only displaced if the primitive has them
+      const auto hasNormals =
+          findAttribute(primitive.attributes, "NORMAL") >= 0 &&
+          anyTargetHas(primitive, "NORMAL");
+      const auto hasTangents =
+          findAttribute(primitive.attributes, "TANGENT") >= 0 &&
+          anyTargetHas(primitive, "TANGENT");
+      targets.vertexCount = GLint(positions.count);
+      targets.targetCount = GLint(primitive.targets.size());
+      targets.texelsPerVertex = hasTangents ? 3 : hasNormals ? 2 : 1;
+
+      const auto texelCount = size_t(targets.vertexCount) *
+                              targets.targetCount * targets.texelsPerVertex;
+      if (texelCount > size_t(maxTexels)) {
+        std::cerr << "Morph targets of mesh " << meshIdx << ": " << texelCount
+                  << " texels, more than the " << maxTexels
+                  << " of a texture buffer" << std::endl;
+        m_Primitives.push_back(PrimitiveTargets{0, 0, 0, 0, 0});
+        continue;
+      }
+      std::vector<glm::vec4> texels(texelCount, glm::vec4(0));
+      for (GLint targetIdx = 0; targetIdx < targets.targetCount;
+           ++targetIdx) {
+        const auto &target = primitive.targets[targetIdx];
+        const auto packAttribute = [&](const char *name, GLint slot) {
+          const auto accessorIdx = findAttribute(target, name);
+          if (accessorIdx < 0 || slot >= targets.texelsPerVertex) {
+            return;
+          }
+          const auto displacements =
+              AccessorView<glm::vec3>{model, accessorIdx}.decode();
+          const auto count = std::min(
+              displacements.size(), size_t(targets.vertexCount));
+          auto texel = size_t(targetIdx) * targets.vertexCount *
+                           targets.texelsPerVertex +
+                       slot;
+          for (size_t i = 0; i < count;
+               ++i, texel += targets.texelsPerVertex) {
+            texels[texel] = glm::vec4(displacements[i], 0);
+          }
+        };
+        try {
+          packAttribute("POSITION", 0);
+          packAttribute("NORMAL", 1);
+          packAttribute("TANGENT", 2);
+        } catch (const std::runtime_error &e) {
+          std::cerr << "Morph target " << targetIdx << " of mesh " << meshIdx
+                    << ": " << e.what() << std::endl;
+        }
+      }
+
+      glGenBuffers(1, &targets.bufferObject);
+      glBindBuffer(GL_TEXTURE_BUFFER, targets.bufferObject);
+      glBufferStorage(GL_TEXTURE_BUFFER, texels.size() * sizeof(glm::vec4),
+          texels.data(), 0);
+      glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+      glGenTextures(1, &targets.textureObject);
+      glBindTexture(GL_TEXTURE_BUFFER, targets.textureObject);
+      glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, targets.bufferObject);
+      glBindTexture(GL_TEXTURE_BUFFER, 0);
+
+      m_Primitives.push_back(targets);
+      ++m_PrimitiveCount;
+      m_TargetCount += primitive.targets.size();
+    }
+  }
+  if (!m_PrimitiveCount) {
+    return;
+  }
+
+  // At most every weight of every node is active
+  size_t weightCapacity = 1;
+  for (size_t nodeIdx = 0; nodeIdx < model.nodes.size(); ++nodeIdx) {
+    const auto meshIdx = model.nodes[nodeIdx].mesh;
+    if (meshIdx >= 0 && size_t(meshIdx) < model.meshes.size() &&
+        m_FirstPrimitives[meshIdx] >= 0) {
+      m_MorphedNodes.push_back(int(nodeIdx));
+      for (const auto &primitive : model.meshes[meshIdx].primitives) {
+        weightCapacity += primitive.targets.size();
+      }
+    }
+  }
+
+  glGenBuffers(1, &m_WeightBufferObject);
+  glBindBuffer(GL_TEXTURE_BUFFER, m_WeightBufferObject);
+  glBufferData(GL_TEXTURE_BUFFER, weightCapacity * sizeof(glm::vec2), nullptr,
+      GL_DYNAMIC_DRAW);
+  glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+  glGenTextures(1, &m_WeightTextureObject);
+  glBindTexture(GL_TEXTURE_BUFFER, m_WeightTextureObject);
+  glTexBuffer(GL_TEXTURE_BUFFER, GL_RG32F, m_WeightBufferObject);
+  glBindTexture(GL_TEXTURE_BUFFER, 0);
+}
+
+MorphTargetBuffers::~MorphTargetBuffers()
+{
+  for (const auto &targets : m_Primitives) {
+    glDeleteTextures(1, &targets.textureObject);
+    glDeleteBuffers(1, &targets.bufferObject);
+  }
+  glDeleteTextures(1, &m_WeightTextureObject);
+  glDeleteBuffers(1, &m_WeightBufferObject);
+}
+
+const MorphTargetBuffers::PrimitiveTargets *MorphTargetBuffers::targets(
+    int meshIdx, size_t primitiveIdx) const
+{
+  if (!hasTargets(meshIdx)) {
+    return nullptr;
+  }
+  const auto &targets = m_Primitives[m_FirstPrimitives[meshIdx] + primitiveIdx];
+  return targets.targetCount ? &targets : nullptr;
+}
+
+bool MorphTargetBuffers::update(const SceneHierarchy &hierarchy)
+{
+  if (!m_PrimitiveCount ||
+      hierarchy.weightsGeneration() == m_WeightsGeneration) {
+    return false;
+  }
+  m_WeightsGeneration = hierarchy.weightsGeneration();
+
+  m_Weights.clear();
+  for (const auto nodeIdx : m_MorphedNodes) {
+    const auto offset = m_Weights.size();
+    const auto weights = hierarchy.weights(nodeIdx);
+    const auto weightCount = hierarchy.weightCount(nodeIdx);
+    for (size_t i = 0; i < weightCount; ++i) {
+      if (weights[i] != 0.f) {
+        m_Weights.emplace_back(float(i), weights[i]);
+      }
+    }
+    m_ActiveTargets[nodeIdx] = {
+        GLint(offset), GLint(m_Weights.size() - offset)};
+  }
+  if (!m_Weights.empty()) {
+    glBindBuffer(GL_TEXTURE_BUFFER, m_WeightBufferObject);
+    glBufferSubData(GL_TEXTURE_BUFFER, 0, m_Weights.size() * sizeof(glm::vec2),
+        m_Weights.data());
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+  }
+  return true;
+}
+
+void MorphTargetBuffers::bindWeights() const
+{
+  glActiveTexture(GL_TEXTURE0 + WEIGHTS_TEXTURE_UNIT);
+  glBindTexture(GL_TEXTURE_BUFFER, m_WeightTextureObject);
+}
+
+void MorphTargetBuffers::bindTargets(const PrimitiveTargets &targets) const
+{
+  glActiveTexture(GL_TEXTURE0 + TARGETS_TEXTURE_UNIT);
+  glBindTexture(GL_TEXTURE_BUFFER, targets.textureObject);
+}
+
+PreBlendedPrimitives::PreBlendedPrimitives(const tinygltf::Model &model,
+    const fs::path &computeShaderPath, const MorphTargetBuffers &targets,
+    const std::function<GLuint(int, size_t)> &primitiveVao) :
+    m_Targets(targets),
+    m_Program(buildProgram({loadShader(computeShaderPath)})),
+    m_UniformMorphParameters(m_Program.getUniformLocation("uMorphParameters"))
+{
+  glProgramUniform1i(m_Program.glId(),
+      m_Program.getUniformLocation("uMorphTargets"),
+      GLint(MorphTargetBuffers::TARGETS_TEXTURE_UNIT));
+  glProgramUniform1i(m_Program.glId(),
+      m_Program.getUniformLocation("uMorphWeights"),
+      GLint(MorphTargetBuffers::WEIGHTS_TEXTURE_UNIT));
+
+  // Base vertices of each primitive, decoded for its first instance
+  std::map<const MorphTargetBuffers::PrimitiveTargets *, GLuint> baseBuffers;
+  for (size_t nodeIdx = 0; nodeIdx < model.nodes.size(); ++nodeIdx) {
+    const auto meshIdx = model.nodes[nodeIdx].mesh;
+    if (!targets.hasTargets(meshIdx)) {
+      continue;
+    }
+    const auto &primitives = model.meshes[meshIdx].primitives;
+    const auto firstInstance = m_Instances.size();
+    for (size_t primitiveIdx = 0; primitiveIdx < primitives.size();
+         ++primitiveIdx) {
+      const auto &primitive = primitives[primitiveIdx];
+      Instance instance{targets.targets(meshIdx, primitiveIdx), 0, 0, 0};
+      if (!instance.pTargets) {
+        m_Instances.push_back(instance);
+        continue;
+      }
+      const auto it = baseBuffers.find(instance.pTargets);
+      if (it != end(baseBuffers)) {
+        instance.baseBuffer = (*it).second;
+      } else {
+        std::vector<DeformedVertex> vertices;
+        try {
+          vertices = decodeBaseVertices(model, primitive);
+        } catch (const std::runtime_error &e) {
+          // Blended in the vertex shader
+          std::cerr << "Morphed vertices of mesh " << meshIdx << ": "
+                    << e.what() << std::endl;
+        }
+        if (vertices.size() != size_t(instance.pTargets->vertexCount)) {
+          instance.pTargets = nullptr;
+          m_Instances.push_back(instance);
+          continue;
+        }
+        glGenBuffers(1, &instance.baseBuffer);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, instance.baseBuffer);
+        glBufferStorage(GL_SHADER_STORAGE_BUFFER,
+            vertices.size() * sizeof(DeformedVertex), vertices.data(), 0);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+        baseBuffers[instance.pTargets] = instance.baseBuffer;
+        m_BaseBuffers.push_back(instance.baseBuffer);
+      }
+
+      glGenBuffers(1, &instance.blendedBuffer);
+      glBindBuffer(GL_SHADER_STORAGE_BUFFER, instance.blendedBuffer);
+      glBufferStorage(GL_SHADER_STORAGE_BUFFER,
+          instance.pTargets->vertexCount * sizeof(DeformedVertex), nullptr, 0);
+      glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+      // Texture coordinates, skin and indices are those of the primitive
+      instance.vertexArrayObject = createDeformedVertexArray(
+          primitiveVao(meshIdx, primitiveIdx), instance.blendedBuffer,
+          findAttribute(primitive.attributes, "NORMAL") >= 0,
+          findAttribute(primitive.attributes, "TANGENT") >= 0);
+      m_Instances.push_back(instance);
+    }
+    m_NodeInstances[int(nodeIdx)] = {firstInstance, primitives.size()};
+  }
+}
+
+PreBlendedPrimitives::~PreBlendedPrimitives()
+{
+  for (const auto &instance : m_Instances) {
+    if (instance.pTargets) {
+      glDeleteBuffers(1, &instance.blendedBuffer);
+      glDeleteVertexArrays(1, &instance.vertexArrayObject);
+    }
+  }
+  glDeleteBuffers(GLsizei(m_BaseBuffers.size()), m_BaseBuffers.data());
+}
+
+GLuint PreBlendedPrimitives::vertexArrayObject(
+    int node, size_t primitiveIdx) const
+{
+  const auto it = m_NodeInstances.find(node);
+  if (it == end(m_NodeInstances)) {
+    return 0;
+  }
+  return m_Instances[(*it).second.first + primitiveIdx].vertexArrayObject;
+}
+
+size_t PreBlendedPrimitives::update(const SceneHierarchy &hierarchy)
+{
+  size_t blendedCount = 0;
+  for (const auto &it : m_NodeInstances) {
+    const auto nodeIdx = it.first;
+    const auto weights = hierarchy.weights(nodeIdx);
+    auto &blendedWeights = m_BlendedWeights[nodeIdx];
+    if (blendedWeights.size() == hierarchy.weightCount(nodeIdx) &&
+        std::equal(begin(blendedWeights), end(blendedWeights), weights)) {
+      continue;
+    }
+    blendedWeights.assign(weights, weights + hierarchy.weightCount(nodeIdx));
+
+    if (!blendedCount) {
+      m_Program.use();
+      m_Targets.bindWeights();
+    }
+    for (size_t i = 0; i < it.second.second; ++i) {
+      const auto &instance = m_Instances[it.second.first + i];
+      if (!instance.pTargets) {
+        continue;
+      }
+      m_Targets.bindTargets(*instance.pTargets);
+      glUniform4i(m_UniformMorphParameters,
+          m_Targets.activeTargetOffset(nodeIdx),
+          m_Targets.activeTargetCount(nodeIdx), instance.pTargets->vertexCount,
+          instance.pTargets->texelsPerVertex);
+      glBindBufferBase(GL_SHADER_STORAGE_BUFFER, BASE_STORAGE_BINDING,
+          instance.baseBuffer);
+      glBindBufferBase(GL_SHADER_STORAGE_BUFFER, BLENDED_STORAGE_BINDING,
+          instance.blendedBuffer);
+      glDispatchCompute(
+          (GLuint(instance.pTargets->vertexCount) + WORK_GROUP_SIZE - 1) /
+              WORK_GROUP_SIZE,
+          1, 1);
+    }
+    ++blendedCount;
+  }
+  if (blendedCount) {
+    // Blended vertices are read as vertex attributes by the next draws
+    glMemoryBarrier(GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT);
+    glUseProgram(0);
+  }
+  return blendedCount;
+}
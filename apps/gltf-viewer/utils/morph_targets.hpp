@@ -0,0 +1,182 @@
+#pragma once
+
+#include "filesystem.hpp"
+#include "scene_hierarchy.hpp"
+#include "shaders.hpp"
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <tiny_gltf.h>
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+// How primitives with morph targets are drawn:
+// - VertexShader: each draw blends the targets of its vertices (HAS_MORPH
+// shader variants)
+// - Compute: a compute shader writes the blended vertices of each instance to
+// a buffer when its weights change, drawn like static geometry until they
+// change again
+// Auto picks Compute when each frame is drawn several times (offscreen images,
+// with their passes and tiles), VertexShader otherwise.
+enum class MorphMode
+{
+  Auto,
+  VertexShader,
+  Compute
+};
+
+const char *toString(MorphMode mode);
+
+// Parse "auto", "vertex" or "compute", throw on other values
+MorphMode parseMorphMode(const std::string &str);
+
+// Whether a primitive has morph targets displacing its positions
+bool hasMorphTargets(const tinygltf::Primitive &primitive);
+
+// Morph targets of the primitives of a model, and morph weights of the nodes
+// drawing them.
+//
+// The displacements of the targets of a primitive are packed in a texture
+// buffer (RGBA32F), target after target and vertex after vertex, with one
+// texel per displaced attribute: position, then normal and tangent when the
+// targets of the primitive displace them (see PrimitiveTargets).
+//
+// Weights are compacted to the active targets (non-zero weight) of each node
+// (the primitives of a mesh have the same targets, and share its weights),
+// as (target index, weight) pairs in a texture buffer (RG32F) shared by every
+// draw and uploaded when weights change: blending costs the active targets
+// only, whatever the number of targets of the mesh.
+class MorphTargetBuffers
+{
+public:
+  // After the joint matrices of skinning
+  static const GLuint TARGETS_TEXTURE_UNIT = 17;
+  static const GLuint WEIGHTS_TEXTURE_UNIT = 18;
+
+  struct PrimitiveTargets
+  {
+    GLint vertexCount;
+    GLint targetCount;
+    GLint texelsPerVertex; // 1: position, 2: normal, 3: tangent
+    GLuint bufferObject;
+    GLuint textureObject;
+  };
+
+  // Displacements of targets with an invalid accessor are zeros (with a
+  // message on the error output)
+  explicit MorphTargetBuffers(const tinygltf::Model &model);
+  ~MorphTargetBuffers();
+
+  MorphTargetBuffers(const MorphTargetBuffers &) = delete;
+  MorphTargetBuffers &operator=(const MorphTargetBuffers &) = delete;
+
+  // Number of primitives with targets, and of their targets
+  size_t primitiveCount() const { return m_PrimitiveCount; }
+  size_t targetCount() const { return m_TargetCount; }
+
+  // Whether a primitive of meshIdx has targets
+  bool hasTargets(int meshIdx) const
+  {
+    return meshIdx >= 0 && size_t(meshIdx) < m_FirstPrimitives.size() &&
+           m_FirstPrimitives[meshIdx] >= 0;
+  }
+
+  // Targets of primitiveIdx of meshIdx, nullptr if it has none
+  const PrimitiveTargets *targets(int meshIdx, size_t primitiveIdx) const;
+
+  // Compact and upload the weights of the nodes if they changed since the
+  // last call. Return true if they did.
+  bool update(const SceneHierarchy &hierarchy);
+
+  // Active targets of node in the weight buffer: index of the first one, and
+  // count (both 0 if the node has no morph targets)
+  GLint activeTargetOffset(int node) const
+  {
+    return m_ActiveTargets[node].first;
+  }
+  GLint activeTargetCount(int node) const
+  {
+    return m_ActiveTargets[node].second;
+  }
+
+  // Total active targets of the last update()
+  size_t activeTargetCount() const { return m_Weights.size(); }
+
+  // Bind the weight buffer on WEIGHTS_TEXTURE_UNIT, once per frame
+  void bindWeights() const;
+
+  // Bind the targets of a primitive on TARGETS_TEXTURE_UNIT
+  void bindTargets(const PrimitiveTargets &targets) const;
+
+private:
+  // Primitives of the meshes with targets, with a 0 targetCount for those
+  // without
+  std::vector<PrimitiveTargets> m_Primitives;
+  // First primitive of each mesh, -1 for meshes without targets
+  std::vector<int> m_FirstPrimitives;
+  size_t m_PrimitiveCount = 0;
+  size_t m_TargetCount = 0;
+  std::vector<int> m_MorphedNodes; // Nodes drawing targets
+  std::vector<std::pair<GLint, GLint>> m_ActiveTargets; // Of each node
+  std::vector<glm::vec2> m_Weights; // (target index, weight) pairs
+  GLuint m_WeightBufferObject = 0;
+  GLuint m_WeightTextureObject = 0;
+  uint64_t m_WeightsGeneration = 0;
+};
+
+// Vertices of primitives with morph targets blended ahead of their draws by a
+// compute shader (MorphMode::Compute), for each node drawing them. Base
+// vertices are decoded once per primitive; blended positions, normals and
+// tangents are written to a buffer per instance that a copy of the vertex
+// array object of the primitive draws instead of the base vertices. An
+// instance is only blended again when its weights change.
+//
+// Skinned instances are drawn with their joints and weights: the vertex
+// shader skins the blended vertices.
+class PreBlendedPrimitives
+{
+public:
+  // primitiveVao gives the vertex array object of a primitive (mesh index,
+  // primitive index), for its texture coordinates, skin and indices
+  PreBlendedPrimitives(const tinygltf::Model &model,
+      const fs::path &computeShaderPath, const MorphTargetBuffers &targets,
+      const std::function<GLuint(int, size_t)> &primitiveVao);
+  ~PreBlendedPrimitives();
+
+  PreBlendedPrimitives(const PreBlendedPrimitives &) = delete;
+  PreBlendedPrimitives &operator=(const PreBlendedPrimitives &) = delete;
+
+  size_t size() const { return m_Instances.size(); }
+
+  // Vertex array object drawing primitiveIdx of the mesh of node blended by
+  // the weights of node, 0 if it is not pre-blended
+  GLuint vertexArrayObject(int node, size_t primitiveIdx) const;
+
+  // Blend the instances whose weights changed since they were last blended,
+  // after targets.update(hierarchy). Return the number of instances blended.
+  size_t update(const SceneHierarchy &hierarchy);
+
+private:
+  struct Instance
+  {
+    const MorphTargetBuffers::PrimitiveTargets *pTargets;
+    GLuint baseBuffer; // Of the primitive, shared by its instances
+    GLuint blendedBuffer;
+    GLuint vertexArrayObject;
+  };
+
+  const MorphTargetBuffers &m_Targets;
+  GLProgram m_Program;
+  GLint m_UniformMorphParameters;
+  std::vector<Instance> m_Instances;
+  std::vector<GLuint> m_BaseBuffers;
+  // First instance and instance count of each node with morph targets, and
+  // weights it was last blended with
+  std::map<int, std::pair<size_t, size_t>> m_NodeInstances;
+  std::map<int, std::vector<float>> m_BlendedWeights;
+};
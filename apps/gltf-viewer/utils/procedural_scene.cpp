@@ -0,0 +1,375 @@
+#include "procedural_scene.hpp"
+#include "trace.hpp"
+
+#include <glm/glm.hpp>
+#include <glm/gtc/constants.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+namespace
+{
+
+// Distance between two nodes of the grid, spheres have a radius around 1
+const float NODE_SPACING = 3.f;
+
+struct SphereVertices
+{
+  std::vector<glm::vec3> positions;
+  std::vector<glm::vec3> normals;
+  std::vector<glm::vec4> tangents;
+  std::vector<glm::vec2> texCoords;
+  std::vector<uint32_t> indices;
+};
+
+// UV sphere of about triangleCount triangles, with bumps of frequency
+// bumpFrequency
+SphereVertices makeBumpySphere(uint32_t triangleCount, int bumpFrequency,
+    const glm::vec3 &center, float radius)
+{
+  // rings * segments quads, with twice as many segments as rings
+  const auto rings = std::max(2u,
+      uint32_t(std::lround(std::sqrt(std::max(triangleCount, 1u) / 4.))));
+  const auto segments =
+      std::max(3u, (std::max(triangleCount, 1u) + 2 * rings - 1) / (2 * rings));
+
+  SphereVertices sphere;
+  const auto vertexCount = size_t(rings + 1) * (segments + 1);
+  sphere.positions.reserve(vertexCount);
+  sphere.texCoords.reserve(vertexCount);
+  sphere.tangents.reserve(vertexCount);
+  for (uint32_t ring = 0; ring <= rings; ++ring) {
+    const auto theta = glm::pi<float>() * ring / rings;
+    for (uint32_t segment = 0; segment <= segments; ++segment) {
+      const auto phi = 2.f * glm::pi<float>() * segment / segments;
+      const auto direction = glm::vec3(std::sin(theta) * std::cos(phi),
+          std::cos(theta), std::sin(theta) * std::sin(phi));
+      const auto bump = 1.f + 0.08f * std::sin(bumpFrequency * theta) *
+                                  std::sin(bumpFrequency * phi);
+      sphere.positions.push_back(center + radius * bump * direction);
+      sphere.texCoords.emplace_back(float(segment) / segments,
+          float(ring) / rings);
+      sphere.tangents.emplace_back(-std::sin(phi), 0.f, std::cos(phi), 1.f);
+    }
+  }
+
+  sphere.indices.reserve(size_t(rings) * segments * 6);
+  for (uint32_t ring = 0; ring < rings; ++ring) {
+    for (uint32_t segment = 0; segment < segments; ++segment) {
+      const auto i0 = ring * (segments + 1) + segment;
+      const auto i1 = i0 + segments + 1;
+      for (const auto idx : {i0, i0 + 1, i1, i1, i0 + 1, i1 + 1}) {
+        sphere.indices.push_back(idx);
+      }
+    }
+  }
+
+  // Normals of the bumps, from the faces around each vertex
+  sphere.normals.assign(vertexCount, glm::vec3(0));
+  for (size_t i = 0; i < sphere.indices.size(); i += 3) {
+    const auto a = sphere.indices[i];
+    const auto b = sphere.indices[i + 1];
+    const auto c = sphere.indices[i + 2];
+    const auto faceNormal = glm::cross(
+        sphere.positions[b] - sphere.positions[a],
+        sphere.positions[c] - sphere.positions[a]);
+    sphere.normals[a] += faceNormal;
+    sphere.normals[b] += faceNormal;
+    sphere.normals[c] += faceNormal;
+  }
+  for (size_t i = 0; i < vertexCount; ++i) {
+    const auto length = glm::length(sphere.normals[i]);
+    sphere.normals[i] = length > 0.f
+                            ? sphere.normals[i] / length
+                            : glm::normalize(sphere.positions[i] - center);
+  }
+  return sphere;
+}
+
+// Appends arrays to the single buffer of a model
+class BufferBuilder
+{
+public:
+  explicit BufferBuilder(tinygltf::Model &model) : m_Model(model)
+  {
+    m_Model.buffers.emplace_back();
+  }
+
+  template <typename T>
+  int addAccessor(const std::vector<T> &values, int componentType, int type,
+      int target)
+  {
+    auto &data = m_Model.buffers.front().data;
+    // Elements are aligned on 4 bytes
+    data.resize((data.size() + 3) & ~size_t(3));
+
+    tinygltf::BufferView view;
+    view.buffer = 0;
+    view.byteOffset = data.size();
+    view.byteLength = values.size() * sizeof(T);
+    view.target = target;
+    const auto bytes = reinterpret_cast<const unsigned char *>(values.data());
+    data.insert(end(data), bytes, bytes + view.byteLength);
+    m_Model.bufferViews.push_back(view);
+
+    tinygltf::Accessor accessor;
+    accessor.bufferView = int(m_Model.bufferViews.size() - 1);
+    accessor.componentType = componentType;
+    accessor.count = values.size();
+    accessor.type = type;
+    m_Model.accessors.push_back(accessor);
+    return int(m_Model.accessors.size() - 1);
+  }
+
+private:
+  tinygltf::Model &m_Model;
+};
+
+// Texel returns the color of a texel from its coordinates
+template <typename Texel>
+void addImage(tinygltf::Model &model, const std::string &name, uint32_t size,
+    Texel texel)
+{
+  tinygltf::Image image;
+  image.name = name;
+  image.width = int(size);
+  image.height = int(size);
+  image.component = 4;
+  image.bits = 8;
+  image.pixel_type = TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE;
+  image.mimeType = "image/png";
+  image.image.resize(size_t(size) * size * 4);
+  for (uint32_t y = 0; y < size; ++y) {
+    for (uint32_t x = 0; x < size; ++x) {
+      const auto value = texel(x, y);
+      std::memcpy(&image.image[(size_t(y) * size + x) * 4], &value, 4);
+    }
+  }
+  model.images.push_back(std::move(image));
+
+  tinygltf::Texture texture;
+  texture.name = name;
+  texture.sampler = 0;
+  texture.source = int(model.images.size() - 1);
+  model.textures.push_back(texture);
+}
+
+// Color of material idx, hues spread around the color wheel
+glm::vec3 materialColor(uint32_t idx)
+{
+  const auto hue = std::fmod(idx * 0.618034f, 1.f);
+  const auto channel = [&](float offset) {
+    return 0.5f + 0.45f * std::cos(2.f * glm::pi<float>() * (hue + offset));
+  };
+  return glm::vec3(channel(0.f), channel(1.f / 3.f), channel(2.f / 3.f));
+}
+
+// Branching factor of a balanced tree of nodeCount nodes over depth levels
+uint32_t getBranching(uint32_t nodeCount, uint32_t depth)
+{
+  if (depth <= 1) {
+    return std::max(nodeCount, 1u);
+  }
+  for (uint32_t branching = 2;; ++branching) {
+    double capacity = 0.;
+    double levelSize = 1.;
+    for (uint32_t level = 0; level < depth; ++level) {
+      levelSize *= branching;
+      capacity += levelSize;
+    }
+    if (capacity >= nodeCount) {
+      return branching;
+    }
+  }
+}
+
+} // namespace
+
+tinygltf::Model generateProceduralScene(const ProceduralSceneParams &params)
+{
+  TraceScope trace{"Generate"};
+
+  tinygltf::Model model;
+  model.asset.version = "2.0";
+  model.asset.generator = "gltf-viewer procedural scene";
+  BufferBuilder buffer{model};
+
+  // Materials, with a base color texture each and a shared normal map
+  const auto materialCount = std::max(params.materialCount, 1u);
+  const auto textureSize = params.textureSize;
+  if (textureSize) {
+    tinygltf::Sampler sampler;
+    sampler.magFilter = TINYGLTF_TEXTURE_FILTER_LINEAR;
+    sampler.minFilter = TINYGLTF_TEXTURE_FILTER_LINEAR_MIPMAP_LINEAR;
+    sampler.wrapS = TINYGLTF_TEXTURE_WRAP_REPEAT;
+    sampler.wrapT = TINYGLTF_TEXTURE_WRAP_REPEAT;
+    model.samplers.push_back(sampler);
+
+    // Rounded tiles
+    addImage(model, "normal", textureSize, [&](uint32_t x, uint32_t y) {
+      const auto tile = std::max(textureSize / 16, 1u);
+      const auto dx = 2.f * float(x % tile) / tile - 1.f;
+      const auto dy = 2.f * float(y % tile) / tile - 1.f;
+      const auto normal = glm::normalize(glm::vec3(0.5f * dx, 0.5f * dy, 1.f));
+      return glm::u8vec4(glm::vec3(127.5f) + 127.f * normal, 255);
+    });
+  }
+  for (uint32_t materialIdx = 0; materialIdx < materialCount; ++materialIdx) {
+    const auto color = materialColor(materialIdx);
+    tinygltf::Material material;
+    material.name = "material" + std::to_string(materialIdx);
+    material.emissiveFactor = {0., 0., 0.}; // Left empty by tinygltf
+    auto &pbr = material.pbrMetallicRoughness;
+    pbr.metallicFactor = (materialIdx % 4) / 3.;
+    pbr.roughnessFactor = 0.2 + 0.8 * ((materialIdx / 4) % 4) / 3.;
+    if (textureSize) {
+      // Checkerboard of the color of the material and white, tinted by the
+      // factor
+      const auto name = "baseColor" + std::to_string(materialIdx);
+      addImage(model, name, textureSize, [&](uint32_t x, uint32_t y) {
+        const auto cell = std::max(textureSize / 8, 1u);
+        const auto white = ((x / cell) + (y / cell)) % 2 == 0;
+        return white ? glm::u8vec4(255)
+                     : glm::u8vec4(glm::vec3(255.f) * color, 255);
+      });
+      pbr.baseColorTexture.index = int(model.textures.size() - 1);
+      material.normalTexture.index = 0;
+    } else {
+      pbr.baseColorFactor = {color.r, color.g, color.b, 1.};
+    }
+    model.materials.push_back(material);
+  }
+
+  // Meshes, the primitives of a mesh around its center
+  const auto nodeCount = std::max(params.nodeCount, 1u);
+  const auto meshCount = std::max(1u,
+      uint32_t(std::ceil(nodeCount *
+                         (1. - std::min(std::max(params.instancingRatio, 0.f),
+                                   1.f)))));
+  const auto primitiveCount = std::max(params.primitivesPerMesh, 1u);
+  for (uint32_t meshIdx = 0; meshIdx < meshCount; ++meshIdx) {
+    tinygltf::Mesh mesh;
+    mesh.name = "mesh" + std::to_string(meshIdx);
+    for (uint32_t primitiveIdx = 0; primitiveIdx < primitiveCount;
+         ++primitiveIdx) {
+      const auto angle = 2.f * glm::pi<float>() * primitiveIdx / primitiveCount;
+      const auto center = primitiveCount > 1
+                              ? 0.6f * glm::vec3(std::cos(angle), 0.f,
+                                           std::sin(angle))
+                              : glm::vec3(0);
+      const auto radius = primitiveCount > 1 ? 0.5f : 1.f;
+      const auto sphere = makeBumpySphere(params.trianglesPerPrimitive,
+          2 + int((meshIdx + primitiveIdx) % 6), center, radius);
+
+      tinygltf::Primitive primitive;
+      primitive.mode = TINYGLTF_MODE_TRIANGLES;
+      primitive.material =
+          int((meshIdx * primitiveCount + primitiveIdx) % materialCount);
+      const auto positions = buffer.addAccessor(sphere.positions,
+          TINYGLTF_COMPONENT_TYPE_FLOAT, TINYGLTF_TYPE_VEC3,
+          TINYGLTF_TARGET_ARRAY_BUFFER);
+      auto &positionAccessor = model.accessors[positions];
+      positionAccessor.minValues.assign(3, 1e30);
+      positionAccessor.maxValues.assign(3, -1e30);
+      for (const auto &position : sphere.positions) {
+        for (int i = 0; i < 3; ++i) {
+          positionAccessor.minValues[i] =
+              std::min(positionAccessor.minValues[i], double(position[i]));
+          positionAccessor.maxValues[i] =
+              std::max(positionAccessor.maxValues[i], double(position[i]));
+        }
+      }
+      primitive.attributes["POSITION"] = positions;
+      primitive.attributes["NORMAL"] = buffer.addAccessor(sphere.normals,
+          TINYGLTF_COMPONENT_TYPE_FLOAT, TINYGLTF_TYPE_VEC3,
+          TINYGLTF_TARGET_ARRAY_BUFFER);
+      primitive.attributes["TEXCOORD_0"] = buffer.addAccessor(
+          sphere.texCoords, TINYGLTF_COMPONENT_TYPE_FLOAT, TINYGLTF_TYPE_VEC2,
+          TINYGLTF_TARGET_ARRAY_BUFFER);
+      if (textureSize) {
+        primitive.attributes["TANGENT"] = buffer.addAccessor(sphere.tangents,
+            TINYGLTF_COMPONENT_TYPE_FLOAT, TINYGLTF_TYPE_VEC4,
+            TINYGLTF_TARGET_ARRAY_BUFFER);
+      }
+      primitive.indices = buffer.addAccessor(sphere.indices,
+          TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT, TINYGLTF_TYPE_SCALAR,
+          TINYGLTF_TARGET_ELEMENT_ARRAY_BUFFER);
+      mesh.primitives.push_back(primitive);
+    }
+    model.meshes.push_back(mesh);
+  }
+
+  // Nodes on a square grid centered on the origin, in a balanced tree under
+  // a root node: the children of the root are the first branching nodes, the
+  // children of node i the branching nodes from (i + 1) * branching. Only
+  // translations, relative to the parent.
+  const auto side = uint32_t(std::ceil(std::sqrt(double(nodeCount))));
+  const auto gridPosition = [&](uint32_t nodeIdx) {
+    return NODE_SPACING *
+           glm::vec3(float(nodeIdx % side) - 0.5f * (side - 1), 0.f,
+               float(nodeIdx / side) - 0.5f * (side - 1));
+  };
+  const auto branching = getBranching(nodeCount, params.hierarchyDepth);
+
+  model.nodes.resize(size_t(nodeCount) + 1);
+  model.nodes[0].name = "root";
+  for (uint32_t nodeIdx = 0; nodeIdx < nodeCount; ++nodeIdx) {
+    auto &node = model.nodes[nodeIdx + 1];
+    node.name = "node" + std::to_string(nodeIdx);
+    node.mesh = int(nodeIdx % meshCount);
+    auto translation = gridPosition(nodeIdx);
+    if (nodeIdx >= branching) {
+      const auto parentIdx = nodeIdx / branching - 1;
+      translation -= gridPosition(parentIdx);
+      model.nodes[parentIdx + 1].children.push_back(int(nodeIdx + 1));
+    } else {
+      model.nodes[0].children.push_back(int(nodeIdx + 1));
+    }
+    node.translation = {translation.x, translation.y, translation.z};
+  }
+
+  tinygltf::Scene scene;
+  scene.nodes.push_back(0);
+  model.scenes.push_back(scene);
+  model.defaultScene = 0;
+  return model;
+}
+
+const std::vector<std::string> &standardSceneNames()
+{
+  static const std::vector<std::string> names{
+      "draw-calls", "triangles", "hierarchy", "textures"};
+  return names;
+}
+
+ProceduralSceneParams getStandardScene(const std::string &name)
+{
+  ProceduralSceneParams params;
+  if (name == "draw-calls") {
+    params.nodeCount = 4096;
+    params.instancingRatio = 0.99f;
+    params.trianglesPerPrimitive = 32;
+    params.materialCount = 16;
+  } else if (name == "triangles") {
+    params.nodeCount = 16;
+    params.instancingRatio = 0.f;
+    params.primitivesPerMesh = 2;
+    params.trianglesPerPrimitive = 32768;
+    params.materialCount = 4;
+  } else if (name == "hierarchy") {
+    params.nodeCount = 4096;
+    params.hierarchyDepth = 12;
+    params.instancingRatio = 0.95f;
+    params.trianglesPerPrimitive = 64;
+  } else if (name == "textures") {
+    params.nodeCount = 64;
+    params.instancingRatio = 0.75f;
+    params.materialCount = 64;
+    params.textureSize = 512;
+  } else {
+    throw std::runtime_error("Unknown scene " + name);
+  }
+  return params;
+}
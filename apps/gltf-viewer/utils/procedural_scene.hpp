@@ -0,0 +1,41 @@
+#pragma once
+
+#include <tiny_gltf.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Shape of a generated scene: a grid of nodes drawing bumpy spheres, with
+// every size controlled, for benchmarks that need no download
+struct ProceduralSceneParams
+{
+  uint32_t nodeCount = 1024; // Nodes drawing a mesh
+  // Levels of the node hierarchy: 1 puts every node under the root, more
+  // levels nest them in a balanced tree
+  uint32_t hierarchyDepth = 1;
+  // Fraction of the nodes drawing a mesh already drawn by another node, from
+  // 0 (a mesh per node) to 1 (a single mesh)
+  float instancingRatio = 0.9f;
+  uint32_t primitivesPerMesh = 1;
+  uint32_t trianglesPerPrimitive = 512; // Rounded to a sphere tessellation
+  uint32_t materialCount = 8;
+  // Width and height of the base color texture of each material, and of the
+  // normal map they share. 0 for materials without textures.
+  uint32_t textureSize = 0;
+};
+
+// Generate a scene in memory, as if loaded from a file (a single buffer, and
+// decoded RGBA8 images). Same parameters, same scene.
+tinygltf::Model generateProceduralScene(const ProceduralSceneParams &params);
+
+// Standard scenes of benchmarks:
+// - draw-calls: many small instanced meshes
+// - triangles: a few dense meshes
+// - hierarchy: a deep node hierarchy
+// - textures: many textured materials
+const std::vector<std::string> &standardSceneNames();
+
+// Parameters of a standard scene, throw std::runtime_error if there is none
+// with this name
+ProceduralSceneParams getStandardScene(const std::string &name);
@@ -0,0 +1,284 @@
+#include "profiler.hpp"
+
+#include "reports.hpp"
+
+#include <imgui.h>
+
+#include <algorithm>
+#include <cfloat>
+#include <cstdio>
+
+namespace
+{
+
+const char *const FRAME_SERIES = "Frame";
+
+} // namespace
+
+const size_t FrameProfiler::HISTORY_SIZE;
+
+void FrameCounters::addDraw(GLenum mode, GLsizei count)
+{
+  ++drawCalls;
+  switch (mode) {
+  case GL_TRIANGLES:
+    triangles += count / 3;
+    break;
+  case GL_TRIANGLE_STRIP:
+  case GL_TRIANGLE_FAN:
+    triangles += count > 2 ? count - 2 : 0;
+    break;
+  default:
+    break;
+  }
+}
+
+FrameProfiler::CpuScope::CpuScope(FrameProfiler &profiler, const char *name) :
+    m_Profiler(profiler),
+    m_Series(profiler.getSeries(name, false)),
+    m_Start(Clock::now()),
+    m_Trace(name)
+{
+}
+
+FrameProfiler::CpuScope::~CpuScope()
+{
+  m_Profiler.m_Series[m_Series].frameMs +=
+      std::chrono::duration<double, std::milli>(Clock::now() - m_Start)
+          .count();
+}
+
+FrameProfiler::GpuScope::GpuScope(FrameProfiler &profiler, const char *name) :
+    m_pProfiler(profiler.m_Timestamps ||
+                        (profiler.m_GpuTimers && !profiler.m_GpuScopeActive)
+                    ? &profiler
+                    : nullptr),
+    m_Query(profiler.m_FrameQueries.size())
+{
+  if (!m_pProfiler) {
+    return;
+  }
+  const auto series = profiler.getSeries(name, true);
+  if (profiler.m_Timestamps) {
+    const auto query = profiler.acquireQuery();
+    profiler.m_FrameQueries.push_back(
+        PassQuery{series, query, profiler.acquireQuery()});
+    glQueryCounter(query, GL_TIMESTAMP);
+    return;
+  }
+  const auto query = profiler.acquireQuery();
+  profiler.m_FrameQueries.push_back(PassQuery{series, query, 0});
+  profiler.m_GpuScopeActive = true;
+  glBeginQuery(GL_TIME_ELAPSED, query);
+}
+
+FrameProfiler::GpuScope::~GpuScope()
+{
+  if (!m_pProfiler) {
+    return;
+  }
+  if (m_pProfiler->m_Timestamps) {
+    glQueryCounter(
+        m_pProfiler->m_FrameQueries[m_Query].endQuery, GL_TIMESTAMP);
+    return;
+  }
+  glEndQuery(GL_TIME_ELAPSED);
+  m_pProfiler->m_GpuScopeActive = false;
+}
+
+FrameProfiler::FrameProfiler(bool gpuTimers) :
+    m_GpuTimers(gpuTimers), m_Timestamps(traceEnabled())
+{
+  getSeries(FRAME_SERIES, false);
+  if (m_Timestamps) {
+    GLint64 gpuNanoseconds = 0;
+    glGetInteger64v(GL_TIMESTAMP, &gpuNanoseconds);
+    m_GpuClockOffsetUs = traceTimeUs() - gpuNanoseconds / 1000;
+  }
+}
+
+FrameProfiler::~FrameProfiler()
+{
+  if (m_FrameStarted && traceEnabled()) {
+    const auto nowUs = traceTimeUs();
+    recordTrace(FRAME_SERIES, m_FrameStartUs, nowUs - m_FrameStartUs);
+  }
+  // The passes of the last frames are waited for, to be in the trace
+  if (m_Timestamps) {
+    if (!m_FrameQueries.empty()) {
+      m_PendingFrames.emplace_back(std::move(m_FrameQueries));
+      m_FrameQueries.clear();
+    }
+    glFinish();
+    collectQueries();
+  }
+  const auto freeQueries = [&](const FrameQueries &frame) {
+    for (const auto &query : frame) {
+      m_FreeQueries.push_back(query.query);
+      if (query.endQuery) {
+        m_FreeQueries.push_back(query.endQuery);
+      }
+    }
+  };
+  for (const auto &frame : m_PendingFrames) {
+    freeQueries(frame);
+  }
+  freeQueries(m_FrameQueries);
+  glDeleteQueries(GLsizei(m_FreeQueries.size()), m_FreeQueries.data());
+}
+
+void FrameProfiler::newFrame()
+{
+  const auto now = Clock::now();
+  if (m_FrameStarted) {
+    m_Series[0].frameMs =
+        std::chrono::duration<double, std::milli>(now - m_FrameStart).count();
+    for (auto &series : m_Series) {
+      if (!series.gpu) {
+        push(series, float(series.frameMs));
+      }
+    }
+    m_LastCounters = m_Counters;
+  }
+  if (traceEnabled()) {
+    const auto nowUs = traceTimeUs();
+    if (m_FrameStarted) {
+      recordTrace(FRAME_SERIES, m_FrameStartUs, nowUs - m_FrameStartUs);
+    }
+    m_FrameStartUs = nowUs;
+  }
+  m_FrameStarted = true;
+  m_FrameStart = now;
+  for (auto &series : m_Series) {
+    series.frameMs = 0.;
+  }
+  m_Counters = FrameCounters{};
+
+  if (!m_FrameQueries.empty()) {
+    m_PendingFrames.emplace_back(std::move(m_FrameQueries));
+    m_FrameQueries.clear();
+  }
+  collectQueries();
+}
+
+void FrameProfiler::collectQueries()
+{
+  // Frames complete in order: stop at the first one still running
+  const auto isAvailable = [](GLuint query) {
+    GLint available = 0;
+    glGetQueryObjectiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+    return available != 0;
+  };
+  std::vector<double> passMs(m_Series.size());
+  while (!m_PendingFrames.empty()) {
+    const auto &frame = m_PendingFrames.front();
+    // Nested passes end after the ones they contain: any can be the last
+    if (!std::all_of(begin(frame), end(frame), [&](const PassQuery &query) {
+          return isAvailable(query.endQuery ? query.endQuery : query.query);
+        })) {
+      break;
+    }
+    std::fill(begin(passMs), end(passMs), -1.);
+    for (const auto &query : frame) {
+      GLuint64 nanoseconds = 0;
+      glGetQueryObjectui64v(query.query, GL_QUERY_RESULT, &nanoseconds);
+      m_FreeQueries.push_back(query.query);
+      if (query.endQuery) {
+        const auto beginNs = nanoseconds;
+        glGetQueryObjectui64v(query.endQuery, GL_QUERY_RESULT, &nanoseconds);
+        m_FreeQueries.push_back(query.endQuery);
+        nanoseconds = nanoseconds > beginNs ? nanoseconds - beginNs : 0;
+        recordGpuTrace(m_Series[query.series].name,
+            int64_t(beginNs / 1000) + m_GpuClockOffsetUs,
+            int64_t(nanoseconds / 1000));
+      }
+      auto &ms = passMs[query.series];
+      ms = std::max(ms, 0.) + 1e-6 * double(nanoseconds);
+    }
+    for (size_t i = 0; i < m_Series.size(); ++i) {
+      if (passMs[i] >= 0.) {
+        push(m_Series[i], float(passMs[i]));
+      }
+    }
+    m_PendingFrames.pop_front();
+  }
+}
+
+GLuint FrameProfiler::acquireQuery()
+{
+  GLuint query = 0;
+  if (!m_FreeQueries.empty()) {
+    query = m_FreeQueries.back();
+    m_FreeQueries.pop_back();
+  } else {
+    glGenQueries(1, &query);
+  }
+  return query;
+}
+
+size_t FrameProfiler::getSeries(const char *name, bool gpu)
+{
+  for (size_t i = 0; i < m_Series.size(); ++i) {
+    if (m_Series[i].name == name && m_Series[i].gpu == gpu) {
+      return i;
+    }
+  }
+  m_Series.push_back(
+      Series{name, gpu, 0., std::vector<float>(HISTORY_SIZE, 0.f), 0, 0});
+  return m_Series.size() - 1;
+}
+
+void FrameProfiler::push(Series &series, float ms)
+{
+  series.history[series.next] = ms;
+  series.next = (series.next + 1) % HISTORY_SIZE;
+  series.count = std::min(series.count + 1, HISTORY_SIZE);
+}
+
+void FrameProfiler::drawGUI()
+{
+  const auto drawSeries = [&](const Series &series) {
+    if (!series.count) {
+      return;
+    }
+    // Oldest value first
+    std::vector<float> values;
+    values.reserve(series.count);
+    const auto first =
+        (series.next + HISTORY_SIZE - series.count) % HISTORY_SIZE;
+    for (size_t i = 0; i < series.count; ++i) {
+      values.push_back(series.history[(first + i) % HISTORY_SIZE]);
+    }
+    char overlay[64];
+    std::snprintf(overlay, sizeof(overlay), "%.3f ms", values.back());
+    ImGui::PlotLines(series.name, values.data(), int(values.size()), 0,
+        overlay, 0.f, FLT_MAX, ImVec2(0, 40));
+    ImGui::Text("p50 %.3f  p95 %.3f  p99 %.3f  max %.3f ms",
+        percentile(values, 0.5f), percentile(values, 0.95f),
+        percentile(values, 0.99f),
+        *std::max_element(begin(values), end(values)));
+  };
+
+  ImGui::Text("CPU");
+  for (const auto &series : m_Series) {
+    if (!series.gpu) {
+      drawSeries(series);
+    }
+  }
+  ImGui::Separator();
+  ImGui::Text("GPU");
+  for (const auto &series : m_Series) {
+    if (series.gpu) {
+      ImGui::PushID(&series);
+      drawSeries(series);
+      ImGui::PopID();
+    }
+  }
+  ImGui::Separator();
+  const auto &counters = m_LastCounters;
+  ImGui::Text("Draw calls: %llu", (unsigned long long)counters.drawCalls);
+  ImGui::Text("Triangles: %llu", (unsigned long long)counters.triangles);
+  ImGui::Text("State changes: %llu", (unsigned long long)counters.stateChanges);
+  ImGui::Text("Texture binds: %llu", (unsigned long long)counters.textureBinds);
+  ImGui::Text("Uploaded: %.1f KB", counters.uploadedBytes / 1024.);
+}
@@ -0,0 +1,144 @@
+#pragma once
+
+#include "trace.hpp"
+
+#include <glad/glad.h>
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+// Work submitted to the GPU in a frame
+struct FrameCounters
+{
+  uint64_t drawCalls = 0;
+  uint64_t triangles = 0;
+  uint64_t stateChanges = 0; // Programs, vertex arrays and materials switched
+  uint64_t textureBinds = 0;
+  uint64_t uploadedBytes = 0;
+
+  // Count a draw of count vertices in mode
+  void addDraw(GLenum mode, GLsizei count);
+};
+
+// Frame time instrumentation: times of CPU scopes and GPU passes, and
+// counters, of the last HISTORY_SIZE frames, shown by an ImGui panel with
+// rolling graphs and percentiles.
+//
+// Scopes and passes are named by string literals, compared by address. A name
+// timed several times in a frame (tiles, supersampling passes) accumulates.
+//
+// GPU passes are timed by GL_TIME_ELAPSED queries, which cannot nest. The
+// queries of a frame are read back by a later newFrame() once they are all
+// available, from a pool of query objects that grows with the latency of the
+// GPU: reading them never stalls. GPU times lag the CPU ones by that latency,
+// usually one or two frames.
+//
+// While a trace is recorded (see trace.hpp), scopes are recorded too, and GPU
+// passes are timed by pairs of GL_TIMESTAMP queries instead, which nest: a
+// pass inside another one, or of a profiler without GPU timers, is timed.
+class FrameProfiler
+{
+  using Clock = std::chrono::steady_clock;
+
+public:
+  static const size_t HISTORY_SIZE = 256;
+
+  // Times its lifetime on the CPU
+  class CpuScope
+  {
+  public:
+    CpuScope(FrameProfiler &profiler, const char *name);
+    ~CpuScope();
+
+    CpuScope(const CpuScope &) = delete;
+    CpuScope &operator=(const CpuScope &) = delete;
+
+  private:
+    FrameProfiler &m_Profiler;
+    size_t m_Series;
+    Clock::time_point m_Start;
+    TraceScope m_Trace;
+  };
+
+  // Times the GL commands issued during its lifetime on the GPU. A pass
+  // started inside another one is not timed, nor are passes of a profiler
+  // without GPU timers, unless a trace is recorded.
+  class GpuScope
+  {
+  public:
+    GpuScope(FrameProfiler &profiler, const char *name);
+    ~GpuScope();
+
+    GpuScope(const GpuScope &) = delete;
+    GpuScope &operator=(const GpuScope &) = delete;
+
+  private:
+    FrameProfiler *m_pProfiler; // nullptr if not timed
+    size_t m_Query; // In m_FrameQueries
+  };
+
+  // Without GPU timers, GL_TIME_ELAPSED queries are left to the caller
+  explicit FrameProfiler(bool gpuTimers = true);
+  ~FrameProfiler();
+
+  FrameProfiler(const FrameProfiler &) = delete;
+  FrameProfiler &operator=(const FrameProfiler &) = delete;
+
+  // End the current frame, recording its duration, scopes and counters, and
+  // start the next one. GPU passes of previous frames are collected if their
+  // results are available.
+  void newFrame();
+
+  // Counters of the current frame
+  FrameCounters &counters() { return m_Counters; }
+
+  // Counters of the last frame
+  const FrameCounters &lastCounters() const { return m_LastCounters; }
+
+  // Graphs and percentiles of each scope and pass, and the counters
+  void drawGUI();
+
+private:
+  struct Series
+  {
+    const char *name;
+    bool gpu;
+    double frameMs; // Accumulated in the current frame (CPU only)
+    std::vector<float> history; // Ring of HISTORY_SIZE values, in ms
+    size_t next;
+    size_t count;
+  };
+
+  // GPU pass: a GL_TIME_ELAPSED query, or two GL_TIMESTAMP ones
+  struct PassQuery
+  {
+    size_t series;
+    GLuint query;
+    GLuint endQuery; // 0 for GL_TIME_ELAPSED
+  };
+
+  // GPU passes of a frame
+  using FrameQueries = std::vector<PassQuery>;
+
+  GLuint acquireQuery();
+  size_t getSeries(const char *name, bool gpu);
+  void push(Series &series, float ms);
+  void collectQueries();
+
+  std::vector<Series> m_Series;
+  FrameCounters m_Counters;
+  FrameCounters m_LastCounters;
+  Clock::time_point m_FrameStart;
+  int64_t m_FrameStartUs = 0; // In the trace
+  bool m_FrameStarted = false;
+  std::vector<GLuint> m_FreeQueries;
+  std::deque<FrameQueries> m_PendingFrames; // Oldest first
+  FrameQueries m_FrameQueries;
+  bool m_GpuTimers;
+  bool m_GpuScopeActive = false;
+  bool m_Timestamps; // Recording a trace
+  int64_t m_GpuClockOffsetUs = 0; // From GL_TIMESTAMP to trace times
+};
@@ -0,0 +1,281 @@
+#include "program_cache.hpp"
+
+#include "gl_extensions.hpp"
+#include "trace.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <unistd.h>
+#elif defined(_WIN32)
+#include <process.h>
+#define getpid _getpid
+#endif
+
+namespace
+{
+
+const uint32_t CACHE_FILE_MAGIC = 0x42504c47; // "GLPB"
+const uint32_t CACHE_FILE_VERSION = 1;
+
+struct CacheFileHeader
+{
+  uint32_t magic;
+  uint32_t version;
+  uint64_t key;
+  uint32_t binaryFormat;
+  uint32_t binaryLength;
+};
+
+// 64-bit FNV-1a
+uint64_t hashBytes(const void *data, size_t size, uint64_t hash)
+{
+  const auto *bytes = static_cast<const unsigned char *>(data);
+  for (size_t i = 0; i < size; ++i) {
+    hash ^= bytes[i];
+    hash *= 0x100000001b3ull;
+  }
+  return hash;
+}
+
+uint64_t hashString(const std::string &str, uint64_t hash)
+{
+  // Hash the size too, so that ("ab", "c") and ("a", "bc") differ
+  const uint64_t size = str.size();
+  hash = hashBytes(&size, sizeof(size), hash);
+  return hashBytes(str.data(), str.size(), hash);
+}
+
+std::string getGLString(GLenum name)
+{
+  const auto *str = reinterpret_cast<const char *>(glGetString(name));
+  return str ? str : "";
+}
+
+} // namespace
+
+ProgramBinaryCache::ProgramBinaryCache(fs::path directory) :
+    m_Directory(std::move(directory))
+{
+  if (m_Directory.empty()) {
+    return;
+  }
+
+  GLint formatCount = 0;
+  glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formatCount);
+  if (formatCount == 0) {
+    std::clog << "Program binary cache disabled: the driver does not support "
+                 "program binaries"
+              << std::endl;
+    m_Directory.clear();
+    return;
+  }
+
+  std::error_code error;
+  fs::create_directories(m_Directory, error);
+  if (error) {
+    std::cerr << "Program binary cache disabled: unable to create "
+              << m_Directory << ": " << error.message() << std::endl;
+    m_Directory.clear();
+    return;
+  }
+
+  m_DriverString = getGLString(GL_VENDOR) + "\n" + getGLString(GL_RENDERER) +
+                   "\n" + getGLString(GL_VERSION);
+}
+
+ProgramBinaryCache::PendingProgram ProgramBinaryCache::beginProgram(
+    const std::vector<fs::path> &shaderPaths,
+    const std::vector<std::string> &defines)
+{
+  TraceScope trace{"Shader compile"};
+  PendingProgram pending;
+  pending.shaderPaths = shaderPaths;
+  for (const auto &path : shaderPaths) {
+    pending.sources.emplace_back(
+        injectDefines(loadShaderSource(path), defines));
+  }
+
+  if (enabled()) {
+    uint64_t key = 0xcbf29ce484222325ull;
+    key = hashString(m_DriverString, key);
+    for (size_t i = 0; i < shaderPaths.size(); ++i) {
+      key = hashString(getShaderType(shaderPaths[i]).second, key);
+      key = hashString(pending.sources[i], key);
+    }
+
+    char filename[32];
+    std::snprintf(filename, sizeof(filename), "%016llx.bin",
+        static_cast<unsigned long long>(key));
+    pending.key = key;
+    pending.cachePath = m_Directory / filename;
+
+    if (restoreBinary(pending)) {
+      return pending;
+    }
+  }
+
+  compileShaders(pending);
+  return pending;
+}
+
+bool ProgramBinaryCache::isComplete(const PendingProgram &pending) const
+{
+  if (!GLAD_GL_KHR_parallel_shader_compile) {
+    return true;
+  }
+  GLint complete = GL_TRUE;
+  glGetProgramiv(pending.program.glId(), GL_COMPLETION_STATUS_KHR, &complete);
+  return complete == GL_TRUE;
+}
+
+GLProgram ProgramBinaryCache::finishProgram(PendingProgram pending)
+{
+  TraceScope trace{"Shader link"};
+  if (pending.shaders.empty()) {
+    if (pending.program.getLinkStatus()) {
+      std::clog << "Loaded program binary " << pending.cachePath << "\n";
+      std::lock_guard<std::mutex> lock(m_StatsMutex);
+      ++m_LoadedCount;
+      return std::move(pending.program);
+    }
+    std::clog << "Program binary " << pending.cachePath
+              << " rejected by the driver, compiling" << std::endl;
+    pending.program = GLProgram{};
+    compileShaders(pending);
+  }
+
+  if (!pending.program.getLinkStatus()) {
+    // Report the compile errors of the shaders first, if any
+    for (size_t i = 0; i < pending.shaders.size(); ++i) {
+      const auto &shader = pending.shaders[i];
+      if (!shader.getCompileStatus()) {
+        std::cerr << "Shader compilation error (" << pending.shaderPaths[i]
+                  << "):" << shader.getInfoLog() << std::endl;
+        throw std::runtime_error(
+            "Shader compilation error:" + shader.getInfoLog());
+      }
+    }
+    std::cerr << "Program link error:" << pending.program.getInfoLog()
+              << std::endl;
+    throw std::runtime_error(
+        "Program link error:" + pending.program.getInfoLog());
+  }
+
+  if (enabled()) {
+    saveBinary(pending);
+  }
+  {
+    std::lock_guard<std::mutex> lock(m_StatsMutex);
+    ++m_CompiledCount;
+  }
+  return std::move(pending.program);
+}
+
+size_t ProgramBinaryCache::loadedCount() const
+{
+  std::lock_guard<std::mutex> lock(m_StatsMutex);
+  return m_LoadedCount;
+}
+
+size_t ProgramBinaryCache::compiledCount() const
+{
+  std::lock_guard<std::mutex> lock(m_StatsMutex);
+  return m_CompiledCount;
+}
+
+void ProgramBinaryCache::compileShaders(PendingProgram &pending) const
+{
+  pending.shaders.clear();
+  for (size_t i = 0; i < pending.shaderPaths.size(); ++i) {
+    const auto type = getShaderType(pending.shaderPaths[i]);
+    std::clog << "Compiling " << type.second << " shader "
+              << pending.shaderPaths[i] << "\n";
+
+    GLShader shader{type.first};
+    shader.setSource(pending.sources[i]);
+    glCompileShader(shader.glId());
+    pending.program.attachShader(shader);
+    pending.shaders.emplace_back(std::move(shader));
+  }
+  if (enabled()) {
+    glProgramParameteri(
+        pending.program.glId(), GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+  }
+  glLinkProgram(pending.program.glId());
+}
+
+bool ProgramBinaryCache::restoreBinary(PendingProgram &pending) const
+{
+  std::ifstream input(pending.cachePath.string(), std::ios::binary);
+  if (!input) {
+    return false;
+  }
+
+  CacheFileHeader header;
+  if (!input.read(reinterpret_cast<char *>(&header), sizeof(header)) ||
+      header.magic != CACHE_FILE_MAGIC ||
+      header.version != CACHE_FILE_VERSION || header.key != pending.key) {
+    return false;
+  }
+
+  std::vector<char> binary(header.binaryLength);
+  if (!input.read(binary.data(), binary.size())) {
+    return false;
+  }
+
+  glProgramBinary(pending.program.glId(), header.binaryFormat, binary.data(),
+      GLsizei(binary.size()));
+  return true;
+}
+
+void ProgramBinaryCache::saveBinary(const PendingProgram &pending) const
+{
+  const auto &program = pending.program;
+  const auto &path = pending.cachePath;
+
+  GLint length = 0;
+  glGetProgramiv(program.glId(), GL_PROGRAM_BINARY_LENGTH, &length);
+  if (length <= 0) {
+    return;
+  }
+
+  std::vector<char> binary(length);
+  GLenum format = 0;
+  glGetProgramBinary(program.glId(), length, &length, &format, binary.data());
+
+  const CacheFileHeader header{CACHE_FILE_MAGIC, CACHE_FILE_VERSION,
+      pending.key, format, uint32_t(length)};
+
+  // Write to a temporary file then rename it, so that concurrent runs never
+  // read a partially written binary. The name is unique per process: the
+  // workers of a render farm share the cache directory.
+  auto tmpPath = path;
+  tmpPath += "." + std::to_string(getpid()) + "." +
+             std::to_string(
+                 std::chrono::steady_clock::now().time_since_epoch().count()) +
+             ".tmp";
+  {
+    std::ofstream output(tmpPath.string(), std::ios::binary);
+    output.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    output.write(binary.data(), length);
+    if (!output) {
+      std::cerr << "Unable to write program binary " << tmpPath << std::endl;
+      output.close();
+      std::error_code error;
+      fs::remove(tmpPath, error);
+      return;
+    }
+  }
+  std::error_code error;
+  fs::rename(tmpPath, path, error);
+  if (error) {
+    std::cerr << "Unable to write program binary " << path << ": "
+              << error.message() << std::endl;
+    fs::remove(tmpPath, error);
+  }
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include "filesystem.hpp"
+#include "shaders.hpp"
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Persists linked programs in a directory with glGetProgramBinary, so that
+// later runs restore them with glProgramBinary instead of compiling shaders.
+//
+// A program is identified by a hash of its shader sources (after defines are
+// injected) and of the vendor, renderer and version strings of the driver:
+// editing a shader or updating the driver selects a new entry. If the driver
+// rejects a binary anyway, the program is compiled again and its entry
+// rewritten.
+//
+// Builds are split in beginProgram() and finishProgram() so that the driver
+// can compile in the background in between (GL_KHR_parallel_shader_compile):
+// beginProgram() never queries a compile or link status.
+class ProgramBinaryCache
+{
+public:
+  // A program whose shaders may still be compiling and linking
+  struct PendingProgram
+  {
+    GLProgram program;
+    std::vector<fs::path> shaderPaths;
+    std::vector<std::string> sources; // With defines injected
+    std::vector<GLShader> shaders;    // Empty if restored from a binary
+    fs::path cachePath;
+    uint64_t key = 0;
+  };
+
+  // An empty directory disables the cache: programs are always compiled.
+  explicit ProgramBinaryCache(fs::path directory);
+
+  bool enabled() const { return !m_Directory.empty(); }
+
+  // Start restoring or compiling the program of shaderPaths with defines
+  PendingProgram beginProgram(const std::vector<fs::path> &shaderPaths,
+      const std::vector<std::string> &defines = {});
+
+  // Whether finishProgram(pending) would not block, always true without
+  // GL_KHR_parallel_shader_compile
+  bool isComplete(const PendingProgram &pending) const;
+
+  // Check the link status of pending, throw on errors, and save its binary
+  // if it was compiled
+  GLProgram finishProgram(PendingProgram pending);
+
+  // Same as compileProgram(shaderPaths, defines), through the cache.
+  GLProgram compileProgram(const std::vector<fs::path> &shaderPaths,
+      const std::vector<std::string> &defines = {})
+  {
+    return finishProgram(beginProgram(shaderPaths, defines));
+  }
+
+  // Statistics since construction. Builds may run on several threads
+  // (see ProgramCompiler), each one with its own GL context.
+  size_t loadedCount() const;
+  size_t compiledCount() const;
+
+private:
+  void compileShaders(PendingProgram &pending) const;
+  bool restoreBinary(PendingProgram &pending) const;
+  void saveBinary(const PendingProgram &pending) const;
+
+  fs::path m_Directory;
+  std::string m_DriverString;
+
+  mutable std::mutex m_StatsMutex;
+  size_t m_LoadedCount = 0;
+  size_t m_CompiledCount = 0;
+};
@@ -0,0 +1,198 @@
+#include "program_compiler.hpp"
+
+#include "gl_extensions.hpp"
+#include "trace.hpp"
+
+#include <iostream>
+
+const char *toString(ProgramCompiler::Backend backend)
+{
+  switch (backend) {
+  case ProgramCompiler::Backend::Synchronous:
+    return "synchronous";
+  case ProgramCompiler::Backend::Parallel:
+    return "parallel (GL_KHR_parallel_shader_compile)";
+  case ProgramCompiler::Backend::BackgroundContext:
+    return "background context";
+  }
+  return "";
+}
+
+ProgramCompiler::ProgramCompiler(
+    ProgramBinaryCache &cache, GLFWwindow *window, bool allowAsync) :
+    m_Cache(cache)
+{
+  if (!allowAsync) {
+    return;
+  }
+
+  if (GLAD_GL_KHR_parallel_shader_compile) {
+    glMaxShaderCompilerThreadsKHR(0xFFFFFFFF); // As many as the driver wants
+    m_Backend = Backend::Parallel;
+    return;
+  }
+
+  // Headless contexts have no window to share objects with
+  if (!window) {
+    return;
+  }
+
+  // The hints of the rendering context (version, profile) are still set
+  glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+  m_pBackgroundWindow = glfwCreateWindow(1, 1, "", nullptr, window);
+  if (!m_pBackgroundWindow) {
+    std::clog << "Unable to create a background GL context, shaders are "
+                 "compiled synchronously"
+              << std::endl;
+    return;
+  }
+  m_Backend = Backend::BackgroundContext;
+  m_Worker = std::thread([this]() { runWorker(); });
+}
+
+ProgramCompiler::~ProgramCompiler()
+{
+  if (m_Worker.joinable()) {
+    {
+      std::lock_guard<std::mutex> lock(m_Mutex);
+      m_Stop = true;
+    }
+    m_Condition.notify_all();
+    m_Worker.join();
+  }
+  for (const auto &job : m_Jobs) {
+    if ((*job.second).fence) {
+      glDeleteSync((*job.second).fence);
+    }
+  }
+  if (m_pBackgroundWindow) {
+    glfwDestroyWindow(m_pBackgroundWindow);
+  }
+}
+
+ProgramCompiler::Ticket ProgramCompiler::submit(
+    std::vector<fs::path> shaderPaths, std::vector<std::string> defines)
+{
+  const auto ticket = m_NextTicket++;
+  auto job = std::make_unique<Job>();
+  job->shaderPaths = std::move(shaderPaths);
+  job->defines = std::move(defines);
+  auto &jobRef = *job;
+  m_Jobs.emplace(ticket, std::move(job));
+
+  switch (m_Backend) {
+  case Backend::Synchronous:
+    try {
+      jobRef.program =
+          m_Cache.compileProgram(jobRef.shaderPaths, jobRef.defines);
+    } catch (...) {
+      jobRef.error = std::current_exception();
+    }
+    jobRef.done = true;
+    break;
+  case Backend::Parallel:
+    try {
+      jobRef.pending =
+          m_Cache.beginProgram(jobRef.shaderPaths, jobRef.defines);
+    } catch (...) {
+      jobRef.error = std::current_exception();
+    }
+    jobRef.done = true;
+    break;
+  case Backend::BackgroundContext: {
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    m_Queue.push_back(&jobRef);
+  }
+    m_Condition.notify_all();
+    break;
+  }
+  return ticket;
+}
+
+bool ProgramCompiler::isReady(Ticket ticket)
+{
+  auto &job = *m_Jobs.at(ticket);
+  switch (m_Backend) {
+  case Backend::Synchronous:
+    return true;
+  case Backend::Parallel:
+    return job.error || m_Cache.isComplete(job.pending);
+  case Backend::BackgroundContext: {
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    if (!job.done) {
+      return false;
+    }
+  }
+    if (job.fence) {
+      const auto status = glClientWaitSync(job.fence, 0, 0);
+      return status == GL_ALREADY_SIGNALED ||
+             status == GL_CONDITION_SATISFIED;
+    }
+    return true;
+  }
+  return true;
+}
+
+GLProgram ProgramCompiler::take(Ticket ticket)
+{
+  const auto it = m_Jobs.find(ticket);
+  if (it == end(m_Jobs)) {
+    throw std::runtime_error("Program already taken or never submitted");
+  }
+  const auto job = std::move((*it).second);
+  m_Jobs.erase(it);
+
+  if (m_Backend == Backend::BackgroundContext) {
+    std::unique_lock<std::mutex> lock(m_Mutex);
+    m_Condition.wait(lock, [&]() { return job->done; });
+  }
+  if (job->fence) {
+    glClientWaitSync(
+        job->fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+    glDeleteSync(job->fence);
+  }
+  if (job->error) {
+    std::rethrow_exception(job->error);
+  }
+  if (m_Backend == Backend::Parallel) {
+    return m_Cache.finishProgram(std::move(job->pending));
+  }
+  return std::move(job->program);
+}
+
+void ProgramCompiler::runWorker()
+{
+  glfwMakeContextCurrent(m_pBackgroundWindow);
+  setTraceThreadName("Shader compiler");
+
+  for (;;) {
+    Job *job = nullptr;
+    {
+      std::unique_lock<std::mutex> lock(m_Mutex);
+      m_Condition.wait(lock, [&]() { return m_Stop || !m_Queue.empty(); });
+      if (m_Stop) {
+        break;
+      }
+      job = m_Queue.front();
+      m_Queue.pop_front();
+    }
+
+    try {
+      job->program = m_Cache.compileProgram(job->shaderPaths, job->defines);
+    } catch (...) {
+      job->error = std::current_exception();
+    }
+    // The rendering context must not use the program before the commands of
+    // this context that built it have completed
+    job->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    glFlush();
+
+    {
+      std::lock_guard<std::mutex> lock(m_Mutex);
+      job->done = true;
+    }
+    m_Condition.notify_all();
+  }
+
+  glfwMakeContextCurrent(nullptr);
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include "glfw.hpp"
+#include "program_cache.hpp"
+
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+// Builds programs without blocking the rendering thread on each compile and
+// link, so that all the programs needed by a scene can be requested up front.
+//
+// - Parallel: GL_KHR_parallel_shader_compile lets the driver compile on its
+// own threads; completion is polled with GL_COMPLETION_STATUS_KHR.
+// - BackgroundContext: programs are built on a worker thread with a hidden
+// GL context sharing its objects with the rendering context; completion is
+// signaled with a fence.
+// - Synchronous: programs are built by submit().
+//
+// Compile and link status are only queried by take(), which blocks if the
+// program is not ready yet.
+class ProgramCompiler
+{
+public:
+  enum class Backend
+  {
+    Synchronous,
+    Parallel,
+    BackgroundContext
+  };
+
+  using Ticket = size_t;
+
+  // window is the window of the rendering context, whose objects the
+  // background context shares (nullptr for a headless context: no background
+  // context). allowAsync == false forces Synchronous.
+  ProgramCompiler(
+      ProgramBinaryCache &cache, GLFWwindow *window, bool allowAsync = true);
+  ~ProgramCompiler();
+
+  ProgramCompiler(const ProgramCompiler &) = delete;
+  ProgramCompiler &operator=(const ProgramCompiler &) = delete;
+
+  Backend backend() const { return m_Backend; }
+
+  // Start building the program of shaderPaths with defines
+  Ticket submit(std::vector<fs::path> shaderPaths,
+      std::vector<std::string> defines = {});
+
+  // Whether take(ticket) would not block
+  bool isReady(Ticket ticket);
+
+  // The program of ticket, waiting for it if needed. Throw if it failed to
+  // build. Each ticket can be taken once.
+  GLProgram take(Ticket ticket);
+
+  // Number of submitted programs not taken yet
+  size_t pendingCount() const { return m_Jobs.size(); }
+
+private:
+  struct Job
+  {
+    std::vector<fs::path> shaderPaths;
+    std::vector<std::string> defines;
+    ProgramBinaryCache::PendingProgram pending; // Parallel backend
+    GLProgram program;                          // Other backends
+    std::exception_ptr error;
+    bool done = false;       // Guarded by m_Mutex
+    GLsync fence = nullptr;  // BackgroundContext backend
+  };
+
+  void runWorker();
+
+  ProgramBinaryCache &m_Cache;
+  Backend m_Backend = Backend::Synchronous;
+  Ticket m_NextTicket = 0;
+  std::unordered_map<Ticket, std::unique_ptr<Job>> m_Jobs;
+
+  // BackgroundContext backend
+  GLFWwindow *m_pBackgroundWindow = nullptr;
+  std::thread m_Worker;
+  std::mutex m_Mutex;
+  std::condition_variable m_Condition;
+  std::deque<Job *> m_Queue;
+  bool m_Stop = false;
+};
+
+const char *toString(ProgramCompiler::Backend backend);
@@ -0,0 +1,196 @@
+#include "render_farm.hpp"
+
+#include "reports.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#define GLMLV_RENDER_FARM_FORK 1
+#endif
+
+struct RenderFarmQueue::Shared
+{
+  // Lock free, hence usable between processes
+  std::atomic<uint64_t> nextJob{0};
+  JobStats jobs[1]; // jobCount in the mapping
+};
+
+RenderFarmQueue::RenderFarmQueue(size_t jobCount) :
+    m_JobCount(jobCount),
+    m_MappingSize(sizeof(Shared) +
+                  std::max(jobCount, size_t(1)) * sizeof(JobStats))
+{
+  static_assert(ATOMIC_LLONG_LOCK_FREE == 2,
+      "The job counter must be lock free to be shared between processes");
+#ifdef GLMLV_RENDER_FARM_FORK
+  auto *pMapping = mmap(nullptr, m_MappingSize, PROT_READ | PROT_WRITE,
+      MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if (pMapping == MAP_FAILED) {
+    throw std::runtime_error("Unable to map the render farm queue");
+  }
+#else
+  auto *pMapping = ::operator new(m_MappingSize);
+#endif
+  m_pShared = new (pMapping) Shared;
+  std::uninitialized_fill_n(m_pShared->jobs, m_JobCount, JobStats{});
+}
+
+RenderFarmQueue::~RenderFarmQueue()
+{
+  m_pShared->~Shared();
+#ifdef GLMLV_RENDER_FARM_FORK
+  munmap(m_pShared, m_MappingSize);
+#else
+  ::operator delete(m_pShared);
+#endif
+}
+
+size_t RenderFarmQueue::claim(int32_t worker)
+{
+  const auto job = size_t(m_pShared->nextJob.fetch_add(1));
+  if (job >= m_JobCount) {
+    return m_JobCount;
+  }
+  m_pShared->jobs[job].worker = worker;
+  return job;
+}
+
+void RenderFarmQueue::complete(size_t job, double seconds)
+{
+  m_pShared->jobs[job].seconds = seconds;
+  m_pShared->jobs[job].done = true;
+}
+
+const RenderFarmQueue::JobStats &RenderFarmQueue::stats(size_t job) const
+{
+  return m_pShared->jobs[job];
+}
+
+size_t runRenderFarm(
+    size_t workerCount, const std::function<int(size_t worker)> &work)
+{
+#ifdef GLMLV_RENDER_FARM_FORK
+  // Buffered output would be written again by each fork
+  std::cout.flush();
+  std::cerr.flush();
+  std::fflush(nullptr);
+
+  std::vector<pid_t> workers;
+  for (size_t worker = 0; worker < workerCount; ++worker) {
+    const auto pid = fork();
+    if (pid < 0) {
+      // The workers already forked empty the queue
+      std::cerr << "Unable to fork render farm worker " << worker << std::endl;
+      if (workers.empty()) {
+        throw std::runtime_error("Unable to fork render farm workers");
+      }
+      break;
+    }
+    if (pid == 0) {
+      // llvmpipe renders with one thread per core: share them between the
+      // workers, unless LP_NUM_THREADS is already set
+      const auto threadCount = std::max(
+          std::thread::hardware_concurrency() / unsigned(workerCount), 1u);
+      setenv("LP_NUM_THREADS", std::to_string(threadCount).c_str(), 0);
+
+      auto returnCode = 1;
+      try {
+        returnCode = work(worker);
+      } catch (const std::exception &e) {
+        std::cerr << "Render farm worker " << worker << ": " << e.what()
+                  << std::endl;
+      }
+      std::cout.flush();
+      std::cerr.flush();
+      std::fflush(nullptr);
+      // Without destroying what the parent still owns
+      _exit(returnCode);
+    }
+    workers.push_back(pid);
+  }
+
+  size_t failureCount = 0;
+  for (size_t worker = 0; worker < workers.size(); ++worker) {
+    int status = 0;
+    while (waitpid(workers[worker], &status, 0) < 0 && errno == EINTR) {
+    }
+    if (WIFSIGNALED(status)) {
+      std::cerr << "Render farm worker " << worker << " killed by signal "
+                << WTERMSIG(status) << std::endl;
+      ++failureCount;
+    } else if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+      ++failureCount;
+    }
+  }
+  return failureCount;
+#else
+  (void)workerCount;
+  (void)work;
+  throw std::runtime_error("render-farm needs fork(), only available on Unix");
+#endif
+}
+
+size_t printRenderFarmStats(std::ostream &output,
+    const RenderFarmQueue &queue, size_t workerCount, double wallSeconds)
+{
+  std::vector<double> seconds;
+  std::vector<size_t> workerJobCounts(workerCount, 0);
+  std::vector<double> workerSeconds(workerCount, 0.);
+  size_t failedCount = 0;
+  for (size_t job = 0; job < queue.jobCount(); ++job) {
+    const auto &stats = queue.stats(job);
+    if (!stats.done) {
+      ++failedCount;
+      continue;
+    }
+    seconds.push_back(stats.seconds);
+    if (size_t(stats.worker) < workerCount) {
+      ++workerJobCounts[stats.worker];
+      workerSeconds[stats.worker] += stats.seconds;
+    }
+  }
+
+  const auto ms = [](double seconds) { return 1000. * seconds; };
+  output << queue.jobCount() - failedCount << "/" << queue.jobCount()
+         << " jobs in " << ms(wallSeconds) << " ms with " << workerCount
+         << " workers (" << (queue.jobCount() - failedCount) / wallSeconds
+         << " images/s)" << std::endl;
+  if (!seconds.empty()) {
+    std::sort(begin(seconds), end(seconds));
+    double total = 0.;
+    for (const auto s : seconds) {
+      total += s;
+    }
+    output << "  per job: min " << ms(seconds.front()) << " ms, mean "
+           << ms(total / seconds.size()) << " ms, median "
+           << ms(percentile(seconds, 0.5)) << " ms, p95 " << ms(percentile(seconds, 0.95))
+           << " ms, max " << ms(seconds.back()) << " ms" << std::endl;
+  }
+  for (size_t worker = 0; worker < workerCount; ++worker) {
+    output << "  worker " << worker << ": " << workerJobCounts[worker]
+           << " jobs, " << ms(workerSeconds[worker]) << " ms" << std::endl;
+  }
+  if (failedCount) {
+    output << "  " << failedCount << " jobs were not rendered:";
+    for (size_t job = 0; job < queue.jobCount(); ++job) {
+      if (!queue.stats(job).done) {
+        output << " " << job;
+      }
+    }
+    output << std::endl;
+  }
+  return failedCount;
+}
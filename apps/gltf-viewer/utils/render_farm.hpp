@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <ostream>
+
+// Work queue of the render-farm command, shared by the processes rendering
+// its jobs. It lives in anonymous shared memory mapped before the workers are
+// forked: workers claim jobs with an atomic counter, so that fast workers take
+// more of them, and record how long each one took.
+class RenderFarmQueue
+{
+public:
+  // Outcome of a job, written by the worker that claimed it
+  struct JobStats
+  {
+    int32_t worker = -1; // -1 if the job was never claimed
+    bool done = false;   // false if its worker died while rendering it
+    double seconds = 0.; // From claim to pixels read back
+  };
+
+  explicit RenderFarmQueue(size_t jobCount);
+  ~RenderFarmQueue();
+
+  RenderFarmQueue(const RenderFarmQueue &) = delete;
+  RenderFarmQueue &operator=(const RenderFarmQueue &) = delete;
+
+  size_t jobCount() const { return m_JobCount; }
+
+  // Index of the next job for worker, jobCount() once all are claimed. Can be
+  // called from any process.
+  size_t claim(int32_t worker);
+
+  void complete(size_t job, double seconds);
+
+  const JobStats &stats(size_t job) const;
+
+private:
+  struct Shared;
+
+  size_t m_JobCount;
+  size_t m_MappingSize;
+  Shared *m_pShared;
+};
+
+// Fork workerCount processes running work(workerIndex) and wait for them.
+// The calling process must not have created an OpenGL context (it would be
+// shared by the forks): each worker creates its own. Return the number of
+// workers that failed (non zero return code or crash). Throw
+// std::runtime_error if processes cannot be forked.
+size_t runRenderFarm(
+    size_t workerCount, const std::function<int(size_t worker)> &work);
+
+// Print per job and per worker timing statistics of queue, whose jobs took
+// wallSeconds to render with workerCount workers. Return the number of jobs
+// that were not completed.
+size_t printRenderFarmStats(std::ostream &output,
+    const RenderFarmQueue &queue, size_t workerCount, double wallSeconds);
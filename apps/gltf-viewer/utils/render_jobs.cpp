@@ -0,0 +1,363 @@
+#include "render_jobs.hpp"
+
+#include <json.hpp>
+
+#include <algorithm>
+#include <cassert>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+namespace
+{
+
+std::string trim(const std::string &str)
+{
+  const auto first = str.find_first_not_of(" \t\r");
+  if (first == std::string::npos) {
+    return "";
+  }
+  const auto last = str.find_last_not_of(" \t\r");
+  return str.substr(first, last - first + 1);
+}
+
+std::vector<std::string> splitCSVLine(const std::string &line)
+{
+  std::vector<std::string> fields;
+  std::stringstream ss(line);
+  std::string field;
+  while (std::getline(ss, field, ',')) {
+    fields.emplace_back(trim(field));
+  }
+  if (!line.empty() && line.back() == ',') {
+    fields.emplace_back();
+  }
+  return fields;
+}
+
+Camera parseJSONLookat(const nlohmann::json &value, const std::string &where)
+{
+  if (!value.is_array() || value.size() != 9) {
+    throw std::runtime_error(where + "\"lookat\" must have 9 numbers");
+  }
+  float numbers[9];
+  for (size_t i = 0; i < 9; ++i) {
+    numbers[i] = value[i].get<float>();
+  }
+  return makeLookatCamera(numbers);
+}
+
+// Object of a JSON document that is either an array, or an object holding the
+// array as member name
+const nlohmann::json &getJSONArray(
+    const nlohmann::json &document, const char *name)
+{
+  const auto *array = &document;
+  if (document.is_object()) {
+    const auto it = document.find(name);
+    if (it == document.end()) {
+      throw std::runtime_error(
+          std::string("missing \"") + name + "\" array");
+    }
+    array = &(*it);
+  }
+  if (!array->is_array()) {
+    throw std::runtime_error(std::string("expected an array of ") + name);
+  }
+  return *array;
+}
+
+nlohmann::json parseJSON(std::istream &input)
+{
+  nlohmann::json document;
+  try {
+    input >> document;
+  } catch (const nlohmann::json::exception &e) {
+    throw std::runtime_error(e.what());
+  }
+  return document;
+}
+
+std::ifstream openInput(const fs::path &path)
+{
+  std::ifstream input(path.string());
+  if (!input) {
+    std::stringstream ss;
+    ss << "Unable to open file " << path;
+    throw std::runtime_error(ss.str());
+  }
+  return input;
+}
+
+RenderJob parseJSONJob(const nlohmann::json &value, size_t index,
+    uint32_t defaultWidth, uint32_t defaultHeight)
+{
+  const auto where = "job " + std::to_string(index) + ": ";
+  if (!value.is_object()) {
+    throw std::runtime_error(where + "expected an object");
+  }
+
+  RenderJob job;
+  const auto output = value.find("output");
+  if (output == value.end() || !output->is_string()) {
+    throw std::runtime_error(where + "missing \"output\" path");
+  }
+  job.output = output->get<std::string>();
+  job.width = value.value("width", defaultWidth);
+  job.height = value.value("height", defaultHeight);
+
+  const auto lookat = value.find("lookat");
+  if (lookat != value.end()) {
+    job.hasCamera = true;
+    job.camera = parseJSONLookat(*lookat, where);
+  }
+  return job;
+}
+
+std::vector<RenderJob> loadJSONJobs(
+    std::istream &input, uint32_t defaultWidth, uint32_t defaultHeight)
+{
+  const auto document = parseJSON(input);
+  const auto &jobs = getJSONArray(document, "jobs");
+
+  std::vector<RenderJob> result;
+  try {
+    for (size_t i = 0; i < jobs.size(); ++i) {
+      result.emplace_back(
+          parseJSONJob(jobs[i], i, defaultWidth, defaultHeight));
+    }
+  } catch (const nlohmann::json::exception &e) {
+    throw std::runtime_error(e.what());
+  }
+  return result;
+}
+
+std::vector<RenderJob> loadCSVJobs(
+    std::istream &input, uint32_t defaultWidth, uint32_t defaultHeight)
+{
+  std::vector<RenderJob> result;
+  std::string line;
+  for (size_t lineNumber = 1; std::getline(input, line); ++lineNumber) {
+    line = trim(line);
+    if (line.empty() || line[0] == '#') {
+      continue;
+    }
+
+    const auto where = "line " + std::to_string(lineNumber) + ": ";
+    const auto fields = splitCSVLine(line);
+    if (lineNumber == 1 && fields.size() > 1 && fields[1] == "width") {
+      continue; // Header
+    }
+    if (fields.empty() || fields[0].empty()) {
+      throw std::runtime_error(where + "missing output path");
+    }
+    if (fields.size() != 1 && fields.size() != 3 && fields.size() != 12) {
+      throw std::runtime_error(where +
+                               "expected output,width,height[,9 lookat "
+                               "numbers], got " +
+                               std::to_string(fields.size()) + " fields");
+    }
+
+    try {
+      RenderJob job;
+      job.output = fields[0];
+      job.width = fields.size() > 1 && !fields[1].empty()
+                      ? uint32_t(std::stoul(fields[1]))
+                      : defaultWidth;
+      job.height = fields.size() > 2 && !fields[2].empty()
+                       ? uint32_t(std::stoul(fields[2]))
+                       : defaultHeight;
+      if (fields.size() == 12) {
+        float numbers[9];
+        for (size_t i = 0; i < 9; ++i) {
+          numbers[i] = std::stof(fields[3 + i]);
+        }
+        job.hasCamera = true;
+        job.camera = makeLookatCamera(numbers);
+      }
+      result.emplace_back(std::move(job));
+    } catch (const std::logic_error &) {
+      // std::invalid_argument or std::out_of_range from std::sto*
+      throw std::runtime_error(where + "invalid number");
+    }
+  }
+  return result;
+}
+
+std::vector<CameraKeyframe> loadJSONKeyframes(std::istream &input)
+{
+  const auto document = parseJSON(input);
+  const auto &keyframes = getJSONArray(document, "keyframes");
+
+  std::vector<CameraKeyframe> result;
+  try {
+    for (size_t i = 0; i < keyframes.size(); ++i) {
+      const auto where = "keyframe " + std::to_string(i) + ": ";
+      const auto &value = keyframes[i];
+      if (!value.is_object() || value.find("time") == value.end() ||
+          value.find("lookat") == value.end()) {
+        throw std::runtime_error(
+            where + "expected an object with \"time\" and \"lookat\"");
+      }
+      CameraKeyframe keyframe;
+      keyframe.time = value["time"].get<float>();
+      keyframe.camera = parseJSONLookat(value["lookat"], where);
+      result.emplace_back(keyframe);
+    }
+  } catch (const nlohmann::json::exception &e) {
+    throw std::runtime_error(e.what());
+  }
+  return result;
+}
+
+std::vector<CameraKeyframe> loadCSVKeyframes(std::istream &input)
+{
+  std::vector<CameraKeyframe> result;
+  std::string line;
+  for (size_t lineNumber = 1; std::getline(input, line); ++lineNumber) {
+    line = trim(line);
+    if (line.empty() || line[0] == '#') {
+      continue;
+    }
+
+    const auto where = "line " + std::to_string(lineNumber) + ": ";
+    const auto fields = splitCSVLine(line);
+    if (lineNumber == 1 && !fields.empty() && fields[0] == "time") {
+      continue; // Header
+    }
+    if (fields.size() != 10) {
+      throw std::runtime_error(where +
+                               "expected time followed by 9 lookat numbers, "
+                               "got " +
+                               std::to_string(fields.size()) + " fields");
+    }
+
+    try {
+      CameraKeyframe keyframe;
+      keyframe.time = std::stof(fields[0]);
+      float numbers[9];
+      for (size_t i = 0; i < 9; ++i) {
+        numbers[i] = std::stof(fields[1 + i]);
+      }
+      keyframe.camera = makeLookatCamera(numbers);
+      result.emplace_back(keyframe);
+    } catch (const std::logic_error &) {
+      throw std::runtime_error(where + "invalid number");
+    }
+  }
+  return result;
+}
+
+glm::vec3 catmullRom(const glm::vec3 &p0, const glm::vec3 &p1,
+    const glm::vec3 &p2, const glm::vec3 &p3, float t)
+{
+  const auto t2 = t * t;
+  const auto t3 = t2 * t;
+  return 0.5f * ((2.f * p1) + (p2 - p0) * t +
+                    (2.f * p0 - 5.f * p1 + 4.f * p2 - p3) * t2 +
+                    (3.f * p1 - p0 - 3.f * p2 + p3) * t3);
+}
+
+} // namespace
+
+std::vector<RenderJob> loadRenderJobs(
+    const fs::path &path, uint32_t defaultWidth, uint32_t defaultHeight)
+{
+  auto input = openInput(path);
+
+  std::vector<RenderJob> jobs;
+  try {
+    jobs = path.extension() == ".csv"
+               ? loadCSVJobs(input, defaultWidth, defaultHeight)
+               : loadJSONJobs(input, defaultWidth, defaultHeight);
+  } catch (const std::runtime_error &e) {
+    throw std::runtime_error(path.string() + ": " + e.what());
+  }
+
+  for (size_t i = 0; i < jobs.size(); ++i) {
+    if (jobs[i].width == 0 || jobs[i].height == 0) {
+      throw std::runtime_error(path.string() + ": job " + std::to_string(i) +
+                               " has an empty resolution");
+    }
+  }
+  return jobs;
+}
+
+Camera makeLookatCamera(const float *lookat)
+{
+  return Camera{glm::vec3(lookat[0], lookat[1], lookat[2]),
+      glm::vec3(lookat[3], lookat[4], lookat[5]),
+      glm::vec3(lookat[6], lookat[7], lookat[8])};
+}
+
+std::vector<CameraKeyframe> loadCameraPath(const fs::path &path)
+{
+  auto input = openInput(path);
+
+  std::vector<CameraKeyframe> keyframes;
+  try {
+    keyframes = path.extension() == ".csv" ? loadCSVKeyframes(input)
+                                           : loadJSONKeyframes(input);
+  } catch (const std::runtime_error &e) {
+    throw std::runtime_error(path.string() + ": " + e.what());
+  }
+
+  if (keyframes.empty()) {
+    throw std::runtime_error(path.string() + ": no keyframe");
+  }
+  for (size_t i = 1; i < keyframes.size(); ++i) {
+    if (keyframes[i].time <= keyframes[i - 1].time) {
+      throw std::runtime_error(path.string() + ": keyframe " +
+                               std::to_string(i) +
+                               " is not after the previous one");
+    }
+  }
+  return keyframes;
+}
+
+Camera sampleCameraPath(const std::vector<CameraKeyframe> &path, float time)
+{
+  assert(!path.empty());
+  if (time <= path.front().time) {
+    return path.front().camera;
+  }
+  if (time >= path.back().time) {
+    return path.back().camera;
+  }
+
+  size_t i = 1;
+  while (path[i].time < time) {
+    ++i;
+  }
+  // Segment from path[i - 1] to path[i], end points are repeated
+  const auto &k0 = path[i > 1 ? i - 2 : 0].camera;
+  const auto &k1 = path[i - 1].camera;
+  const auto &k2 = path[i].camera;
+  const auto &k3 = path[std::min(i + 1, path.size() - 1)].camera;
+  const auto t = (time - path[i - 1].time) / (path[i].time - path[i - 1].time);
+
+  return Camera{catmullRom(k0.eye(), k1.eye(), k2.eye(), k3.eye(), t),
+      catmullRom(k0.center(), k1.center(), k2.center(), k3.center(), t),
+      glm::mix(k1.up(), k2.up(), t)};
+}
+
+fs::path formatFramePath(const fs::path &pattern, uint32_t frame)
+{
+  auto filename = pattern.filename().string();
+  auto number = std::to_string(frame);
+
+  const auto first = filename.find('#');
+  if (first == std::string::npos) {
+    return pattern.parent_path() /
+           (pattern.stem().string() + number + pattern.extension().string());
+  }
+  const auto last = filename.find_first_not_of('#', first);
+  const auto length =
+      (last == std::string::npos ? filename.size() : last) - first;
+  if (number.size() < length) {
+    number.insert(0, length - number.size(), '0');
+  }
+  filename.replace(first, length, number);
+  return pattern.parent_path() / filename;
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include "cameras.hpp"
+#include "filesystem.hpp"
+
+#include <cstdint>
+#include <vector>
+
+// One image to render offscreen
+struct RenderJob
+{
+  fs::path output;
+  uint32_t width = 0;
+  uint32_t height = 0;
+  bool hasCamera = false; // If false, the default camera of the scene is used
+  Camera camera;
+  // Time in the first animation of the scene, in seconds. If negative, the
+  // scene is rendered in its rest pose.
+  float animationTime = -1.f;
+};
+
+// Load the jobs listed in a .json or .csv file. Throw std::runtime_error with
+// the location of the problem if the file cannot be parsed.
+//
+// JSON: an array of jobs, or an object with a "jobs" array. Each job has an
+// "output" path, and optionally "width", "height" and a "lookat" array of 9
+// numbers (eye, center, up):
+//   [{"output": "front.png", "width": 256, "height": 256,
+//     "lookat": [0, 0, 5, 0, 0, 0, 0, 1, 0]}]
+//
+// CSV: one job per line, "output,width,height" optionally followed by the 9
+// lookat numbers. Empty width/height fields take the default values; empty
+// lines, lines starting with '#' and a "output,width,..." header are ignored.
+std::vector<RenderJob> loadRenderJobs(
+    const fs::path &path, uint32_t defaultWidth, uint32_t defaultHeight);
+
+// Camera from the 9 numbers of a --lookat argument or of a job
+Camera makeLookatCamera(const float *lookat);
+
+// Camera at a given time of a path
+struct CameraKeyframe
+{
+  float time = 0.f;
+  Camera camera;
+};
+
+// Frames of the render-sequence command, rendered without window
+struct RenderSequence
+{
+  uint32_t frameCount = 0; // No sequence if 0
+  // Keyframes sampled at regular times from the first to the last one. If
+  // empty, the camera turns around the center of the scene instead.
+  std::vector<CameraKeyframe> cameraPath;
+  // Path of the image of each frame, runs of '#' are replaced by the frame
+  // number padded with zeros. Empty if frames are only streamed.
+  fs::path outputPattern;
+  // File or named pipe receiving the raw frames (RGB, 8 bits per component,
+  // rows from top to bottom), "-" for the standard output. Empty if frames are
+  // only written as images.
+  fs::path stream;
+};
+
+// Load keyframes from a .json or .csv file, sorted by strictly increasing
+// time. Throw std::runtime_error like loadRenderJobs().
+//
+// JSON: an array of keyframes, or an object with a "keyframes" array. Each
+// keyframe has a "time" and a "lookat" array of 9 numbers:
+//   [{"time": 0, "lookat": [0, 0, 5, 0, 0, 0, 0, 1, 0]},
+//    {"time": 2.5, "lookat": [5, 0, 0, 0, 0, 0, 0, 1, 0]}]
+//
+// CSV: one keyframe per line, "time" followed by the 9 lookat numbers.
+std::vector<CameraKeyframe> loadCameraPath(const fs::path &path);
+
+// Camera of path at time, interpolated with a Catmull-Rom spline through the
+// eye and center positions. Times outside of the path are clamped.
+Camera sampleCameraPath(const std::vector<CameraKeyframe> &path, float time);
+
+// Replace the runs of '#' in the file name of pattern by frame, padded with
+// zeros to the length of the run. If there is none, the number is inserted
+// before the extension.
+fs::path formatFramePath(const fs::path &pattern, uint32_t frame);
@@ -0,0 +1,20 @@
+#include "reports.hpp"
+
+#include <cstdio>
+
+void writeJsonString(std::ostream &out, const std::string &str)
+{
+  out << '"';
+  for (const auto c : str) {
+    if (c == '"' || c == '\\') {
+      out << '\\' << c;
+    } else if (static_cast<unsigned char>(c) < 0x20) {
+      char escaped[8];
+      std::snprintf(escaped, sizeof(escaped), "\\u%04x", unsigned(c));
+      out << escaped;
+    } else {
+      out << c;
+    }
+  }
+  out << '"';
+}
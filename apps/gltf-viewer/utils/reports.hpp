@@ -0,0 +1,26 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Helpers shared by the reports of the application: statistics of the
+// profiler panel, render farm and bench, and their JSON outputs
+
+// Nearest rank percentile: the smallest value that fraction of the values are
+// less than or equal to. The values need not be sorted.
+template <typename T> T percentile(std::vector<T> values, double fraction)
+{
+  if (values.empty()) {
+    return T(0);
+  }
+  const auto rank = size_t(std::ceil(fraction * values.size()));
+  const auto n = std::min(std::max(rank, size_t(1)), values.size()) - 1;
+  std::nth_element(begin(values), begin(values) + n, end(values));
+  return values[n];
+}
+
+// Write str as a quoted JSON string, escaping its special characters
+void writeJsonString(std::ostream &out, const std::string &str);
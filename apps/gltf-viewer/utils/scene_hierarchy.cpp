@@ -0,0 +1,106 @@
+#include "scene_hierarchy.hpp"
+
+#include <glm/gtc/type_ptr.hpp>
+
+#include <algorithm>
+
+SceneHierarchy::SceneHierarchy(const tinygltf::Model &model) :
+    m_Parents(model.nodes.size(), -1),
+    m_Translations(model.nodes.size(), glm::vec3(0)),
+    m_Rotations(model.nodes.size(), glm::quat(1, 0, 0, 0)),
+    m_Scales(model.nodes.size(), glm::vec3(1)),
+    m_LocalMatrixIndices(model.nodes.size(), -1),
+    m_WorldMatrices(model.nodes.size(), glm::mat4(1)),
+    m_WeightOffsets(model.nodes.size() + 1, 0)
+{
+  const auto nodeCount = int(model.nodes.size());
+  for (int nodeIdx = 0; nodeIdx < nodeCount; ++nodeIdx) {
+    const auto &node = model.nodes[nodeIdx];
+    m_WeightOffsets[nodeIdx] = m_Weights.size();
+    if (node.mesh >= 0 && size_t(node.mesh) < model.meshes.size()) {
+      // Weights of the node, or else of its mesh, or else zeros
+      const auto &mesh = model.meshes[node.mesh];
+      size_t targetCount = 0;
+      for (const auto &primitive : mesh.primitives) {
+        targetCount = std::max(targetCount, primitive.targets.size());
+      }
+      const auto &weights =
+          node.weights.size() == targetCount ? node.weights : mesh.weights;
+      for (size_t i = 0; i < targetCount; ++i) {
+        m_Weights.push_back(
+            weights.size() == targetCount ? float(weights[i]) : 0.f);
+      }
+    }
+    if (node.matrix.size() == 16) {
+      m_LocalMatrixIndices[nodeIdx] = int(m_LocalMatrices.size());
+      m_LocalMatrices.push_back(glm::mat4(glm::make_mat4(node.matrix.data())));
+    }
+    if (node.translation.size() == 3) {
+      m_Translations[nodeIdx] =
+          glm::vec3(glm::make_vec3(node.translation.data()));
+    }
+    if (node.rotation.size() == 4) {
+      // glTF stores x, y, z, w
+      m_Rotations[nodeIdx] = glm::quat(float(node.rotation[3]),
+          float(node.rotation[0]), float(node.rotation[1]),
+          float(node.rotation[2]));
+    }
+    if (node.scale.size() == 3) {
+      m_Scales[nodeIdx] = glm::vec3(glm::make_vec3(node.scale.data()));
+    }
+    m_WeightOffsets[nodeIdx + 1] = m_Weights.size();
+    for (const auto child : node.children) {
+      // The first parent wins if the file lists a node twice
+      if (child >= 0 && child < nodeCount && child != nodeIdx &&
+          m_Parents[child] < 0) {
+        m_Parents[child] = nodeIdx;
+      }
+    }
+  }
+
+  // Breadth first from the roots. Nodes in a cycle are never reached and stay
+  // at the identity.
+  std::vector<std::vector<int>> children(model.nodes.size());
+  for (int nodeIdx = 0; nodeIdx < nodeCount; ++nodeIdx) {
+    if (m_Parents[nodeIdx] >= 0) {
+      children[m_Parents[nodeIdx]].push_back(nodeIdx);
+    } else {
+      m_Order.push_back(nodeIdx);
+    }
+  }
+  for (size_t i = 0; i < m_Order.size(); ++i) {
+    for (const auto child : children[m_Order[i]]) {
+      m_Order.push_back(child);
+    }
+  }
+}
+
+bool SceneHierarchy::update()
+{
+  if (!m_Dirty) {
+    return false;
+  }
+  m_Dirty = false;
+  ++m_Generation;
+
+  for (const auto nodeIdx : m_Order) {
+    glm::mat4 localMatrix;
+    const auto matrixIdx = m_LocalMatrixIndices[nodeIdx];
+    if (matrixIdx >= 0) {
+      localMatrix = m_LocalMatrices[matrixIdx];
+    } else {
+      // T * R * S without the intermediate products
+      const auto rotation = glm::mat3_cast(m_Rotations[nodeIdx]);
+      const auto &scale = m_Scales[nodeIdx];
+      localMatrix = glm::mat4(glm::vec4(rotation[0] * scale.x, 0),
+          glm::vec4(rotation[1] * scale.y, 0),
+          glm::vec4(rotation[2] * scale.z, 0),
+          glm::vec4(m_Translations[nodeIdx], 1));
+    }
+    const auto parentIdx = m_Parents[nodeIdx];
+    m_WorldMatrices[nodeIdx] = parentIdx >= 0
+                                   ? m_WorldMatrices[parentIdx] * localMatrix
+                                   : localMatrix;
+  }
+  return true;
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <tiny_gltf.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Transforms of the nodes of a model, flattened for per frame updates. Local
+// translations, rotations and scales are stored in separate arrays indexed by
+// glTF node, for animations to write to, and world matrices are recomputed by
+// walking the nodes parents first, without recursion.
+//
+// Nodes defined by a matrix keep it as their local transform: glTF does not
+// allow animating them.
+//
+// Morph target weights of the nodes with a mesh are stored the same way, one
+// run of weights per node in a single array.
+class SceneHierarchy
+{
+public:
+  explicit SceneHierarchy(const tinygltf::Model &model);
+
+  size_t size() const { return m_Parents.size(); }
+
+  // Parent of node, -1 for roots
+  int parent(int node) const { return m_Parents[node]; }
+
+  // Local transforms: call invalidate() after writing them
+  std::vector<glm::vec3> &translations() { return m_Translations; }
+  std::vector<glm::quat> &rotations() { return m_Rotations; }
+  std::vector<glm::vec3> &scales() { return m_Scales; }
+  void invalidate() { m_Dirty = true; }
+
+  // Morph target weights of node (as many as the targets of its mesh, none if
+  // it has no mesh): call invalidateWeights() after writing them
+  float *weights(int node)
+  {
+    return m_Weights.data() + m_WeightOffsets[node];
+  }
+  const float *weights(int node) const
+  {
+    return m_Weights.data() + m_WeightOffsets[node];
+  }
+  size_t weightCount(int node) const
+  {
+    return m_WeightOffsets[node + 1] - m_WeightOffsets[node];
+  }
+  void invalidateWeights() { ++m_WeightsGeneration; }
+
+  // Incremented by each invalidateWeights()
+  uint64_t weightsGeneration() const { return m_WeightsGeneration; }
+
+  // Recompute world matrices if local transforms were invalidated, return
+  // true if they did
+  bool update();
+
+  const glm::mat4 &worldMatrix(int node) const
+  {
+    return m_WorldMatrices[node];
+  }
+
+  // Incremented by each update() that changes world matrices, so that what
+  // derives from them is only recomputed when needed
+  uint64_t generation() const { return m_Generation; }
+
+private:
+  std::vector<int> m_Parents;
+  std::vector<int> m_Order; // Parents before their children
+  std::vector<glm::vec3> m_Translations;
+  std::vector<glm::quat> m_Rotations;
+  std::vector<glm::vec3> m_Scales;
+  std::vector<int> m_LocalMatrixIndices; // In m_LocalMatrices, -1 for TRS
+  std::vector<glm::mat4> m_LocalMatrices;
+  std::vector<glm::mat4> m_WorldMatrices;
+  bool m_Dirty = true;
+  uint64_t m_Generation = 0;
+  std::vector<float> m_Weights;
+  std::vector<size_t> m_WeightOffsets; // Of each node, and the end
+  uint64_t m_WeightsGeneration = 1;
+};
@@ -2,6 +2,7 @@
 
 #include "filesystem.hpp"
 #include <fstream>
+#include <functional>
 #include <glad/glad.h>
 #include <iostream>
 #include <memory>
@@ -9,6 +10,7 @@
 #include <stdexcept>
 #include <string>
 #include <unordered_map>
+#include <vector>
 
 
 class GLShader
@@ -81,6 +83,29 @@ inline std::string loadShaderSource(const fs::path &filepath)
   return buffer.str();
 }
 
+// Insert a #define line for each element of defines right after the #version
+// directive of src (which must stay the first statement of a shader).
+inline std::string injectDefines(
+    const std::string &src, const std::vector<std::string> &defines)
+{
+  if (defines.empty()) {
+    return src;
+  }
+  std::string defineLines;
+  for (const auto &define : defines) {
+    defineLines += "#define " + define + "\n";
+  }
+  const auto versionPos = src.find("#version");
+  if (versionPos == std::string::npos) {
+    return defineLines + src;
+  }
+  const auto lineEnd = src.find('\n', versionPos);
+  if (lineEnd == std::string::npos) {
+    return src + "\n" + defineLines;
+  }
+  return src.substr(0, lineEnd + 1) + defineLines + src.substr(lineEnd + 1);
+}
+
 template <typename StringType>
 GLShader compileShader(GLenum type, StringType &&src)
 {
@@ -93,12 +118,13 @@ GLShader compileShader(GLenum type, StringType &&src)
   return shader;
 }
 
-// Load and compile a shader according to the following naming convention:
+// Type of a shader file according to the following naming convention:
 // *.vs.glsl -> vertex shader
 // *.fs.glsl -> fragment shader
 // *.gs.glsl -> geometry shader
 // *.cs.glsl -> compute shader
-inline GLShader loadShader(const fs::path &shaderPath)
+// Return the GL shader type and its name, throw for other names.
+inline std::pair<GLenum, std::string> getShaderType(const fs::path &shaderPath)
 {
   static auto extToShaderType =
       std::unordered_map<std::string, std::pair<GLenum, std::string>>(
@@ -113,12 +139,20 @@ inline GLShader loadShader(const fs::path &shaderPath)
     std::cerr << "Unrecognized shader extension " << ext << std::endl;
     throw std::runtime_error("Unrecognized shader extension " + ext.string());
   }
+  return (*it).second;
+}
+
+// Compile a shader from its source, with the type given by the name of
+// shaderPath (see getShaderType)
+inline GLShader compileShaderSource(
+    const fs::path &shaderPath, const std::string &src)
+{
+  const auto type = getShaderType(shaderPath);
 
-  std::clog << "Compiling " << (*it).second.second << " shader " << shaderPath
-            << "\n";
+  std::clog << "Compiling " << type.second << " shader " << shaderPath << "\n";
 
-  GLShader shader{(*it).second.first};
-  shader.setSource(loadShaderSource(shaderPath));
+  GLShader shader{type.first};
+  shader.setSource(src);
   shader.compile();
   if (!shader.getCompileStatus()) {
     std::cerr << "Shader compilation error:" << shader.getInfoLog()
@@ -128,6 +162,15 @@ inline GLShader loadShader(const fs::path &shaderPath)
   return shader;
 }
 
+// Load and compile a shader, see getShaderType for the naming convention.
+// Each element of defines is added as a #define to the source.
+inline GLShader loadShader(
+    const fs::path &shaderPath, const std::vector<std::string> &defines = {})
+{
+  return compileShaderSource(
+      shaderPath, injectDefines(loadShaderSource(shaderPath), defines));
+}
+
 class GLProgram
 {
   GLuint m_GLId;
@@ -244,11 +287,12 @@ template <typename CSrc> GLProgram buildComputeProgram(CSrc &&src)
   ;
 }
 
-inline GLProgram compileProgram(std::vector<fs::path> shaderPaths)
+inline GLProgram compileProgram(std::vector<fs::path> shaderPaths,
+    const std::vector<std::string> &defines = {})
 {
   GLProgram program;
   for (const auto &path : shaderPaths) {
-    auto shader = loadShader(path);
+    auto shader = loadShader(path, defines);
     program.attachShader(shader);
   }
   program.link();
@@ -258,3 +302,90 @@ inline GLProgram compileProgram(std::vector<fs::path> shaderPaths)
   }
   return program;
 }
+
+// Variants of a program, identified by a bitmask of features and created
+// the first time they are requested. The factory creates the variant of a
+// feature set, typically by compiling the program with one define per feature
+// (see compileProgram). Variant must be movable, e.g. a GLProgram or a struct
+// holding a GLProgram and its uniform locations.
+//
+// Variants may finish building asynchronously (see ProgramCompiler): the
+// finisher then completes a variant created by the factory, without blocking
+// unless wait is true, and returns whether it is ready. Without finisher,
+// variants are ready as soon as they are created.
+template <typename Variant> class ShaderVariantCache
+{
+public:
+  using Factory = std::function<Variant(uint32_t features)>;
+  using Finisher = std::function<bool(Variant &variant, bool wait)>;
+
+  explicit ShaderVariantCache(Factory factory, Finisher finisher = {}) :
+      m_Factory(std::move(factory)), m_Finisher(std::move(finisher))
+  {
+  }
+
+  // The variant of features, waiting for it to be ready if needed.
+  // References stay valid until the cache is destroyed.
+  const Variant &get(uint32_t features)
+  {
+    auto &entry = find(features);
+    if (!entry.ready) {
+      entry.ready = m_Finisher(entry.variant, true);
+    }
+    return entry.variant;
+  }
+
+  // The variant of features if it is ready, nullptr otherwise (its creation
+  // is started on first request)
+  const Variant *tryGet(uint32_t features)
+  {
+    auto &entry = find(features);
+    if (!entry.ready) {
+      entry.ready = m_Finisher(entry.variant, false);
+    }
+    return entry.ready ? &entry.variant : nullptr;
+  }
+
+  // Wait for every variant requested so far to be ready
+  void finishAll()
+  {
+    for (auto &variant : m_Variants) {
+      if (!variant.second.ready) {
+        variant.second.ready = m_Finisher(variant.second.variant, true);
+      }
+    }
+  }
+
+  size_t size() const { return m_Variants.size(); }
+
+  size_t readyCount() const
+  {
+    size_t count = 0;
+    for (const auto &variant : m_Variants) {
+      count += variant.second.ready ? 1 : 0;
+    }
+    return count;
+  }
+
+private:
+  struct Entry
+  {
+    Variant variant;
+    bool ready;
+  };
+
+  Entry &find(uint32_t features)
+  {
+    auto it = m_Variants.find(features);
+    if (it == end(m_Variants)) {
+      it = m_Variants
+               .emplace(features, Entry{m_Factory(features), !m_Finisher})
+               .first;
+    }
+    return (*it).second;
+  }
+
+  Factory m_Factory;
+  Finisher m_Finisher;
+  std::unordered_map<uint32_t, Entry> m_Variants;
+};
@@ -0,0 +1,288 @@
+#include "skinning.hpp"
+
+#include "deformed_vertices.hpp"
+#include "gltf.hpp"
+
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+#include <type_traits>
+
+namespace
+{
+
+// Source vertices of skinning.cs.glsl (std430), skinned to DeformedVertex
+struct SkinVertex
+{
+  glm::vec4 position;
+  glm::vec4 normal;
+  glm::vec4 tangent;
+  glm::uvec4 joints;
+  glm::vec4 weights;
+};
+static_assert(sizeof(SkinVertex) == 80, "SkinVertex must match std430");
+
+const GLuint SOURCE_STORAGE_BINDING = 1;
+const GLuint SKINNED_STORAGE_BINDING = 2;
+const GLuint WORK_GROUP_SIZE = 64;
+
+int findAttribute(const tinygltf::Primitive &primitive, const char *name)
+{
+  const auto it = primitive.attributes.find(name);
+  return it != end(primitive.attributes) ? (*it).second : -1;
+}
+
+// Source vertices of a skinned primitive, with the accessors it lacks as zeros
+std::vector<SkinVertex> decodeSkinVertices(
+    const tinygltf::Model &model, const tinygltf::Primitive &primitive)
+{
+  const auto positions =
+      AccessorView<glm::vec3>{model, findAttribute(primitive, "POSITION")}
+          .decode();
+  std::vector<SkinVertex> vertices(positions.size(), SkinVertex{});
+  for (size_t i = 0; i < vertices.size(); ++i) {
+    vertices[i].position = glm::vec4(positions[i], 1);
+  }
+
+  const auto decodeAttribute = [&](const char *name, auto member) {
+    using Element = typename std::remove_reference<decltype(
+        vertices[0].*member)>::type;
+    const auto accessorIdx = findAttribute(primitive, name);
+    if (accessorIdx < 0) {
+      return;
+    }
+    const auto elements = AccessorView<Element>{model, accessorIdx}.decode();
+    const auto count = std::min(elements.size(), vertices.size());
+    for (size_t i = 0; i < count; ++i) {
+      vertices[i].*member = elements[i];
+    }
+  };
+  decodeAttribute("NORMAL", &SkinVertex::normal);
+  decodeAttribute("TANGENT", &SkinVertex::tangent);
+  decodeAttribute("JOINTS_0", &SkinVertex::joints);
+  decodeAttribute("WEIGHTS_0", &SkinVertex::weights);
+  return vertices;
+}
+
+} // namespace
+
+const char *toString(SkinningMode mode)
+{
+  switch (mode) {
+  case SkinningMode::Auto:
+    return "auto";
+  case SkinningMode::VertexShader:
+    return "vertex";
+  case SkinningMode::Compute:
+    return "compute";
+  }
+  return "unknown";
+}
+
+SkinningMode parseSkinningMode(const std::string &str)
+{
+  for (const auto mode : {SkinningMode::Auto, SkinningMode::VertexShader,
+           SkinningMode::Compute}) {
+    if (str == toString(mode)) {
+      return mode;
+    }
+  }
+  throw std::runtime_error("Unknown skinning mode " + str);
+}
+
+bool isSkinnedPrimitive(const tinygltf::Primitive &primitive)
+{
+  return findAttribute(primitive, "POSITION") >= 0 &&
+         findAttribute(primitive, "JOINTS_0") >= 0 &&
+         findAttribute(primitive, "WEIGHTS_0") >= 0;
+}
+
+JointMatrixBuffer::JointMatrixBuffer(const tinygltf::Model &model)
+{
+  for (const auto &skin : model.skins) {
+    m_SkinOffsets.push_back(GLint(m_JointNodes.size()));
+    std::vector<glm::mat4> inverseBindMatrices;
+    if (skin.inverseBindMatrices >= 0) {
+      try {
+        inverseBindMatrices =
+            AccessorView<glm::mat4>{model, skin.inverseBindMatrices}.decode();
+      } catch (const std::runtime_error &e) {
+        std::cerr << "Inverse bind matrices of skin " << skin.name << ": "
+                  << e.what() << std::endl;
+      }
+    }
+    // Missing matrices are identities
+    inverseBindMatrices.resize(skin.joints.size(), glm::mat4(1));
+    for (size_t i = 0; i < skin.joints.size(); ++i) {
+      const auto jointNode = skin.joints[i];
+      m_JointNodes.push_back(
+          jointNode >= 0 && size_t(jointNode) < model.nodes.size() ? jointNode
+                                                                   : -1);
+      m_InverseBindMatrices.push_back(inverseBindMatrices[i]);
+    }
+  }
+  if (m_JointNodes.empty()) {
+    return;
+  }
+  m_JointMatrices.resize(m_JointNodes.size(), glm::mat4(1));
+
+  glGenBuffers(1, &m_BufferObject);
+  glBindBuffer(GL_TEXTURE_BUFFER, m_BufferObject);
+  glBufferData(GL_TEXTURE_BUFFER, m_JointMatrices.size() * sizeof(glm::mat4),
+      nullptr, GL_DYNAMIC_DRAW);
+  glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+  glGenTextures(1, &m_TextureObject);
+  glBindTexture(GL_TEXTURE_BUFFER, m_TextureObject);
+  glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, m_BufferObject);
+  glBindTexture(GL_TEXTURE_BUFFER, 0);
+}
+
+JointMatrixBuffer::~JointMatrixBuffer()
+{
+  glDeleteTextures(1, &m_TextureObject);
+  glDeleteBuffers(1, &m_BufferObject);
+}
+
+bool JointMatrixBuffer::update(const SceneHierarchy &hierarchy)
+{
+  if (m_JointNodes.empty() ||
+      hierarchy.generation() == m_HierarchyGeneration) {
+    return false;
+  }
+  m_HierarchyGeneration = hierarchy.generation();
+
+  for (size_t i = 0; i < m_JointNodes.size(); ++i) {
+    const auto jointNode = m_JointNodes[i];
+    m_JointMatrices[i] =
+        jointNode >= 0
+            ? hierarchy.worldMatrix(jointNode) * m_InverseBindMatrices[i]
+            : m_InverseBindMatrices[i];
+  }
+  glBindBuffer(GL_TEXTURE_BUFFER, m_BufferObject);
+  glBufferSubData(GL_TEXTURE_BUFFER, 0,
+      m_JointMatrices.size() * sizeof(glm::mat4), m_JointMatrices.data());
+  glBindBuffer(GL_TEXTURE_BUFFER, 0);
+  return true;
+}
+
+void JointMatrixBuffer::bind() const
+{
+  glActiveTexture(GL_TEXTURE0 + TEXTURE_UNIT);
+  glBindTexture(GL_TEXTURE_BUFFER, m_TextureObject);
+}
+
+PreSkinnedPrimitives::PreSkinnedPrimitives(const tinygltf::Model &model,
+    const fs::path &computeShaderPath,
+    const std::function<GLuint(int, size_t)> &primitiveVao) :
+    m_Program(buildProgram({loadShader(computeShaderPath)})),
+    m_UniformJointOffset(m_Program.getUniformLocation("uJointOffset")),
+    m_UniformVertexCount(m_Program.getUniformLocation("uVertexCount"))
+{
+  glProgramUniform1i(m_Program.glId(),
+      m_Program.getUniformLocation("uJointMatrices"),
+      GLint(JointMatrixBuffer::TEXTURE_UNIT));
+
+  GLint jointOffset = 0;
+  std::vector<GLint> skinOffsets;
+  for (const auto &skin : model.skins) {
+    skinOffsets.push_back(jointOffset);
+    jointOffset += GLint(skin.joints.size());
+  }
+
+  for (const auto &node : model.nodes) {
+    if (node.skin < 0 || size_t(node.skin) >= model.skins.size() ||
+        node.mesh < 0 || size_t(node.mesh) >= model.meshes.size() ||
+        m_FirstPrimitives.count({node.skin, node.mesh})) {
+      continue;
+    }
+    m_FirstPrimitives[{node.skin, node.mesh}] = m_Primitives.size();
+    const auto &primitives = model.meshes[node.mesh].primitives;
+    for (size_t primitiveIdx = 0; primitiveIdx < primitives.size();
+         ++primitiveIdx) {
+      const auto &primitive = primitives[primitiveIdx];
+      Primitive skinned{skinOffsets[node.skin], 0, 0, 0, 0};
+      std::vector<SkinVertex> vertices;
+      // Morph targets are blended before skinning: primitives that have
+      // some are skinned by their draws, after the blending
+      if (isSkinnedPrimitive(primitive) && primitive.targets.empty()) {
+        try {
+          vertices = decodeSkinVertices(model, primitive);
+        } catch (const std::runtime_error &e) {
+          // Drawn in bind pose
+          std::cerr << "Skinned vertices of mesh " << node.mesh << ": "
+                    << e.what() << std::endl;
+        }
+      }
+      if (vertices.empty()) {
+        m_Primitives.push_back(skinned);
+        continue;
+      }
+      skinned.vertexCount = GLuint(vertices.size());
+
+      GLuint buffers[2];
+      glGenBuffers(2, buffers);
+      skinned.sourceBuffer = buffers[0];
+      skinned.skinnedBuffer = buffers[1];
+      glBindBuffer(GL_SHADER_STORAGE_BUFFER, skinned.sourceBuffer);
+      glBufferStorage(GL_SHADER_STORAGE_BUFFER,
+          vertices.size() * sizeof(SkinVertex), vertices.data(), 0);
+      glBindBuffer(GL_SHADER_STORAGE_BUFFER, skinned.skinnedBuffer);
+      glBufferStorage(GL_SHADER_STORAGE_BUFFER,
+          vertices.size() * sizeof(DeformedVertex), nullptr, 0);
+      glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+      // Texture coordinates and indices are those of the primitive
+      skinned.vertexArrayObject =
+          createDeformedVertexArray(primitiveVao(node.mesh, primitiveIdx),
+              skinned.skinnedBuffer, findAttribute(primitive, "NORMAL") >= 0,
+              findAttribute(primitive, "TANGENT") >= 0);
+
+      m_Primitives.push_back(skinned);
+    }
+  }
+}
+
+PreSkinnedPrimitives::~PreSkinnedPrimitives()
+{
+  for (const auto &primitive : m_Primitives) {
+    if (primitive.vertexCount) {
+      const GLuint buffers[] = {
+          primitive.sourceBuffer, primitive.skinnedBuffer};
+      glDeleteBuffers(2, buffers);
+      glDeleteVertexArrays(1, &primitive.vertexArrayObject);
+    }
+  }
+}
+
+GLuint PreSkinnedPrimitives::vertexArrayObject(
+    int skinIdx, int meshIdx, size_t primitiveIdx) const
+{
+  const auto it = m_FirstPrimitives.find({skinIdx, meshIdx});
+  if (it == end(m_FirstPrimitives)) {
+    return 0;
+  }
+  return m_Primitives[(*it).second + primitiveIdx].vertexArrayObject;
+}
+
+void PreSkinnedPrimitives::update(const JointMatrixBuffer &jointMatrices)
+{
+  m_Program.use();
+  jointMatrices.bind();
+  for (const auto &primitive : m_Primitives) {
+    if (!primitive.vertexCount) {
+      continue;
+    }
+    glUniform1i(m_UniformJointOffset, primitive.jointOffset);
+    glUniform1ui(m_UniformVertexCount, primitive.vertexCount);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, SOURCE_STORAGE_BINDING,
+        primitive.sourceBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, SKINNED_STORAGE_BINDING,
+        primitive.skinnedBuffer);
+    glDispatchCompute(
+        (primitive.vertexCount + WORK_GROUP_SIZE - 1) / WORK_GROUP_SIZE, 1, 1);
+  }
+  // Skinned vertices are read as vertex attributes by the next draws
+  glMemoryBarrier(GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT);
+  glUseProgram(0);
+}
@@ -0,0 +1,124 @@
+#pragma once
+
+#include "filesystem.hpp"
+#include "scene_hierarchy.hpp"
+#include "shaders.hpp"
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <tiny_gltf.h>
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+// How skinned meshes are drawn:
+// - VertexShader: each draw skins its vertices (HAS_SKIN shader variants)
+// - Compute: a compute shader writes the skinned vertices to buffers once per
+// pose, drawn like static geometry however many times the pose is drawn
+// Auto picks Compute when each pose is drawn several times (offscreen images,
+// with their passes and tiles), VertexShader otherwise.
+enum class SkinningMode
+{
+  Auto,
+  VertexShader,
+  Compute
+};
+
+const char *toString(SkinningMode mode);
+
+// Parse "auto", "vertex" or "compute", throw on other values
+SkinningMode parseSkinningMode(const std::string &str);
+
+// Whether a primitive of a node with a skin has the joints and weights to be
+// skinned (only the first set of 4 influences is used)
+bool isSkinnedPrimitive(const tinygltf::Primitive &primitive);
+
+// Joint matrices of all the skins of a model in a single texture buffer
+// (RGBA32F, 4 texels per matrix), shared by every skinned draw and uploaded
+// once per pose. A joint matrix is the world matrix of its joint times its
+// inverse bind matrix: skinned vertices are in world space, and drawn with an
+// identity model matrix.
+class JointMatrixBuffer
+{
+public:
+  static const GLuint TEXTURE_UNIT = 16; // After those of materials
+
+  explicit JointMatrixBuffer(const tinygltf::Model &model);
+  ~JointMatrixBuffer();
+
+  JointMatrixBuffer(const JointMatrixBuffer &) = delete;
+  JointMatrixBuffer &operator=(const JointMatrixBuffer &) = delete;
+
+  size_t jointCount() const { return m_JointNodes.size(); }
+
+  // Index of the first matrix of skin in the buffer
+  GLint jointOffset(int skinIdx) const { return m_SkinOffsets[skinIdx]; }
+
+  // Recompute and upload joint matrices if the world matrices of hierarchy
+  // changed since the last call. Return true if they did.
+  bool update(const SceneHierarchy &hierarchy);
+
+  // Bind the texture buffer on TEXTURE_UNIT
+  void bind() const;
+
+private:
+  std::vector<GLint> m_SkinOffsets;
+  std::vector<int> m_JointNodes; // Node of each joint matrix
+  std::vector<glm::mat4> m_InverseBindMatrices;
+  std::vector<glm::mat4> m_JointMatrices;
+  GLuint m_BufferObject = 0;
+  GLuint m_TextureObject = 0;
+  uint64_t m_HierarchyGeneration = 0;
+};
+
+// Vertices of skinned primitives skinned ahead of their draws by a compute
+// shader (SkinningMode::Compute), for each (skin, mesh) pair used by a node.
+// Source vertices are decoded once to a fixed layout; skinned positions,
+// normals and tangents are written to a buffer that a copy of the vertex
+// array object of the primitive draws instead of the bind pose.
+//
+// Primitives with morph targets are left to the vertex shader, which blends
+// them before skinning.
+class PreSkinnedPrimitives
+{
+public:
+  // primitiveVao gives the vertex array object of a primitive (mesh index,
+  // primitive index), for its texture coordinates and indices
+  PreSkinnedPrimitives(const tinygltf::Model &model,
+      const fs::path &computeShaderPath,
+      const std::function<GLuint(int, size_t)> &primitiveVao);
+  ~PreSkinnedPrimitives();
+
+  PreSkinnedPrimitives(const PreSkinnedPrimitives &) = delete;
+  PreSkinnedPrimitives &operator=(const PreSkinnedPrimitives &) = delete;
+
+  size_t size() const { return m_Primitives.size(); }
+
+  // Vertex array object drawing primitiveIdx of meshIdx skinned by skinIdx,
+  // 0 if it is not pre-skinned
+  GLuint vertexArrayObject(int skinIdx, int meshIdx, size_t primitiveIdx) const;
+
+  // Skin every primitive with the current joint matrices, after they changed
+  void update(const JointMatrixBuffer &jointMatrices);
+
+private:
+  struct Primitive
+  {
+    GLint jointOffset;
+    GLuint vertexCount;
+    GLuint sourceBuffer;  // SkinVertex in skinning.cs.glsl
+    GLuint skinnedBuffer; // DeformedVertex
+    GLuint vertexArrayObject;
+  };
+
+  GLProgram m_Program;
+  GLint m_UniformJointOffset;
+  GLint m_UniformVertexCount;
+  std::vector<Primitive> m_Primitives;
+  // First primitive of each (skin, mesh) pair
+  std::map<std::pair<int, int>, size_t> m_FirstPrimitives;
+};
@@ -0,0 +1,122 @@
+#include "sparse_accessors.hpp"
+
+#include "gltf.hpp"
+#include "trace.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+#include <memory>
+
+bool needsDenseCopy(const tinygltf::Accessor &accessor)
+{
+  return accessor.sparse.isSparse || accessor.bufferView < 0;
+}
+
+SparseAccessorBuffers::SparseAccessorBuffers(
+    const tinygltf::Model &model, const std::vector<std::string> &attributes)
+{
+  std::vector<bool> drawnMeshes(model.meshes.size(), false);
+  for (const auto &node : model.nodes) {
+    if (node.mesh >= 0 && size_t(node.mesh) < drawnMeshes.size()) {
+      drawnMeshes[node.mesh] = true;
+    }
+  }
+
+  const auto addAccessor = [&](int accessorIdx) {
+    if (accessorIdx < 0 || size_t(accessorIdx) >= model.accessors.size() ||
+        !needsDenseCopy(model.accessors[accessorIdx]) ||
+        m_AccessorSlots.count(accessorIdx)) {
+      return;
+    }
+    m_AccessorSlots[accessorIdx] = m_Accessors.size();
+    m_Accessors.push_back(accessorIdx);
+  };
+  for (size_t meshIdx = 0; meshIdx < model.meshes.size(); ++meshIdx) {
+    if (!drawnMeshes[meshIdx]) {
+      continue;
+    }
+    for (const auto &primitive : model.meshes[meshIdx].primitives) {
+      for (const auto &attribute : attributes) {
+        const auto it = primitive.attributes.find(attribute);
+        if (it != end(primitive.attributes)) {
+          addAccessor((*it).second);
+        }
+      }
+      addAccessor(primitive.indices);
+    }
+  }
+  if (m_Accessors.empty()) {
+    return;
+  }
+
+  m_Data.resize(m_Accessors.size());
+  const auto threadCount = std::min<size_t>(
+      std::max(std::thread::hardware_concurrency(), 1u), m_Accessors.size());
+  auto pNextAccessor = std::make_shared<std::atomic<size_t>>(0);
+  for (size_t i = 0; i < threadCount; ++i) {
+    m_Workers.emplace_back([this, &model, pNextAccessor]() {
+      setTraceThreadName("Sparse accessors");
+      for (auto slot = (*pNextAccessor)++; slot < m_Accessors.size();
+           slot = (*pNextAccessor)++) {
+        TraceScope trace{"Sparse accessor"};
+        const auto &accessor = model.accessors[m_Accessors[slot]];
+        try {
+          m_Data[slot] = getAccessorBytes(model, accessor);
+        } catch (const std::runtime_error &e) {
+          // Drawn as zeros
+          std::cerr << "Sparse accessor " << m_Accessors[slot] << ": "
+                    << e.what() << std::endl;
+          const auto elementSize =
+              tinygltf::GetComponentSizeInBytes(accessor.componentType) *
+              tinygltf::GetNumComponentsInType(accessor.type);
+          m_Data[slot].assign(
+              accessor.count * size_t(std::max(elementSize, 0)), 0);
+        }
+      }
+    });
+  }
+}
+
+SparseAccessorBuffers::~SparseAccessorBuffers()
+{
+  for (auto &worker : m_Workers) {
+    worker.join();
+  }
+  if (!m_BufferObjects.empty()) {
+    glDeleteBuffers(GLsizei(m_BufferObjects.size()), m_BufferObjects.data());
+  }
+}
+
+GLuint SparseAccessorBuffers::getBufferObject(int accessorIdx)
+{
+  const auto it = m_AccessorSlots.find(accessorIdx);
+  if (it == end(m_AccessorSlots)) {
+    return 0;
+  }
+  if (m_BufferObjects.empty()) {
+    upload();
+  }
+  return m_BufferObjects[(*it).second];
+}
+
+void SparseAccessorBuffers::upload()
+{
+  for (auto &worker : m_Workers) {
+    worker.join();
+  }
+  m_Workers.clear();
+
+  m_BufferObjects.resize(m_Accessors.size(), 0);
+  glGenBuffers(GLsizei(m_BufferObjects.size()), m_BufferObjects.data());
+  for (size_t slot = 0; slot < m_Accessors.size(); ++slot) {
+    auto &data = m_Data[slot];
+    glBindBuffer(GL_ARRAY_BUFFER, m_BufferObjects[slot]);
+    glBufferStorage(GL_ARRAY_BUFFER,
+        GLsizeiptr(std::max<size_t>(data.size(), 1)),
+        data.empty() ? nullptr : data.data(), 0);
+    std::vector<unsigned char>().swap(data);
+  }
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+  m_Data.clear();
+}
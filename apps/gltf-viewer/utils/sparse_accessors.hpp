@@ -0,0 +1,51 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <tiny_gltf.h>
+
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// Whether accessor cannot be read in place from its buffer view: it has sparse
+// values, or no buffer view at all (zeros)
+bool needsDenseCopy(const tinygltf::Accessor &accessor);
+
+// Buffer objects holding a dense copy of the accessors drawn by a model that
+// cannot be drawn from the buffers of the model (see needsDenseCopy()).
+//
+// Only the given vertex attributes and the indices of the primitives of the
+// meshes used by nodes are copied. Copies are materialized by worker threads
+// started by the constructor, so that they overlap with the rest of the
+// loading, and uploaded on first use. Each accessor is materialized and
+// uploaded once, however many primitives share it.
+//
+// Dense copies are tightly packed, in the component type of their accessor:
+// draw them with a zero offset and stride.
+class SparseAccessorBuffers
+{
+public:
+  SparseAccessorBuffers(const tinygltf::Model &model,
+      const std::vector<std::string> &attributes);
+  ~SparseAccessorBuffers();
+
+  SparseAccessorBuffers(const SparseAccessorBuffers &) = delete;
+  SparseAccessorBuffers &operator=(const SparseAccessorBuffers &) = delete;
+
+  // Buffer object of the dense copy of accessorIdx, 0 if it is drawn from its
+  // buffer view. The first call waits for the workers and uploads the copies:
+  // call it from the thread of the GL context.
+  GLuint getBufferObject(int accessorIdx);
+
+  size_t size() const { return m_Accessors.size(); }
+
+private:
+  void upload();
+
+  std::vector<int> m_Accessors;
+  std::unordered_map<int, size_t> m_AccessorSlots;
+  std::vector<std::vector<unsigned char>> m_Data; // Freed once uploaded
+  std::vector<GLuint> m_BufferObjects;
+  std::vector<std::thread> m_Workers;
+};
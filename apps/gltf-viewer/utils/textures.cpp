@@ -0,0 +1,377 @@
+#include "textures.hpp"
+#include "trace.hpp"
+
+#include <imgui.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <iostream>
+#include <limits>
+#include <tuple>
+
+namespace
+{
+
+// Box filter an RGBA image to half its size (each dimension clamped to 1)
+template <typename ComponentType>
+std::vector<unsigned char> downsample(
+    const unsigned char *src, int width, int height)
+{
+  const int dstWidth = std::max(1, width / 2);
+  const int dstHeight = std::max(1, height / 2);
+  std::vector<unsigned char> dst(
+      size_t(dstWidth) * dstHeight * 4 * sizeof(ComponentType));
+
+  const auto *in = reinterpret_cast<const ComponentType *>(src);
+  auto *out = reinterpret_cast<ComponentType *>(dst.data());
+  for (int y = 0; y < dstHeight; ++y) {
+    const int y0 = std::min(2 * y, height - 1);
+    const int y1 = std::min(2 * y + 1, height - 1);
+    for (int x = 0; x < dstWidth; ++x) {
+      const int x0 = std::min(2 * x, width - 1);
+      const int x1 = std::min(2 * x + 1, width - 1);
+      for (int c = 0; c < 4; ++c) {
+        const uint32_t sum = uint32_t(in[(size_t(y0) * width + x0) * 4 + c]) +
+                             in[(size_t(y0) * width + x1) * 4 + c] +
+                             in[(size_t(y1) * width + x0) * 4 + c] +
+                             in[(size_t(y1) * width + x1) * 4 + c];
+        out[(size_t(y) * dstWidth + x) * 4 + c] = ComponentType(sum / 4);
+      }
+    }
+  }
+  return dst;
+}
+
+} // namespace
+
+tinygltf::Sampler getTextureSampler(
+    const tinygltf::Model &model, const tinygltf::Texture &texture)
+{
+  tinygltf::Sampler sampler;
+  if (texture.sampler >= 0) {
+    sampler = model.samplers[texture.sampler];
+  }
+  sampler.minFilter = sampler.minFilter != -1 ? sampler.minFilter : GL_LINEAR;
+  sampler.magFilter = sampler.magFilter != -1 ? sampler.magFilter : GL_LINEAR;
+  if (texture.sampler < 0) {
+    sampler.wrapS = GL_REPEAT;
+    sampler.wrapT = GL_REPEAT;
+  }
+  return sampler;
+}
+
+bool isMipmapFilter(GLint minFilter)
+{
+  return minFilter == GL_NEAREST_MIPMAP_NEAREST ||
+         minFilter == GL_NEAREST_MIPMAP_LINEAR ||
+         minFilter == GL_LINEAR_MIPMAP_NEAREST ||
+         minFilter == GL_LINEAR_MIPMAP_LINEAR;
+}
+
+TextureResidencyManager::TextureResidencyManager(
+    const tinygltf::Model &model, size_t budgetBytes) :
+    m_Model(model),
+    m_BudgetBytes(budgetBytes)
+{
+  m_Textures.resize(model.textures.size());
+  for (size_t i = 0; i < model.textures.size(); ++i) {
+    const auto &gltfTexture = model.textures[i];
+    auto &texture = m_Textures[i];
+    assert(gltfTexture.source >= 0);
+    texture.imageIdx = gltfTexture.source;
+
+    const auto sampler = getTextureSampler(model, gltfTexture);
+    texture.minFilter = sampler.minFilter;
+    texture.magFilter = sampler.magFilter;
+    texture.wrapS = sampler.wrapS;
+    texture.wrapT = sampler.wrapT;
+    texture.useMipmaps = isMipmapFilter(texture.minFilter);
+
+    const auto &image = model.images[texture.imageIdx];
+    if (image.width <= 0 || image.height <= 0 || image.image.empty()) {
+      std::cerr << "Texture " << i << " has no decoded image, skipping it."
+                << std::endl;
+      continue;
+    }
+    texture.width = image.width;
+    texture.height = image.height;
+    texture.levelCount =
+        1 + int(std::floor(std::log2(std::max(image.width, image.height))));
+  }
+
+  // Start fully resident, or with the least damaging coarsening if that does
+  // not fit in the budget.
+  std::vector<int> targets(m_Textures.size(), 0);
+  size_t totalBytes = 0;
+  for (const auto &texture : m_Textures) {
+    totalBytes += bytesAtLevel(texture, 0);
+  }
+  while (m_BudgetBytes && totalBytes > m_BudgetBytes &&
+         evictOneLevel(targets, totalBytes, true, -1)) {
+  }
+
+  for (size_t i = 0; i < m_Textures.size(); ++i) {
+    if (m_Textures[i].width > 0) {
+      upload(m_Textures[i], targets[i]);
+    }
+  }
+}
+
+TextureResidencyManager::~TextureResidencyManager()
+{
+  for (const auto &texture : m_Textures) {
+    if (texture.glId) {
+      if (m_TextureReleaseCallback) {
+        m_TextureReleaseCallback(texture.glId);
+      }
+      glDeleteTextures(1, &texture.glId);
+    }
+  }
+}
+
+void TextureResidencyManager::requestFootprint(
+    int textureIdx, float footprintInPixels)
+{
+  auto &texture = m_Textures[textureIdx];
+  if (texture.lastUsedFrame != m_FrameIndex) {
+    texture.lastUsedFrame = m_FrameIndex;
+    texture.frameFootprint = 0.f;
+  }
+  texture.frameFootprint = std::max(texture.frameFootprint, footprintInPixels);
+}
+
+void TextureResidencyManager::update(size_t maxUploads)
+{
+  // Finest level needed by each texture used this frame: about one texel per
+  // pixel, assuming the texture is mapped once over the primitive.
+  std::vector<size_t> growCandidates;
+  for (size_t i = 0; i < m_Textures.size(); ++i) {
+    auto &texture = m_Textures[i];
+    if (texture.width <= 0 || texture.lastUsedFrame != m_FrameIndex) {
+      continue;
+    }
+    const auto texels = float(std::max(texture.width, texture.height));
+    const auto level =
+        texture.frameFootprint >= 1.f
+            ? int(std::floor(std::log2(texels / texture.frameFootprint)))
+            : texture.levelCount - 1;
+    texture.desiredLevel = std::min(std::max(level, 0), texture.levelCount - 1);
+    if (texture.desiredLevel < texture.residentLevel) {
+      growCandidates.emplace_back(i);
+    }
+  }
+
+  std::vector<int> targets(m_Textures.size());
+  for (size_t i = 0; i < m_Textures.size(); ++i) {
+    targets[i] = m_Textures[i].residentLevel;
+  }
+  auto totalBytes = m_ResidentBytes;
+
+  // Enforce the budget first (it may have been lowered)
+  while (m_BudgetBytes && totalBytes > m_BudgetBytes &&
+         evictOneLevel(targets, totalBytes, true, -1)) {
+  }
+
+  // Then stream in the most undersampled textures, as long as room can be
+  // made by evicting unneeded or unused levels
+  std::sort(begin(growCandidates), end(growCandidates), [&](auto lhs, auto rhs) {
+    const auto &l = m_Textures[lhs];
+    const auto &r = m_Textures[rhs];
+    return l.residentLevel - l.desiredLevel > r.residentLevel - r.desiredLevel;
+  });
+  size_t uploadCount = 0;
+  for (const auto i : growCandidates) {
+    if (uploadCount >= maxUploads) {
+      break;
+    }
+    const auto &texture = m_Textures[i];
+    const auto currentBytes = bytesAtLevel(texture, targets[i]);
+    for (auto level = texture.desiredLevel; level < targets[i]; ++level) {
+      const auto bytes = bytesAtLevel(texture, level);
+      while (m_BudgetBytes && totalBytes - currentBytes + bytes > m_BudgetBytes &&
+             evictOneLevel(targets, totalBytes, false, int(i))) {
+      }
+      if (!m_BudgetBytes || totalBytes - currentBytes + bytes <= m_BudgetBytes) {
+        totalBytes = totalBytes - currentBytes + bytes;
+        targets[i] = level;
+        ++uploadCount;
+        break;
+      }
+    }
+  }
+
+  for (size_t i = 0; i < m_Textures.size(); ++i) {
+    if (m_Textures[i].width > 0 && targets[i] != m_Textures[i].residentLevel) {
+      upload(m_Textures[i], targets[i]);
+    }
+  }
+
+  ++m_FrameIndex;
+}
+
+bool TextureResidencyManager::evictOneLevel(std::vector<int> &targets,
+    size_t &totalBytes, bool allowUsed, int excludedIdx) const
+{
+  // Lowest key is evicted first: levels finer than needed, then levels of
+  // textures not used this frame (least recently used first), then the
+  // biggest textures used this frame.
+  using Key = std::tuple<int, uint64_t, size_t>;
+  auto bestKey = Key{std::numeric_limits<int>::max(), 0, 0};
+  int victim = -1;
+  for (size_t i = 0; i < m_Textures.size(); ++i) {
+    const auto &texture = m_Textures[i];
+    if (int(i) == excludedIdx || texture.width <= 0 ||
+        targets[i] >= texture.levelCount - 1) {
+      continue;
+    }
+    const auto used = texture.lastUsedFrame == m_FrameIndex;
+    const auto bytes = bytesAtLevel(texture, targets[i]);
+    Key key;
+    if (targets[i] < texture.desiredLevel) {
+      key = Key{0, texture.lastUsedFrame, ~bytes};
+    } else if (!used) {
+      key = Key{1, texture.lastUsedFrame, ~bytes};
+    } else if (allowUsed) {
+      key = Key{2, 0, ~bytes};
+    } else {
+      continue;
+    }
+    if (key < bestKey) {
+      bestKey = key;
+      victim = int(i);
+    }
+  }
+  if (victim < 0) {
+    return false;
+  }
+  const auto &texture = m_Textures[victim];
+  totalBytes -= bytesAtLevel(texture, targets[victim]);
+  ++targets[victim];
+  totalBytes += bytesAtLevel(texture, targets[victim]);
+  return true;
+}
+
+size_t TextureResidencyManager::bytesAtLevel(
+    const Texture &texture, int level) const
+{
+  if (texture.width <= 0) {
+    return 0;
+  }
+  const auto &image = m_Model.images[texture.imageIdx];
+  const size_t bytesPerTexel = 4 * (image.bits == 16 ? 2 : 1);
+  const auto lastLevel = texture.useMipmaps ? texture.levelCount - 1 : level;
+  size_t bytes = 0;
+  for (auto l = level; l <= lastLevel; ++l) {
+    bytes += size_t(std::max(1, texture.width >> l)) *
+             size_t(std::max(1, texture.height >> l)) * bytesPerTexel;
+  }
+  return bytes;
+}
+
+void TextureResidencyManager::upload(Texture &texture, int level)
+{
+  TraceScope trace{"Texture upload"};
+  const auto &image = m_Model.images[texture.imageIdx];
+  const bool is16Bits = image.bits == 16;
+
+  // Rebuild the requested level from the decoded source image
+  std::vector<unsigned char> levelData;
+  const unsigned char *pixels = image.image.data();
+  int width = image.width;
+  int height = image.height;
+  for (int l = 0; l < level; ++l) {
+    levelData = is16Bits ? downsample<uint16_t>(pixels, width, height)
+                         : downsample<uint8_t>(pixels, width, height);
+    pixels = levelData.data();
+    width = std::max(1, width / 2);
+    height = std::max(1, height / 2);
+  }
+
+  GLint previousTextureObject = 0;
+  glGetIntegerv(GL_TEXTURE_BINDING_2D, &previousTextureObject);
+
+  GLuint textureObject = 0;
+  glGenTextures(1, &textureObject);
+  glBindTexture(GL_TEXTURE_2D, textureObject);
+  glTexStorage2D(GL_TEXTURE_2D,
+      texture.useMipmaps ? texture.levelCount - level : 1,
+      is16Bits ? GL_RGBA16 : GL_RGBA8, width, height);
+  glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, GL_RGBA,
+      image.pixel_type, pixels);
+  m_UploadedBytes += uint64_t(width) * height * (is16Bits ? 8 : 4);
+
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, texture.minFilter);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, texture.magFilter);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, texture.wrapS);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, texture.wrapT);
+  if (texture.useMipmaps) {
+    glGenerateMipmap(GL_TEXTURE_2D);
+  }
+
+  glBindTexture(GL_TEXTURE_2D, previousTextureObject);
+
+  if (texture.glId) {
+    if (m_TextureReleaseCallback) {
+      m_TextureReleaseCallback(texture.glId);
+    }
+    glDeleteTextures(1, &texture.glId);
+  }
+  texture.glId = textureObject;
+  texture.residentLevel = level;
+
+  m_ResidentBytes -= texture.residentBytes;
+  texture.residentBytes = bytesAtLevel(texture, level);
+  m_ResidentBytes += texture.residentBytes;
+
+  ++m_Generation;
+}
+
+void TextureResidencyManager::drawGUI()
+{
+  const auto toMB = [](size_t bytes) { return float(bytes) / (1024 * 1024); };
+
+  if (m_BudgetBytes) {
+    ImGui::Text("Resident %.1f MB / %.1f MB budget", toMB(m_ResidentBytes),
+        toMB(m_BudgetBytes));
+  } else {
+    ImGui::Text("Resident %.1f MB (no budget)", toMB(m_ResidentBytes));
+  }
+
+  int budgetMB = int(m_BudgetBytes / (1024 * 1024));
+  if (ImGui::InputInt("Budget (MB, 0 = none)", &budgetMB)) {
+    m_BudgetBytes = size_t(std::max(budgetMB, 0)) * 1024 * 1024;
+  }
+
+  ImGui::Columns(5, "residency");
+  ImGui::Separator();
+  ImGui::Text("Texture");
+  ImGui::NextColumn();
+  ImGui::Text("Source");
+  ImGui::NextColumn();
+  ImGui::Text("Resident / needed");
+  ImGui::NextColumn();
+  ImGui::Text("MB");
+  ImGui::NextColumn();
+  ImGui::Text("Frames unused");
+  ImGui::NextColumn();
+  ImGui::Separator();
+  for (size_t i = 0; i < m_Textures.size(); ++i) {
+    const auto &texture = m_Textures[i];
+    ImGui::Text("%d", int(i));
+    ImGui::NextColumn();
+    ImGui::Text("%dx%d", texture.width, texture.height);
+    ImGui::NextColumn();
+    ImGui::Text("%dx%d / %dx%d", std::max(1, texture.width >> texture.residentLevel),
+        std::max(1, texture.height >> texture.residentLevel),
+        std::max(1, texture.width >> texture.desiredLevel),
+        std::max(1, texture.height >> texture.desiredLevel));
+    ImGui::NextColumn();
+    ImGui::Text("%.2f", toMB(texture.residentBytes));
+    ImGui::NextColumn();
+    ImGui::Text("%d", int(m_FrameIndex - 1 - texture.lastUsedFrame));
+    ImGui::NextColumn();
+  }
+  ImGui::Columns(1);
+  ImGui::Separator();
+}
@@ -0,0 +1,123 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <tiny_gltf.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+// Sampling parameters of texture, with the glTF defaults (linear filtering,
+// repeat wrapping) when they are undefined.
+tinygltf::Sampler getTextureSampler(
+    const tinygltf::Model &model, const tinygltf::Texture &texture);
+
+bool isMipmapFilter(GLint minFilter);
+
+// Owns the GL texture objects of a glTF model (one per model.textures entry)
+// and keeps their GPU memory under a budget.
+//
+// Each texture has a "resident level": the finest mip level of the source
+// image that is uploaded. A texture with resident level r holds a
+// (width >> r) x (height >> r) image as its level 0, followed by the rest of
+// its mip chain if its sampler uses mipmapping. Since texture coordinates are
+// normalized, shaders do not need to know about it.
+//
+// While drawing, callers report the screen-space footprint of each texture
+// with requestFootprint(). update() then streams in the levels that are needed
+// and, when over budget, evicts the levels that are not needed first, then
+// the levels of the least recently used textures. Evicted levels are rebuilt
+// from the decoded images that tinygltf keeps in model.images.
+class TextureResidencyManager
+{
+public:
+  // budgetBytes == 0 means no budget: everything stays fully resident.
+  TextureResidencyManager(const tinygltf::Model &model, size_t budgetBytes);
+  ~TextureResidencyManager();
+
+  TextureResidencyManager(const TextureResidencyManager &) = delete;
+  TextureResidencyManager &operator=(const TextureResidencyManager &) = delete;
+
+  size_t textureCount() const { return m_Textures.size(); }
+
+  // The GL texture object of model.textures[textureIdx]. The object changes
+  // each time the residency of the texture changes, so it must not be cached
+  // across calls to update().
+  GLuint textureObject(int textureIdx) const
+  {
+    return m_Textures[textureIdx].glId;
+  }
+
+  // Incremented each time at least one texture object has been replaced.
+  uint64_t generation() const { return m_Generation; }
+
+  // Called with the GL id of each texture object right before it is deleted,
+  // for users holding state tied to it (e.g. bindless handles).
+  void setTextureReleaseCallback(std::function<void(GLuint)> callback)
+  {
+    m_TextureReleaseCallback = std::move(callback);
+  }
+
+  // Record that model.textures[textureIdx] is sampled by a primitive covering
+  // approximately footprintInPixels pixels (diameter) on screen this frame.
+  void requestFootprint(int textureIdx, float footprintInPixels);
+
+  // Apply residency changes for the footprints requested since last call.
+  // At most maxUploads textures are grown per call so that streaming is
+  // spread over several frames; evictions are always applied immediately.
+  void update(size_t maxUploads = 4);
+
+  size_t budgetBytes() const { return m_BudgetBytes; }
+  void setBudgetBytes(size_t budgetBytes) { m_BudgetBytes = budgetBytes; }
+
+  size_t residentBytes() const { return m_ResidentBytes; }
+
+  // Bytes of texels uploaded since construction (base level of each upload)
+  uint64_t uploadedBytes() const { return m_UploadedBytes; }
+
+  // ImGui panel with the per-texture residency.
+  void drawGUI();
+
+private:
+  struct Texture
+  {
+    GLuint glId = 0;
+    int imageIdx = -1;
+    GLint minFilter = GL_LINEAR;
+    GLint magFilter = GL_LINEAR;
+    GLint wrapS = GL_REPEAT;
+    GLint wrapT = GL_REPEAT;
+    bool useMipmaps = false;
+    int width = 0; // of the source image
+    int height = 0;
+    int levelCount = 1;    // full mip chain of the source image
+    int residentLevel = 0; // finest level currently uploaded
+    int desiredLevel = 0;  // finest level needed by the last footprints
+    float frameFootprint = 0.f; // largest footprint requested this frame
+    uint64_t lastUsedFrame = 0;
+    size_t residentBytes = 0;
+  };
+
+  // Bytes used on GPU by texture if its finest level is level
+  size_t bytesAtLevel(const Texture &texture, int level) const;
+
+  // (Re)create the texture object of texture with level as finest level.
+  void upload(Texture &texture, int level);
+
+  // Drop the finest level of the lowest priority texture in targets, which
+  // holds a finest level per texture for a total of totalBytes. Textures used
+  // this frame are only considered if allowUsed is true. Return false if
+  // nothing could be evicted.
+  bool evictOneLevel(std::vector<int> &targets, size_t &totalBytes,
+      bool allowUsed, int excludedIdx) const;
+
+  const tinygltf::Model &m_Model;
+  std::vector<Texture> m_Textures;
+  size_t m_BudgetBytes = 0;
+  size_t m_ResidentBytes = 0;
+  uint64_t m_UploadedBytes = 0;
+  uint64_t m_FrameIndex = 1;
+  uint64_t m_Generation = 0;
+  std::function<void(GLuint)> m_TextureReleaseCallback;
+};
@@ -0,0 +1,234 @@
+#include "trace.hpp"
+
+#include "reports.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace detail
+{
+std::atomic<bool> g_TraceEnabled{false};
+}
+
+namespace
+{
+
+using Clock = std::chrono::steady_clock;
+
+struct TraceEvent
+{
+  const char *name;
+  int64_t beginUs;
+  int64_t durationUs;
+};
+
+// Ranges of a thread, written by this thread only. The head counts every
+// range recorded: the last min(head, CAPACITY) ones are in the ring.
+struct ThreadTrace
+{
+  static const size_t CAPACITY = size_t(1) << 16;
+
+  explicit ThreadTrace(int id) : id(id), events(CAPACITY) {}
+
+  int id;
+  std::string name;
+  std::vector<TraceEvent> events;
+  std::atomic<uint64_t> head{0};
+
+  void record(const char *eventName, int64_t beginUs, int64_t durationUs)
+  {
+    const auto h = head.load(std::memory_order_relaxed);
+    events[h % CAPACITY] = TraceEvent{eventName, beginUs, durationUs};
+    head.store(h + 1, std::memory_order_release);
+  }
+};
+
+const size_t ThreadTrace::CAPACITY;
+
+// Owns the rings, so that they outlive their threads
+struct TraceRegistry
+{
+  std::mutex mutex;
+  std::vector<std::unique_ptr<ThreadTrace>> threads;
+  std::unique_ptr<ThreadTrace> gpu;
+  Clock::time_point start;
+  int processId = 0;
+  std::string processName = "gltf-viewer";
+};
+
+TraceRegistry &registry()
+{
+  static TraceRegistry instance;
+  return instance;
+}
+
+thread_local ThreadTrace *t_pThreadTrace = nullptr;
+
+ThreadTrace &threadTrace()
+{
+  if (!t_pThreadTrace) {
+    auto &r = registry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    const auto id = int(r.threads.size());
+    r.threads.emplace_back(std::make_unique<ThreadTrace>(id));
+    t_pThreadTrace = r.threads.back().get();
+    t_pThreadTrace->name = "Thread " + std::to_string(id);
+  }
+  return *t_pThreadTrace;
+}
+
+} // namespace
+
+void startTrace()
+{
+  auto &r = registry();
+  {
+    std::lock_guard<std::mutex> lock(r.mutex);
+    r.start = Clock::now();
+    // After the CPU threads, whose ids are given in order of first record
+    r.gpu = std::make_unique<ThreadTrace>(1000);
+    r.gpu->name = "GPU";
+  }
+  detail::g_TraceEnabled.store(true, std::memory_order_release);
+  setTraceThreadName("Main");
+}
+
+int64_t traceTimeUs()
+{
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+      Clock::now() - registry().start)
+      .count();
+}
+
+void setTraceThreadName(const char *name)
+{
+  if (!traceEnabled()) {
+    return;
+  }
+  auto &trace = threadTrace();
+  std::lock_guard<std::mutex> lock(registry().mutex);
+  trace.name = name;
+}
+
+void setTraceProcess(int processId, const char *name)
+{
+  auto &r = registry();
+  std::lock_guard<std::mutex> lock(r.mutex);
+  r.processId = processId;
+  r.processName = name;
+  for (auto &trace : r.threads) {
+    trace->head.store(0, std::memory_order_relaxed);
+  }
+  if (r.gpu) {
+    r.gpu->head.store(0, std::memory_order_relaxed);
+  }
+}
+
+void recordTrace(const char *name, int64_t beginUs, int64_t durationUs)
+{
+  if (traceEnabled()) {
+    threadTrace().record(name, beginUs, durationUs);
+  }
+}
+
+void recordGpuTrace(const char *name, int64_t beginUs, int64_t durationUs)
+{
+  if (traceEnabled()) {
+    registry().gpu->record(name, beginUs, durationUs);
+  }
+}
+
+std::vector<std::pair<std::string, int64_t>> getTraceTotals()
+{
+  std::vector<std::pair<std::string, int64_t>> totals;
+  auto &r = registry();
+  std::lock_guard<std::mutex> lock(r.mutex);
+  for (const auto &trace : r.threads) {
+    const auto head = trace->head.load(std::memory_order_acquire);
+    const auto count = std::min<uint64_t>(head, ThreadTrace::CAPACITY);
+    for (auto i = head - count; i < head; ++i) {
+      const auto &event = trace->events[i % ThreadTrace::CAPACITY];
+      auto it = std::find_if(begin(totals), end(totals),
+          [&](const auto &total) { return total.first == event.name; });
+      if (it == end(totals)) {
+        totals.emplace_back(event.name, 0);
+        it = end(totals) - 1;
+      }
+      it->second += event.durationUs;
+    }
+  }
+  return totals;
+}
+
+bool writeTrace(const fs::path &path)
+{
+  std::ofstream out(path.string());
+  if (!out) {
+    std::cerr << "Unable to write trace " << path << std::endl;
+    return false;
+  }
+
+  auto &r = registry();
+  std::lock_guard<std::mutex> lock(r.mutex);
+  uint64_t droppedCount = 0;
+  auto first = true;
+  const auto separate = [&]() {
+    out << (first ? "\n" : ",\n");
+    first = false;
+  };
+
+  out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+  separate();
+  out << "{\"ph\":\"M\",\"name\":\"process_name\",\"pid\":" << r.processId
+      << ",\"tid\":0,\"args\":{\"name\":";
+  writeJsonString(out, r.processName);
+  out << "}}";
+
+  const auto writeThread = [&](const ThreadTrace &trace) {
+    separate();
+    out << "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":" << r.processId
+        << ",\"tid\":" << trace.id << ",\"args\":{\"name\":";
+    writeJsonString(out, trace.name);
+    out << "}}";
+    separate();
+    out << "{\"ph\":\"M\",\"name\":\"thread_sort_index\",\"pid\":"
+        << r.processId << ",\"tid\":" << trace.id
+        << ",\"args\":{\"sort_index\":" << trace.id << "}}";
+
+    const auto head = trace.head.load(std::memory_order_acquire);
+    const auto count = std::min<uint64_t>(head, ThreadTrace::CAPACITY);
+    droppedCount += head - count;
+    for (auto i = head - count; i < head; ++i) {
+      const auto &event = trace.events[i % ThreadTrace::CAPACITY];
+      separate();
+      out << "{\"ph\":\"X\",\"name\":";
+      writeJsonString(out, event.name);
+      out << ",\"pid\":" << r.processId << ",\"tid\":" << trace.id
+          << ",\"ts\":" << event.beginUs << ",\"dur\":" << event.durationUs
+          << "}";
+    }
+  };
+  for (const auto &trace : r.threads) {
+    writeThread(*trace);
+  }
+  if (r.gpu) {
+    writeThread(*r.gpu);
+  }
+  out << "\n]}\n";
+
+  if (droppedCount) {
+    std::cerr << "Trace " << path << ": " << droppedCount
+              << " oldest ranges overwritten" << std::endl;
+  }
+  if (!out) {
+    std::cerr << "Unable to write trace " << path << std::endl;
+    return false;
+  }
+  return true;
+}
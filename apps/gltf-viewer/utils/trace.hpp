@@ -0,0 +1,81 @@
+#pragma once
+
+#include "filesystem.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Recording of named time ranges of the CPU threads and of the GPU, written as
+// a Chrome Trace Event file (chrome://tracing, https://ui.perfetto.dev).
+//
+// Each thread records its ranges in its own ring buffer, allocated on its
+// first record: recording takes no lock and does not allocate, and the oldest
+// ranges of a thread are overwritten once its ring is full. Until
+// startTrace(), recording is a relaxed atomic load and a branch.
+//
+// Names must be string literals (or outlive the trace).
+
+namespace detail
+{
+extern std::atomic<bool> g_TraceEnabled;
+}
+
+// Whether ranges are recorded
+inline bool traceEnabled()
+{
+  return detail::g_TraceEnabled.load(std::memory_order_relaxed);
+}
+
+// Start recording, naming the calling thread "Main"
+void startTrace();
+
+// Microseconds since startTrace()
+int64_t traceTimeUs();
+
+// Name the calling thread in the trace, if recording
+void setTraceThreadName(const char *name);
+
+// Process id of the ranges in the written trace (0 by default), to merge the
+// traces of several processes. Ranges recorded so far are dropped: those of
+// the parent of a forked process.
+void setTraceProcess(int processId, const char *name);
+
+// Record a range of the calling thread, in microseconds since startTrace()
+void recordTrace(const char *name, int64_t beginUs, int64_t durationUs);
+
+// Record a range executed by the GPU, on its own track
+void recordGpuTrace(const char *name, int64_t beginUs, int64_t durationUs);
+
+// Total duration of the ranges of each name recorded by the CPU threads and
+// still in their rings, in microseconds, in order of first record
+std::vector<std::pair<std::string, int64_t>> getTraceTotals();
+
+// Write the recorded ranges to a .json file, with a message on the error
+// output if it fails. Recording threads must be idle.
+bool writeTrace(const fs::path &path);
+
+// Records its lifetime on the calling thread, if recording
+class TraceScope
+{
+public:
+  explicit TraceScope(const char *name) :
+      m_Name(name), m_Start(traceEnabled() ? traceTimeUs() : -1)
+  {
+  }
+  ~TraceScope()
+  {
+    if (m_Start >= 0) {
+      recordTrace(m_Name, m_Start, traceTimeUs() - m_Start);
+    }
+  }
+
+  TraceScope(const TraceScope &) = delete;
+  TraceScope &operator=(const TraceScope &) = delete;
+
+private:
+  const char *m_Name;
+  int64_t m_Start;
+};